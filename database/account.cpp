@@ -18,6 +18,8 @@
 
 #include "account.hpp"
 
+#include "dirtyids.hpp"
+
 namespace pxd
 {
 
@@ -64,6 +66,10 @@ Account::~Account ()
   stmt.BindProto (3, data);
 
   stmt.Execute ();
+
+  auto* dirty = db.GetDirtyIds ();
+  if (dirty != nullptr)
+    dirty->MarkAccount (name);
 }
 
 void
@@ -126,6 +132,23 @@ AccountsTable::QueryAll ()
   return stmt.Query<AccountResult> ();
 }
 
+Database::Result<AccountResult>
+AccountsTable::QueryModifiedSince (const unsigned h)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `accounts`
+      WHERE `name` IN (
+        SELECT `name`
+          FROM `changes_accounts`
+          WHERE `deleted` = 0 AND `height` >= ?1
+      )
+      ORDER BY `name`
+  )");
+  stmt.Bind (1, h);
+  return stmt.Query<AccountResult> ();
+}
+
 Database::Result<AccountResult>
 AccountsTable::QueryInitialised ()
 {
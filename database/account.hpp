@@ -191,6 +191,13 @@ public:
    */
   Database::Result<AccountResult> QueryAll ();
 
+  /**
+   * Queries the database for all accounts that have been changed (but not
+   * deleted) at or after the given block height, as recorded by
+   * EntityChanges.
+   */
+  Database::Result<AccountResult> QueryModifiedSince (unsigned h);
+
   /**
    * Queries the database for all accounts which have been initialised yet
    * with a faction.  Returns a result set that can be used together with
@@ -18,6 +18,8 @@
 
 #include "building.hpp"
 
+#include "dirtyids.hpp"
+
 #include <glog/logging.h>
 
 namespace pxd
@@ -108,6 +110,10 @@ Building::~Building ()
       stmt.BindProto (15, data);
       stmt.Execute ();
 
+      auto* dirty = db.GetDirtyIds ();
+      if (dirty != nullptr)
+        dirty->MarkBuilding (id);
+
       return;
     }
 
@@ -172,6 +178,19 @@ BuildingsTable::GetById (const Database::IdT id)
   return c;
 }
 
+Database::Result<BuildingResult>
+BuildingsTable::QueryForIds (const std::vector<Database::IdT>& ids)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `buildings`
+      WHERE )" + IdBatchCondition ("`id`", 1) + R"(
+      ORDER BY `id`
+  )");
+  BindIdBatch (stmt, 1, ids);
+  return stmt.Query<BuildingResult> ();
+}
+
 Database::Result<BuildingResult>
 BuildingsTable::QueryAll ()
 {
@@ -179,6 +198,113 @@ BuildingsTable::QueryAll ()
   return stmt.Query<BuildingResult> ();
 }
 
+Database::Result<BuildingResult>
+BuildingsTable::QueryModifiedSince (const unsigned h)
+{
+  /* With lazy HP regeneration, the HP of fighters that can regenerate
+     change every block without the row being written.  Thus those are
+     always included in that case.  */
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `buildings`
+      WHERE `id` IN (
+        SELECT `id`
+          FROM `changes_buildings`
+          WHERE `deleted` = 0 AND `height` >= ?1
+      ) OR (?2 AND `canregen`)
+      ORDER BY `id`
+  )");
+  stmt.Bind (1, h);
+  stmt.Bind (2, db.GetLazyRegenHeight () != Database::NO_LAZY_REGEN);
+  return stmt.Query<BuildingResult> ();
+}
+
+namespace
+{
+
+struct ShapeResult : public ResultWithCoord
+{
+  RESULT_COLUMN (int64_t, id, 1);
+  RESULT_COLUMN (std::string, type, 2);
+  RESULT_COLUMN (pxd::proto::Building, proto, 3);
+};
+
+struct TypeAndCentreResult : public ResultWithCoord
+{
+  RESULT_COLUMN (std::string, type, 1);
+};
+
+} // anonymous namespace
+
+void
+BuildingsTable::ProcessAllShapes (const ShapeFcn& cb)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT `id`, `type`, `x`, `y`, `proto`
+      FROM `buildings`
+      ORDER BY `id`
+  )");
+
+  auto res = stmt.Query<ShapeResult> ();
+  while (res.Step ())
+    {
+      const Database::IdT id = res.Get<ShapeResult::id> ();
+      const std::string type = res.Get<ShapeResult::type> ();
+      const HexCoord centre = GetCoordFromColumn (res);
+      const auto data = res.GetProto<ShapeResult::proto> ();
+      cb (id, type, data.Get ().shape_trafo (), centre);
+    }
+}
+
+bool
+BuildingsTable::GetTypeAndCentre (const Database::IdT id, std::string& type,
+                                  HexCoord& centre)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT `type`, `x`, `y` FROM `buildings` WHERE `id` = ?1
+  )");
+  stmt.Bind (1, id);
+
+  auto res = stmt.Query<TypeAndCentreResult> ();
+  if (!res.Step ())
+    return false;
+
+  type = res.Get<TypeAndCentreResult::type> ();
+  centre = GetCoordFromColumn (res);
+  CHECK (!res.Step ());
+  return true;
+}
+
+Database::Result<BuildingResult>
+BuildingsTable::QueryInArea (const HexCoord& centre,
+                             const HexCoord::IntT l1range)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `buildings`
+      WHERE )" + L1AreaCondition (1) + R"(
+      ORDER BY `id`
+  )");
+  BindL1AreaParameters (stmt, 1, centre, l1range);
+  return stmt.Query<BuildingResult> ();
+}
+
+Database::Result<BuildingResult>
+BuildingsTable::QueryInArea (const HexCoord& centre,
+                             const HexCoord::IntT l1range,
+                             const std::string& owner)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `buildings`
+      WHERE `owner` = ?8 AND )" + L1AreaCondition (1) + R"(
+      ORDER BY `id`
+  )");
+  BindL1AreaParameters (stmt, 1, centre, l1range);
+  stmt.Bind (8, owner);
+  return stmt.Query<BuildingResult> ();
+}
+
 void
 BuildingsTable::DeleteById (const Database::IdT id)
 {
@@ -190,6 +316,10 @@ BuildingsTable::DeleteById (const Database::IdT id)
   )");
   stmt.Bind (1, id);
   stmt.Execute ();
+
+  auto* dirty = db.GetDirtyIds ();
+  if (dirty != nullptr)
+    dirty->MarkBuilding (id);
 }
 
 Database::Result<BuildingResult>
@@ -216,6 +346,18 @@ BuildingsTable::QueryForRegen ()
   return stmt.Query<BuildingResult> ();
 }
 
+Database::Result<BuildingResult>
+BuildingsTable::QueryForRegenWithEffects ()
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `buildings`
+      WHERE `canregen` AND `effects` IS NOT NULL
+      ORDER BY `id`
+  )");
+  return stmt.Query<BuildingResult> ();
+}
+
 Database::Result<BuildingResult>
 BuildingsTable::QueryWithTarget ()
 {
@@ -23,10 +23,17 @@
 #include "coord.hpp"
 #include "database.hpp"
 #include "faction.hpp"
+#include "idbatch.hpp"
 #include "lazyproto.hpp"
 
+#include "hexagonal/coord.hpp"
 #include "proto/building.pb.h"
 
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
 namespace pxd
 {
 
@@ -196,6 +203,12 @@ public:
     return data.Get ().combat_data ();
   }
 
+  proto::CombatData&
+  MutableCombatData () override
+  {
+    return *data.Mutable ().mutable_combat_data ();
+  }
+
 };
 
 /**
@@ -215,6 +228,12 @@ public:
   /** Movable handle to a region instance.  */
   using Handle = std::unique_ptr<Building>;
 
+  /** Callback function for processing the shapes of buildings.  */
+  using ShapeFcn
+      = std::function<void (Database::IdT id, const std::string& type,
+                            const proto::ShapeTransformation& trafo,
+                            const HexCoord& centre)>;
+
   /**
    * Constructs the table.
    */
@@ -243,11 +262,59 @@ public:
    */
   Handle GetById (Database::IdT id);
 
+  /**
+   * Queries for the buildings with the given IDs (at most ID_BATCH_SIZE
+   * of them), ordered by ID.  IDs that do not exist are ignored.
+   */
+  Database::Result<BuildingResult> QueryForIds (
+      const std::vector<Database::IdT>& ids);
+
   /**
    * Queries the database for all buildings.
    */
   Database::Result<BuildingResult> QueryAll ();
 
+  /**
+   * Queries the database for all buildings that have been changed (but not
+   * deleted) at or after the given block height, as recorded by
+   * EntityChanges.  With lazy HP regeneration, this also includes all
+   * that are regenerating HP.
+   */
+  Database::Result<BuildingResult> QueryModifiedSince (unsigned h);
+
+  /**
+   * Queries for all buildings whose centre is within the given L1 range
+   * around some coordinate, ordered by ID.  This uses the position index.
+   */
+  Database::Result<BuildingResult> QueryInArea (const HexCoord& centre,
+                                                HexCoord::IntT l1range);
+
+  /**
+   * Queries for all buildings of the given owner whose centre is within
+   * the given area, ordered by ID.
+   */
+  Database::Result<BuildingResult> QueryInArea (const HexCoord& centre,
+                                                HexCoord::IntT l1range,
+                                                const std::string& owner);
+
+  /**
+   * Processes the type, shape transformation and centre of all buildings,
+   * ordered by ID.  This is used to construct the dynamic obstacle map
+   * without constructing full Building handles.
+   *
+   * Since this reads the database directly, it must not be called while
+   * a modified Building handle is still alive.
+   */
+  void ProcessAllShapes (const ShapeFcn& cb);
+
+  /**
+   * Looks up just the type and centre of the building with the given ID,
+   * without constructing a full handle.  Returns false if there is no
+   * such building.
+   */
+  bool GetTypeAndCentre (Database::IdT id, std::string& type,
+                         HexCoord& centre);
+
   /**
    * Queries for all buildings with attacks (including friendly ones).
    */
@@ -258,6 +325,12 @@ public:
    */
   Database::Result<BuildingResult> QueryForRegen ();
 
+  /**
+   * Queries for all buildings that may need to have HP regenerated
+   * and have combat effects applied.
+   */
+  Database::Result<BuildingResult> QueryForRegenWithEffects ();
+
   /**
    * Queries for all buildings that have a combat target and thus need
    * to be processed for damage.  This includes buildings that only have
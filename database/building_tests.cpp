@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -22,6 +22,9 @@
 
 #include <gtest/gtest.h>
 
+#include <string>
+#include <vector>
+
 namespace pxd
 {
 namespace
@@ -121,15 +124,15 @@ TEST_F (BuildingTests, CombatFields)
   auto h = tbl.GetById (id);
   EXPECT_EQ (h->GetAttackRange (false), CombatEntity::NO_ATTACKS);
   EXPECT_EQ (h->GetAttackRange (true), CombatEntity::NO_ATTACKS);
-  auto* att = h->MutableProto ().mutable_combat_data ()->add_attacks ();
+  auto* att = h->MutableCombatData ().add_attacks ();
   att->set_range (5);
-  att = h->MutableProto ().mutable_combat_data ()->add_attacks ();
+  att = h->MutableCombatData ().add_attacks ();
   att->set_area (3);
   att->set_friendlies (true);
   h.reset ();
 
   h = tbl.GetById (id);
-  EXPECT_EQ (h->GetProto ().combat_data ().attacks_size (), 2);
+  EXPECT_EQ (h->GetCombatData ().attacks_size (), 2);
   EXPECT_EQ (h->GetAttackRange (false), 5);
   EXPECT_EQ (h->GetAttackRange (true), 3);
   h->MutableHP ().set_armour (10);
@@ -193,6 +196,20 @@ TEST_F (BuildingsTableTests, GetById)
   CHECK_EQ (tbl.GetById (id2)->GetOwner (), "andy");
 }
 
+TEST_F (BuildingsTableTests, QueryForIds)
+{
+  const auto id1 = tbl.CreateNew ("turret", "domob", Faction::RED)->GetId ();
+  tbl.CreateNew ("turret", "andy", Faction::RED);
+  const auto id3 = tbl.CreateNew ("turret", "daniel", Faction::RED)->GetId ();
+
+  auto res = tbl.QueryForIds ({id3, 500, id1});
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetOwner (), "domob");
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetOwner (), "daniel");
+  ASSERT_FALSE (res.Step ());
+}
+
 TEST_F (BuildingsTableTests, QueryAll)
 {
   tbl.CreateNew ("turret", "domob", Faction::RED);
@@ -206,13 +223,81 @@ TEST_F (BuildingsTableTests, QueryAll)
   ASSERT_FALSE (res.Step ());
 }
 
+TEST_F (BuildingsTableTests, QueryInArea)
+{
+  tbl.CreateNew ("turret", "domob", Faction::RED)
+    ->SetCentre (HexCoord (10, 0));
+  tbl.CreateNew ("turret", "andy", Faction::RED)
+    ->SetCentre (HexCoord (2, -1));
+  tbl.CreateNew ("turret", "domob", Faction::RED)
+    ->SetCentre (HexCoord (-1, 0));
+  tbl.CreateNew ("checkmark", "", Faction::ANCIENT)
+    ->SetCentre (HexCoord (0, 0));
+
+  auto res = tbl.QueryInArea (HexCoord (0, 0), 2);
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetOwner (), "andy");
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetCentre (), HexCoord (-1, 0));
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetFaction (), Faction::ANCIENT);
+  ASSERT_FALSE (res.Step ());
+
+  res = tbl.QueryInArea (HexCoord (0, 0), 2, "domob");
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetCentre (), HexCoord (-1, 0));
+  ASSERT_FALSE (res.Step ());
+}
+
+TEST_F (BuildingsTableTests, ProcessAllShapes)
+{
+  auto h = tbl.CreateNew ("checkmark", "domob", Faction::RED);
+  h->SetCentre (HexCoord (1, 2));
+  h->MutableProto ().mutable_shape_trafo ()->set_rotation_steps (3);
+  h.reset ();
+  tbl.CreateNew ("huesli", "", Faction::ANCIENT)->SetCentre (HexCoord (-5, 0));
+
+  std::vector<std::string> types;
+  std::vector<HexCoord> centres;
+  std::vector<unsigned> rotations;
+  tbl.ProcessAllShapes ([&] (const Database::IdT id, const std::string& type,
+                             const proto::ShapeTransformation& trafo,
+                             const HexCoord& centre)
+    {
+      types.push_back (type);
+      centres.push_back (centre);
+      rotations.push_back (trafo.rotation_steps ());
+    });
+
+  EXPECT_EQ (types, std::vector<std::string> ({"checkmark", "huesli"}));
+  EXPECT_EQ (centres,
+             std::vector<HexCoord> ({HexCoord (1, 2), HexCoord (-5, 0)}));
+  EXPECT_EQ (rotations, std::vector<unsigned> ({3, 0}));
+}
+
+TEST_F (BuildingsTableTests, GetTypeAndCentre)
+{
+  auto h = tbl.CreateNew ("checkmark", "domob", Faction::RED);
+  const auto id = h->GetId ();
+  h->SetCentre (HexCoord (1, 2));
+  h.reset ();
+
+  std::string type;
+  HexCoord centre;
+  ASSERT_TRUE (tbl.GetTypeAndCentre (id, type, centre));
+  EXPECT_EQ (type, "checkmark");
+  EXPECT_EQ (centre, HexCoord (1, 2));
+
+  EXPECT_FALSE (tbl.GetTypeAndCentre (id + 1, type, centre));
+}
+
 TEST_F (BuildingsTableTests, QueryWithAttacks)
 {
   tbl.CreateNew ("checkmark", "domob", Faction::RED);
   tbl.CreateNew ("checkmark", "andy", Faction::RED)
-    ->MutableProto ().mutable_combat_data ()->add_attacks ()->set_range (0);
+    ->MutableCombatData ().add_attacks ()->set_range (0);
   auto c = tbl.CreateNew ("checkmark", "daniel", Faction::RED);
-  auto* att = c->MutableProto ().mutable_combat_data ()->add_attacks ();
+  auto* att = c->MutableCombatData ().add_attacks ();
   att->set_area (0);
   att->set_friendlies (true);
   c.reset ();
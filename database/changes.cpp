@@ -0,0 +1,264 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "changes.hpp"
+
+#include "coord.hpp"
+
+#include <glog/logging.h>
+
+#include <set>
+#include <string>
+
+namespace pxd
+{
+
+namespace
+{
+
+/** Entity tables for which changes are tracked.  */
+const char* const TRACKED_TABLES[] = {
+  "accounts",
+  "buildings",
+  "characters",
+  "ground_loot",
+  "ongoing_operations",
+};
+
+struct ChangedIdResult : public Database::ResultType
+{
+  RESULT_COLUMN (int64_t, id, 1);
+};
+
+struct ChangedCoordResult : public ResultWithCoord
+{};
+
+struct ChangedNameResult : public Database::ResultType
+{
+  RESULT_COLUMN (std::string, name, 1);
+};
+
+/**
+ * Records the given IDs as changed at some height for a table whose
+ * entities are keyed by an integer `id` column.
+ */
+void
+RecordIds (Database& db, const std::string& table,
+           const std::set<Database::IdT>& ids, const unsigned height)
+{
+  if (ids.empty ())
+    return;
+
+  auto stmt = db.Prepare (R"(
+    INSERT OR REPLACE INTO `changes_)" + table + R"(`
+      (`id`, `height`, `deleted`)
+      VALUES (?1, ?2, NOT EXISTS (
+        SELECT 1 FROM `)" + table + R"(` WHERE `id` = ?1
+      ))
+  )");
+
+  for (const auto id : ids)
+    {
+      stmt.Reset ();
+      stmt.Bind (1, id);
+      stmt.Bind (2, height);
+      stmt.Execute ();
+    }
+}
+
+/**
+ * Returns the IDs of entities in a table with `id` column that have been
+ * deleted at or after the given height.
+ */
+std::vector<Database::IdT>
+GetDeletedIds (Database& db, const std::string& table, const unsigned h)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT `id`
+      FROM `changes_)" + table + R"(`
+      WHERE `deleted` = 1 AND `height` >= ?1
+      ORDER BY `id`
+  )");
+  stmt.Bind (1, h);
+
+  std::vector<Database::IdT> res;
+  auto rows = stmt.Query<ChangedIdResult> ();
+  while (rows.Step ())
+    res.push_back (rows.Get<ChangedIdResult::id> ());
+
+  return res;
+}
+
+} // anonymous namespace
+
+void
+EntityChanges::Record (const DirtyIds& dirty, const unsigned height)
+{
+  std::set<std::string> accounts = dirty.GetAccounts ();
+  std::set<Database::IdT> buildings = dirty.GetBuildings ();
+  for (const auto& key : dirty.GetBuildingInventories ())
+    buildings.insert (key.first);
+  for (const auto& key : dirty.GetOrderKeys ())
+    {
+      buildings.insert (key.first);
+      accounts.insert (key.second);
+    }
+
+  VLOG (1)
+      << "Recording changes at height " << height << ": "
+      << accounts.size () << " accounts, "
+      << buildings.size () << " buildings, "
+      << dirty.GetCharacters ().size () << " characters, "
+      << dirty.GetGroundLoot ().size () << " ground loot, "
+      << dirty.GetOngoings ().size () << " ongoings";
+
+  if (!accounts.empty ())
+    {
+      auto stmt = db.Prepare (R"(
+        INSERT OR REPLACE INTO `changes_accounts`
+          (`name`, `height`, `deleted`)
+          VALUES (?1, ?2, NOT EXISTS (
+            SELECT 1 FROM `accounts` WHERE `name` = ?1
+          ))
+      )");
+
+      for (const auto& name : accounts)
+        {
+          stmt.Reset ();
+          stmt.Bind (1, name);
+          stmt.Bind (2, height);
+          stmt.Execute ();
+        }
+    }
+
+  RecordIds (db, "buildings", buildings, height);
+  RecordIds (db, "characters", dirty.GetCharacters (), height);
+  RecordIds (db, "ongoing_operations", dirty.GetOngoings (), height);
+
+  if (!dirty.GetGroundLoot ().empty ())
+    {
+      auto stmt = db.Prepare (R"(
+        INSERT OR REPLACE INTO `changes_ground_loot`
+          (`x`, `y`, `height`, `deleted`)
+          VALUES (?1, ?2, ?3, NOT EXISTS (
+            SELECT 1 FROM `ground_loot` WHERE `x` = ?1 AND `y` = ?2
+          ))
+      )");
+
+      for (const auto& pos : dirty.GetGroundLoot ())
+        {
+          stmt.Reset ();
+          BindCoordParameter (stmt, 1, 2, pos);
+          stmt.Bind (3, height);
+          stmt.Execute ();
+        }
+    }
+}
+
+void
+EntityChanges::PruneTombstones (const unsigned height)
+{
+  VLOG (1) << "Pruning change tombstones before height " << height;
+
+  for (const std::string table : TRACKED_TABLES)
+    {
+      auto stmt = db.Prepare (R"(
+        DELETE FROM `changes_)" + table + R"(`
+          WHERE `deleted` = 1 AND `height` < ?1
+      )");
+      stmt.Bind (1, height);
+      stmt.Execute ();
+    }
+}
+
+std::vector<std::string>
+EntityChanges::GetChangedAccounts (const unsigned h)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT `name`
+      FROM `changes_accounts`
+      WHERE `deleted` IN (0, 1) AND `height` >= ?1
+      ORDER BY `name`
+  )");
+  stmt.Bind (1, h);
+
+  std::vector<std::string> res;
+  auto rows = stmt.Query<ChangedNameResult> ();
+  while (rows.Step ())
+    res.push_back (rows.Get<ChangedNameResult::name> ());
+
+  return res;
+}
+
+std::vector<Database::IdT>
+EntityChanges::GetChangedCharacters (const unsigned h)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT `id`
+      FROM `changes_characters`
+      WHERE `deleted` IN (0, 1) AND `height` >= ?1
+      ORDER BY `id`
+  )");
+  stmt.Bind (1, h);
+
+  std::vector<Database::IdT> res;
+  auto rows = stmt.Query<ChangedIdResult> ();
+  while (rows.Step ())
+    res.push_back (rows.Get<ChangedIdResult::id> ());
+
+  return res;
+}
+
+std::vector<Database::IdT>
+EntityChanges::GetDeletedBuildings (const unsigned h)
+{
+  return GetDeletedIds (db, "buildings", h);
+}
+
+std::vector<Database::IdT>
+EntityChanges::GetDeletedCharacters (const unsigned h)
+{
+  return GetDeletedIds (db, "characters", h);
+}
+
+std::vector<Database::IdT>
+EntityChanges::GetDeletedOngoings (const unsigned h)
+{
+  return GetDeletedIds (db, "ongoing_operations", h);
+}
+
+std::vector<HexCoord>
+EntityChanges::GetEmptiedGroundLoot (const unsigned h)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT `x`, `y`
+      FROM `changes_ground_loot`
+      WHERE `deleted` = 1 AND `height` >= ?1
+      ORDER BY `x`, `y`
+  )");
+  stmt.Bind (1, h);
+
+  std::vector<HexCoord> res;
+  auto rows = stmt.Query<ChangedCoordResult> ();
+  while (rows.Step ())
+    res.push_back (GetCoordFromColumn (rows));
+
+  return res;
+}
+
+} // namespace pxd
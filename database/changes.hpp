@@ -0,0 +1,119 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATABASE_CHANGES_HPP
+#define DATABASE_CHANGES_HPP
+
+#include "database.hpp"
+#include "dirtyids.hpp"
+
+#include "hexagonal/coord.hpp"
+
+#include <string>
+#include <vector>
+
+namespace pxd
+{
+
+/**
+ * Wrapper class around the database tables that keep track of when
+ * entities (accounts, buildings, characters, ground loot and ongoing
+ * operations) have last been changed, and which have been deleted.
+ * This allows clients to sync the state incrementally.
+ *
+ * The entities that have been modified themselves can be queried through
+ * the QueryModifiedSince methods of the individual tables.  This class
+ * handles the recording of changes and the deletion tombstones.
+ */
+class EntityChanges
+{
+
+private:
+
+  /** The underlying database handle.  */
+  Database& db;
+
+public:
+
+  explicit EntityChanges (Database& d)
+    : db(d)
+  {}
+
+  EntityChanges () = delete;
+  EntityChanges (const EntityChanges&) = delete;
+  void operator= (const EntityChanges&) = delete;
+
+  /**
+   * Records all entities marked in the given DirtyIds as changed at the
+   * given block height.  Entities that no longer exist in the database
+   * are recorded as deleted.
+   *
+   * Changes to building inventories and DEX orders are recorded as changes
+   * to the building (and account) they belong to, since that is where
+   * they are part of the game-state JSON.
+   */
+  void Record (const DirtyIds& dirty, unsigned height);
+
+  /**
+   * Removes all tombstones for entities deleted before the given height.
+   * Afterwards, deletions can only be retrieved reliably for heights
+   * starting at the given one.
+   */
+  void PruneTombstones (unsigned height);
+
+  /**
+   * Returns the names of all accounts that have been changed at or after
+   * the given height.
+   */
+  std::vector<std::string> GetChangedAccounts (unsigned h);
+
+  /**
+   * Returns the IDs of all characters that have been changed (including
+   * created or deleted) at or after the given height.
+   */
+  std::vector<Database::IdT> GetChangedCharacters (unsigned h);
+
+  /**
+   * Returns the IDs of buildings that have been deleted at or after
+   * the given height.
+   */
+  std::vector<Database::IdT> GetDeletedBuildings (unsigned h);
+
+  /**
+   * Returns the IDs of characters that have been deleted at or after
+   * the given height.
+   */
+  std::vector<Database::IdT> GetDeletedCharacters (unsigned h);
+
+  /**
+   * Returns the IDs of ongoing operations that have been deleted at or
+   * after the given height.
+   */
+  std::vector<Database::IdT> GetDeletedOngoings (unsigned h);
+
+  /**
+   * Returns the positions of ground loot that has been emptied at or after
+   * the given height (and not been refilled since).
+   */
+  std::vector<HexCoord> GetEmptiedGroundLoot (unsigned h);
+
+};
+
+} // namespace pxd
+
+#endif // DATABASE_CHANGES_HPP
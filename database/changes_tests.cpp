@@ -0,0 +1,293 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "changes.hpp"
+
+#include "account.hpp"
+#include "building.hpp"
+#include "character.hpp"
+#include "dbtest.hpp"
+#include "dex.hpp"
+#include "inventory.hpp"
+#include "ongoing.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace pxd
+{
+namespace
+{
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+class EntityChangesTests : public DBTestWithSchema
+{
+
+protected:
+
+  DirtyIds dirty;
+  EntityChanges changes;
+
+  AccountsTable accounts;
+  BuildingsTable buildings;
+  BuildingInventoriesTable inventories;
+  CharacterTable characters;
+  DexOrderTable orders;
+  GroundLootTable loot;
+  OngoingsTable ongoings;
+
+  EntityChangesTests ()
+    : changes(db),
+      accounts(db), buildings(db), inventories(db), characters(db),
+      orders(db), loot(db), ongoings(db)
+  {
+    db.SetNextId (101);
+    db.SetDirtyIds (&dirty);
+  }
+
+  ~EntityChangesTests ()
+  {
+    db.SetDirtyIds (nullptr);
+  }
+
+  /**
+   * Records the currently marked changes at the given height and clears
+   * the marks afterwards.
+   */
+  void
+  Record (const unsigned height)
+  {
+    changes.Record (dirty, height);
+    dirty.Clear ();
+  }
+
+  /**
+   * Returns the IDs of entities returned by a QueryModifiedSince call
+   * on the given table.
+   */
+  template <typename T>
+    static std::vector<Database::IdT>
+    GetModifiedIds (T& tbl, const unsigned h)
+  {
+    std::vector<Database::IdT> res;
+    auto q = tbl.QueryModifiedSince (h);
+    while (q.Step ())
+      res.push_back (tbl.GetFromResult (q)->GetId ());
+    return res;
+  }
+
+  /**
+   * Returns the names of accounts modified since the given height.
+   */
+  std::vector<std::string>
+  GetModifiedAccounts (const unsigned h)
+  {
+    std::vector<std::string> res;
+    auto q = accounts.QueryModifiedSince (h);
+    while (q.Step ())
+      res.push_back (accounts.GetFromResult (q)->GetName ());
+    return res;
+  }
+
+  /**
+   * Returns the positions of ground loot modified since the given height.
+   */
+  std::vector<HexCoord>
+  GetModifiedLoot (const unsigned h)
+  {
+    std::vector<HexCoord> res;
+    auto q = loot.QueryModifiedSince (h);
+    while (q.Step ())
+      res.push_back (loot.GetFromResult (q)->GetPosition ());
+    return res;
+  }
+
+};
+
+TEST_F (EntityChangesTests, Writes)
+{
+  accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+  characters.CreateNew ("domob", Faction::RED);
+  buildings.CreateNew ("checkmark", "domob", Faction::RED);
+  ongoings.CreateNew (1)->SetHeight (5);
+  loot.GetByCoord (HexCoord (1, 2))->GetInventory ()
+      .AddFungibleCount ("foo", 1);
+  Record (10);
+
+  characters.CreateNew ("domob", Faction::RED);
+  Record (12);
+
+  EXPECT_THAT (GetModifiedAccounts (10), ElementsAre ("domob"));
+  EXPECT_THAT (GetModifiedIds (characters, 10), ElementsAre (101, 104));
+  EXPECT_THAT (GetModifiedIds (buildings, 10), ElementsAre (102));
+  EXPECT_THAT (GetModifiedIds (ongoings, 10), ElementsAre (103));
+  EXPECT_THAT (GetModifiedLoot (10), ElementsAre (HexCoord (1, 2)));
+
+  EXPECT_THAT (GetModifiedAccounts (11), IsEmpty ());
+  EXPECT_THAT (GetModifiedIds (characters, 11), ElementsAre (104));
+  EXPECT_THAT (GetModifiedIds (buildings, 11), IsEmpty ());
+  EXPECT_THAT (GetModifiedIds (ongoings, 11), IsEmpty ());
+  EXPECT_THAT (GetModifiedLoot (11), IsEmpty ());
+
+  characters.GetById (101)->MutableProto ().set_speed (42);
+  Record (20);
+  EXPECT_THAT (GetModifiedIds (characters, 15), ElementsAre (101));
+}
+
+TEST_F (EntityChangesTests, LazyRegeneration)
+{
+  db.SetLazyRegenHeight (10);
+
+  auto c = characters.CreateNew ("domob", Faction::RED);
+  auto* regen = &c->MutableRegenData ();
+  regen->mutable_max_hp ()->set_shield (10);
+  regen->mutable_regeneration_mhp ()->set_shield (1'000);
+  c->MutableHP ().set_shield (2);
+  c.reset ();
+
+  c = characters.CreateNew ("domob", Faction::RED);
+  regen = &c->MutableRegenData ();
+  regen->mutable_max_hp ()->set_shield (10);
+  regen->mutable_regeneration_mhp ()->set_shield (1'000);
+  c->MutableHP ().set_shield (10);
+  c.reset ();
+
+  auto b = buildings.CreateNew ("checkmark", "", Faction::ANCIENT);
+  regen = &b->MutableRegenData ();
+  regen->mutable_max_hp ()->set_armour (10);
+  regen->mutable_regeneration_mhp ()->set_armour (1'000);
+  b->MutableHP ().set_armour (5);
+  b.reset ();
+
+  Record (10);
+
+  /* The HP of the regenerating entities change in every block, even though
+     their rows are not written.  They must be reported as changed.  */
+  for (unsigned h = 11; h <= 13; ++h)
+    {
+      db.SetLazyRegenHeight (h);
+      Record (h);
+      EXPECT_THAT (GetModifiedIds (characters, h), ElementsAre (101));
+      EXPECT_THAT (GetModifiedIds (buildings, h), ElementsAre (103));
+      EXPECT_EQ (characters.GetById (101)->GetHP ().shield (), 2 + h - 10);
+    }
+}
+
+TEST_F (EntityChangesTests, InventoriesAndOrders)
+{
+  accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+  accounts.CreateNew ("andy")->SetFaction (Faction::RED);
+  buildings.CreateNew ("checkmark", "", Faction::ANCIENT);
+  buildings.CreateNew ("checkmark", "", Faction::ANCIENT);
+  Record (1);
+
+  inventories.Get (101, "domob")->GetInventory ().AddFungibleCount ("foo", 1);
+  orders.CreateNew (102, "andy", DexOrder::Type::BID, "foo", 1, 2);
+  Record (10);
+
+  EXPECT_THAT (GetModifiedIds (buildings, 10), ElementsAre (101, 102));
+  EXPECT_THAT (GetModifiedAccounts (10), ElementsAre ("andy"));
+}
+
+TEST_F (EntityChangesTests, Deletions)
+{
+  characters.CreateNew ("domob", Faction::RED);
+  characters.CreateNew ("domob", Faction::RED);
+  buildings.CreateNew ("checkmark", "domob", Faction::RED);
+  auto op = ongoings.CreateNew (1);
+  op->SetHeight (5);
+  op->SetBuildingId (103);
+  op.reset ();
+  loot.GetByCoord (HexCoord (1, 2))->GetInventory ()
+      .AddFungibleCount ("foo", 1);
+  Record (10);
+
+  characters.DeleteById (101);
+  ongoings.DeleteForBuilding (103);
+  buildings.DeleteById (103);
+  loot.GetByCoord (HexCoord (1, 2))->GetInventory ()
+      .SetFungibleCount ("foo", 0);
+  Record (12);
+
+  EXPECT_THAT (GetModifiedIds (characters, 0), ElementsAre (102));
+  EXPECT_THAT (GetModifiedIds (buildings, 0), IsEmpty ());
+  EXPECT_THAT (GetModifiedIds (ongoings, 0), IsEmpty ());
+  EXPECT_THAT (GetModifiedLoot (0), IsEmpty ());
+
+  EXPECT_THAT (changes.GetDeletedCharacters (12), ElementsAre (101));
+  EXPECT_THAT (changes.GetDeletedBuildings (12), ElementsAre (103));
+  EXPECT_THAT (changes.GetDeletedOngoings (12), ElementsAre (104));
+  EXPECT_THAT (changes.GetEmptiedGroundLoot (12),
+               ElementsAre (HexCoord (1, 2)));
+
+  EXPECT_THAT (changes.GetDeletedCharacters (13), IsEmpty ());
+  EXPECT_THAT (changes.GetEmptiedGroundLoot (13), IsEmpty ());
+
+  /* Refilling the loot tile makes it a regular modification again.  */
+  loot.GetByCoord (HexCoord (1, 2))->GetInventory ()
+      .AddFungibleCount ("bar", 1);
+  Record (15);
+  EXPECT_THAT (changes.GetEmptiedGroundLoot (0), IsEmpty ());
+  EXPECT_THAT (GetModifiedLoot (15), ElementsAre (HexCoord (1, 2)));
+}
+
+TEST_F (EntityChangesTests, ChangedAccountsAndCharacters)
+{
+  accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+  characters.CreateNew ("domob", Faction::RED);
+  characters.CreateNew ("domob", Faction::RED);
+  Record (10);
+
+  accounts.CreateNew ("andy")->SetFaction (Faction::GREEN);
+  characters.DeleteById (101);
+  characters.CreateNew ("andy", Faction::GREEN);
+  Record (12);
+
+  EXPECT_THAT (changes.GetChangedAccounts (10), ElementsAre ("andy", "domob"));
+  EXPECT_THAT (changes.GetChangedAccounts (11), ElementsAre ("andy"));
+  EXPECT_THAT (changes.GetChangedAccounts (13), IsEmpty ());
+
+  EXPECT_THAT (changes.GetChangedCharacters (10), ElementsAre (101, 102, 103));
+  EXPECT_THAT (changes.GetChangedCharacters (11), ElementsAre (101, 103));
+  EXPECT_THAT (changes.GetChangedCharacters (13), IsEmpty ());
+}
+
+TEST_F (EntityChangesTests, PruneTombstones)
+{
+  characters.CreateNew ("domob", Faction::RED);
+  characters.CreateNew ("domob", Faction::RED);
+  characters.CreateNew ("domob", Faction::RED);
+  Record (1);
+
+  characters.DeleteById (101);
+  Record (5);
+  characters.DeleteById (102);
+  Record (10);
+
+  changes.PruneTombstones (10);
+  EXPECT_THAT (changes.GetDeletedCharacters (0), ElementsAre (102));
+  EXPECT_THAT (GetModifiedIds (characters, 0), ElementsAre (103));
+}
+
+} // anonymous namespace
+} // namespace pxd
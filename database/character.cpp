@@ -18,8 +18,13 @@
 
 #include "character.hpp"
 
+#include "dirtyids.hpp"
+
 #include <glog/logging.h>
 
+#include <string>
+#include <utility>
+
 namespace pxd
 {
 
@@ -36,6 +41,7 @@ Character::Character (Database& d, const std::string& o, const Faction f)
       << "owner=" << owner;
   volatileMv.SetToDefault ();
   effects.SetToDefault ();
+  combatData.SetToDefault ();
   data.SetToDefault ();
   Validate ();
 }
@@ -69,8 +75,33 @@ Character::Character (Database& d, const Database::Result<CharacterResult>& res)
 
   volatileMv = res.GetProto<CharacterResult::volatilemv> ();
   inv = res.GetProto<CharacterResult::inventory> ();
+  combatData = res.GetProto<CharacterResult::combatdata> ();
   data = res.GetProto<CharacterResult::proto> ();
 
+  /* Rows restored from undo data of blocks before the combat data was
+     moved to its own column (see MigrateCharacterCombatData) still have it
+     in the main proto.  Move it over in that case.  This is only checked
+     if the combat data column is empty (which in practice does not happen
+     for other characters), so that the main proto is not always parsed.  */
+  if (combatData.GetSerialised ().empty () && data.Get ().has_combat_data ())
+    {
+      VLOG (1) << "Character " << id << " has combat data in the main proto";
+
+      std::string combatBytes;
+      CHECK (data.Get ().combat_data ().SerializeToString (&combatBytes));
+
+      proto::Character pb = data.Get ();
+      pb.clear_combat_data ();
+      std::string dataBytes;
+      CHECK (pb.SerializeToString (&dataBytes));
+
+      /* The data stays in the legacy form in the database until the
+         character is modified or CharacterTable::NormaliseLegacyCombatData
+         is called, in which case both columns are written in the new form.  */
+      combatData = LazyProto<proto::CombatData> (std::move (combatBytes));
+      data = LazyProto<proto::Character> (std::move (dataBytes));
+    }
+
   VLOG (2) << "Fetched character with ID " << id << " from database result";
   Validate ();
 }
@@ -80,7 +111,8 @@ Character::~Character ()
   Validate ();
 
   if (isNew || CombatEntity::IsDirtyFull ()
-        || inv.IsDirty () || effects.IsDirty () || data.IsDirty ())
+        || inv.IsDirty () || effects.IsDirty ()
+        || combatData.IsDirty () || data.IsDirty ())
     {
       VLOG (2)
           << "Character " << id
@@ -94,7 +126,8 @@ Character::~Character ()
            `canregen`, `friendlytargets`,
            `faction`,
            `ismoving`, `ismining`, `attackrange`, `friendlyrange`,
-           `regendata`, `target`, `inventory`, `effects`, `proto`)
+           `regendata`, `target`, `inventory`, `effects`, `proto`,
+           `combatdata`)
           VALUES
           (?1,
            ?2, ?3, ?4,
@@ -103,7 +136,8 @@ Character::~Character ()
            ?9, ?10,
            ?101,
            ?102, ?103, ?104, ?105,
-           ?106, ?107, ?108, ?109, ?110)
+           ?106, ?107, ?108, ?109, ?110,
+           ?111)
       )");
 
       BindFieldValues (stmt);
@@ -119,8 +153,13 @@ Character::~Character ()
       stmt.Bind (103, data.Get ().mining ().active ());
       stmt.BindProto (108, inv.GetProtoForBinding ());
       stmt.BindProto (110, data);
+      stmt.BindProto (111, combatData);
       stmt.Execute ();
 
+      auto* dirty = db.GetDirtyIds ();
+      if (dirty != nullptr)
+        dirty->MarkCharacter (id);
+
       return;
     }
 
@@ -145,6 +184,11 @@ Character::~Character ()
 
       BindFieldValues (stmt);
       stmt.Execute ();
+
+      auto* dirty = db.GetDirtyIds ();
+      if (dirty != nullptr)
+        dirty->MarkCharacter (id);
+
       return;
     }
 
@@ -167,6 +211,9 @@ Character::Validate () const
 
   const auto& pb = data.Get ();
 
+  CHECK (!pb.has_combat_data ())
+      << "Character " << id << " has combat data in the main proto";
+
   if (IsBusy ())
     CHECK (!pb.has_movement ()) << "Busy character should not be moving";
 
@@ -290,6 +337,27 @@ CharacterTable::QueryAll ()
   return stmt.Query<CharacterResult> ();
 }
 
+Database::Result<CharacterResult>
+CharacterTable::QueryModifiedSince (const unsigned h)
+{
+  /* With lazy HP regeneration, the HP of fighters that can regenerate
+     change every block without the row being written.  Thus those are
+     always included in that case.  */
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `characters`
+      WHERE `id` IN (
+        SELECT `id`
+          FROM `changes_characters`
+          WHERE `deleted` = 0 AND `height` >= ?1
+      ) OR (?2 AND `canregen`)
+      ORDER BY `id`
+  )");
+  stmt.Bind (1, h);
+  stmt.Bind (2, db.GetLazyRegenHeight () != Database::NO_LAZY_REGEN);
+  return stmt.Query<CharacterResult> ();
+}
+
 Database::Result<CharacterResult>
 CharacterTable::QueryForOwner (const std::string& owner)
 {
@@ -313,6 +381,62 @@ CharacterTable::QueryForBuilding (const Database::IdT building)
   return stmt.Query<CharacterResult> ();
 }
 
+Database::Result<CharacterResult>
+CharacterTable::QueryForIds (const std::vector<Database::IdT>& ids)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `characters`
+      WHERE )" + IdBatchCondition ("`id`", 1) + R"(
+      ORDER BY `id`
+  )");
+  BindIdBatch (stmt, 1, ids);
+  return stmt.Query<CharacterResult> ();
+}
+
+Database::Result<CharacterResult>
+CharacterTable::QueryForBuildings (const std::vector<Database::IdT>& buildings)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `characters`
+      WHERE )" + IdBatchCondition ("`inbuilding`", 1) + R"(
+      ORDER BY `id`
+  )");
+  BindIdBatch (stmt, 1, buildings);
+  return stmt.Query<CharacterResult> ();
+}
+
+Database::Result<CharacterResult>
+CharacterTable::QueryInArea (const HexCoord& centre,
+                             const HexCoord::IntT l1range)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `characters`
+      WHERE )" + L1AreaCondition (1) + R"(
+      ORDER BY `id`
+  )");
+  BindL1AreaParameters (stmt, 1, centre, l1range);
+  return stmt.Query<CharacterResult> ();
+}
+
+Database::Result<CharacterResult>
+CharacterTable::QueryInArea (const HexCoord& centre,
+                             const HexCoord::IntT l1range,
+                             const std::string& owner)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `characters`
+      WHERE `owner` = ?8 AND )" + L1AreaCondition (1) + R"(
+      ORDER BY `id`
+  )");
+  BindL1AreaParameters (stmt, 1, centre, l1range);
+  stmt.Bind (8, owner);
+  return stmt.Query<CharacterResult> ();
+}
+
 Database::Result<CharacterResult>
 CharacterTable::QueryMoving ()
 {
@@ -354,23 +478,24 @@ CharacterTable::QueryForRegen ()
 }
 
 Database::Result<CharacterResult>
-CharacterTable::QueryWithTarget ()
+CharacterTable::QueryForRegenWithEffects ()
 {
   auto stmt = db.Prepare (R"(
     SELECT *
       FROM `characters`
-      WHERE (`target` IS NOT NULL) OR `friendlytargets`
+      WHERE `canregen` AND `effects` IS NOT NULL
       ORDER BY `id`
   )");
   return stmt.Query<CharacterResult> ();
 }
 
 Database::Result<CharacterResult>
-CharacterTable::QueryForEnterBuilding ()
+CharacterTable::QueryWithTarget ()
 {
   auto stmt = db.Prepare (R"(
-    SELECT * FROM `characters`
-      WHERE `enterbuilding` IS NOT NULL
+    SELECT *
+      FROM `characters`
+      WHERE (`target` IS NOT NULL) OR `friendlytargets`
       ORDER BY `id`
   )");
   return stmt.Query<CharacterResult> ();
@@ -384,6 +509,17 @@ struct PositionResult : public ResultWithFaction, public ResultWithCoord
   RESULT_COLUMN (int64_t, id, 1);
 };
 
+struct EnterBuildingResult : public ResultWithCoord
+{
+  RESULT_COLUMN (int64_t, id, 1);
+  RESULT_COLUMN (int64_t, enterbuilding, 2);
+};
+
+struct OwnerResult : public Database::ResultType
+{
+  RESULT_COLUMN (std::string, owner, 1);
+};
+
 } // anonymous namespace
 
 void
@@ -406,6 +542,44 @@ CharacterTable::ProcessAllPositions (const PositionFcn& cb)
     }
 }
 
+void
+CharacterTable::ProcessEnterBuildingIntents (const EnterBuildingFcn& cb)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT `id`, `x`, `y`, `enterbuilding`
+      FROM `characters`
+      WHERE `enterbuilding` IS NOT NULL
+      ORDER BY `id`
+  )");
+
+  auto res = stmt.Query<EnterBuildingResult> ();
+  while (res.Step ())
+    {
+      const Database::IdT id = res.Get<EnterBuildingResult::id> ();
+      const HexCoord pos = GetCoordFromColumn (res);
+      const Database::IdT building
+          = res.Get<EnterBuildingResult::enterbuilding> ();
+      cb (id, pos, building);
+    }
+}
+
+bool
+CharacterTable::GetOwnerById (const Database::IdT id, std::string& owner)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT `owner` FROM `characters` WHERE `id` = ?1
+  )");
+  stmt.Bind (1, id);
+
+  auto res = stmt.Query<OwnerResult> ();
+  if (!res.Step ())
+    return false;
+
+  owner = res.Get<OwnerResult::owner> ();
+  CHECK (!res.Step ());
+  return true;
+}
+
 void
 CharacterTable::DeleteById (const Database::IdT id)
 {
@@ -416,6 +590,10 @@ CharacterTable::DeleteById (const Database::IdT id)
   )");
   stmt.Bind (1, id);
   stmt.Execute ();
+
+  auto* dirty = db.GetDirtyIds ();
+  if (dirty != nullptr)
+    dirty->MarkCharacter (id);
 }
 
 namespace
@@ -447,6 +625,40 @@ CharacterTable::CountForOwner (const std::string& owner)
   return count;
 }
 
+unsigned
+CharacterTable::NormaliseLegacyCombatData ()
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `characters`
+      WHERE length (`combatdata`) = 0
+      ORDER BY `id`
+  )");
+  auto res = stmt.Query<CharacterResult> ();
+
+  unsigned count = 0;
+  while (res.Step ())
+    {
+      /* The combat data column may also be empty legitimately, if the
+         character has no combat data at all.  Those are left alone.  */
+      if (!res.GetProto<CharacterResult::proto> ().Get ().has_combat_data ())
+        continue;
+
+      /* The character is converted to the new form in memory when loaded.
+         Marking the combat data as modified writes it back like that.  */
+      auto c = GetFromResult (res);
+      c->MutableCombatData ();
+      ++count;
+    }
+
+  if (count > 0)
+    LOG (INFO)
+        << "Moved legacy combat data of " << count
+        << " characters to the separate column";
+
+  return count;
+}
+
 void
 CharacterTable::ClearAllEffects ()
 {
@@ -23,6 +23,7 @@
 #include "coord.hpp"
 #include "database.hpp"
 #include "faction.hpp"
+#include "idbatch.hpp"
 #include "inventory.hpp"
 #include "lazyproto.hpp"
 
@@ -36,6 +37,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace pxd
 {
@@ -54,6 +56,7 @@ struct CharacterResult : public ResultWithFaction, public ResultWithCoord,
   RESULT_COLUMN (pxd::proto::CombatEffects, effects, 6);
   RESULT_COLUMN (pxd::proto::Inventory, inventory, 7);
   RESULT_COLUMN (pxd::proto::Character, proto, 8);
+  RESULT_COLUMN (pxd::proto::CombatData, combatdata, 9);
 };
 
 /**
@@ -101,6 +104,12 @@ private:
   /** Combat effects applying to this character.  */
   LazyProto<proto::CombatEffects> effects;
 
+  /**
+   * The character's static combat data.  This is stored separately from
+   * the main proto, so that combat processing need not parse the latter.
+   */
+  LazyProto<proto::CombatData> combatData;
+
   /** All other data in the protocol buffer.  */
   LazyProto<proto::Character> data;
 
@@ -144,7 +153,7 @@ protected:
   bool
   IsDirtyCombatData () const override
   {
-    return data.IsDirty ();
+    return combatData.IsDirty ();
   }
 
 public:
@@ -306,7 +315,13 @@ public:
   const proto::CombatData&
   GetCombatData () const override
   {
-    return data.Get ().combat_data ();
+    return combatData.Get ();
+  }
+
+  proto::CombatData&
+  MutableCombatData () override
+  {
+    return combatData.Mutable ();
   }
 
 };
@@ -333,6 +348,14 @@ public:
   using PositionFcn
       = std::function<void (Database::IdT id, const HexCoord& pos, Faction f)>;
 
+  /**
+   * Callback function for processing characters that want to enter
+   * a building, with their position and the building's ID.
+   */
+  using EnterBuildingFcn
+      = std::function<void (Database::IdT id, const HexCoord& pos,
+                            Database::IdT building)>;
+
   explicit CharacterTable (Database& d)
     : db(d)
   {}
@@ -364,16 +387,55 @@ public:
    */
   Database::Result<CharacterResult> QueryAll ();
 
+  /**
+   * Queries the database for all characters that have been changed (but not
+   * deleted) at or after the given block height, as recorded by
+   * EntityChanges.  With lazy HP regeneration, this also includes all
+   * that are regenerating HP.
+   */
+  Database::Result<CharacterResult> QueryModifiedSince (unsigned h);
+
   /**
    * Queries for all characters with a given owner, ordered by ID.
    */
   Database::Result<CharacterResult> QueryForOwner (const std::string& owner);
 
+  /**
+   * Queries for the characters with the given IDs (at most ID_BATCH_SIZE
+   * of them), ordered by ID.  IDs that do not exist are ignored.
+   */
+  Database::Result<CharacterResult> QueryForIds (
+      const std::vector<Database::IdT>& ids);
+
   /**
    * Queries all characters that are in a given building.
    */
   Database::Result<CharacterResult> QueryForBuilding (Database::IdT building);
 
+  /**
+   * Queries all characters that are in one of the given buildings
+   * (at most ID_BATCH_SIZE of them), ordered by ID.
+   */
+  Database::Result<CharacterResult> QueryForBuildings (
+      const std::vector<Database::IdT>& buildings);
+
+  /**
+   * Queries for all characters on the map within the given L1 range
+   * around a centre, ordered by ID.  This uses the position index, so
+   * that the cost scales with the size of the area rather than the total
+   * number of characters.
+   */
+  Database::Result<CharacterResult> QueryInArea (const HexCoord& centre,
+                                                 HexCoord::IntT l1range);
+
+  /**
+   * Queries for all characters of a given owner that are within the
+   * given area on the map, ordered by ID.
+   */
+  Database::Result<CharacterResult> QueryInArea (const HexCoord& centre,
+                                                 HexCoord::IntT l1range,
+                                                 const std::string& owner);
+
   /**
    * Queries for all characters that are currently moving (and thus may need
    * to be updated for move stepping).
@@ -397,6 +459,12 @@ public:
    */
   Database::Result<CharacterResult> QueryForRegen ();
 
+  /**
+   * Queries for all characters that may need to have HP regenerated
+   * and have combat effects applied.
+   */
+  Database::Result<CharacterResult> QueryForRegenWithEffects ();
+
   /**
    * Queries for all characters that have a combat target and thus need
    * to be processed for damage.  This also includes ones that have
@@ -404,11 +472,6 @@ public:
    */
   Database::Result<CharacterResult> QueryWithTarget ();
 
-  /**
-   * Queries all characters that want to enter a building.
-   */
-  Database::Result<CharacterResult> QueryForEnterBuilding ();
-
   /**
    * Processes all positions of characters on the map.  This is used to
    * construct the dynamic obstacle map, avoiding the need to query all data
@@ -417,6 +480,22 @@ public:
    */
   void ProcessAllPositions (const PositionFcn& cb);
 
+  /**
+   * Processes the position and target building of all characters that want
+   * to enter a building, ordered by ID.  Like ProcessAllPositions, this only
+   * reads the needed columns rather than constructing full handles.
+   *
+   * Since this reads the database directly, it must not be called while
+   * a modified Character handle is still alive.
+   */
+  void ProcessEnterBuildingIntents (const EnterBuildingFcn& cb);
+
+  /**
+   * Looks up just the owner of the character with the given ID, without
+   * constructing a full handle.  Returns false if there is no such character.
+   */
+  bool GetOwnerById (Database::IdT id, std::string& owner);
+
   /**
    * Deletes the character with the given ID.
    */
@@ -432,6 +511,14 @@ public:
    */
   void ClearAllEffects ();
 
+  /**
+   * Rewrites all characters that still have their combat data in the
+   * main proto instead of the separate column (as can happen for rows
+   * restored from undo data of blocks before that was introduced) in the
+   * current form.  Returns the number of characters updated.
+   */
+  unsigned NormaliseLegacyCombatData ();
+
 };
 
 } // namespace pxd
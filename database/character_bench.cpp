@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -50,6 +50,8 @@ InsertTestCharacters (Database& db, const unsigned n, const unsigned numWP)
       auto* wp = h->MutableProto ().mutable_movement ()->mutable_waypoints ();
       for (unsigned j = 0; j < numWP; ++j)
         wp->Add ()->set_x (j);
+
+      h->MutableCombatData ().add_attacks ()->set_range (5);
     }
 
   return ids;
@@ -131,6 +133,43 @@ BENCHMARK (CharacterLookupProto)
   ->Args ({1, 1000})
   ->Args ({10, 100});
 
+/**
+ * Benchmarks the lookup of characters from the database with access only
+ * to the combat data (as done in the combat phases).  Since that is stored
+ * separately, this should not depend on the size of the main proto.
+ *
+ * Arguments are:
+ *  - Characters to look up
+ *  - Number of waypoints in the character proto
+ */
+void
+CharacterLookupCombatData (benchmark::State& state)
+{
+  TestDatabase db;
+  SetupDatabaseSchema (*db);
+
+  const unsigned numChar = state.range (0);
+  const unsigned numWP = state.range (1);
+
+  const auto charIds = InsertTestCharacters (db, numChar, numWP);
+  CharacterTable tbl(db);
+
+  for (auto _ : state)
+    for (const auto id : charIds)
+      {
+        const auto h = tbl.GetById (id);
+        CHECK_EQ (h->GetId (), id);
+        CHECK_EQ (h->GetCombatData ().attacks_size (), 1);
+      }
+}
+BENCHMARK (CharacterLookupCombatData)
+  ->Unit (benchmark::kMicrosecond)
+  ->Args ({1, 0})
+  ->Args ({1, 10})
+  ->Args ({1, 100})
+  ->Args ({1, 1000})
+  ->Args ({10, 100});
+
 /**
  * Benchmarks the lookup of characters from the database while looping
  * through a single result set.
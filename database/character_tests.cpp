@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -25,6 +25,10 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <string>
+#include <tuple>
+#include <vector>
+
 namespace pxd
 {
 namespace
@@ -252,9 +256,9 @@ TEST_F (CharacterTests, AttackRange)
   c = tbl.GetById (id);
   EXPECT_EQ (c->GetAttackRange (false), CombatEntity::NO_ATTACKS);
   EXPECT_EQ (c->GetAttackRange (true), CombatEntity::NO_ATTACKS);
-  auto* att = c->MutableProto ().mutable_combat_data ()->add_attacks ();
+  auto* att = c->MutableCombatData ().add_attacks ();
   att->set_range (0);
-  att = c->MutableProto ().mutable_combat_data ()->add_attacks ();
+  att = c->MutableCombatData ().add_attacks ();
   att->set_range (1);
   att->set_friendlies (true);
   c.reset ();
@@ -262,13 +266,13 @@ TEST_F (CharacterTests, AttackRange)
   c = tbl.GetById (id);
   EXPECT_EQ (c->GetAttackRange (false), 0);
   EXPECT_EQ (c->GetAttackRange (true), 1);
-  c->MutableProto ().mutable_combat_data ()->add_attacks ()->set_range (5);
+  c->MutableCombatData ().add_attacks ()->set_range (5);
   c.reset ();
 
   c = tbl.GetById (id);
   EXPECT_EQ (c->GetAttackRange (false), 5);
   EXPECT_EQ (c->GetAttackRange (true), 1);
-  c->MutableProto ().clear_combat_data ();
+  c->MutableCombatData ().Clear ();
   c.reset ();
 
   c = tbl.GetById (id);
@@ -276,6 +280,85 @@ TEST_F (CharacterTests, AttackRange)
   EXPECT_EQ (c->GetAttackRange (true), CombatEntity::NO_ATTACKS);
 }
 
+TEST_F (CharacterTests, CombatDataSeparateFromProto)
+{
+  auto c = tbl.CreateNew ("domob", Faction::RED);
+  const auto id = c->GetId ();
+  c->MutableCombatData ().add_attacks ()->set_range (3);
+  c->MutableProto ().set_speed (100);
+  c.reset ();
+
+  /* Modifying only the main proto keeps the cached attack range valid
+     and does not touch the combat data.  */
+  c = tbl.GetById (id);
+  c->MutableProto ().set_speed (200);
+  EXPECT_EQ (c->GetAttackRange (false), 3);
+  c.reset ();
+
+  c = tbl.GetById (id);
+  EXPECT_EQ (c->GetProto ().speed (), 200);
+  EXPECT_FALSE (c->GetProto ().has_combat_data ());
+  EXPECT_EQ (c->GetAttackRange (false), 3);
+  ASSERT_EQ (c->GetCombatData ().attacks_size (), 1);
+  EXPECT_EQ (c->GetCombatData ().attacks (0).range (), 3);
+}
+
+/**
+ * Result type for reading the stored protos of a character directly.
+ */
+struct StoredProtosResult : public Database::ResultType
+{
+  RESULT_COLUMN (pxd::proto::Character, proto, 1);
+  RESULT_COLUMN (pxd::proto::CombatData, combatdata, 2);
+};
+
+TEST_F (CharacterTests, NormaliseLegacyCombatData)
+{
+  const auto legacyId = tbl.CreateNew ("domob", Faction::RED)->GetId ();
+  const auto emptyId = tbl.CreateNew ("domob", Faction::RED)->GetId ();
+  auto c = tbl.CreateNew ("domob", Faction::RED);
+  const auto newId = c->GetId ();
+  c->MutableCombatData ().add_attacks ()->set_range (5);
+  c.reset ();
+
+  /* Put the first character into the legacy form, as if it was restored
+     from old undo data.  */
+  LazyProto<proto::Character> legacy;
+  legacy.SetToDefault ();
+  legacy.Mutable ().set_speed (100);
+  legacy.Mutable ().mutable_combat_data ()->add_attacks ()->set_range (3);
+  auto upd = db.Prepare (R"(
+    UPDATE `characters`
+      SET `proto` = ?2, `combatdata` = x'', `attackrange` = 3
+      WHERE `id` = ?1
+  )");
+  upd.Bind (1, legacyId);
+  upd.BindProto (2, legacy);
+  upd.Execute ();
+
+  EXPECT_EQ (tbl.NormaliseLegacyCombatData (), 1);
+  EXPECT_EQ (tbl.NormaliseLegacyCombatData (), 0);
+
+  auto stmt = db.Prepare (R"(
+    SELECT `proto`, `combatdata`
+      FROM `characters`
+      WHERE `id` = ?1
+  )");
+  stmt.Bind (1, legacyId);
+  auto res = stmt.Query<StoredProtosResult> ();
+  ASSERT_TRUE (res.Step ());
+  const auto& pb = res.GetProto<StoredProtosResult::proto> ().Get ();
+  EXPECT_EQ (pb.speed (), 100);
+  EXPECT_FALSE (pb.has_combat_data ());
+  const auto& cd = res.GetProto<StoredProtosResult::combatdata> ().Get ();
+  ASSERT_EQ (cd.attacks_size (), 1);
+  EXPECT_EQ (cd.attacks (0).range (), 3);
+  EXPECT_FALSE (res.Step ());
+
+  EXPECT_EQ (tbl.GetById (emptyId)->GetCombatData ().attacks_size (), 0);
+  EXPECT_EQ (tbl.GetById (newId)->GetCombatData ().attacks (0).range (), 5);
+}
+
 TEST_F (CharacterTests, UsedCargoSpace)
 {
   const RoConfig cfg(xaya::Chain::REGTEST);
@@ -291,6 +374,188 @@ TEST_F (CharacterTests, UsedCargoSpace)
 
 /* ************************************************************************** */
 
+/**
+ * Result type for reading the stored HP of a character directly.
+ */
+struct StoredHpResult : public Database::ResultType
+{
+  RESULT_COLUMN (pxd::proto::HP, hp, 1);
+};
+
+class CharacterLazyRegenTests : public CharacterTests
+{
+
+protected:
+
+  /**
+   * Reads the HP proto as stored in the database for the given character,
+   * without applying any lazy regeneration.
+   */
+  proto::HP
+  GetStoredHp (const Database::IdT id)
+  {
+    auto stmt = db.Prepare (R"(
+      SELECT `hp` FROM `characters` WHERE `id` = ?1
+    )");
+    stmt.Bind (1, id);
+
+    auto res = stmt.Query<StoredHpResult> ();
+    CHECK (res.Step ());
+    const auto hp = res.GetProto<StoredHpResult::hp> ().Get ();
+    CHECK (!res.Step ());
+
+    return hp;
+  }
+
+  /**
+   * Creates a character with 10 shield HP regenerating at half an HP
+   * per block, and 2 shield HP when created.
+   */
+  Database::IdT
+  CreateRegenerating ()
+  {
+    auto c = tbl.CreateNew ("domob", Faction::RED);
+    auto& regen = c->MutableRegenData ();
+    regen.mutable_max_hp ()->set_shield (10);
+    regen.mutable_regeneration_mhp ()->set_shield (500);
+    c->MutableHP ().set_shield (2);
+    return c->GetId ();
+  }
+
+};
+
+TEST_F (CharacterLazyRegenTests, HeightInDatabase)
+{
+  EXPECT_EQ (db.GetLazyRegenHeight (), Database::NO_LAZY_REGEN);
+  db.SetLazyRegenHeight (10);
+  EXPECT_EQ (db.GetLazyRegenHeight (), 10);
+  db.SetLazyRegenHeight (11);
+  EXPECT_EQ (db.GetLazyRegenHeight (), 11);
+}
+
+TEST_F (CharacterLazyRegenTests, NotActive)
+{
+  const auto id = CreateRegenerating ();
+  EXPECT_FALSE (GetStoredHp (id).has_regen_height ());
+  EXPECT_EQ (tbl.GetById (id)->GetHP ().shield (), 2);
+}
+
+TEST_F (CharacterLazyRegenTests, HpReferenceValidAfterModification)
+{
+  db.SetLazyRegenHeight (10);
+  const auto id = CreateRegenerating ();
+
+  db.SetLazyRegenHeight (13);
+  auto c = tbl.GetById (id);
+  const auto& hp = c->GetHP ();
+  EXPECT_EQ (hp.shield (), 3);
+
+  c->MutableHP ().set_armour (5);
+  EXPECT_EQ (hp.shield (), 3);
+  EXPECT_EQ (hp.mhp ().shield (), 500);
+  EXPECT_EQ (c->GetHP ().armour (), 5);
+  EXPECT_EQ (c->GetHP ().shield (), 3);
+}
+
+TEST_F (CharacterLazyRegenTests, ReadingDoesNotUpdate)
+{
+  db.SetLazyRegenHeight (10);
+  const auto id = CreateRegenerating ();
+  EXPECT_EQ (GetStoredHp (id).regen_height (), 10);
+  EXPECT_EQ (tbl.GetById (id)->GetHP ().shield (), 2);
+
+  db.SetLazyRegenHeight (13);
+  auto c = tbl.GetById (id);
+  EXPECT_EQ (c->GetHP ().shield (), 3);
+  EXPECT_EQ (c->GetHP ().mhp ().shield (), 500);
+  c->SetPosition (HexCoord (1, 2));
+  c.reset ();
+
+  const auto stored = GetStoredHp (id);
+  EXPECT_EQ (stored.shield (), 2);
+  EXPECT_EQ (stored.regen_height (), 10);
+
+  db.SetLazyRegenHeight (100);
+  c = tbl.GetById (id);
+  EXPECT_EQ (c->GetHP ().shield (), 10);
+  EXPECT_EQ (c->GetHP ().mhp ().shield (), 0);
+}
+
+TEST_F (CharacterLazyRegenTests, ModificationAnchors)
+{
+  db.SetLazyRegenHeight (10);
+  const auto id = CreateRegenerating ();
+
+  db.SetLazyRegenHeight (15);
+  auto c = tbl.GetById (id);
+  c->MutableHP ().set_armour (5);
+  EXPECT_EQ (c->GetHP ().shield (), 4);
+  EXPECT_EQ (c->GetHP ().mhp ().shield (), 500);
+  c.reset ();
+
+  const auto stored = GetStoredHp (id);
+  EXPECT_EQ (stored.armour (), 5);
+  EXPECT_EQ (stored.shield (), 4);
+  EXPECT_EQ (stored.mhp ().shield (), 500);
+  EXPECT_EQ (stored.regen_height (), 15);
+}
+
+TEST_F (CharacterLazyRegenTests, RegenDataChange)
+{
+  db.SetLazyRegenHeight (10);
+  const auto id = CreateRegenerating ();
+
+  /* The old regeneration rate applies up to the height at which
+     the regeneration data is changed, and the new one afterwards.  */
+  db.SetLazyRegenHeight (12);
+  auto c = tbl.GetById (id);
+  c->MutableRegenData ().mutable_regeneration_mhp ()->set_shield (2'000);
+  c.reset ();
+
+  db.SetLazyRegenHeight (14);
+  c = tbl.GetById (id);
+  EXPECT_EQ (c->GetHP ().shield (), 2 + 1 + 4);
+}
+
+TEST_F (CharacterLazyRegenTests, AdvanceHeight)
+{
+  db.SetLazyRegenHeight (10);
+  const auto id = CreateRegenerating ();
+
+  auto c = tbl.GetById (id);
+  c->MutableHP ().set_shield (5);
+  c->AdvanceHpRegenHeight ();
+  c.reset ();
+
+  EXPECT_EQ (GetStoredHp (id).regen_height (), 11);
+  EXPECT_EQ (tbl.GetById (id)->GetHP ().shield (), 5);
+
+  db.SetLazyRegenHeight (13);
+  EXPECT_EQ (tbl.GetById (id)->GetHP ().shield (), 6);
+}
+
+TEST_F (CharacterLazyRegenTests, QueryForRegenWithEffects)
+{
+  db.SetLazyRegenHeight (10);
+  const auto id1 = CreateRegenerating ();
+  const auto id2 = CreateRegenerating ();
+
+  auto c = tbl.GetById (id2);
+  c->MutableEffects ().mutable_shield_regen ()->set_percent (10);
+  c.reset ();
+
+  c = tbl.CreateNew ("domob", Faction::RED);
+  c->MutableEffects ().mutable_speed ()->set_percent (10);
+  c.reset ();
+
+  auto res = tbl.QueryForRegenWithEffects ();
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetId (), id2);
+  ASSERT_FALSE (res.Step ());
+
+  EXPECT_NE (id1, id2);
+}
+
 using CharacterTableTests = CharacterTests;
 
 TEST_F (CharacterTableTests, GetById)
@@ -342,6 +607,74 @@ TEST_F (CharacterTableTests, QueryForBuilding)
   ASSERT_FALSE (res.Step ());
 }
 
+TEST_F (CharacterTableTests, QueryForIds)
+{
+  const auto id1 = tbl.CreateNew ("domob", Faction::RED)->GetId ();
+  tbl.CreateNew ("domob", Faction::RED);
+  const auto id3 = tbl.CreateNew ("andy", Faction::RED)->GetId ();
+
+  auto res = tbl.QueryForIds ({id3, 12345, id1});
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetId (), id1);
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetId (), id3);
+  ASSERT_FALSE (res.Step ());
+
+  res = tbl.QueryForIds ({});
+  ASSERT_FALSE (res.Step ());
+}
+
+TEST_F (CharacterTableTests, QueryForBuildings)
+{
+  const auto id1 = tbl.CreateNew ("domob", Faction::RED)->GetId ();
+  const auto id2 = tbl.CreateNew ("domob", Faction::RED)->GetId ();
+  const auto id3 = tbl.CreateNew ("domob", Faction::RED)->GetId ();
+  tbl.CreateNew ("domob", Faction::RED);
+
+  tbl.GetById (id3)->SetBuildingId (10);
+  tbl.GetById (id2)->SetBuildingId (42);
+  tbl.GetById (id1)->SetBuildingId (10);
+
+  auto res = tbl.QueryForBuildings ({42, 10, 5});
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetId (), id1);
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetId (), id2);
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetId (), id3);
+  ASSERT_FALSE (res.Step ());
+}
+
+TEST_F (CharacterTableTests, QueryInArea)
+{
+  const auto id1 = tbl.CreateNew ("domob", Faction::RED)->GetId ();
+  const auto id2 = tbl.CreateNew ("andy", Faction::RED)->GetId ();
+  const auto id3 = tbl.CreateNew ("domob", Faction::RED)->GetId ();
+  const auto id4 = tbl.CreateNew ("domob", Faction::RED)->GetId ();
+
+  tbl.GetById (id1)->SetPosition (HexCoord (1, 1));
+  tbl.GetById (id2)->SetPosition (HexCoord (0, -2));
+  tbl.GetById (id3)->SetPosition (HexCoord (2, -2));
+  tbl.GetById (id4)->SetBuildingId (10);
+
+  auto res = tbl.QueryInArea (HexCoord (0, 0), 2);
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetId (), id1);
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetId (), id2);
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetId (), id3);
+  ASSERT_FALSE (res.Step ());
+
+  res = tbl.QueryInArea (HexCoord (0, 0), 1);
+  ASSERT_FALSE (res.Step ());
+
+  res = tbl.QueryInArea (HexCoord (1, -1), 1, "domob");
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetId (), id3);
+  ASSERT_FALSE (res.Step ());
+}
+
 TEST_F (CharacterTableTests, QueryMoving)
 {
   tbl.CreateNew ("domob", Faction::RED);
@@ -371,13 +704,13 @@ TEST_F (CharacterTableTests, QueryWithAttacks)
 {
   tbl.CreateNew ("domob", Faction::RED);
   tbl.CreateNew ("andy", Faction::RED)
-    ->MutableProto ().mutable_combat_data ()->add_attacks ()->set_range (0);
+    ->MutableCombatData ().add_attacks ()->set_range (0);
   auto c = tbl.CreateNew ("inbuilding", Faction::RED);
   c->SetBuildingId (100);
-  c->MutableProto ().mutable_combat_data ()->add_attacks ()->set_range (1);
+  c->MutableCombatData ().add_attacks ()->set_range (1);
   c.reset ();
   c = tbl.CreateNew ("daniel", Faction::RED);
-  auto* att = c->MutableProto ().mutable_combat_data ()->add_attacks ();
+  auto* att = c->MutableCombatData ().add_attacks ();
   att->set_area (1);
   att->set_friendlies (true);
   c.reset ();
@@ -516,20 +849,6 @@ TEST_F (CharacterTableTests, QueryWithTarget)
   ASSERT_FALSE (res.Step ());
 }
 
-TEST_F (CharacterTableTests, QueryForEnterBuilding)
-{
-  tbl.CreateNew ("not entering", Faction::RED);
-  tbl.CreateNew ("entering 1", Faction::GREEN)->SetEnterBuilding (10);
-  tbl.CreateNew ("entering 2", Faction::GREEN)->SetEnterBuilding (1);
-
-  auto res = tbl.QueryForEnterBuilding ();
-  ASSERT_TRUE (res.Step ());
-  EXPECT_EQ (tbl.GetFromResult (res)->GetOwner (), "entering 1");
-  ASSERT_TRUE (res.Step ());
-  EXPECT_EQ (tbl.GetFromResult (res)->GetOwner (), "entering 2");
-  ASSERT_FALSE (res.Step ());
-}
-
 TEST_F (CharacterTableTests, ProcessAllPositions)
 {
   tbl.CreateNew ("red", Faction::RED)->SetPosition (HexCoord (1, 5));
@@ -571,6 +890,43 @@ TEST_F (CharacterTableTests, ProcessAllPositions)
                                      Entry (3, Faction::BLUE, HexCoord (0, 0))));
 }
 
+TEST_F (CharacterTableTests, ProcessEnterBuildingIntents)
+{
+  tbl.CreateNew ("not entering", Faction::RED);
+  auto c = tbl.CreateNew ("entering 1", Faction::GREEN);
+  c->SetPosition (HexCoord (1, 2));
+  c->SetEnterBuilding (10);
+  c = tbl.CreateNew ("entering 2", Faction::GREEN);
+  c->SetPosition (HexCoord (-3, 0));
+  c->SetEnterBuilding (1);
+  c.reset ();
+
+  using Entry = std::tuple<Database::IdT, HexCoord, Database::IdT>;
+  std::vector<Entry> entries;
+  tbl.ProcessEnterBuildingIntents ([&entries] (const Database::IdT id,
+                                               const HexCoord& pos,
+                                               const Database::IdT building)
+    {
+      entries.emplace_back (id, pos, building);
+    });
+
+  EXPECT_THAT (entries, ElementsAre (Entry (2, HexCoord (1, 2), 10),
+                                     Entry (3, HexCoord (-3, 0), 1)));
+}
+
+TEST_F (CharacterTableTests, GetOwnerById)
+{
+  const auto id = tbl.CreateNew ("domob", Faction::RED)->GetId ();
+
+  std::string owner;
+  ASSERT_TRUE (tbl.GetOwnerById (id, owner));
+  EXPECT_EQ (owner, "domob");
+
+  owner = "unchanged";
+  EXPECT_FALSE (tbl.GetOwnerById (id + 1, owner));
+  EXPECT_EQ (owner, "unchanged");
+}
+
 TEST_F (CharacterTableTests, DeleteById)
 {
   const auto id1 = tbl.CreateNew ("domob", Faction::RED)->GetId ();
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -28,7 +28,8 @@ constexpr HexCoord::IntT CombatEntity::NO_ATTACKS;
 CombatEntity::CombatEntity (Database& d)
   : db(d), isNew(true),
     friendlyTargets(false), oldCanRegen(false),
-    isDirty(true)
+    isDirty(true), regenHeight(db.GetLazyRegenHeight ()),
+    regenComputed(false), hpAnchored(false)
 {
   hp.SetToDefault ();
   regenData.SetToDefault ();
@@ -44,13 +45,25 @@ CombatEntity::BindFullFields (Database::Statement& stmt,
 {
   stmt.BindProto (indRegenData, regenData);
 
-  const auto attackRange = FindAttackRange (GetCombatData (), false);
+  /* If the combat data is unchanged, we can just use the ranges loaded
+     from the database and avoid parsing it.  */
+  HexCoord::IntT attackRange, friendlyRange;
+  if (isNew || IsDirtyCombatData ())
+    {
+      attackRange = FindAttackRange (GetCombatData (), false);
+      friendlyRange = FindAttackRange (GetCombatData (), true);
+    }
+  else
+    {
+      attackRange = oldAttackRange;
+      friendlyRange = oldFriendlyRange;
+    }
+
   if (attackRange == NO_ATTACKS)
     stmt.BindNull (indAttackRange);
   else
     stmt.Bind (indAttackRange, attackRange);
 
-  const auto friendlyRange = FindAttackRange (GetCombatData (), true);
   if (friendlyRange == NO_ATTACKS)
     stmt.BindNull (indFriendlyRange);
   else
@@ -94,6 +107,65 @@ CombatEntity::Validate () const
 #endif // ENABLE_SLOW_ASSERTS
 }
 
+const proto::HP&
+CombatEntity::GetHP () const
+{
+  if (regenHeight == Database::NO_LAZY_REGEN || hpAnchored)
+    return hp.Get ();
+
+  if (!regenComputed)
+    {
+      regeneratedHp = ComputeLazyRegen (hp.Get (), regenData.Get (),
+                                        regenHeight);
+      regenComputed = true;
+    }
+
+  if (regeneratedHp != nullptr)
+    return *regeneratedHp;
+
+  return hp.Get ();
+}
+
+proto::HP&
+CombatEntity::MutableHP ()
+{
+  if (regenHeight == Database::NO_LAZY_REGEN || hpAnchored)
+    return hp.Mutable ();
+
+  /* regeneratedHp is not freed here, since callers may still hold a
+     reference obtained from GetHP before (e.g. to read the shield after
+     modifying the armour).  It is not used anymore once the HP are
+     anchored, though.  */
+  GetHP ();
+  auto& res = hp.Mutable ();
+  if (regeneratedHp != nullptr)
+    res = *regeneratedHp;
+  res.set_regen_height (regenHeight);
+  hpAnchored = true;
+
+  return res;
+}
+
+proto::RegenData&
+CombatEntity::MutableRegenData ()
+{
+  if (regenHeight != Database::NO_LAZY_REGEN)
+    MutableHP ();
+
+  return regenData.Mutable ();
+}
+
+void
+CombatEntity::AdvanceHpRegenHeight ()
+{
+  CHECK_NE (regenHeight, Database::NO_LAZY_REGEN)
+      << "Lazy regeneration is not active";
+
+  MutableHP ();
+  ++regenHeight;
+  hp.Mutable ().set_regen_height (regenHeight);
+}
+
 const proto::TargetId&
 CombatEntity::GetTarget () const
 {
@@ -139,6 +211,80 @@ CombatEntity::ComputeCanRegen (const proto::HP& hp,
   return false;
 }
 
+namespace
+{
+
+/**
+ * Applies the given number of blocks of regeneration to one type of HP
+ * (armour or shield) in closed form.  Returns true if anything changed.
+ */
+bool
+RegenerateHpType (const unsigned max, const unsigned mhpRate,
+                  const unsigned blocks, unsigned& cur, unsigned& milli)
+{
+  if (mhpRate == 0 || cur >= max)
+    return false;
+
+  const uint64_t total = static_cast<uint64_t> (cur) * 1'000 + milli
+                          + static_cast<uint64_t> (mhpRate) * blocks;
+  if (total >= static_cast<uint64_t> (max) * 1'000)
+    {
+      cur = max;
+      milli = 0;
+    }
+  else
+    {
+      cur = total / 1'000;
+      milli = total % 1'000;
+    }
+
+  return true;
+}
+
+} // anonymous namespace
+
+std::unique_ptr<proto::HP>
+CombatEntity::ComputeLazyRegen (const proto::HP& hp,
+                                const proto::RegenData& regen,
+                                const unsigned height)
+{
+  if (!hp.has_regen_height () || hp.regen_height () >= height)
+    return nullptr;
+  const unsigned blocks = height - hp.regen_height ();
+
+  auto res = std::make_unique<proto::HP> (hp);
+  bool changed = false;
+  unsigned cur, milli;
+
+  cur = hp.armour ();
+  milli = hp.mhp ().armour ();
+  if (RegenerateHpType (regen.max_hp ().armour (),
+                        regen.regeneration_mhp ().armour (),
+                        blocks, cur, milli))
+    {
+      res->set_armour (cur);
+      res->mutable_mhp ()->set_armour (milli);
+      changed = true;
+    }
+
+  cur = hp.shield ();
+  milli = hp.mhp ().shield ();
+  if (RegenerateHpType (regen.max_hp ().shield (),
+                        regen.regeneration_mhp ().shield (),
+                        blocks, cur, milli))
+    {
+      res->set_shield (cur);
+      res->mutable_mhp ()->set_shield (milli);
+      changed = true;
+    }
+
+  if (!changed)
+    return nullptr;
+
+  res->set_regen_height (height);
+  return res;
+}
+
 HexCoord::IntT
 CombatEntity::FindAttackRange (const proto::CombatData& cd, const bool friendly)
 {
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -26,6 +26,8 @@
 #include "hexagonal/coord.hpp"
 #include "proto/combat.pb.h"
 
+#include <memory>
+
 namespace pxd
 {
 
@@ -109,6 +111,28 @@ private:
   /** Set to true if non-proto fields have been changed.  */
   bool isDirty;
 
+  /**
+   * The height up to which HP regeneration applies to this entity's
+   * HP if lazy regeneration is active, and NO_LAZY_REGEN otherwise.
+   */
+  unsigned regenHeight;
+
+  /**
+   * The HP with pending lazy regeneration applied, if that has been computed
+   * and there is any.  This is kept separate from the stored HP, so that
+   * just reading the current HP does not trigger a database update.
+   */
+  mutable std::unique_ptr<proto::HP> regeneratedHp;
+
+  /** Whether or not regeneratedHp has been computed already.  */
+  mutable bool regenComputed;
+
+  /**
+   * Set to true once the stored HP have been brought up-to-date with
+   * lazy regeneration and anchored at regenHeight (when they are modified).
+   */
+  bool hpAnchored;
+
   /**
    * Computes (from HP and RegenData protos) whether or not an entity
    * needs to regenerate HP.
@@ -116,6 +140,14 @@ private:
   static bool ComputeCanRegen (const proto::HP& hp,
                                const proto::RegenData& regen);
 
+  /**
+   * Computes the HP after applying lazy regeneration up to the given height
+   * to the HP anchored in the given proto.  Returns null if there is no
+   * change (e.g. because the HP are already full or are not anchored).
+   */
+  static std::unique_ptr<proto::HP> ComputeLazyRegen (
+      const proto::HP& hp, const proto::RegenData& regen, unsigned height);
+
   /**
    * Computes the attack range of a fighter with the given combat data,
    * or the range of the longest friendly attack.
@@ -126,6 +158,7 @@ private:
                                          bool friendly);
 
   friend class ComputeCanRegenTests;
+  friend class ComputeLazyRegenTests;
   friend class FindAttackRangeTests;
 
 protected:
@@ -185,8 +218,8 @@ protected:
   virtual void Validate () const;
 
   /**
-   * Subclasses must implement this to return whether or not the main proto
-   * (with combat data) is dirty.
+   * Subclasses must implement this to return whether or not the combat data
+   * (or the proto it is stored in) may have been modified.
    */
   virtual bool IsDirtyCombatData () const = 0;
 
@@ -201,17 +234,17 @@ public:
    */
   virtual ~CombatEntity () = default;
 
-  const proto::HP&
-  GetHP () const
-  {
-    return hp.Get ();
-  }
+  /**
+   * Returns the entity's current HP.  With lazy regeneration, this includes
+   * all regeneration up to the current height.
+   */
+  const proto::HP& GetHP () const;
 
-  proto::HP&
-  MutableHP ()
-  {
-    return hp.Mutable ();
-  }
+  /**
+   * Returns the HP for modification.  With lazy regeneration, this applies
+   * any pending regeneration and anchors the HP at the current height.
+   */
+  proto::HP& MutableHP ();
 
   const proto::RegenData&
   GetRegenData () const
@@ -219,11 +252,20 @@ public:
     return regenData.Get ();
   }
 
-  proto::RegenData&
-  MutableRegenData ()
-  {
-    return regenData.Mutable ();
-  }
+  /**
+   * Returns the regeneration data for modification.  With lazy regeneration,
+   * pending regeneration is applied to the HP first, so that the modified
+   * data only affects regeneration from now on.
+   */
+  proto::RegenData& MutableRegenData ();
+
+  /**
+   * In lazy-regeneration mode, marks the HP as regenerated explicitly
+   * for the next block.  This is used when a fighter's regeneration
+   * for a block has to be done explicitly (e.g. due to combat effects)
+   * instead of by the closed-form computation.
+   */
+  void AdvanceHpRegenHeight ();
 
   bool
   HasTarget () const
@@ -287,6 +329,11 @@ public:
    */
   virtual const proto::CombatData& GetCombatData () const = 0;
 
+  /**
+   * Returns a mutable reference to the entity's CombatData proto.
+   */
+  virtual proto::CombatData& MutableCombatData () = 0;
+
   /**
    * Returns the combat effects applied to this entity.
    */
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -25,7 +25,9 @@ namespace pxd
 
 template <typename T>
   CombatEntity::CombatEntity (Database& d, const Database::Result<T>& res)
-    : db(d), isNew(false), isDirty(false)
+    : db(d), isNew(false), isDirty(false),
+      regenHeight(db.GetLazyRegenHeight ()),
+      regenComputed(false), hpAnchored(false)
 {
   static_assert (std::is_base_of<ResultWithCombat, T>::value,
                  "CombatEntity needs a ResultWithCombat");
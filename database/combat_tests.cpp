@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -109,6 +109,134 @@ TEST_F (ComputeCanRegenTests, FullHp)
 
 } // anonymous namespace
 
+class ComputeLazyRegenTests : public testing::Test
+{
+
+protected:
+
+  proto::RegenData regen;
+
+  ComputeLazyRegenTests ()
+  {
+    CHECK (TextFormat::ParseFromString (R"(
+      max_hp: { armour: 100 shield: 10 }
+      regeneration_mhp: { armour: 300 shield: 1500 }
+    )", &regen));
+  }
+
+  /**
+   * Calls ComputeLazyRegen for the given HP (as text proto) and height.
+   * Returns the resulting HP, or the input ones if there was no change.
+   */
+  proto::HP
+  Regenerate (const proto::HP& hp, const unsigned height) const
+  {
+    auto res = CombatEntity::ComputeLazyRegen (hp, regen, height);
+    if (res == nullptr)
+      return hp;
+    return *res;
+  }
+
+  /**
+   * Returns true if ComputeLazyRegen reports no change for the given HP.
+   */
+  bool
+  IsUnchanged (const std::string& hpStr, const unsigned height) const
+  {
+    proto::HP hp;
+    CHECK (TextFormat::ParseFromString (hpStr, &hp));
+    return CombatEntity::ComputeLazyRegen (hp, regen, height) == nullptr;
+  }
+
+  proto::HP
+  Regenerate (const std::string& hpStr, const unsigned height) const
+  {
+    proto::HP hp;
+    CHECK (TextFormat::ParseFromString (hpStr, &hp));
+    return Regenerate (hp, height);
+  }
+
+};
+
+namespace
+{
+
+TEST_F (ComputeLazyRegenTests, NotAnchored)
+{
+  const auto hp = Regenerate ("armour: 10 shield: 5", 100);
+  EXPECT_EQ (hp.armour (), 10);
+  EXPECT_EQ (hp.shield (), 5);
+  EXPECT_FALSE (hp.has_regen_height ());
+}
+
+TEST_F (ComputeLazyRegenTests, AlreadyUpToDate)
+{
+  EXPECT_TRUE (IsUnchanged ("armour: 10 shield: 5 regen_height: 100", 100));
+  EXPECT_TRUE (IsUnchanged ("armour: 10 shield: 5 regen_height: 100", 50));
+  EXPECT_FALSE (IsUnchanged ("armour: 10 shield: 5 regen_height: 100", 101));
+}
+
+TEST_F (ComputeLazyRegenTests, FullHp)
+{
+  EXPECT_TRUE (IsUnchanged ("armour: 100 shield: 10 regen_height: 10", 20));
+}
+
+TEST_F (ComputeLazyRegenTests, ClosedForm)
+{
+  const auto hp = Regenerate (R"(
+    armour: 10
+    shield: 5
+    mhp: { armour: 900 shield: 100 }
+    regen_height: 10
+  )", 13);
+
+  EXPECT_EQ (hp.armour (), 10 + 1);
+  EXPECT_EQ (hp.mhp ().armour (), 800);
+  EXPECT_EQ (hp.shield (), 5 + 4);
+  EXPECT_EQ (hp.mhp ().shield (), 600);
+  EXPECT_EQ (hp.regen_height (), 13);
+}
+
+TEST_F (ComputeLazyRegenTests, CappedAtMax)
+{
+  const auto hp = Regenerate (R"(
+    armour: 99
+    shield: 9
+    mhp: { armour: 900 shield: 100 }
+    regen_height: 10
+  )", 1'000'000);
+
+  EXPECT_EQ (hp.armour (), 100);
+  EXPECT_EQ (hp.mhp ().armour (), 0);
+  EXPECT_EQ (hp.shield (), 10);
+  EXPECT_EQ (hp.mhp ().shield (), 0);
+}
+
+TEST_F (ComputeLazyRegenTests, MatchesStepwise)
+{
+  proto::HP start;
+  CHECK (TextFormat::ParseFromString (R"(
+    armour: 0
+    shield: 0
+    mhp: { armour: 123 shield: 456 }
+    regen_height: 100
+  )", &start));
+
+  proto::HP stepwise = start;
+  for (unsigned h = 101; h <= 500; ++h)
+    {
+      stepwise = Regenerate (stepwise, h);
+
+      const auto closed = Regenerate (start, h);
+      ASSERT_EQ (closed.armour (), stepwise.armour ()) << "Height " << h;
+      ASSERT_EQ (closed.mhp ().armour (), stepwise.mhp ().armour ());
+      ASSERT_EQ (closed.shield (), stepwise.shield ());
+      ASSERT_EQ (closed.mhp ().shield (), stepwise.mhp ().shield ());
+    }
+}
+
+} // anonymous namespace
+
 class FindAttackRangeTests : public testing::Test
 {
 
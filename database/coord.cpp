@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -18,6 +18,8 @@
 
 #include "coord.hpp"
 
+#include <sstream>
+
 namespace pxd
 {
 
@@ -30,4 +32,37 @@ BindCoordParameter (Database::Statement& stmt,
   stmt.Bind (indY, coord.GetY ());
 }
 
+std::string
+L1AreaCondition (const unsigned ind)
+{
+  /* The first part is the bounding box in axial coordinates (which is what
+     the index can be used for), and the second part the exact L1 distance
+     as computed by HexCoord::DistanceL1 (but multiplied by two).  */
+  std::ostringstream res;
+  res << "(`x` BETWEEN ?" << ind << " AND ?" << (ind + 1) << ")"
+      << " AND (`y` BETWEEN ?" << (ind + 2) << " AND ?" << (ind + 3) << ")"
+      << " AND (ABS (`x` - ?" << (ind + 4) << ")"
+      << " + ABS (`y` - ?" << (ind + 5) << ")"
+      << " + ABS (`x` + `y` - ?" << (ind + 4) << " - ?" << (ind + 5) << ")"
+      << " <= 2 * ?" << (ind + 6) << ")";
+  return res.str ();
+}
+
+void
+BindL1AreaParameters (Database::Statement& stmt, const unsigned ind,
+                      const HexCoord& centre, const HexCoord::IntT l1range)
+{
+  const int64_t x = centre.GetX ();
+  const int64_t y = centre.GetY ();
+  const int64_t r = l1range;
+
+  stmt.Bind (ind, x - r);
+  stmt.Bind (ind + 1, x + r);
+  stmt.Bind (ind + 2, y - r);
+  stmt.Bind (ind + 3, y + r);
+  stmt.Bind (ind + 4, x);
+  stmt.Bind (ind + 5, y);
+  stmt.Bind (ind + 6, r);
+}
+
 } // namespace pxd
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -24,6 +24,7 @@
 #include "hexagonal/coord.hpp"
 
 #include <cstdint>
+#include <string>
 
 namespace pxd
 {
@@ -53,6 +54,22 @@ void BindCoordParameter (Database::Statement& stmt,
                          unsigned indX, unsigned indY,
                          const HexCoord& coord);
 
+/**
+ * Returns an SQL condition (for use in a WHERE clause) that matches rows
+ * whose `x` and `y` columns are within some L1 range of a centre.  The
+ * condition uses seven statement parameters starting at the given index,
+ * which should be bound with BindL1AreaParameters.  The condition contains
+ * a bounding-box restriction, so that an index on (`x`, `y`) can be used.
+ * Rows with NULL coordinates never match.
+ */
+std::string L1AreaCondition (unsigned ind);
+
+/**
+ * Binds the parameters for a condition returned by L1AreaCondition.
+ */
+void BindL1AreaParameters (Database::Statement& stmt, unsigned ind,
+                           const HexCoord& centre, HexCoord::IntT l1range);
+
 } // namespace pxd
 
 #include "coord.tpp"
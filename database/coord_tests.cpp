@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -22,6 +22,7 @@
 
 #include <gtest/gtest.h>
 
+#include <set>
 #include <vector>
 
 namespace pxd
@@ -46,6 +47,22 @@ protected:
     stmt.Execute ();
   }
 
+  /**
+   * Inserts a row with the given coordinate.
+   */
+  void
+  Insert (const HexCoord& c)
+  {
+    auto stmt = db.Prepare (R"(
+      INSERT INTO `test`
+        (`id`, `x`, `y`)
+        VALUES (?1, ?2, ?3)
+    )");
+    stmt.Bind (1, db.GetNextId ());
+    BindCoordParameter (stmt, 2, 3, c);
+    stmt.Execute ();
+  }
+
 };
 
 TEST_F (CoordDatabaseTests, RoundTrip)
@@ -82,5 +99,37 @@ TEST_F (CoordDatabaseTests, RoundTrip)
     }
 }
 
+TEST_F (CoordDatabaseTests, L1Area)
+{
+  constexpr HexCoord::IntT size = 10;
+  for (HexCoord::IntT x = -size; x <= size; ++x)
+    for (HexCoord::IntT y = -size; y <= size; ++y)
+      Insert (HexCoord (x, y));
+
+  const HexCoord centre(2, -3);
+  for (const HexCoord::IntT range : {0, 1, 5})
+    {
+      std::set<HexCoord> expected;
+      for (HexCoord::IntT x = -size; x <= size; ++x)
+        for (HexCoord::IntT y = -size; y <= size; ++y)
+          {
+            const HexCoord c(x, y);
+            if (HexCoord::DistanceL1 (c, centre) <= range)
+              expected.insert (c);
+          }
+
+      auto stmt = db.Prepare ("SELECT `x`, `y` FROM `test` WHERE "
+                                + L1AreaCondition (3));
+      BindL1AreaParameters (stmt, 3, centre, range);
+      auto res = stmt.Query<ResultWithCoord> ();
+
+      std::set<HexCoord> actual;
+      while (res.Step ())
+        actual.insert (GetCoordFromColumn (res));
+
+      EXPECT_EQ (actual, expected) << "Range: " << range;
+    }
+}
+
 } // anonymous namespace
 } // namespace pxd
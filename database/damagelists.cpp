@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -23,6 +23,18 @@
 namespace pxd
 {
 
+DamageLists::DamageLists (Database& d, const unsigned h, DamageListsCache& c)
+  : db(d), height(h), cache(&c)
+{
+  if (!cache->IsLoaded ())
+    cache->Load (db);
+}
+
+DamageLists::~DamageLists ()
+{
+  Flush ();
+}
+
 void
 DamageLists::RemoveOld (const unsigned n)
 {
@@ -34,6 +46,12 @@ DamageLists::RemoveOld (const unsigned n)
   if (n > height)
     return;
 
+  if (cache != nullptr)
+    {
+      cache->RemoveUpTo (height - n);
+      return;
+    }
+
   auto stmt = db.Prepare (R"(
     DELETE FROM `damage_lists`
       WHERE `height` <= ?1
@@ -52,6 +70,12 @@ DamageLists::AddEntry (const Database::IdT victim, const Database::IdT attacker)
       << "Adding damage-list entry for height " << height << ": "
       << attacker << " damaged " << victim;
 
+  if (cache != nullptr)
+    {
+      cache->AddEntry (victim, attacker, height);
+      return;
+    }
+
   auto stmt = db.Prepare (R"(
     INSERT OR REPLACE INTO `damage_lists`
       (`victim`, `attacker`, `height`)
@@ -69,6 +93,12 @@ DamageLists::RemoveCharacter (const Database::IdT id)
 {
   VLOG (1) << "Removing character " << id << " from damage lists...";
 
+  if (cache != nullptr)
+    {
+      cache->RemoveCharacter (id);
+      return;
+    }
+
   auto stmt = db.Prepare (R"(
     DELETE FROM `damage_lists`
       WHERE `victim` = ?1 OR `attacker` = ?1
@@ -91,6 +121,9 @@ struct AttackerResult : public Database::ResultType
 DamageLists::Attackers
 DamageLists::GetAttackers (const Database::IdT victim) const
 {
+  if (cache != nullptr)
+    return cache->GetAttackers (victim);
+
   auto stmt = db.Prepare (R"(
     SELECT `attacker` FROM `damage_lists`
       WHERE `victim` = ?1
@@ -110,4 +143,222 @@ DamageLists::GetAttackers (const Database::IdT victim) const
   return attackers;
 }
 
+void
+DamageLists::Flush ()
+{
+  if (cache != nullptr)
+    cache->Flush (db);
+}
+
+/* ************************************************************************** */
+
+void
+DamageListsCache::Invalidate ()
+{
+  VLOG (1) << "Invalidating damage-lists cache";
+
+  CHECK (dirty.empty () && !hasExpired)
+      << "Invalidating damage-lists cache with unflushed changes";
+
+  entries.clear ();
+  victimsByAttacker.clear ();
+  buckets.clear ();
+  loaded = false;
+}
+
+void
+DamageListsCache::EraseEntry (const std::map<Key, unsigned>::iterator it)
+{
+  const Key key = it->first;
+
+  auto bucketIt = buckets.find (it->second);
+  CHECK (bucketIt != buckets.end ());
+  CHECK_EQ (bucketIt->second.erase (key), 1);
+  if (bucketIt->second.empty ())
+    buckets.erase (bucketIt);
+
+  auto victimsIt = victimsByAttacker.find (key.second);
+  CHECK (victimsIt != victimsByAttacker.end ());
+  CHECK_EQ (victimsIt->second.erase (key.first), 1);
+  if (victimsIt->second.empty ())
+    victimsByAttacker.erase (victimsIt);
+
+  entries.erase (it);
+}
+
+void
+DamageListsCache::AddEntry (const Database::IdT victim,
+                            const Database::IdT attacker, const unsigned h)
+{
+  CHECK (loaded);
+
+  const Key key(victim, attacker);
+  auto it = entries.find (key);
+  if (it != entries.end ())
+    {
+      if (it->second == h)
+        return;
+      EraseEntry (it);
+    }
+
+  CHECK (entries.emplace (key, h).second);
+  buckets[h].insert (key);
+  victimsByAttacker[attacker].insert (victim);
+  dirty.insert (key);
+}
+
+void
+DamageListsCache::RemoveUpTo (const unsigned h)
+{
+  CHECK (loaded);
+
+  while (!buckets.empty () && buckets.begin ()->first <= h)
+    {
+      /* EraseEntry modifies the bucket itself, so we need to take out
+         the keys before processing them.  */
+      const auto keys = buckets.begin ()->second;
+      for (const auto& k : keys)
+        EraseEntry (entries.find (k));
+    }
+
+  if (!hasExpired || h > expiredUpTo)
+    expiredUpTo = h;
+  hasExpired = true;
+}
+
+void
+DamageListsCache::RemoveCharacter (const Database::IdT id)
+{
+  CHECK (loaded);
+
+  auto it = entries.lower_bound (Key (id, Database::EMPTY_ID));
+  while (it != entries.end () && it->first.first == id)
+    {
+      dirty.insert (it->first);
+      auto toErase = it++;
+      EraseEntry (toErase);
+    }
+
+  const auto victimsIt = victimsByAttacker.find (id);
+  if (victimsIt == victimsByAttacker.end ())
+    return;
+
+  const auto victims = victimsIt->second;
+  for (const auto v : victims)
+    {
+      const Key key(v, id);
+      dirty.insert (key);
+      EraseEntry (entries.find (key));
+    }
+}
+
+DamageLists::Attackers
+DamageListsCache::GetAttackers (const Database::IdT victim) const
+{
+  CHECK (loaded);
+
+  DamageLists::Attackers res;
+  for (auto it = entries.lower_bound (Key (victim, Database::EMPTY_ID));
+       it != entries.end () && it->first.first == victim; ++it)
+    res.insert (it->first.second);
+
+  return res;
+}
+
+namespace
+{
+
+struct EntryResult : public Database::ResultType
+{
+  RESULT_COLUMN (int64_t, victim, 1);
+  RESULT_COLUMN (int64_t, attacker, 2);
+  RESULT_COLUMN (int64_t, height, 3);
+};
+
+} // anonymous namespace
+
+void
+DamageListsCache::Load (Database& db)
+{
+  CHECK (!loaded);
+  CHECK (entries.empty () && dirty.empty () && !hasExpired);
+
+  auto stmt = db.Prepare (R"(
+    SELECT `victim`, `attacker`, `height`
+      FROM `damage_lists`
+      ORDER BY `victim`, `attacker`
+  )");
+  auto res = stmt.Query<EntryResult> ();
+  loaded = true;
+
+  while (res.Step ())
+    {
+      const Database::IdT victim = res.Get<EntryResult::victim> ();
+      const Database::IdT attacker = res.Get<EntryResult::attacker> ();
+      const unsigned h = res.Get<EntryResult::height> ();
+      AddEntry (victim, attacker, h);
+    }
+
+  /* Loading entries is not a change that needs to be written back.  */
+  dirty.clear ();
+
+  VLOG (1) << "Loaded " << entries.size () << " damage-list entries";
+}
+
+void
+DamageListsCache::Flush (Database& db)
+{
+  if (!hasExpired && dirty.empty ())
+    return;
+
+  VLOG (1)
+      << "Flushing " << dirty.size () << " modified damage-list entries"
+      << " to the database";
+
+  /* Expired entries are removed first, so that refreshed entries with
+     a new height (which are marked dirty) are written afterwards.  */
+  if (hasExpired)
+    {
+      auto stmt = db.Prepare (R"(
+        DELETE FROM `damage_lists`
+          WHERE `height` <= ?1
+      )");
+      stmt.Bind (1, expiredUpTo);
+      stmt.Execute ();
+      hasExpired = false;
+    }
+
+  auto upsert = db.Prepare (R"(
+    INSERT OR REPLACE INTO `damage_lists`
+      (`victim`, `attacker`, `height`)
+      VALUES (?1, ?2, ?3)
+  )");
+  auto del = db.Prepare (R"(
+    DELETE FROM `damage_lists`
+      WHERE `victim` = ?1 AND `attacker` = ?2
+  )");
+
+  for (const auto& key : dirty)
+    {
+      const auto it = entries.find (key);
+      if (it == entries.end ())
+        {
+          del.Reset ();
+          del.Bind (1, key.first);
+          del.Bind (2, key.second);
+          del.Execute ();
+        }
+      else
+        {
+          upsert.Reset ();
+          upsert.Bind (1, key.first);
+          upsert.Bind (2, key.second);
+          upsert.Bind (3, it->second);
+          upsert.Execute ();
+        }
+    }
+
+  dirty.clear ();
+}
+
 } // namespace pxd
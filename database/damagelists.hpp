@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -21,13 +21,22 @@
 
 #include "database.hpp"
 
+#include <map>
 #include <set>
+#include <utility>
 
 namespace pxd
 {
 
+class DamageListsCache;
+
 /**
  * Wrapper class for access to the damage lists in the database.
+ *
+ * By default, all operations are done directly on the database table.
+ * If a DamageListsCache is passed in on construction, then updates are
+ * instead done in memory and written back to the database in one batch
+ * when Flush is called (or the instance is destructed).
  */
 class DamageLists
 {
@@ -47,6 +56,9 @@ private:
    */
   const unsigned height;
 
+  /** The in-memory cache to use, if any.  */
+  DamageListsCache* cache = nullptr;
+
 public:
 
   /** Set of attackers.  */
@@ -65,6 +77,18 @@ public:
     : db(d), height(h)
   {}
 
+  /**
+   * Constructs a damage list for the given height, which operates on the
+   * given in-memory cache.  If the cache is not yet loaded, it will be
+   * filled from the database.
+   */
+  explicit DamageLists (Database& d, unsigned h, DamageListsCache& c);
+
+  /**
+   * Writes back all pending changes from the cache (if any).
+   */
+  ~DamageLists ();
+
   DamageLists () = delete;
   DamageLists (const DamageLists&) = delete;
   void operator= (const DamageLists&) = delete;
@@ -92,6 +116,127 @@ public:
    */
   Attackers GetAttackers (Database::IdT victim) const;
 
+  /**
+   * Writes all changes done on the in-memory cache to the database.  This is
+   * a no-op if no cache is used.  It should be called at the end of
+   * processing a block, so that the database is in sync with the cache
+   * (e.g. for RPC methods and undo data).
+   */
+  void Flush ();
+
+};
+
+/**
+ * In-memory copy of the damage_lists table.  It is meant to be kept around
+ * across blocks (e.g. by the game logic) and used through DamageLists.
+ * This turns the many single-row updates done per hit into a single batch
+ * of updates at the end of a block, and allows expiring old entries in
+ * time proportional to the number of expired entries.
+ *
+ * Whenever the database state changes without going through the cache
+ * (e.g. when blocks are detached during a reorg), Invalidate must be called.
+ * The next DamageLists instance will then reload the data from the database.
+ */
+class DamageListsCache
+{
+
+private:
+
+  /** Key of an entry, which is (victim, attacker).  */
+  using Key = std::pair<Database::IdT, Database::IdT>;
+
+  /** Whether or not the data has been loaded from the database.  */
+  bool loaded = false;
+
+  /**
+   * All entries with the height of their last damage.  Since the keys are
+   * sorted by victim first, we can look up all attackers of a given
+   * victim directly from this map.
+   */
+  std::map<Key, unsigned> entries;
+
+  /** Victims damaged by each attacker, to handle RemoveCharacter.  */
+  std::map<Database::IdT, std::set<Database::IdT>> victimsByAttacker;
+
+  /**
+   * All keys sorted into buckets by their height.  This is used to find
+   * the expired entries in RemoveOld without looking at the others.
+   */
+  std::map<unsigned, std::set<Key>> buckets;
+
+  /**
+   * Keys that have been modified (added, refreshed or removed) and need
+   * to be written to the database.
+   */
+  std::set<Key> dirty;
+
+  /**
+   * If set, entries with height up to (including) this value have been
+   * expired, and that needs to be synced to the database.
+   */
+  unsigned expiredUpTo;
+  bool hasExpired = false;
+
+  /**
+   * Removes an entry from all the maps (but does not mark it dirty).
+   * The entry must exist.
+   */
+  void EraseEntry (std::map<Key, unsigned>::iterator it);
+
+  /**
+   * Adds or refreshes an entry with the given height.
+   */
+  void AddEntry (Database::IdT victim, Database::IdT attacker, unsigned h);
+
+  /**
+   * Expires all entries with height less than or equal to the given one.
+   */
+  void RemoveUpTo (unsigned h);
+
+  /**
+   * Removes all entries for the given character.
+   */
+  void RemoveCharacter (Database::IdT id);
+
+  /**
+   * Returns the attackers of a given victim.
+   */
+  DamageLists::Attackers GetAttackers (Database::IdT victim) const;
+
+  /**
+   * Fills the cache from the database table.
+   */
+  void Load (Database& db);
+
+  /**
+   * Writes all pending changes back to the database.
+   */
+  void Flush (Database& db);
+
+  friend class DamageLists;
+
+public:
+
+  DamageListsCache () = default;
+
+  DamageListsCache (const DamageListsCache&) = delete;
+  void operator= (const DamageListsCache&) = delete;
+
+  /**
+   * Returns true if the cache has been loaded from the database.
+   */
+  bool
+  IsLoaded () const
+  {
+    return loaded;
+  }
+
+  /**
+   * Clears all data, so that it will be reloaded from the database on
+   * next use.  There must not be any unflushed changes.
+   */
+  void Invalidate ();
+
 };
 
 } // namespace pxd
@@ -0,0 +1,108 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "damagelists.hpp"
+
+#include "dbtest.hpp"
+#include "schema.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <glog/logging.h>
+
+#include <memory>
+
+namespace pxd
+{
+namespace
+{
+
+/** Number of blocks after which damage-list entries expire.  */
+constexpr unsigned EXPIRY_BLOCKS = 100;
+
+/**
+ * Simulates one block of a big battle between two sides of n fighters
+ * each on the given damage lists.  Each fighter hits the enemies with
+ * the same index and the next (numHits - 1) ones.  Also the attackers
+ * of a few victims are looked up, as would be done for kills.
+ */
+void
+SimulateBattleBlock (DamageLists& dl, const unsigned n, const unsigned numHits)
+{
+  dl.RemoveOld (EXPIRY_BLOCKS);
+
+  for (unsigned i = 0; i < n; ++i)
+    for (unsigned j = 0; j < numHits; ++j)
+      {
+        const Database::IdT red = 1 + i;
+        const Database::IdT green = 1 + n + (i + j) % n;
+        dl.AddEntry (green, red);
+        dl.AddEntry (red, green);
+      }
+
+  for (unsigned i = 0; i < n; i += 100)
+    CHECK (!dl.GetAttackers (1 + i).empty ());
+}
+
+/**
+ * Benchmarks the damage-list updates for blocks of a battle, either
+ * with direct database updates or through the in-memory cache.
+ *
+ * Arguments are:
+ *  - Number of fighters on each side
+ *  - Number of hits done by each fighter per block
+ *  - Whether or not to use the cache
+ */
+void
+DamageListsBattle (benchmark::State& state)
+{
+  TestDatabase db;
+  SetupDatabaseSchema (*db);
+
+  const unsigned n = state.range (0);
+  const unsigned numHits = state.range (1);
+  const bool useCache = state.range (2);
+
+  DamageListsCache cache;
+  unsigned height = 1;
+
+  for (auto _ : state)
+    {
+      std::unique_ptr<DamageLists> dl;
+      if (useCache)
+        dl = std::make_unique<DamageLists> (db, height, cache);
+      else
+        dl = std::make_unique<DamageLists> (db, height);
+
+      SimulateBattleBlock (*dl, n, numHits);
+      dl->Flush ();
+
+      ++height;
+    }
+}
+BENCHMARK (DamageListsBattle)
+  ->Unit (benchmark::kMillisecond)
+  ->Args ({100, 1, false})
+  ->Args ({100, 1, true})
+  ->Args ({1'000, 1, false})
+  ->Args ({1'000, 1, true})
+  ->Args ({1'000, 5, false})
+  ->Args ({1'000, 5, true});
+
+} // anonymous namespace
+} // namespace pxd
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -19,6 +19,7 @@
 #include "damagelists.hpp"
 
 #include "dbtest.hpp"
+#include "schema.hpp"
 
 #include <gtest/gtest.h>
 
@@ -125,5 +126,178 @@ TEST_F (DamageListsTests, WithoutHeight)
   EXPECT_DEATH (dl.AddEntry (1, 2), "height != NO_HEIGHT");
 }
 
+/* ************************************************************************** */
+
+class DamageListsCacheTests : public DamageListsTests
+{
+
+protected:
+
+  DamageListsCache cache;
+
+};
+
+TEST_F (DamageListsCacheTests, LoadsFromDatabase)
+{
+  AddWithHeight (1, 2, 5);
+  AddWithHeight (1, 3, 10);
+  AddWithHeight (2, 1, 10);
+
+  EXPECT_FALSE (cache.IsLoaded ());
+  DamageLists dl(db, 10, cache);
+  EXPECT_TRUE (cache.IsLoaded ());
+
+  EXPECT_EQ (dl.GetAttackers (1), DamageLists::Attackers ({2, 3}));
+  EXPECT_EQ (dl.GetAttackers (2), DamageLists::Attackers ({1}));
+  EXPECT_EQ (dl.GetAttackers (3), DamageLists::Attackers ({}));
+}
+
+TEST_F (DamageListsCacheTests, UpdatesOnlyOnFlush)
+{
+  DamageLists dl(db, 100, cache);
+  dl.AddEntry (1, 2);
+  dl.AddEntry (1, 3);
+  dl.AddEntry (1, 2);
+  dl.AddEntry (2, 1);
+
+  EXPECT_EQ (dl.GetAttackers (1), DamageLists::Attackers ({2, 3}));
+  EXPECT_EQ (dl.GetAttackers (2), DamageLists::Attackers ({1}));
+  ExpectAttackers (1, {});
+  ExpectAttackers (2, {});
+
+  dl.Flush ();
+  ExpectAttackers (1, {2, 3});
+  ExpectAttackers (2, {1});
+  ExpectAttackers (42, {});
+}
+
+TEST_F (DamageListsCacheTests, FlushOnDestruction)
+{
+  DamageLists (db, 100, cache).AddEntry (1, 2);
+  ExpectAttackers (1, {2});
+}
+
+TEST_F (DamageListsCacheTests, RemoveCharacter)
+{
+  AddWithHeight (1, 2, 100);
+  AddWithHeight (2, 3, 100);
+
+  DamageLists dl(db, 100, cache);
+  dl.AddEntry (1, 3);
+  dl.AddEntry (3, 2);
+  dl.RemoveCharacter (2);
+
+  EXPECT_EQ (dl.GetAttackers (1), DamageLists::Attackers ({3}));
+  EXPECT_EQ (dl.GetAttackers (2), DamageLists::Attackers ({}));
+  EXPECT_EQ (dl.GetAttackers (3), DamageLists::Attackers ({}));
+
+  dl.Flush ();
+  ExpectAttackers (1, {3});
+  ExpectAttackers (2, {});
+  ExpectAttackers (3, {});
+}
+
+TEST_F (DamageListsCacheTests, RemoveOld)
+{
+  AddWithHeight (1, 2, 5);
+  AddWithHeight (1, 3, 6);
+  AddWithHeight (1, 4, 10);
+
+  DamageLists dl(db, 10, cache);
+  dl.RemoveOld (5);
+  EXPECT_EQ (dl.GetAttackers (1), DamageLists::Attackers ({3, 4}));
+
+  dl.Flush ();
+  ExpectAttackers (1, {3, 4});
+}
+
+TEST_F (DamageListsCacheTests, RefreshHeight)
+{
+  {
+    DamageLists dl(db, 1, cache);
+    dl.AddEntry (1, 2);
+    dl.AddEntry (1, 3);
+  }
+  {
+    DamageLists dl(db, 2, cache);
+    dl.AddEntry (1, 3);
+  }
+
+  DamageLists dl(db, 2, cache);
+  dl.RemoveOld (1);
+  EXPECT_EQ (dl.GetAttackers (1), DamageLists::Attackers ({3}));
+
+  dl.Flush ();
+  ExpectAttackers (1, {3});
+}
+
+TEST_F (DamageListsCacheTests, ExpiredAndReadded)
+{
+  AddWithHeight (1, 2, 5);
+
+  DamageLists dl(db, 10, cache);
+  dl.RemoveOld (5);
+  dl.AddEntry (1, 2);
+  dl.Flush ();
+
+  ExpectAttackers (1, {2});
+  DamageLists (db, 15, cache).RemoveOld (5);
+  ExpectAttackers (1, {});
+}
+
+TEST_F (DamageListsCacheTests, SameAsDatabase)
+{
+  /* Performs a sequence of operations over multiple "blocks", and checks
+     that the cached version ends up with exactly the same table as the
+     direct one.  */
+
+  TestDatabase otherDb;
+  SetupDatabaseSchema (*otherDb);
+
+  for (unsigned h = 1; h <= 20; ++h)
+    {
+      DamageLists direct(otherDb, h);
+      DamageLists cached(db, h, cache);
+
+      direct.RemoveOld (3);
+      cached.RemoveOld (3);
+
+      for (Database::IdT v = 1; v <= 5; ++v)
+        if ((v + h) % 3 == 0)
+          {
+            direct.AddEntry (v, (v + h) % 5 + 1);
+            cached.AddEntry (v, (v + h) % 5 + 1);
+          }
+
+      if (h % 7 == 0)
+        {
+          direct.RemoveCharacter (h % 5 + 1);
+          cached.RemoveCharacter (h % 5 + 1);
+        }
+
+      for (Database::IdT v = 1; v <= 5; ++v)
+        ASSERT_EQ (cached.GetAttackers (v), direct.GetAttackers (v));
+    }
+
+  for (Database::IdT v = 1; v <= 5; ++v)
+    {
+      DamageLists dl(otherDb);
+      ExpectAttackers (v, dl.GetAttackers (v));
+    }
+}
+
+TEST_F (DamageListsCacheTests, Invalidate)
+{
+  DamageLists (db, 10, cache).AddEntry (1, 2);
+  AddWithHeight (1, 3, 10);
+  EXPECT_EQ (DamageLists (db, 10, cache).GetAttackers (1),
+             DamageLists::Attackers ({2}));
+
+  cache.Invalidate ();
+  EXPECT_FALSE (cache.IsLoaded ());
+  EXPECT_EQ (DamageLists (db, 10, cache).GetAttackers (1),
+             DamageLists::Attackers ({2, 3}));
+}
+
 } // anonymous namespace
 } // namespace pxd
@@ -24,6 +24,7 @@ namespace pxd
 {
 
 constexpr Database::IdT Database::EMPTY_ID;
+constexpr unsigned Database::NO_LAZY_REGEN;
 
 void
 Database::SetDatabase (xaya::SQLiteDatabase& d)
@@ -36,7 +37,89 @@ Database::Statement
 Database::Prepare (const std::string& sql)
 {
   CHECK (db != nullptr) << "Database has not been set";
-  return Statement (*this, db->Prepare (sql));
+  ++PerfCounters::ForThread ().statementsPrepared;
+  return Statement (*this, db->Prepare (sql),
+                    PerfCounters::CachedTableForStatement (sql));
+}
+
+namespace
+{
+
+/**
+ * Result type for reading the lazy-regeneration height.
+ */
+struct LazyRegenResult : public Database::ResultType
+{
+  RESULT_COLUMN (int64_t, height, 1);
+};
+
+} // anonymous namespace
+
+bool
+Database::ResetArena ()
+{
+  const size_t alive = protoBuffers.GetNumTaken ();
+  if (alive > 0)
+    {
+      VLOG (1)
+          << "Not resetting protobuf arena, " << alive
+          << " protos are still alive";
+      return false;
+    }
+
+  const uint64_t freed = arena.Reset ();
+  VLOG (2) << "Reset protobuf arena, freed " << freed << " bytes";
+
+  return true;
+}
+
+unsigned
+Database::GetLazyRegenHeight ()
+{
+  if (!lazyRegenLoaded)
+    {
+      auto stmt = Prepare (R"(
+        SELECT `height`
+          FROM `lazy_regen`
+          WHERE `id` = 1
+      )");
+
+      auto res = stmt.Query<LazyRegenResult> ();
+      if (res.Step ())
+        {
+          lazyRegenHeight = res.Get<LazyRegenResult::height> ();
+          CHECK (!res.Step ());
+        }
+      else
+        lazyRegenHeight = NO_LAZY_REGEN;
+
+      lazyRegenLoaded = true;
+    }
+
+  return lazyRegenHeight;
+}
+
+void
+Database::SetLazyRegenHeight (const unsigned h)
+{
+  CHECK_NE (h, NO_LAZY_REGEN);
+
+  auto stmt = Prepare (R"(
+    INSERT OR REPLACE INTO `lazy_regen`
+      (`id`, `height`)
+      VALUES (1, ?1)
+  )");
+  stmt.Bind (1, h);
+  stmt.Execute ();
+
+  lazyRegenHeight = h;
+  lazyRegenLoaded = true;
+}
+
+void
+Database::ClearCachedState ()
+{
+  lazyRegenLoaded = false;
 }
 
 void
@@ -54,6 +137,11 @@ Database::Statement::Execute ()
   CHECK (!executed && !queried) << "Database statement has already been run";
   executed = true;
   stmt.Execute ();
+
+  auto& counters = PerfCounters::ForThread ();
+  ++counters.statementsStepped;
+  if (!table.empty () && !sqlite3_stmt_readonly (*stmt))
+    counters.rowsWritten[table] += sqlite3_changes (sqlite3_db_handle (*stmt));
 }
 
 template <>
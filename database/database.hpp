@@ -20,6 +20,7 @@
 #define DATABASE_DATABASE_HPP
 
 #include "lazyproto.hpp"
+#include "perfcounters.hpp"
 #include "uniquehandles.hpp"
 
 #include <xayagame/sqlitegame.hpp>
@@ -38,6 +39,9 @@
 namespace pxd
 {
 
+class DirtyIds;
+class OngoingsSchedule;
+
 /**
  * Basic class that is used to provide connectivity to the database
  * and related services provided by SQLiteGame (e.g. AutoId's and prepared
@@ -58,9 +62,38 @@ private:
   /** Protocol buffer arena used for protos extracted from the database.  */
   google::protobuf::Arena arena;
 
+  /**
+   * Pool of string buffers for the raw data of protos extracted from the
+   * database.  This also tracks how many of them are alive, so that we know
+   * when it is safe to reset the arena.
+   */
+  LazyProtoBufferPool protoBuffers;
+
   /** Tracker for active handles in this database.  */
   UniqueHandles handleTracker;
 
+  /**
+   * If set, an in-memory schedule of ongoing operations that corresponds
+   * to the current state of the database and is kept in sync with it
+   * by OngoingsTable and OngoingOperation.
+   */
+  OngoingsSchedule* ongoingsSchedule = nullptr;
+
+  /**
+   * If set, the handles record all entities they write back or delete
+   * in this instance.
+   */
+  DirtyIds* dirtyIds = nullptr;
+
+  /**
+   * The cached value of the lazy-regeneration height, if it has been
+   * read from the database already.
+   */
+  unsigned lazyRegenHeight;
+
+  /** Whether or not lazyRegenHeight has been loaded.  */
+  bool lazyRegenLoaded = false;
+
 protected:
 
   Database () = default;
@@ -78,6 +111,9 @@ public:
   using IdT = xaya::SQLiteGame::IdT;
   static constexpr IdT EMPTY_ID = xaya::SQLiteGame::EMPTY_ID;
 
+  /** Lazy-regeneration height if lazy regeneration is not (yet) active.  */
+  static constexpr unsigned NO_LAZY_REGEN = static_cast<unsigned> (-1);
+
   /** A UniqueHandles tracker for this database.  */
   using HandleTracker = std::unique_ptr<UniqueHandles::Tracker>;
 
@@ -127,6 +163,84 @@ public:
   template <typename T>
     HandleTracker TrackHandle (const std::string& type, const T& id);
 
+  /**
+   * Frees all memory in the protocol buffer arena, if no protos allocated
+   * on it are alive anymore.  This should be called at points where all
+   * database handles are known to be destroyed (e.g. between processing
+   * phases of a block), to keep memory usage flat.  Returns true if the
+   * arena has been reset.
+   */
+  bool ResetArena ();
+
+  /**
+   * Returns the number of bytes currently used in the protocol buffer arena.
+   */
+  uint64_t
+  GetArenaSpaceUsed () const
+  {
+    return arena.SpaceUsed ();
+  }
+
+  /**
+   * Returns the block height up to which HP regeneration has been applied
+   * in lazy mode, or NO_LAZY_REGEN if HP are not regenerated lazily.
+   * The value is read from the database once and cached afterwards.
+   */
+  unsigned GetLazyRegenHeight ();
+
+  /**
+   * Updates the lazy-regeneration height in the database.
+   */
+  void SetLazyRegenHeight (unsigned h);
+
+  /**
+   * Discards all values cached from the database (like the lazy-regeneration
+   * height), so that they are read again when needed.  This must be called
+   * when the underlying data may have been changed through some other
+   * connection, e.g. before a new read transaction on a pooled connection.
+   */
+  void ClearCachedState ();
+
+  /**
+   * Attaches an in-memory schedule of ongoing operations to this database.
+   * The schedule must be loaded and match the current database state.
+   * Passing null detaches it again.
+   */
+  void
+  SetOngoingsSchedule (OngoingsSchedule* s)
+  {
+    ongoingsSchedule = s;
+  }
+
+  /**
+   * Returns the attached schedule of ongoing operations, or null if there
+   * is none.
+   */
+  OngoingsSchedule*
+  GetOngoingsSchedule () const
+  {
+    return ongoingsSchedule;
+  }
+
+  /**
+   * Attaches a DirtyIds instance, in which all entities written to or
+   * deleted from the database will be recorded.  Passing null detaches it.
+   */
+  void
+  SetDirtyIds (DirtyIds* d)
+  {
+    dirtyIds = d;
+  }
+
+  /**
+   * Returns the attached DirtyIds instance, or null if there is none.
+   */
+  DirtyIds*
+  GetDirtyIds () const
+  {
+    return dirtyIds;
+  }
+
 };
 
 /**
@@ -144,6 +258,9 @@ private:
   /** The underlying SQLite prepared statement.  */
   xaya::SQLiteDatabase::Statement stmt;
 
+  /** The table this statement works on, for the PerfCounters.  */
+  std::string table;
+
   /** Set to true when Execute has been called.  */
   bool executed = false;
   /** Set to true when Query has been called.  */
@@ -153,8 +270,9 @@ private:
    * Constructs an instance based on the given libxayagame statement.
    * This is called by Database::Prepare and not used directly.
    */
-  explicit Statement (Database& d, xaya::SQLiteDatabase::Statement&& s)
-    : db(&d), stmt(std::move (s))
+  explicit Statement (Database& d, xaya::SQLiteDatabase::Statement&& s,
+                      const std::string& t)
+    : db(&d), stmt(std::move (s)), table(t)
   {}
 
   friend class Database;
@@ -290,11 +408,15 @@ private:
   /** Map of ColumnId values to the indices in the SQLite statement.  */
   mutable std::array<int, ResultType::MAX_ID> columnInd;
 
+  /** The PerfCounters entry for rows read from our table.  */
+  uint64_t* rowsRead;
+
   /**
    * Constructs an instance based on the given statement handle.  This is called
    * by Statement::Query and not used directly.
    */
-  explicit Result (Database& d, xaya::SQLiteDatabase::Statement&& s);
+  explicit Result (Database& d, xaya::SQLiteDatabase::Statement&& s,
+                   const std::string& table);
 
   /**
    * Returns the index for a column defined in the result type.  Fills it in
@@ -326,7 +448,12 @@ public:
   inline bool
   Step ()
   {
-    return stmt.Step ();
+    ++PerfCounters::ForThread ().statementsStepped;
+    if (!stmt.Step ())
+      return false;
+
+    ++*rowsRead;
+    return true;
   }
 
   /**
@@ -38,7 +38,7 @@ template <typename T>
 {
   CHECK (!executed && !queried) << "Database statement has already been run";
   queried = true;
-  return Result<T> (*db, std::move (stmt));
+  return Result<T> (*db, std::move (stmt), table);
 }
 
 template <typename T>
@@ -67,8 +67,10 @@ template <typename Proto>
 }
 
 template <typename T>
-  Database::Result<T>::Result (Database& d, xaya::SQLiteDatabase::Statement&& s)
-    : db(&d), stmt(std::move (s))
+  Database::Result<T>::Result (Database& d, xaya::SQLiteDatabase::Statement&& s,
+                               const std::string& table)
+    : db(&d), stmt(std::move (s)),
+      rowsRead(&PerfCounters::ForThread ().rowsRead[table])
 {
   columnInd.fill (MISSING_COLUMN);
 }
@@ -119,8 +121,17 @@ template <typename Col>
 {
   const int ind = ColumnIndex<Col> ();
 
-  LazyProto<typename Col::Type> res(stmt.GetBlob (ind));
+  /* We read the blob data into a buffer from the pool, so that its
+     capacity can be reused rather than allocating a fresh string.  */
+  std::string data = db->protoBuffers.Take ();
+  const auto* blob
+      = static_cast<const char*> (sqlite3_column_blob (stmt.ro (), ind));
+  if (blob != nullptr)
+    data.assign (blob, sqlite3_column_bytes (stmt.ro (), ind));
+
+  LazyProto<typename Col::Type> res(std::move (data));
   res.SetArena (db->arena);
+  res.SetBufferPool (db->protoBuffers);
 
   return res;
 }
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -200,6 +200,53 @@ TEST_F (DatabaseTests, ProtoIsOverwritten)
   ASSERT_FALSE (res.Step ());
 }
 
+TEST_F (DatabaseTests, ArenaReset)
+{
+  LazyProto<proto::HexCoord> coord;
+  coord.SetToDefault ();
+  coord.Mutable ().set_x (5);
+
+  auto stmt = db.Prepare (R"(
+    INSERT INTO `test` (`proto`) VALUES (?1);
+  )");
+  stmt.BindProto (1, coord);
+  stmt.Execute ();
+
+  {
+    stmt = db.Prepare ("SELECT `proto` FROM `test`");
+    auto res = stmt.Query<TestResult> ();
+    ASSERT_TRUE (res.Step ());
+
+    auto pb = res.GetProto<TestResult::proto> ();
+    EXPECT_EQ (pb.Get ().x (), 5);
+    EXPECT_GT (db.GetArenaSpaceUsed (), 0);
+    EXPECT_FALSE (db.ResetArena ());
+  }
+
+  EXPECT_TRUE (db.ResetArena ());
+  EXPECT_EQ (db.GetArenaSpaceUsed (), 0);
+
+  stmt = db.Prepare ("SELECT `proto` FROM `test`");
+  auto res = stmt.Query<TestResult> ();
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (res.GetProto<TestResult::proto> ().Get ().x (), 5);
+}
+
+TEST_F (DatabaseTests, NullProto)
+{
+  auto stmt = db.Prepare (R"(
+    INSERT INTO `test` (`id`) VALUES (1);
+  )");
+  stmt.Execute ();
+
+  stmt = db.Prepare ("SELECT `proto` FROM `test`");
+  auto res = stmt.Query<TestResult> ();
+  ASSERT_TRUE (res.Step ());
+  const auto pb = res.GetProto<TestResult::proto> ();
+  EXPECT_EQ (pb.GetSerialised (), "");
+  EXPECT_FALSE (pb.Get ().has_x ());
+}
+
 TEST_F (DatabaseTests, ResultProperties)
 {
   auto stmt = db.Prepare ("SELECT * FROM `test`");
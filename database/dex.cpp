@@ -18,6 +18,8 @@
 
 #include "dex.hpp"
 
+#include "dirtyids.hpp"
+
 #include <glog/logging.h>
 
 namespace pxd
@@ -96,6 +98,11 @@ DexOrder::~DexOrder ()
       stmt.Bind (7, price);
 
       stmt.Execute ();
+
+      auto* dirty = db.GetDirtyIds ();
+      if (dirty != nullptr)
+        dirty->MarkOrder (id, buildingId, account);
+
       return;
     }
 
@@ -105,6 +112,10 @@ DexOrder::~DexOrder ()
       return;
     }
 
+  auto* dirtyIds = db.GetDirtyIds ();
+  if (dirtyIds != nullptr)
+    dirtyIds->MarkOrder (id, buildingId, account);
+
   if (quantity == 0)
     {
       VLOG (1) << "Deleting used up order " << id;
@@ -352,6 +363,10 @@ DexOrderTable::DeleteForBuilding (const Database::IdT building)
   )");
   stmt.Bind (1, building);
   stmt.Execute ();
+
+  auto* dirty = db.GetDirtyIds ();
+  if (dirty != nullptr)
+    dirty->MarkBuilding (building);
 }
 
 /* ************************************************************************** */
@@ -0,0 +1,51 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "dirtyids.hpp"
+
+namespace pxd
+{
+
+bool
+DirtyIds::IsEmpty () const
+{
+  return Size () == 0;
+}
+
+size_t
+DirtyIds::Size () const
+{
+  return accounts.size () + buildings.size () + buildingInventories.size ()
+          + characters.size () + groundLoot.size () + ongoings.size ()
+          + orders.size ();
+}
+
+void
+DirtyIds::Clear ()
+{
+  accounts.clear ();
+  buildings.clear ();
+  buildingInventories.clear ();
+  characters.clear ();
+  groundLoot.clear ();
+  ongoings.clear ();
+  orders.clear ();
+  orderKeys.clear ();
+}
+
+} // namespace pxd
@@ -0,0 +1,192 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATABASE_DIRTYIDS_HPP
+#define DATABASE_DIRTYIDS_HPP
+
+#include "database.hpp"
+
+#include "hexagonal/coord.hpp"
+
+#include <set>
+#include <string>
+#include <utility>
+
+namespace pxd
+{
+
+/**
+ * Set of entities (by their IDs or keys) that have been written to or
+ * deleted from the database.  If an instance is attached to a Database,
+ * the handles of the various tables record their write-backs in it.
+ * This is used to validate only the parts of the state that have been
+ * touched in a block.
+ *
+ * Bulk deletions by some other criterion (e.g. all ongoing operations
+ * of a building) record the entity that the criterion refers to.
+ *
+ * The same data is also used to record which entities have changed in
+ * a block for clients syncing the state incrementally.
+ */
+class DirtyIds
+{
+
+public:
+
+  /** Key of a building inventory:  building ID and account name.  */
+  using InventoryKey = std::pair<Database::IdT, std::string>;
+
+private:
+
+  std::set<std::string> accounts;
+  std::set<Database::IdT> buildings;
+  std::set<InventoryKey> buildingInventories;
+  std::set<Database::IdT> characters;
+  std::set<HexCoord> groundLoot;
+  std::set<Database::IdT> ongoings;
+  std::set<Database::IdT> orders;
+
+  /**
+   * Building and account of all marked orders.  The order book of the
+   * building and the reserved balance of the account are affected by
+   * changes to the order, even if those are not written themselves.
+   */
+  std::set<InventoryKey> orderKeys;
+
+public:
+
+  DirtyIds () = default;
+
+  DirtyIds (const DirtyIds&) = default;
+  DirtyIds (DirtyIds&&) = default;
+  DirtyIds& operator= (const DirtyIds&) = default;
+  DirtyIds& operator= (DirtyIds&&) = default;
+
+  void
+  MarkAccount (const std::string& name)
+  {
+    accounts.insert (name);
+  }
+
+  void
+  MarkBuilding (const Database::IdT id)
+  {
+    buildings.insert (id);
+  }
+
+  void
+  MarkBuildingInventory (const Database::IdT building,
+                         const std::string& account)
+  {
+    buildingInventories.emplace (building, account);
+  }
+
+  void
+  MarkCharacter (const Database::IdT id)
+  {
+    characters.insert (id);
+  }
+
+  void
+  MarkGroundLoot (const HexCoord& pos)
+  {
+    groundLoot.insert (pos);
+  }
+
+  void
+  MarkOngoing (const Database::IdT id)
+  {
+    ongoings.insert (id);
+  }
+
+  void
+  MarkOrder (const Database::IdT id, const Database::IdT building,
+             const std::string& account)
+  {
+    orders.insert (id);
+    orderKeys.emplace (building, account);
+  }
+
+  const std::set<std::string>&
+  GetAccounts () const
+  {
+    return accounts;
+  }
+
+  const std::set<Database::IdT>&
+  GetBuildings () const
+  {
+    return buildings;
+  }
+
+  const std::set<InventoryKey>&
+  GetBuildingInventories () const
+  {
+    return buildingInventories;
+  }
+
+  const std::set<Database::IdT>&
+  GetCharacters () const
+  {
+    return characters;
+  }
+
+  const std::set<HexCoord>&
+  GetGroundLoot () const
+  {
+    return groundLoot;
+  }
+
+  const std::set<Database::IdT>&
+  GetOngoings () const
+  {
+    return ongoings;
+  }
+
+  const std::set<Database::IdT>&
+  GetOrders () const
+  {
+    return orders;
+  }
+
+  const std::set<InventoryKey>&
+  GetOrderKeys () const
+  {
+    return orderKeys;
+  }
+
+  /**
+   * Returns true if nothing has been marked.
+   */
+  bool IsEmpty () const;
+
+  /**
+   * Returns the total number of marked entities.
+   */
+  size_t Size () const;
+
+  /**
+   * Removes all marks.
+   */
+  void Clear ();
+
+};
+
+} // namespace pxd
+
+#endif // DATABASE_DIRTYIDS_HPP
@@ -0,0 +1,187 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "dirtyids.hpp"
+
+#include "account.hpp"
+#include "building.hpp"
+#include "character.hpp"
+#include "dbtest.hpp"
+#include "dex.hpp"
+#include "inventory.hpp"
+#include "ongoing.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace pxd
+{
+namespace
+{
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+class DirtyIdsTests : public DBTestWithSchema
+{
+
+protected:
+
+  DirtyIds dirty;
+
+  AccountsTable accounts;
+  BuildingsTable buildings;
+  BuildingInventoriesTable inventories;
+  CharacterTable characters;
+  DexOrderTable orders;
+  OngoingsTable ongoings;
+
+  DirtyIdsTests ()
+    : accounts(db), buildings(db), inventories(db), characters(db),
+      orders(db), ongoings(db)
+  {
+    db.SetNextId (101);
+  }
+
+  /**
+   * Attaches our DirtyIds instance to the database.
+   */
+  void
+  Attach ()
+  {
+    db.SetDirtyIds (&dirty);
+  }
+
+};
+
+TEST_F (DirtyIdsTests, NotAttached)
+{
+  accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+  characters.CreateNew ("domob", Faction::RED);
+  EXPECT_TRUE (dirty.IsEmpty ());
+}
+
+TEST_F (DirtyIdsTests, Writes)
+{
+  Attach ();
+
+  accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+  characters.CreateNew ("domob", Faction::RED);
+  buildings.CreateNew ("checkmark", "domob", Faction::RED);
+  inventories.Get (102, "domob")->GetInventory ().AddFungibleCount ("foo", 1);
+  orders.CreateNew (102, "domob", DexOrder::Type::BID, "foo", 1, 2);
+  ongoings.CreateNew (1)->SetHeight (5);
+
+  EXPECT_THAT (dirty.GetAccounts (), ElementsAre ("domob"));
+  EXPECT_THAT (dirty.GetCharacters (), ElementsAre (101));
+  EXPECT_THAT (dirty.GetBuildings (), ElementsAre (102));
+  EXPECT_THAT (dirty.GetBuildingInventories (),
+               ElementsAre (DirtyIds::InventoryKey (102, "domob")));
+  EXPECT_THAT (dirty.GetOrders (), ElementsAre (103));
+  EXPECT_THAT (dirty.GetOngoings (), ElementsAre (104));
+  EXPECT_EQ (dirty.Size (), 6);
+
+  dirty.Clear ();
+  EXPECT_TRUE (dirty.IsEmpty ());
+}
+
+TEST_F (DirtyIdsTests, UnmodifiedHandles)
+{
+  accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+  characters.CreateNew ("domob", Faction::RED);
+
+  Attach ();
+  accounts.GetByName ("domob");
+  characters.GetById (101);
+  inventories.Get (1, "domob");
+
+  EXPECT_TRUE (dirty.IsEmpty ());
+}
+
+TEST_F (DirtyIdsTests, Deletions)
+{
+  accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+  characters.CreateNew ("domob", Faction::RED);
+  buildings.CreateNew ("checkmark", "domob", Faction::RED);
+  orders.CreateNew (102, "domob", DexOrder::Type::BID, "foo", 1, 2);
+
+  Attach ();
+  characters.DeleteById (101);
+  orders.GetById (103)->Delete ();
+  EXPECT_THAT (dirty.GetCharacters (), ElementsAre (101));
+  EXPECT_THAT (dirty.GetOrders (), ElementsAre (103));
+  EXPECT_THAT (dirty.GetBuildings (), IsEmpty ());
+
+  /* Bulk deletions for a building mark the building itself.  */
+  ongoings.DeleteForBuilding (102);
+  orders.DeleteForBuilding (102);
+  buildings.DeleteById (102);
+  EXPECT_THAT (dirty.GetBuildings (), ElementsAre (102));
+}
+
+TEST_F (DirtyIdsTests, GroundLoot)
+{
+  GroundLootTable loot(db);
+
+  Attach ();
+  loot.GetByCoord (HexCoord (1, 2))->GetInventory ()
+      .AddFungibleCount ("foo", 1);
+  loot.GetByCoord (HexCoord (3, 4));
+  EXPECT_THAT (dirty.GetGroundLoot (), ElementsAre (HexCoord (1, 2)));
+
+  dirty.Clear ();
+  loot.GetByCoord (HexCoord (1, 2))->GetInventory ()
+      .SetFungibleCount ("foo", 0);
+  EXPECT_THAT (dirty.GetGroundLoot (), ElementsAre (HexCoord (1, 2)));
+}
+
+TEST_F (DirtyIdsTests, OrderKeys)
+{
+  Attach ();
+  orders.CreateNew (10, "domob", DexOrder::Type::BID, "foo", 1, 2);
+  orders.CreateNew (10, "andy", DexOrder::Type::ASK, "foo", 1, 2);
+
+  EXPECT_THAT (dirty.GetOrders (), ElementsAre (101, 102));
+  EXPECT_THAT (dirty.GetOrderKeys (),
+               ElementsAre (DirtyIds::InventoryKey (10, "andy"),
+                            DirtyIds::InventoryKey (10, "domob")));
+  EXPECT_THAT (dirty.GetBuildings (), IsEmpty ());
+}
+
+TEST_F (DirtyIdsTests, BulkOngoingDeletions)
+{
+  ongoings.CreateNew (1)->SetHeight (5);
+  auto op = ongoings.CreateNew (1);
+  op->SetHeight (10);
+  op->SetBuildingId (50);
+  op = ongoings.CreateNew (1);
+  op->SetHeight (10);
+  op->SetCharacterId (60);
+  op.reset ();
+
+  Attach ();
+  ongoings.DeleteForHeight (5);
+  EXPECT_THAT (dirty.GetOngoings (), ElementsAre (101));
+  ongoings.DeleteForBuilding (50);
+  EXPECT_THAT (dirty.GetOngoings (), ElementsAre (101, 102));
+  ongoings.DeleteForCharacter (60);
+  EXPECT_THAT (dirty.GetOngoings (), ElementsAre (101, 102, 103));
+}
+
+} // anonymous namespace
+} // namespace pxd
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -71,6 +71,22 @@ FighterTable::ProcessForRegen (const Callback& cb)
   }
 }
 
+void
+FighterTable::ProcessForRegenWithEffects (const Callback& cb)
+{
+  {
+    auto res = buildings.QueryForRegenWithEffects ();
+    while (res.Step ())
+      cb (buildings.GetFromResult (res));
+  }
+
+  {
+    auto res = characters.QueryForRegenWithEffects ();
+    while (res.Step ())
+      cb (characters.GetFromResult (res));
+  }
+}
+
 void
 FighterTable::ProcessWithTarget (const Callback& cb)
 {
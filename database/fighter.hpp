@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -85,6 +85,13 @@ public:
    */
   void ProcessForRegen (const Callback& cb);
 
+  /**
+   * Retrieves and processes all fighters that may need HP regeneration
+   * and have combat effects applied.  With lazy regeneration, these are
+   * the ones that need explicit processing.
+   */
+  void ProcessForRegenWithEffects (const Callback& cb);
+
   /**
    * Retrieves and processes all fighers that have a target, i.e. for whom
    * we need to deal damage.  This includes fighters that have only
@@ -88,17 +88,17 @@ TEST_F (FighterTableTests, ProcessWithAttacks)
 
   auto c = characters.CreateNew ("domob", Faction::RED);
   const auto idChar = c->GetId ();
-  c->MutableProto ().mutable_combat_data ()->add_attacks ()->set_range (5);
+  c->MutableCombatData ().add_attacks ()->set_range (5);
   c.reset ();
 
   auto b = buildings.CreateNew ("checkmark", "domob", Faction::RED);
   const auto idBuilding = b->GetId ();
-  b->MutableProto ().mutable_combat_data ()->add_attacks ()->set_range (5);
+  b->MutableCombatData ().add_attacks ()->set_range (5);
   b.reset ();
 
   c = characters.CreateNew ("daniel", Faction::RED);
   const auto idFriendly = c->GetId ();
-  auto* att = c->MutableProto ().mutable_combat_data ()->add_attacks ();
+  auto* att = c->MutableCombatData ().add_attacks ();
   att->set_area (1);
   att->set_friendlies (true);
   c.reset ();
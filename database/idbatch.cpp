@@ -0,0 +1,68 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "idbatch.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <sstream>
+
+namespace pxd
+{
+
+std::string
+IdBatchCondition (const std::string& column, const unsigned ind)
+{
+  std::ostringstream res;
+  res << "(" << column << " IN (";
+  for (unsigned i = 0; i < ID_BATCH_SIZE; ++i)
+    {
+      if (i > 0)
+        res << ", ";
+      res << "?" << (ind + i);
+    }
+  res << "))";
+  return res.str ();
+}
+
+void
+BindIdBatch (Database::Statement& stmt, const unsigned ind,
+             const std::vector<Database::IdT>& ids)
+{
+  CHECK_LE (ids.size (), ID_BATCH_SIZE);
+
+  /* Unused parameters are bound to the empty ID, which never matches
+     any actual entity.  */
+  for (unsigned i = 0; i < ID_BATCH_SIZE; ++i)
+    stmt.Bind (ind + i, i < ids.size () ? ids[i] : Database::EMPTY_ID);
+}
+
+std::vector<std::vector<Database::IdT>>
+SplitIdBatches (const std::vector<Database::IdT>& ids)
+{
+  std::vector<std::vector<Database::IdT>> res;
+  for (size_t start = 0; start < ids.size (); start += ID_BATCH_SIZE)
+    {
+      const size_t end = std::min<size_t> (start + ID_BATCH_SIZE, ids.size ());
+      res.emplace_back (ids.begin () + start, ids.begin () + end);
+    }
+  return res;
+}
+
+} // namespace pxd
@@ -0,0 +1,61 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATABASE_IDBATCH_HPP
+#define DATABASE_IDBATCH_HPP
+
+#include "database.hpp"
+
+#include <string>
+#include <vector>
+
+namespace pxd
+{
+
+/**
+ * Number of IDs that can be matched by a single IdBatchCondition.  This is
+ * fixed (with unused parameters padded) so that the same prepared statement
+ * can be reused for all batches, no matter how many IDs they contain.
+ */
+constexpr unsigned ID_BATCH_SIZE = 32;
+
+/**
+ * Returns an SQL condition (for use in a WHERE clause) that matches rows
+ * whose given column is one of up to ID_BATCH_SIZE IDs.  The condition uses
+ * ID_BATCH_SIZE statement parameters starting at the given index, which
+ * should be bound with BindIdBatch.
+ */
+std::string IdBatchCondition (const std::string& column, unsigned ind);
+
+/**
+ * Binds the parameters for a condition returned by IdBatchCondition.
+ * The list of IDs must not be longer than ID_BATCH_SIZE.
+ */
+void BindIdBatch (Database::Statement& stmt, unsigned ind,
+                  const std::vector<Database::IdT>& ids);
+
+/**
+ * Splits a list of IDs into consecutive batches of at most ID_BATCH_SIZE
+ * elements each, which can be used with IdBatchCondition.
+ */
+std::vector<std::vector<Database::IdT>> SplitIdBatches (
+    const std::vector<Database::IdT>& ids);
+
+} // namespace pxd
+
+#endif // DATABASE_IDBATCH_HPP
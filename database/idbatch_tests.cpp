@@ -0,0 +1,117 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "idbatch.hpp"
+
+#include "dbtest.hpp"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace pxd
+{
+namespace
+{
+
+struct IdResult : public Database::ResultType
+{
+  RESULT_COLUMN (int64_t, id, 1);
+};
+
+class IdBatchTests : public DBTestFixture
+{
+
+protected:
+
+  IdBatchTests ()
+  {
+    auto stmt = db.Prepare (R"(
+      CREATE TABLE `test` (
+        `id` INTEGER PRIMARY KEY
+      )
+    )");
+    stmt.Execute ();
+
+    for (unsigned i = 0; i < 100; ++i)
+      {
+        stmt = db.Prepare ("INSERT INTO `test` (`id`) VALUES (?1)");
+        stmt.Bind (1, db.GetNextId ());
+        stmt.Execute ();
+      }
+  }
+
+  /**
+   * Queries for the given batch of IDs and returns the matched ones
+   * in ascending order.
+   */
+  std::vector<Database::IdT>
+  Query (const std::vector<Database::IdT>& ids)
+  {
+    auto stmt = db.Prepare (R"(
+      SELECT `id`
+        FROM `test`
+        WHERE )" + IdBatchCondition ("`id`", 2) + R"(
+        ORDER BY `id`
+    )");
+    BindIdBatch (stmt, 2, ids);
+    auto res = stmt.Query<IdResult> ();
+
+    std::vector<Database::IdT> actual;
+    while (res.Step ())
+      actual.push_back (res.Get<IdResult::id> ());
+
+    return actual;
+  }
+
+};
+
+TEST_F (IdBatchTests, Query)
+{
+  EXPECT_EQ (Query ({}), std::vector<Database::IdT> ({}));
+  EXPECT_EQ (Query ({5, 3, 1000, 3}), std::vector<Database::IdT> ({3, 5}));
+
+  std::vector<Database::IdT> full;
+  for (unsigned i = 0; i < ID_BATCH_SIZE; ++i)
+    full.push_back (ID_BATCH_SIZE - i);
+  std::vector<Database::IdT> expected(full.rbegin (), full.rend ());
+  EXPECT_EQ (Query (full), expected);
+
+  full.push_back (50);
+  EXPECT_DEATH (Query (full), "Check failed");
+}
+
+TEST_F (IdBatchTests, SplitIdBatches)
+{
+  EXPECT_TRUE (SplitIdBatches ({}).empty ());
+
+  std::vector<Database::IdT> ids;
+  for (Database::IdT id = 1; id <= 2 * ID_BATCH_SIZE + 3; ++id)
+    ids.push_back (id);
+
+  const auto batches = SplitIdBatches (ids);
+  ASSERT_EQ (batches.size (), 3);
+  EXPECT_EQ (batches[0].size (), ID_BATCH_SIZE);
+  EXPECT_EQ (batches[1].size (), ID_BATCH_SIZE);
+  EXPECT_EQ (batches[2].size (), 3);
+  EXPECT_EQ (batches[1].front (), ID_BATCH_SIZE + 1);
+  EXPECT_EQ (batches[2].back (), 2 * ID_BATCH_SIZE + 3);
+}
+
+} // anonymous namespace
+} // namespace pxd
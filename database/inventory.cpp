@@ -18,6 +18,8 @@
 
 #include "inventory.hpp"
 
+#include "dirtyids.hpp"
+
 #include <glog/logging.h>
 #include <google/protobuf/util/message_differencer.h>
 
@@ -285,6 +287,11 @@ GroundLoot::~GroundLoot ()
 
       BindCoordParameter (stmt, 1, 2, coord);
       stmt.Execute ();
+
+      auto* dirty = db.GetDirtyIds ();
+      if (dirty != nullptr)
+        dirty->MarkGroundLoot (coord);
+
       return;
     }
 
@@ -299,6 +306,10 @@ GroundLoot::~GroundLoot ()
   BindCoordParameter (stmt, 1, 2, coord);
   stmt.BindProto (3, inventory.GetProtoForBinding ());
   stmt.Execute ();
+
+  auto* dirty = db.GetDirtyIds ();
+  if (dirty != nullptr)
+    dirty->MarkGroundLoot (coord);
 }
 
 GroundLootTable::Handle
@@ -333,6 +344,22 @@ GroundLootTable::QueryNonEmpty ()
   return stmt.Query<GroundLootResult> ();
 }
 
+Database::Result<GroundLootResult>
+GroundLootTable::QueryModifiedSince (const unsigned h)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT `ground_loot`.*
+      FROM `ground_loot` INNER JOIN `changes_ground_loot`
+        ON `changes_ground_loot`.`x` = `ground_loot`.`x`
+          AND `changes_ground_loot`.`y` = `ground_loot`.`y`
+      WHERE `changes_ground_loot`.`deleted` = 0
+        AND `changes_ground_loot`.`height` >= ?1
+      ORDER BY `ground_loot`.`x`, `ground_loot`.`y`
+  )");
+  stmt.Bind (1, h);
+  return stmt.Query<GroundLootResult> ();
+}
+
 /* ************************************************************************** */
 
 namespace
@@ -403,6 +430,11 @@ BuildingInventory::~BuildingInventory ()
       stmt.Bind (1, building);
       stmt.Bind (2, account);
       stmt.Execute ();
+
+      auto* dirty = db.GetDirtyIds ();
+      if (dirty != nullptr)
+        dirty->MarkBuildingInventory (building, account);
+
       return;
     }
 
@@ -420,6 +452,10 @@ BuildingInventory::~BuildingInventory ()
   stmt.Bind (2, account);
   stmt.BindProto (3, inventory.GetProtoForBinding ());
   stmt.Execute ();
+
+  auto* dirty = db.GetDirtyIds ();
+  if (dirty != nullptr)
+    dirty->MarkBuildingInventory (building, account);
 }
 
 BuildingInventoriesTable::Handle
@@ -474,6 +510,21 @@ BuildingInventoriesTable::QueryForBuilding (const Database::IdT building)
   return stmt.Query<BuildingInventoryResult> ();
 }
 
+Database::Result<BuildingInventoryResult>
+BuildingInventoriesTable::QueryForBuildings (
+    const std::vector<Database::IdT>& buildings)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `building_inventories`
+      WHERE )" + IdBatchCondition ("`building`", 1) + R"(
+      ORDER BY `building`, `account`
+  )");
+  BindIdBatch (stmt, 1, buildings);
+
+  return stmt.Query<BuildingInventoryResult> ();
+}
+
 void
 BuildingInventoriesTable::RemoveBuilding (const Database::IdT building)
 {
@@ -21,6 +21,7 @@
 
 #include "coord.hpp"
 #include "database.hpp"
+#include "idbatch.hpp"
 #include "lazyproto.hpp"
 
 #include "proto/inventory.pb.h"
@@ -32,6 +33,7 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace pxd
 {
@@ -366,6 +368,12 @@ public:
    */
   Database::Result<GroundLootResult> QueryNonEmpty ();
 
+  /**
+   * Queries the database for all non-empty piles of loot that have been
+   * changed at or after the given block height.
+   */
+  Database::Result<GroundLootResult> QueryModifiedSince (unsigned h);
+
 };
 
 /* ************************************************************************** */
@@ -503,6 +511,13 @@ public:
    */
   Database::Result<BuildingInventoryResult> QueryForBuilding (Database::IdT b);
 
+  /**
+   * Queries the database for all inventories in one of the given buildings
+   * (at most ID_BATCH_SIZE of them), ordered by building and account.
+   */
+  Database::Result<BuildingInventoryResult> QueryForBuildings (
+      const std::vector<Database::IdT>& buildings);
+
   /**
    * Removes all entries for inventories in the given building.  This is used
    * to clean up data when a building is destroyed.
@@ -478,6 +478,34 @@ TEST_F (BuildingInventoriesTableTests, QueryForBuilding)
   ASSERT_FALSE (res.Step ());
 }
 
+TEST_F (BuildingInventoriesTableTests, QueryForBuildings)
+{
+  tbl.Get (123, "domob")->GetInventory ().SetFungibleCount ("foo", 1);
+  tbl.Get (124, "domob")->GetInventory ().SetFungibleCount ("foo", 2);
+  tbl.Get (123, "andy")->GetInventory ().SetFungibleCount ("foo", 3);
+  tbl.Get (125, "andy")->GetInventory ().SetFungibleCount ("foo", 4);
+
+  auto res = tbl.QueryForBuildings ({124, 123});
+
+  ASSERT_TRUE (res.Step ());
+  auto h = tbl.GetFromResult (res);
+  EXPECT_EQ (h->GetBuildingId (), 123);
+  EXPECT_EQ (h->GetAccount (), "andy");
+
+  ASSERT_TRUE (res.Step ());
+  h = tbl.GetFromResult (res);
+  EXPECT_EQ (h->GetBuildingId (), 123);
+  EXPECT_EQ (h->GetAccount (), "domob");
+
+  ASSERT_TRUE (res.Step ());
+  h = tbl.GetFromResult (res);
+  EXPECT_EQ (h->GetBuildingId (), 124);
+  EXPECT_EQ (h->GetAccount (), "domob");
+  EXPECT_EQ (h->GetInventory ().GetFungibleCount ("foo"), 2);
+
+  ASSERT_FALSE (res.Step ());
+}
+
 TEST_F (BuildingInventoriesTableTests, RemoveBuilding)
 {
   tbl.Get (123, "domob")->GetInventory ().SetFungibleCount ("foo", 1);
@@ -0,0 +1,77 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "lazyproto.hpp"
+
+#include <glog/logging.h>
+
+namespace pxd
+{
+
+constexpr size_t LazyProtoBufferPool::MAX_BUFFERS;
+constexpr size_t LazyProtoBufferPool::MAX_CAPACITY;
+
+LazyProtoBufferPool::~LazyProtoBufferPool ()
+{
+  CHECK_EQ (taken, 0) << "Buffers are still in use";
+}
+
+std::string
+LazyProtoBufferPool::Take ()
+{
+  std::lock_guard<std::mutex> lock(mut);
+  ++taken;
+
+  if (buffers.empty ())
+    return std::string ();
+
+  std::string res = std::move (buffers.back ());
+  buffers.pop_back ();
+
+  return res;
+}
+
+void
+LazyProtoBufferPool::Return (std::string&& buf)
+{
+  std::lock_guard<std::mutex> lock(mut);
+  CHECK_GT (taken, 0);
+  --taken;
+
+  if (buffers.size () >= MAX_BUFFERS || buf.capacity () > MAX_CAPACITY)
+    return;
+
+  buf.clear ();
+  buffers.push_back (std::move (buf));
+}
+
+size_t
+LazyProtoBufferPool::GetNumTaken ()
+{
+  std::lock_guard<std::mutex> lock(mut);
+  return taken;
+}
+
+size_t
+LazyProtoBufferPool::GetNumAvailable ()
+{
+  std::lock_guard<std::mutex> lock(mut);
+  return buffers.size ();
+}
+
+} // namespace pxd
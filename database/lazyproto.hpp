@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -21,11 +21,81 @@
 
 #include <google/protobuf/arena.h>
 
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace pxd
 {
 
+/**
+ * Pool of string buffers that LazyProto instances can use for their raw
+ * byte data.  Buffers are taken when a LazyProto is constructed from
+ * database data, and returned when it is destroyed.  This way, the allocated
+ * capacity of the strings is reused rather than freed and allocated again.
+ *
+ * The pool also keeps track of how many buffers are currently taken, i.e. how
+ * many LazyProto instances using it are alive.  This is used to determine
+ * when it is safe to reset the arena their messages are allocated on.
+ */
+class LazyProtoBufferPool
+{
+
+private:
+
+  /** Maximum number of spare buffers we keep around.  */
+  static constexpr size_t MAX_BUFFERS = 1'024;
+
+  /**
+   * Maximum capacity of a buffer we keep.  Larger ones are freed when
+   * returned, so that a few huge protos do not pin lots of memory.
+   */
+  static constexpr size_t MAX_CAPACITY = 64 << 10;
+
+  /** Lock for the mutable state.  */
+  std::mutex mut;
+
+  /** Currently available buffers.  */
+  std::vector<std::string> buffers;
+
+  /** Number of buffers currently taken.  */
+  size_t taken = 0;
+
+public:
+
+  LazyProtoBufferPool () = default;
+
+  LazyProtoBufferPool (const LazyProtoBufferPool&) = delete;
+  void operator= (const LazyProtoBufferPool&) = delete;
+
+  /**
+   * The destructor verifies that no buffers are still in use.
+   */
+  ~LazyProtoBufferPool ();
+
+  /**
+   * Returns an empty string, potentially with capacity reserved already.
+   */
+  std::string Take ();
+
+  /**
+   * Gives a buffer back to the pool.  Each buffer obtained from Take
+   * must be returned exactly once.
+   */
+  void Return (std::string&& buf);
+
+  /**
+   * Returns the number of buffers that are currently taken.
+   */
+  size_t GetNumTaken ();
+
+  /**
+   * Returns the number of spare buffers available in the pool.
+   */
+  size_t GetNumAvailable ();
+
+};
+
 /**
  * A class that wraps a protocol buffer and implements "lazy deserialisation".
  * Initially, it just keeps the raw data in a string, and only deserialises the
@@ -69,6 +139,12 @@ private:
   /** The arena used to allocate the parsed message, if any.  */
   google::protobuf::Arena* arena = nullptr;
 
+  /**
+   * If set, the buffer pool from which our data string was taken, and
+   * to which it will be returned when this instance is destroyed.
+   */
+  LazyProtoBufferPool* pool = nullptr;
+
   /** The raw bytes of the protocol buffer.  */
   mutable std::string data;
 
@@ -118,6 +194,12 @@ public:
    */
   void SetArena (google::protobuf::Arena& a);
 
+  /**
+   * Marks the data string of this instance as taken from the given pool,
+   * so that it will be returned there when the instance is destroyed.
+   */
+  void SetBufferPool (LazyProtoBufferPool& p);
+
   /**
    * Initialises the protocol buffer value as "empty" (i.e. default-constructed
    * protocol buffer message, empty data string).
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -18,6 +18,8 @@
 
 /* Template implementation code for lazyproto.hpp.  */
 
+#include "perfcounters.hpp"
+
 #include <glog/logging.h>
 
 namespace pxd
@@ -33,6 +35,8 @@ template <typename Proto>
 {
   if (arena == nullptr)
     delete msg;
+  if (pool != nullptr)
+    pool->Return (std::move (data));
 }
 
 template <typename Proto>
@@ -47,13 +51,17 @@ template <typename Proto>
 {
   if (arena == nullptr)
     delete msg;
+  if (pool != nullptr)
+    pool->Return (std::move (data));
 
   arena = o.arena;
+  pool = o.pool;
   data = std::move (o.data);
   msg = o.msg;
   state = o.state;
 
   o.msg = nullptr;
+  o.pool = nullptr;
   o.state = State::UNINITIALISED;
 
   return *this;
@@ -69,6 +77,14 @@ template <typename Proto>
   arena = &a;
 }
 
+template <typename Proto>
+  void
+  LazyProto<Proto>::SetBufferPool (LazyProtoBufferPool& p)
+{
+  CHECK (pool == nullptr);
+  pool = &p;
+}
+
 template <typename Proto>
   inline void
   LazyProto<Proto>::EnsureAllocated () const
@@ -90,6 +106,7 @@ template <typename Proto>
     {
     case State::UNPARSED:
       CHECK (msg->ParseFromString (data));
+      ++PerfCounters::ForThread ().protosParsed;
       state = State::UNMODIFIED;
       return;
 
@@ -158,6 +175,7 @@ template <typename Proto>
     case State::MODIFIED:
       CHECK (msg != nullptr);
       CHECK (msg->SerializeToString (&data));
+      ++PerfCounters::ForThread ().protosSerialised;
       return data;
 
     default:
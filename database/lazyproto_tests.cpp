@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -170,5 +170,67 @@ TEST_P (LazyProtoTests, IsEmpty)
 INSTANTIATE_TEST_SUITE_P (WithAndWithoutArena, LazyProtoTests,
                           testing::Values (false, true));
 
+/* ************************************************************************** */
+
+using LazyProtoBufferPoolTests = testing::Test;
+
+TEST_F (LazyProtoBufferPoolTests, ReusesBuffers)
+{
+  LazyProtoBufferPool pool;
+  EXPECT_EQ (pool.GetNumAvailable (), 0);
+
+  std::string buf = pool.Take ();
+  EXPECT_EQ (pool.GetNumTaken (), 1);
+  buf.assign (100, 'x');
+  const size_t capacity = buf.capacity ();
+  pool.Return (std::move (buf));
+  EXPECT_EQ (pool.GetNumTaken (), 0);
+  EXPECT_EQ (pool.GetNumAvailable (), 1);
+
+  buf = pool.Take ();
+  EXPECT_EQ (buf, "");
+  EXPECT_EQ (buf.capacity (), capacity);
+  EXPECT_EQ (pool.GetNumAvailable (), 0);
+  pool.Return (std::move (buf));
+}
+
+TEST_F (LazyProtoBufferPoolTests, HugeBuffersNotKept)
+{
+  LazyProtoBufferPool pool;
+
+  std::string buf = pool.Take ();
+  buf.assign (1 << 20, 'x');
+  pool.Return (std::move (buf));
+
+  EXPECT_EQ (pool.GetNumTaken (), 0);
+  EXPECT_EQ (pool.GetNumAvailable (), 0);
+}
+
+TEST_F (LazyProtoBufferPoolTests, ReturnedByLazyProto)
+{
+  LazyProtoBufferPool pool;
+
+  {
+    LazyProto<proto::HexCoord> a(pool.Take ());
+    a.SetBufferPool (pool);
+
+    LazyProto<proto::HexCoord> b(pool.Take ());
+    b.SetBufferPool (pool);
+    EXPECT_EQ (pool.GetNumTaken (), 2);
+
+    /* Moving a into b returns b's old buffer, and hands over the
+       ownership of a's buffer.  */
+    b = std::move (a);
+    EXPECT_EQ (pool.GetNumTaken (), 1);
+    EXPECT_EQ (pool.GetNumAvailable (), 1);
+
+    LazyProto<proto::HexCoord> c(std::move (b));
+    EXPECT_EQ (pool.GetNumTaken (), 1);
+  }
+
+  EXPECT_EQ (pool.GetNumTaken (), 0);
+  EXPECT_EQ (pool.GetNumAvailable (), 2);
+}
+
 } // anonymous namespace
 } // namespace pxd
@@ -18,6 +18,12 @@
 
 #include "ongoing.hpp"
 
+#include "dirtyids.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
 namespace pxd
 {
 
@@ -83,6 +89,145 @@ OngoingOperation::~OngoingOperation ()
   stmt.BindProto (5, data);
 
   stmt.Execute ();
+
+  auto* dirty = db.GetDirtyIds ();
+  if (dirty != nullptr)
+    dirty->MarkOngoing (id);
+
+  auto* schedule = db.GetOngoingsSchedule ();
+  if (schedule != nullptr)
+    schedule->Update (*this);
+}
+
+void
+OngoingsSchedule::Update (const OngoingOperation& op)
+{
+  const auto id = op.GetId ();
+  Erase (id);
+
+  Entry e;
+  e.height = op.GetHeight ();
+  e.endHeight = endHeightFcn (op);
+  e.character = op.GetCharacterId ();
+  e.building = op.GetBuildingId ();
+
+  byHeight[e.height].insert (id);
+  if (e.character != Database::EMPTY_ID)
+    byCharacter[e.character].insert (id);
+  if (e.building != Database::EMPTY_ID)
+    byBuilding[e.building].insert (id);
+
+  entries.emplace (id, e);
+}
+
+namespace
+{
+
+/**
+ * Removes the given ID from the set for some key in one of the index maps,
+ * and removes the key entirely if the set is then empty.
+ */
+template <typename Map, typename Key>
+  void
+  RemoveFromIndex (Map& index, const Key& key, const Database::IdT id)
+{
+  auto mit = index.find (key);
+  CHECK (mit != index.end ());
+  CHECK_EQ (mit->second.erase (id), 1);
+  if (mit->second.empty ())
+    index.erase (mit);
+}
+
+} // anonymous namespace
+
+void
+OngoingsSchedule::Erase (const Database::IdT id)
+{
+  const auto mit = entries.find (id);
+  if (mit == entries.end ())
+    return;
+
+  const auto& e = mit->second;
+  RemoveFromIndex (byHeight, e.height, id);
+  if (e.character != Database::EMPTY_ID)
+    RemoveFromIndex (byCharacter, e.character, id);
+  if (e.building != Database::EMPTY_ID)
+    RemoveFromIndex (byBuilding, e.building, id);
+
+  entries.erase (mit);
+}
+
+std::vector<Database::IdT>
+OngoingsSchedule::Lookup (const IdIndex& index, const Database::IdT key)
+{
+  const auto mit = index.find (key);
+  if (mit == index.end ())
+    return {};
+
+  return std::vector<Database::IdT> (mit->second.begin (), mit->second.end ());
+}
+
+void
+OngoingsSchedule::Load (Database& db)
+{
+  CHECK (!loaded);
+  CHECK (entries.empty ());
+
+  OngoingsTable tbl(db);
+  auto res = tbl.QueryAll ();
+  while (res.Step ())
+    Update (*tbl.GetFromResult (res));
+
+  loaded = true;
+  VLOG (1) << "Loaded " << entries.size () << " ongoing operations";
+}
+
+void
+OngoingsSchedule::Invalidate ()
+{
+  entries.clear ();
+  byHeight.clear ();
+  byCharacter.clear ();
+  byBuilding.clear ();
+  loaded = false;
+}
+
+void
+OngoingsSchedule::Verify (Database& db) const
+{
+  CHECK (loaded);
+
+  OngoingsSchedule fresh(endHeightFcn);
+  fresh.Load (db);
+
+  CHECK (entries == fresh.entries)
+      << "Ongoings schedule does not match the database";
+  CHECK (byHeight == fresh.byHeight);
+  CHECK (byCharacter == fresh.byCharacter);
+  CHECK (byBuilding == fresh.byBuilding);
+}
+
+std::vector<Database::IdT>
+OngoingsSchedule::GetForHeight (const unsigned h) const
+{
+  std::vector<Database::IdT> res;
+  for (auto mit = byHeight.begin ();
+       mit != byHeight.end () && mit->first <= h; ++mit)
+    res.insert (res.end (), mit->second.begin (), mit->second.end ());
+
+  /* Operations should be processed in order of their ID (consistent with
+     QueryForHeight), not grouped by height.  */
+  std::sort (res.begin (), res.end ());
+
+  return res;
+}
+
+unsigned
+OngoingsSchedule::GetEndHeight (const Database::IdT id) const
+{
+  const auto mit = entries.find (id);
+  CHECK (mit != entries.end ()) << "Ongoing " << id << " is not scheduled";
+  return mit->second.endHeight;
 }
 
 OngoingsTable::Handle
@@ -126,6 +271,23 @@ OngoingsTable::QueryAll ()
   return stmt.Query<OngoingResult> ();
 }
 
+Database::Result<OngoingResult>
+OngoingsTable::QueryModifiedSince (const unsigned h)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `ongoing_operations`
+      WHERE `id` IN (
+        SELECT `id`
+          FROM `changes_ongoing_operations`
+          WHERE `deleted` = 0 AND `height` >= ?1
+      )
+      ORDER BY `id`
+  )");
+  stmt.Bind (1, h);
+  return stmt.Query<OngoingResult> ();
+}
+
 Database::Result<OngoingResult>
 OngoingsTable::QueryForBuilding (const Database::IdT id)
 {
@@ -139,6 +301,19 @@ OngoingsTable::QueryForBuilding (const Database::IdT id)
   return stmt.Query<OngoingResult> ();
 }
 
+Database::Result<OngoingResult>
+OngoingsTable::QueryForCharacter (const Database::IdT id)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT *
+      FROM `ongoing_operations`
+      WHERE `character` = ?1
+      ORDER BY `id`
+  )");
+  stmt.Bind (1, id);
+  return stmt.Query<OngoingResult> ();
+}
+
 Database::Result<OngoingResult>
 OngoingsTable::QueryForHeight (const unsigned h)
 {
@@ -155,26 +330,150 @@ OngoingsTable::QueryForHeight (const unsigned h)
   return stmt.Query<OngoingResult> ();
 }
 
+namespace
+{
+
+/**
+ * Extracts the IDs from a database result.
+ */
+std::vector<Database::IdT>
+ExtractIds (Database::Result<OngoingResult> res)
+{
+  std::vector<Database::IdT> ids;
+  while (res.Step ())
+    ids.push_back (res.Get<OngoingResult::id> ());
+  return ids;
+}
+
+} // anonymous namespace
+
+std::vector<Database::IdT>
+OngoingsTable::GetIdsForHeight (const unsigned h)
+{
+  const auto* schedule = db.GetOngoingsSchedule ();
+  if (schedule != nullptr)
+    return schedule->GetForHeight (h);
+
+  auto stmt = db.Prepare (R"(
+    SELECT `id`
+      FROM `ongoing_operations`
+      WHERE `height` <= ?1
+      ORDER BY `id`
+  )");
+  stmt.Bind (1, h);
+  return ExtractIds (stmt.Query<OngoingResult> ());
+}
+
+std::vector<Database::IdT>
+OngoingsTable::GetIdsForBuilding (const Database::IdT id)
+{
+  const auto* schedule = db.GetOngoingsSchedule ();
+  if (schedule != nullptr)
+    return schedule->GetForBuilding (id);
+
+  auto stmt = db.Prepare (R"(
+    SELECT `id`
+      FROM `ongoing_operations`
+      WHERE `building` = ?1
+      ORDER BY `id`
+  )");
+  stmt.Bind (1, id);
+  return ExtractIds (stmt.Query<OngoingResult> ());
+}
+
+namespace
+{
+
+/**
+ * Returns the IDs of all operations that will be deleted by a bulk deletion
+ * with the given condition on one of the columns.  This is used to record
+ * them in the attached DirtyIds if there is no schedule to give us the IDs.
+ */
+std::vector<Database::IdT>
+QueryIdsForDeletion (Database& db, const std::string& column,
+                     const int64_t value)
+{
+  auto stmt = db.Prepare (R"(
+    SELECT `id`
+      FROM `ongoing_operations`
+      WHERE `)" + column + R"(` = ?1
+      ORDER BY `id`
+  )");
+  stmt.Bind (1, value);
+  return ExtractIds (stmt.Query<OngoingResult> ());
+}
+
+/**
+ * Marks the given operations (that have been deleted in bulk) in the
+ * attached DirtyIds, if any.
+ */
+void
+MarkDeleted (Database& db, const std::vector<Database::IdT>& ids)
+{
+  auto* dirty = db.GetDirtyIds ();
+  if (dirty != nullptr)
+    for (const auto id : ids)
+      dirty->MarkOngoing (id);
+}
+
+} // anonymous namespace
+
 void
 OngoingsTable::DeleteForCharacter (const Database::IdT id)
 {
+  std::vector<Database::IdT> ids;
+  auto* schedule = db.GetOngoingsSchedule ();
+  if (schedule != nullptr)
+    {
+      ids = schedule->GetForCharacter (id);
+      if (ids.empty ())
+        return;
+      for (const auto opId : ids)
+        schedule->Erase (opId);
+    }
+  else if (db.GetDirtyIds () != nullptr)
+    ids = QueryIdsForDeletion (db, "character", id);
+
   auto stmt = db.Prepare (R"(
     DELETE FROM `ongoing_operations`
       WHERE `character` = ?1
   )");
   stmt.Bind (1, id);
   stmt.Execute ();
+
+  MarkDeleted (db, ids);
+  auto* dirty = db.GetDirtyIds ();
+  if (dirty != nullptr)
+    dirty->MarkCharacter (id);
 }
 
 void
 OngoingsTable::DeleteForBuilding (const Database::IdT id)
 {
+  std::vector<Database::IdT> ids;
+  auto* schedule = db.GetOngoingsSchedule ();
+  if (schedule != nullptr)
+    {
+      ids = schedule->GetForBuilding (id);
+      if (ids.empty ())
+        return;
+      for (const auto opId : ids)
+        schedule->Erase (opId);
+    }
+  else if (db.GetDirtyIds () != nullptr)
+    ids = QueryIdsForDeletion (db, "building", id);
+
   auto stmt = db.Prepare (R"(
     DELETE FROM `ongoing_operations`
       WHERE `building` = ?1
   )");
   stmt.Bind (1, id);
   stmt.Execute ();
+
+  MarkDeleted (db, ids);
+  auto* dirty = db.GetDirtyIds ();
+  if (dirty != nullptr)
+    dirty->MarkBuilding (id);
 }
 
 void
@@ -183,12 +482,29 @@ OngoingsTable::DeleteForHeight (const unsigned h)
   /* We only remove by exact height (not less-or-equal) so that any rows
      with an invalid height (should not happen) will not be silently removed.
      They should instead come up when processing next and assert-fail.  */
+
+  std::vector<Database::IdT> ids;
+  auto* schedule = db.GetOngoingsSchedule ();
+  if (schedule != nullptr)
+    {
+      const auto mit = schedule->byHeight.find (h);
+      if (mit == schedule->byHeight.end ())
+        return;
+      ids.assign (mit->second.begin (), mit->second.end ());
+      for (const auto opId : ids)
+        schedule->Erase (opId);
+    }
+  else if (db.GetDirtyIds () != nullptr)
+    ids = QueryIdsForDeletion (db, "height", h);
+
   auto stmt = db.Prepare (R"(
     DELETE FROM `ongoing_operations`
       WHERE `height` = ?1
   )");
   stmt.Bind (1, h);
   stmt.Execute ();
+
+  MarkDeleted (db, ids);
 }
 
 } // namespace pxd
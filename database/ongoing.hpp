@@ -24,8 +24,12 @@
 
 #include "proto/ongoing.pb.h"
 
+#include <functional>
+#include <map>
 #include <memory>
+#include <set>
 #include <string>
+#include <vector>
 
 namespace pxd
 {
@@ -161,9 +165,172 @@ public:
 
 };
 
+/**
+ * In-memory index of all ongoing operations, which mirrors the data in
+ * the database but allows quick lookups by processing height, character
+ * and building.  It also holds the (precomputed) final height of each
+ * operation, which may be later than its next processing height for
+ * operations that process in multiple steps (e.g. blueprint copies).
+ *
+ * The schedule is filled from the database once, and then kept in sync
+ * while it is attached to a Database instance (by OngoingsTable and
+ * OngoingOperation).  It can be kept across blocks as long as they are
+ * processed in sequence, and has to be invalidated otherwise.
+ */
+class OngoingsSchedule
+{
+
+public:
+
+  /**
+   * Function that computes the final height of an operation.  This depends
+   * on the game configuration and is thus provided by the game logic.
+   */
+  using EndHeightFunction = std::function<unsigned (const OngoingOperation&)>;
+
+private:
+
+  /**
+   * Data stored for each operation.
+   */
+  struct Entry
+  {
+
+    /** The height at which the operation needs processing next.  */
+    unsigned height;
+
+    /** The height at which the operation will be completely finished.  */
+    unsigned endHeight;
+
+    /** The associated character (or EMPTY_ID).  */
+    Database::IdT character;
+
+    /** The associated building (or EMPTY_ID).  */
+    Database::IdT building;
+
+    friend bool
+    operator== (const Entry& a, const Entry& b)
+    {
+      return a.height == b.height && a.endHeight == b.endHeight
+                && a.character == b.character && a.building == b.building;
+    }
+
+  };
+
+  /** Secondary index mapping some key to the associated operation IDs.  */
+  using IdIndex = std::map<Database::IdT, std::set<Database::IdT>>;
+
+  /** The function used to compute end heights.  */
+  const EndHeightFunction endHeightFcn;
+
+  /** Whether or not the data has been loaded from the database.  */
+  bool loaded = false;
+
+  /** All operations by their ID.  */
+  std::map<Database::IdT, Entry> entries;
+
+  /** Operation IDs ordered by their next processing height.  */
+  std::map<unsigned, std::set<Database::IdT>> byHeight;
+
+  /** Operation IDs by associated character.  */
+  IdIndex byCharacter;
+
+  /** Operation IDs by associated building.  */
+  IdIndex byBuilding;
+
+  /**
+   * Inserts or updates the entry for the given operation.
+   */
+  void Update (const OngoingOperation& op);
+
+  /**
+   * Removes the given operation ID from the schedule.
+   */
+  void Erase (Database::IdT id);
+
+  /**
+   * Returns all IDs associated to a given key in one of the secondary
+   * indices, in ascending order.
+   */
+  static std::vector<Database::IdT> Lookup (const IdIndex& index,
+                                            Database::IdT key);
+
+  friend class OngoingOperation;
+  friend class OngoingsTable;
+
+public:
+
+  explicit OngoingsSchedule (const EndHeightFunction& f)
+    : endHeightFcn(f)
+  {}
+
+  OngoingsSchedule () = delete;
+  OngoingsSchedule (const OngoingsSchedule&) = delete;
+  void operator= (const OngoingsSchedule&) = delete;
+
+  /**
+   * Returns true if the schedule has been loaded from the database.
+   */
+  bool
+  IsLoaded () const
+  {
+    return loaded;
+  }
+
+  /**
+   * Fills the schedule from the given database.
+   */
+  void Load (Database& db);
+
+  /**
+   * Clears the schedule, so that it will be loaded again before the
+   * next use.
+   */
+  void Invalidate ();
+
+  /**
+   * CHECK-fails if the schedule does not match the current database state.
+   * This is meant for (slow) state validation.
+   */
+  void Verify (Database& db) const;
+
+  /**
+   * Returns the IDs of all operations whose processing height is less or
+   * equal to the given one, in ascending order.
+   */
+  std::vector<Database::IdT> GetForHeight (unsigned h) const;
+
+  /**
+   * Returns the IDs of all operations associated to a building.
+   */
+  std::vector<Database::IdT>
+  GetForBuilding (const Database::IdT id) const
+  {
+    return Lookup (byBuilding, id);
+  }
+
+  /**
+   * Returns the IDs of all operations associated to a character.
+   */
+  std::vector<Database::IdT>
+  GetForCharacter (const Database::IdT id) const
+  {
+    return Lookup (byCharacter, id);
+  }
+
+  /**
+   * Returns the final height of the given operation, which must exist.
+   */
+  unsigned GetEndHeight (Database::IdT id) const;
+
+};
+
 /**
  * Utility class that handles querying the ongoings table in the database and
  * should be used to obtain OngoingOperation instances.
+ *
+ * If an OngoingsSchedule is attached to the Database, it is used for
+ * the ID-based lookups and kept up-to-date with all changes done.
  */
 class OngoingsTable
 {
@@ -208,6 +375,13 @@ public:
    */
   Database::Result<OngoingResult> QueryAll ();
 
+  /**
+   * Queries the database for all operations that have been changed (but not
+   * deleted) at or after the given block height, as recorded by
+   * EntityChanges.
+   */
+  Database::Result<OngoingResult> QueryModifiedSince (unsigned h);
+
   /**
    * Queries the database for all operations associated to a given building.
    * This is used to process some of them (e.g. blueprint copy) when the
@@ -215,12 +389,30 @@ public:
    */
   Database::Result<OngoingResult> QueryForBuilding (Database::IdT id);
 
+  /**
+   * Queries the database for all operations associated to a given character.
+   */
+  Database::Result<OngoingResult> QueryForCharacter (Database::IdT id);
+
   /**
    * Queries the database for all operations that need processing at the
    * given (current) block height.
    */
   Database::Result<OngoingResult> QueryForHeight (unsigned h);
 
+  /**
+   * Returns the IDs of all operations that need processing at the given
+   * (current) height, in ascending order.  This uses the attached schedule
+   * if there is one, and queries the database otherwise.
+   */
+  std::vector<Database::IdT> GetIdsForHeight (unsigned h);
+
+  /**
+   * Returns the IDs of all operations associated to the given building,
+   * in ascending order.
+   */
+  std::vector<Database::IdT> GetIdsForBuilding (Database::IdT id);
+
   /**
    * Deletes all operations for a given character ID.  This is used when
    * the character dies.
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -22,6 +22,8 @@
 
 #include <gtest/gtest.h>
 
+#include <vector>
+
 namespace pxd
 {
 namespace
@@ -168,6 +170,31 @@ TEST_F (OngoingsTableTests, QueryForBuilding)
   ASSERT_FALSE (res.Step ());
 }
 
+TEST_F (OngoingsTableTests, QueryForCharacter)
+{
+  auto op = Create ();
+  op->SetHeight (1);
+  op->SetCharacterId (42);
+  op.reset ();
+
+  op = Create ();
+  op->SetHeight (2);
+  op->SetCharacterId (5);
+  op.reset ();
+
+  op = Create ();
+  op->SetHeight (3);
+  op->SetBuildingId (42);
+  op.reset ();
+
+  auto res = tbl.QueryForCharacter (42);
+
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetHeight (), 1);
+
+  ASSERT_FALSE (res.Step ());
+}
+
 TEST_F (OngoingsTableTests, DeleteForCharacter)
 {
   db.SetNextId (101);
@@ -233,5 +260,188 @@ TEST_F (OngoingsTableTests, DeleteForHeight)
   ASSERT_FALSE (res.Step ());
 }
 
+TEST_F (OngoingsTableTests, GetIdsWithoutSchedule)
+{
+  db.SetNextId (101);
+
+  auto op = Create ();
+  op->SetHeight (10);
+  op->SetBuildingId (42);
+  op.reset ();
+
+  Create ()->SetHeight (5);
+  Create ()->SetHeight (11);
+
+  op = Create ();
+  op->SetHeight (1);
+  op->SetBuildingId (42);
+  op.reset ();
+
+  using Ids = std::vector<Database::IdT>;
+  EXPECT_EQ (tbl.GetIdsForHeight (10), Ids ({101, 102, 104}));
+  EXPECT_EQ (tbl.GetIdsForHeight (0), Ids ({}));
+  EXPECT_EQ (tbl.GetIdsForBuilding (42), Ids ({101, 104}));
+  EXPECT_EQ (tbl.GetIdsForBuilding (5), Ids ({}));
+}
+
+class OngoingsScheduleTests : public OngoingOperationTests
+{
+
+protected:
+
+  using Ids = std::vector<Database::IdT>;
+
+  OngoingsSchedule schedule;
+
+  OngoingsScheduleTests ()
+    : schedule([] (const OngoingOperation& op)
+        {
+          /* For testing, we just say that everything with a building
+             takes ten blocks longer than the next processing height.  */
+          if (op.GetBuildingId () != Database::EMPTY_ID)
+            return op.GetHeight () + 10;
+          return op.GetHeight ();
+        })
+  {
+    db.SetNextId (101);
+  }
+
+  /**
+   * Creates an operation with the given height, character and building.
+   */
+  void
+  Insert (const unsigned h, const Database::IdT c, const Database::IdT b)
+  {
+    auto op = Create ();
+    op->SetHeight (h);
+    op->SetCharacterId (c);
+    op->SetBuildingId (b);
+  }
+
+  /**
+   * Attaches the schedule to the database, loading it first.
+   */
+  void
+  Attach ()
+  {
+    schedule.Load (db);
+    db.SetOngoingsSchedule (&schedule);
+  }
+
+  ~OngoingsScheduleTests ()
+  {
+    db.SetOngoingsSchedule (nullptr);
+  }
+
+};
+
+TEST_F (OngoingsScheduleTests, LoadsFromDatabase)
+{
+  Insert (10, 1, Database::EMPTY_ID);
+  Insert (5, Database::EMPTY_ID, 2);
+  Insert (10, 1, 2);
+
+  EXPECT_FALSE (schedule.IsLoaded ());
+  schedule.Load (db);
+  EXPECT_TRUE (schedule.IsLoaded ());
+
+  EXPECT_EQ (schedule.GetForHeight (4), Ids ({}));
+  EXPECT_EQ (schedule.GetForHeight (5), Ids ({102}));
+  EXPECT_EQ (schedule.GetForHeight (10), Ids ({101, 102, 103}));
+  EXPECT_EQ (schedule.GetForCharacter (1), Ids ({101, 103}));
+  EXPECT_EQ (schedule.GetForCharacter (2), Ids ({}));
+  EXPECT_EQ (schedule.GetForBuilding (2), Ids ({102, 103}));
+  EXPECT_EQ (schedule.GetForBuilding (1), Ids ({}));
+
+  EXPECT_EQ (schedule.GetEndHeight (101), 10);
+  EXPECT_EQ (schedule.GetEndHeight (102), 15);
+  EXPECT_EQ (schedule.GetEndHeight (103), 20);
+
+  schedule.Verify (db);
+}
+
+TEST_F (OngoingsScheduleTests, TracksUpdates)
+{
+  Insert (10, 1, Database::EMPTY_ID);
+  Attach ();
+
+  Insert (5, Database::EMPTY_ID, 2);
+  EXPECT_EQ (schedule.GetForHeight (10), Ids ({101, 102}));
+  EXPECT_EQ (schedule.GetEndHeight (102), 15);
+
+  auto op = tbl.GetById (101);
+  op->SetHeight (20);
+  op->SetCharacterId (Database::EMPTY_ID);
+  op->SetBuildingId (3);
+  op.reset ();
+
+  EXPECT_EQ (schedule.GetForHeight (10), Ids ({102}));
+  EXPECT_EQ (schedule.GetForHeight (20), Ids ({101, 102}));
+  EXPECT_EQ (schedule.GetForCharacter (1), Ids ({}));
+  EXPECT_EQ (schedule.GetForBuilding (3), Ids ({101}));
+  EXPECT_EQ (schedule.GetEndHeight (101), 30);
+
+  /* Reading without changes should not modify anything.  */
+  tbl.GetById (102);
+
+  schedule.Verify (db);
+}
+
+TEST_F (OngoingsScheduleTests, GetIdsUsesSchedule)
+{
+  Insert (10, Database::EMPTY_ID, 42);
+  Insert (5, 1, Database::EMPTY_ID);
+  Attach ();
+
+  EXPECT_EQ (tbl.GetIdsForHeight (10), Ids ({101, 102}));
+  EXPECT_EQ (tbl.GetIdsForHeight (9), Ids ({102}));
+  EXPECT_EQ (tbl.GetIdsForBuilding (42), Ids ({101}));
+}
+
+TEST_F (OngoingsScheduleTests, Deletions)
+{
+  Insert (10, 1, Database::EMPTY_ID);
+  Insert (10, Database::EMPTY_ID, 2);
+  Insert (20, 1, 2);
+  Insert (30, 3, Database::EMPTY_ID);
+  Insert (40, Database::EMPTY_ID, 4);
+  Attach ();
+
+  tbl.DeleteForCharacter (1);
+  tbl.DeleteForCharacter (12345);
+  EXPECT_EQ (schedule.GetForHeight (100), Ids ({102, 104, 105}));
+  schedule.Verify (db);
+
+  tbl.DeleteForBuilding (2);
+  tbl.DeleteForBuilding (12345);
+  EXPECT_EQ (schedule.GetForHeight (100), Ids ({104, 105}));
+  schedule.Verify (db);
+
+  tbl.DeleteForHeight (30);
+  tbl.DeleteForHeight (35);
+  EXPECT_EQ (schedule.GetForHeight (100), Ids ({105}));
+  schedule.Verify (db);
+
+  auto res = tbl.QueryAll ();
+  ASSERT_TRUE (res.Step ());
+  EXPECT_EQ (tbl.GetFromResult (res)->GetId (), 105);
+  ASSERT_FALSE (res.Step ());
+}
+
+TEST_F (OngoingsScheduleTests, Invalidate)
+{
+  Insert (10, 1, Database::EMPTY_ID);
+  schedule.Load (db);
+
+  schedule.Invalidate ();
+  EXPECT_FALSE (schedule.IsLoaded ());
+  EXPECT_EQ (schedule.GetForHeight (10), Ids ({}));
+
+  Insert (20, 1, Database::EMPTY_ID);
+  schedule.Load (db);
+  EXPECT_EQ (schedule.GetForHeight (20), Ids ({101, 102}));
+  schedule.Verify (db);
+}
+
 } // anonymous namespace
 } // namespace pxd
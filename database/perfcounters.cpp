@@ -0,0 +1,159 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "perfcounters.hpp"
+
+#include <glog/logging.h>
+
+#include <cctype>
+#include <unordered_map>
+
+namespace pxd
+{
+
+PerfCounters&
+PerfCounters::ForThread ()
+{
+  static thread_local PerfCounters instance;
+  return instance;
+}
+
+namespace
+{
+
+/**
+ * Computes the difference between two per-table maps, leaving out
+ * tables that did not change.
+ */
+std::map<std::string, uint64_t>
+MapDifference (const std::map<std::string, uint64_t>& after,
+               const std::map<std::string, uint64_t>& before)
+{
+  std::map<std::string, uint64_t> res;
+  for (const auto& entry : after)
+    {
+      uint64_t prev = 0;
+      const auto mit = before.find (entry.first);
+      if (mit != before.end ())
+        prev = mit->second;
+
+      CHECK_GE (entry.second, prev);
+      if (entry.second > prev)
+        res.emplace (entry.first, entry.second - prev);
+    }
+
+  return res;
+}
+
+} // anonymous namespace
+
+PerfCounters
+PerfCounters::Since (const PerfCounters& before) const
+{
+  CHECK_GE (statementsPrepared, before.statementsPrepared);
+  CHECK_GE (statementsStepped, before.statementsStepped);
+  CHECK_GE (protosParsed, before.protosParsed);
+  CHECK_GE (protosSerialised, before.protosSerialised);
+
+  PerfCounters res;
+  res.statementsPrepared = statementsPrepared - before.statementsPrepared;
+  res.statementsStepped = statementsStepped - before.statementsStepped;
+  res.protosParsed = protosParsed - before.protosParsed;
+  res.protosSerialised = protosSerialised - before.protosSerialised;
+  res.rowsRead = MapDifference (rowsRead, before.rowsRead);
+  res.rowsWritten = MapDifference (rowsWritten, before.rowsWritten);
+
+  return res;
+}
+
+void
+PerfCounters::Add (const PerfCounters& other)
+{
+  statementsPrepared += other.statementsPrepared;
+  statementsStepped += other.statementsStepped;
+  protosParsed += other.protosParsed;
+  protosSerialised += other.protosSerialised;
+
+  for (const auto& entry : other.rowsRead)
+    rowsRead[entry.first] += entry.second;
+  for (const auto& entry : other.rowsWritten)
+    rowsWritten[entry.first] += entry.second;
+}
+
+std::string
+PerfCounters::TableForStatement (const std::string& sql)
+{
+  /* We split the SQL into words (ignoring the quoting characters) and
+     look for the first word following one of the keywords.  This is not
+     a real SQL parser, but it works for the statements we use.  */
+
+  const auto isWordChar = [] (const char c)
+    {
+      return std::isalnum (static_cast<unsigned char> (c)) || c == '_';
+    };
+
+  bool takeNext = false;
+  size_t pos = 0;
+  while (pos < sql.size ())
+    {
+      if (!isWordChar (sql[pos]))
+        {
+          ++pos;
+          continue;
+        }
+
+      const size_t start = pos;
+      while (pos < sql.size () && isWordChar (sql[pos]))
+        ++pos;
+      const std::string word = sql.substr (start, pos - start);
+
+      std::string upper = word;
+      for (auto& c : upper)
+        c = std::toupper (static_cast<unsigned char> (c));
+
+      /* For sub-queries like "FROM (SELECT ...)", we want the table
+         of the inner query.  */
+      if (takeNext && upper != "SELECT")
+        return word;
+
+      takeNext = (upper == "FROM" || upper == "INTO" || upper == "UPDATE");
+    }
+
+  return "";
+}
+
+const std::string&
+PerfCounters::CachedTableForStatement (const std::string& sql)
+{
+  /* Almost all statements we prepare come from a fixed set of SQL strings
+     in the code, so the cache stays small.  As a safeguard against some
+     dynamically built SQL, we still limit its size.  */
+  static constexpr size_t MAX_ENTRIES = 10'000;
+  static thread_local std::unordered_map<std::string, std::string> cache;
+
+  const auto mit = cache.find (sql);
+  if (mit != cache.end ())
+    return mit->second;
+
+  if (cache.size () >= MAX_ENTRIES)
+    cache.clear ();
+
+  return cache.emplace (sql, TableForStatement (sql)).first->second;
+}
+
+} // namespace pxd
@@ -0,0 +1,92 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATABASE_PERFCOUNTERS_HPP
+#define DATABASE_PERFCOUNTERS_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace pxd
+{
+
+/**
+ * Counters for the work done on the database (and with protos extracted
+ * from it).  There is one instance per thread, which is updated by
+ * Database, its statements and results, and LazyProto.  The counters are
+ * only ever increased; to measure some piece of work, callers take a
+ * snapshot before and compute the difference afterwards.
+ */
+struct PerfCounters
+{
+
+  /** Number of SQL statements prepared.  */
+  uint64_t statementsPrepared = 0;
+
+  /** Number of steps done on SQL statements (including executes).  */
+  uint64_t statementsStepped = 0;
+
+  /** Number of protos parsed from their serialised form.  */
+  uint64_t protosParsed = 0;
+
+  /** Number of protos serialised (e.g. for writing them).  */
+  uint64_t protosSerialised = 0;
+
+  /** Number of rows read, by table.  */
+  std::map<std::string, uint64_t> rowsRead;
+
+  /** Number of rows written (inserted, updated or deleted), by table.  */
+  std::map<std::string, uint64_t> rowsWritten;
+
+  /**
+   * Returns the instance for the current thread.
+   */
+  static PerfCounters& ForThread ();
+
+  /**
+   * Returns the counts accumulated since the given earlier snapshot
+   * of the same counters.  Tables without change are left out.
+   */
+  PerfCounters Since (const PerfCounters& before) const;
+
+  /**
+   * Adds all counts from another instance to this one.
+   */
+  void Add (const PerfCounters& other);
+
+  /**
+   * Determines the name of the table a given SQL statement mainly works on
+   * (the first one after FROM, INTO or UPDATE), for use in the per-table
+   * row counters.  Returns the empty string if none can be found.
+   */
+  static std::string TableForStatement (const std::string& sql);
+
+  /**
+   * Returns the same as TableForStatement, but caches the result per
+   * SQL string (and thread), so that preparing the same statement
+   * again does not need to scan the SQL once more.  The returned reference
+   * stays valid until the next call on the same thread.
+   */
+  static const std::string& CachedTableForStatement (const std::string& sql);
+
+};
+
+} // namespace pxd
+
+#endif // DATABASE_PERFCOUNTERS_HPP
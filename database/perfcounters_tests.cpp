@@ -0,0 +1,193 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "perfcounters.hpp"
+
+#include "database.hpp"
+#include "dbtest.hpp"
+
+#include "proto/geometry.pb.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace pxd
+{
+namespace
+{
+
+/* ************************************************************************** */
+
+using PerfCountersTests = testing::Test;
+
+TEST_F (PerfCountersTests, TableForStatement)
+{
+  EXPECT_EQ (PerfCounters::TableForStatement (R"(
+    SELECT `id`, `proto`
+      FROM `characters`
+      WHERE `id` = ?1
+  )"), "characters");
+  EXPECT_EQ (PerfCounters::TableForStatement (R"(
+    INSERT OR REPLACE INTO `accounts`
+      (`name`, `proto`) VALUES (?1, ?2)
+  )"), "accounts");
+  EXPECT_EQ (PerfCounters::TableForStatement (
+      "UPDATE buildings SET `owner` = ?1"), "buildings");
+  EXPECT_EQ (PerfCounters::TableForStatement (
+      "delete from `ground_loot` WHERE `x` = 1"), "ground_loot");
+  EXPECT_EQ (PerfCounters::TableForStatement (
+      "SELECT COUNT(*) AS `cnt` FROM (SELECT * FROM `regions`)"), "regions");
+  EXPECT_EQ (PerfCounters::TableForStatement ("CREATE TABLE `foo` (`x`)"), "");
+}
+
+TEST_F (PerfCountersTests, CachedTableForStatement)
+{
+  const std::string sql = "SELECT * FROM `characters`";
+  EXPECT_EQ (PerfCounters::CachedTableForStatement (sql), "characters");
+  EXPECT_EQ (PerfCounters::CachedTableForStatement (sql), "characters");
+  EXPECT_EQ (PerfCounters::CachedTableForStatement ("DELETE FROM `foo`"),
+             "foo");
+  EXPECT_EQ (PerfCounters::CachedTableForStatement ("CREATE TABLE `foo`"), "");
+}
+
+TEST_F (PerfCountersTests, SinceAndAdd)
+{
+  PerfCounters before;
+  before.statementsPrepared = 1;
+  before.protosParsed = 5;
+  before.rowsRead["a"] = 10;
+  before.rowsRead["b"] = 3;
+
+  PerfCounters after = before;
+  after.statementsPrepared = 4;
+  after.statementsStepped = 2;
+  after.protosSerialised = 7;
+  after.rowsRead["a"] = 12;
+  after.rowsWritten["c"] = 1;
+
+  const auto diff = after.Since (before);
+  EXPECT_EQ (diff.statementsPrepared, 3);
+  EXPECT_EQ (diff.statementsStepped, 2);
+  EXPECT_EQ (diff.protosParsed, 0);
+  EXPECT_EQ (diff.protosSerialised, 7);
+  EXPECT_EQ (diff.rowsRead, (std::map<std::string, uint64_t> {{"a", 2}}));
+  EXPECT_EQ (diff.rowsWritten, (std::map<std::string, uint64_t> {{"c", 1}}));
+
+  before.Add (diff);
+  EXPECT_EQ (before.statementsPrepared, after.statementsPrepared);
+  EXPECT_EQ (before.statementsStepped, after.statementsStepped);
+  EXPECT_EQ (before.protosSerialised, after.protosSerialised);
+  EXPECT_EQ (before.rowsRead, after.rowsRead);
+  EXPECT_EQ (before.rowsWritten, after.rowsWritten);
+}
+
+TEST_F (PerfCountersTests, PerThread)
+{
+  ++PerfCounters::ForThread ().statementsPrepared;
+  const auto snapshot = PerfCounters::ForThread ();
+
+  std::thread other ([] ()
+    {
+      PerfCounters::ForThread ().statementsPrepared += 10;
+    });
+  other.join ();
+
+  EXPECT_EQ (PerfCounters::ForThread ().Since (snapshot).statementsPrepared,
+             0);
+}
+
+/* ************************************************************************** */
+
+/**
+ * Database result type for the test table.
+ */
+struct TestResult : public Database::ResultType
+{
+  RESULT_COLUMN (int64_t, id, 1);
+  RESULT_COLUMN (pxd::proto::HexCoord, proto, 2);
+};
+
+class DatabasePerfCountersTests : public DBTestFixture
+{
+
+protected:
+
+  DatabasePerfCountersTests ()
+  {
+    auto stmt = db.Prepare (R"(
+      CREATE TABLE `test` (
+        `id` INTEGER PRIMARY KEY,
+        `proto` BLOB NULL
+      )
+    )");
+    stmt.Execute ();
+  }
+
+};
+
+TEST_F (DatabasePerfCountersTests, CountsWork)
+{
+  const auto before = PerfCounters::ForThread ();
+
+  pxd::proto::HexCoord coord;
+  coord.set_x (42);
+  LazyProto<pxd::proto::HexCoord> pb;
+  pb.SetToDefault ();
+  pb.Mutable () = coord;
+
+  auto stmt = db.Prepare (R"(
+    INSERT INTO `test`
+      (`id`, `proto`) VALUES (1, ?1), (2, ?1), (3, ?1)
+  )");
+  stmt.BindProto (1, pb);
+  stmt.Execute ();
+
+  auto stmtDel = db.Prepare (R"(
+    DELETE FROM `test`
+      WHERE `id` = 2
+  )");
+  stmtDel.Execute ();
+
+  auto stmtSel = db.Prepare (R"(
+    SELECT `id`, `proto`
+      FROM `test`
+      ORDER BY `id`
+  )");
+  auto res = stmtSel.Query<TestResult> ();
+  while (res.Step ())
+    {
+      auto p = res.GetProto<TestResult::proto> ();
+      EXPECT_EQ (p.Get ().x (), 42);
+    }
+
+  const auto diff = PerfCounters::ForThread ().Since (before);
+  EXPECT_EQ (diff.statementsPrepared, 3);
+  /* Two executes, plus two steps with rows and the final one without.  */
+  EXPECT_EQ (diff.statementsStepped, 5);
+  EXPECT_EQ (diff.protosSerialised, 1);
+  EXPECT_EQ (diff.protosParsed, 2);
+  EXPECT_EQ (diff.rowsRead, (std::map<std::string, uint64_t> {{"test", 2}}));
+  EXPECT_EQ (diff.rowsWritten,
+             (std::map<std::string, uint64_t> {{"test", 4}}));
+}
+
+/* ************************************************************************** */
+
+} // anonymous namespace
+} // namespace pxd
@@ -1,5 +1,5 @@
 --  GSP for the Taurion blockchain game
---  Copyright (C) 2019-2020  Autonomous Worlds Ltd
+--  Copyright (C) 2019-2021  Autonomous Worlds Ltd
 --
 --  This program is free software: you can redistribute it and/or modify
 --  it under the terms of the GNU General Public License as published by
@@ -114,7 +114,14 @@ CREATE TABLE IF NOT EXISTS `characters` (
   `inventory` BLOB NOT NULL,
 
   -- Additional data encoded as a Character protocol buffer.
-  `proto` BLOB NOT NULL
+  `proto` BLOB NOT NULL,
+
+  -- The character's static combat data (derived from its vehicle and
+  -- fitments) as CombatData proto.  This is split out of the main proto
+  -- so that combat processing does not need to parse e.g. long waypoint
+  -- lists.  The column is last, since it is added to existing databases
+  -- by a migration in SetupDatabaseSchema.
+  `combatdata` BLOB NOT NULL
 
 );
 
@@ -241,6 +248,23 @@ CREATE INDEX IF NOT EXISTS `damage_lists_height` ON `damage_lists` (`height`);
 
 -- =============================================================================
 
+-- The block height up to which HP regeneration has been applied, once
+-- HP are regenerated lazily (after the LazyRegen fork).  At that point,
+-- the stored HP of a fighter are anchored at some height, and the current
+-- value is computed from the anchor and this height when accessed.
+-- The table has at most a single row, which is missing before the fork.
+CREATE TABLE IF NOT EXISTS `lazy_regen` (
+
+  -- Dummy key of the single row, which is always 1.
+  `id` INTEGER PRIMARY KEY,
+
+  -- The block height up to which regeneration is done.
+  `height` INTEGER NOT NULL
+
+);
+
+-- =============================================================================
+
 -- Data stored for the Xaya accounts (names) themselves.
 CREATE TABLE IF NOT EXISTS `accounts` (
 
@@ -496,3 +520,82 @@ CREATE INDEX IF NOT EXISTS `ongoing_operations_by_building`
   ON `ongoing_operations` (`building`);
 
 -- =============================================================================
+
+-- Tracking of changes to entities for clients that synchronise the game
+-- state incrementally (getchangessince).  For each entity that has been
+-- written or deleted, we store the block height of its last change and
+-- whether it has been deleted at that point.  The deletion "tombstones"
+-- are pruned after a configurable number of blocks, and tracking may have
+-- started at different heights on different nodes.  Thus the content of
+-- these tables is not consensus-relevant, and they are excluded from
+-- the state hash.
+--
+-- The tables are keyed like the corresponding entity tables.  The index
+-- on `deleted` and `height` is used both for querying changes and for
+-- pruning old tombstones.
+
+CREATE TABLE IF NOT EXISTS `changes_accounts` (
+  `name` TEXT PRIMARY KEY,
+  `height` INTEGER NOT NULL,
+  `deleted` INTEGER NOT NULL
+);
+
+CREATE INDEX IF NOT EXISTS `changes_accounts_by_height`
+  ON `changes_accounts` (`deleted`, `height`);
+
+CREATE TABLE IF NOT EXISTS `changes_buildings` (
+  `id` INTEGER PRIMARY KEY,
+  `height` INTEGER NOT NULL,
+  `deleted` INTEGER NOT NULL
+);
+
+CREATE INDEX IF NOT EXISTS `changes_buildings_by_height`
+  ON `changes_buildings` (`deleted`, `height`);
+
+CREATE TABLE IF NOT EXISTS `changes_characters` (
+  `id` INTEGER PRIMARY KEY,
+  `height` INTEGER NOT NULL,
+  `deleted` INTEGER NOT NULL
+);
+
+CREATE INDEX IF NOT EXISTS `changes_characters_by_height`
+  ON `changes_characters` (`deleted`, `height`);
+
+-- For ground loot, "deleted" means that the tile has become empty.
+CREATE TABLE IF NOT EXISTS `changes_ground_loot` (
+  `x` INTEGER NOT NULL,
+  `y` INTEGER NOT NULL,
+  `height` INTEGER NOT NULL,
+  `deleted` INTEGER NOT NULL,
+  PRIMARY KEY (`x`, `y`)
+);
+
+CREATE INDEX IF NOT EXISTS `changes_ground_loot_by_height`
+  ON `changes_ground_loot` (`deleted`, `height`);
+
+CREATE TABLE IF NOT EXISTS `changes_ongoing_operations` (
+  `id` INTEGER PRIMARY KEY,
+  `height` INTEGER NOT NULL,
+  `deleted` INTEGER NOT NULL
+);
+
+CREATE INDEX IF NOT EXISTS `changes_ongoing_operations_by_height`
+  ON `changes_ongoing_operations` (`deleted`, `height`);
+
+-- =============================================================================
+
+-- Incrementally maintained hashes of the game-state tables, updated by
+-- triggers on each table (see statehash.hpp).  The table intentionally has
+-- no primary key, so that the SQLite session extension (used by libxayagame
+-- for undo data) ignores it.  When blocks are undone, the triggers fire for
+-- the restored rows and update the hashes instead.
+--
+-- `columns` holds the column names of the table as of when the triggers were
+-- created, so that they can be updated after schema changes.
+CREATE TABLE IF NOT EXISTS `statehash_tables` (
+  `name` TEXT NOT NULL UNIQUE,
+  `columns` TEXT NOT NULL,
+  `hash` BLOB NOT NULL
+);
+
+-- =============================================================================
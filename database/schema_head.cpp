@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -18,9 +18,95 @@
 
 #include "schema.hpp"
 
+#include "statehash.hpp"
+
+#include "proto/character.pb.h"
+
+#include <glog/logging.h>
+
+#include <sqlite3.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
 namespace pxd
 {
 namespace
 {
 
+/**
+ * Returns true if the given table has a column with the given name.
+ */
+bool
+HasColumn (xaya::SQLiteDatabase& db, const std::string& table,
+           const std::string& column)
+{
+  auto stmt = db.Prepare ("PRAGMA table_info(`" + table + "`)");
+  while (stmt.Step ())
+    if (stmt.Get<std::string> (1) == column)
+      return true;
+
+  return false;
+}
+
+/**
+ * Migrates a database from before the character combat data was split
+ * into its own column:  The column is added, and the combat data moved
+ * there from the main proto of each character.
+ */
+void
+MigrateCharacterCombatData (xaya::SQLiteDatabase& db)
+{
+  if (HasColumn (db, "characters", "combatdata"))
+    return;
+
+  LOG (INFO) << "Moving character combat data to a separate column...";
+  db.Execute (R"(
+    SAVEPOINT `pxd-migration`;
+    ALTER TABLE `characters`
+      ADD COLUMN `combatdata` BLOB NOT NULL DEFAULT x'';
+  )");
+
+  std::vector<std::pair<int64_t, proto::Character>> toUpdate;
+  {
+    auto stmt = db.Prepare (R"(
+      SELECT `id`, `proto` FROM `characters` ORDER BY `id`
+    )");
+    while (stmt.Step ())
+      {
+        const auto* blob = sqlite3_column_blob (stmt.ro (), 1);
+        const int len = sqlite3_column_bytes (stmt.ro (), 1);
+
+        proto::Character pb;
+        CHECK (pb.ParseFromArray (blob, len));
+        if (pb.has_combat_data ())
+          toUpdate.emplace_back (stmt.Get<int64_t> (0), std::move (pb));
+      }
+  }
+
+  auto stmt = db.Prepare (R"(
+    UPDATE `characters`
+      SET `proto` = ?2, `combatdata` = ?3
+      WHERE `id` = ?1
+  )");
+  for (auto& entry : toUpdate)
+    {
+      std::string combatData;
+      CHECK (entry.second.combat_data ().SerializeToString (&combatData));
+      entry.second.clear_combat_data ();
+      std::string data;
+      CHECK (entry.second.SerializeToString (&data));
+
+      stmt.Reset ();
+      stmt.Bind (1, entry.first);
+      stmt.BindBlob (2, data);
+      stmt.BindBlob (3, combatData);
+      stmt.Execute ();
+    }
+
+  db.Execute ("RELEASE `pxd-migration`");
+  LOG (INFO) << "Migrated " << toUpdate.size () << " characters";
+}
+
 constexpr const char* SCHEMA_SQL = R"(
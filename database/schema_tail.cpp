@@ -6,6 +6,8 @@ void
 SetupDatabaseSchema (xaya::SQLiteDatabase& db)
 {
   db.Execute (SCHEMA_SQL);
+  MigrateCharacterCombatData (db);
+  SetupIncrementalStateHash (db);
 }
 
 } // namespace pxd
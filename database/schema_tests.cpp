@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -16,18 +16,88 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+/* We need the session extension to construct undo data like libxayagame
+   does.  This must be defined before sqlite3.h is included anywhere.  */
+#define SQLITE_ENABLE_SESSION
+#define SQLITE_ENABLE_PREUPDATE_HOOK
+
 #include "schema.hpp"
 
+#include "character.hpp"
 #include "dbtest.hpp"
 
+#include "proto/character.pb.h"
+
+#include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include <sqlite3.h>
+
+#include <string>
+
 namespace pxd
 {
 namespace
 {
 
-using SchemaTests = DBTestFixture;
+class SchemaTests : public DBTestFixture
+{
+
+protected:
+
+  /**
+   * Simulates a database from before the split of the combat data, by
+   * recreating the characters table without that column.
+   */
+  void
+  RevertCombatDataColumn ()
+  {
+    (*db).Execute (R"(
+      CREATE TABLE `old_characters` (
+        `id` INTEGER PRIMARY KEY,
+        `owner`, `x`, `y`, `inbuilding`, `enterbuilding`,
+        `volatilemv`, `hp`, `regendata`, `target`, `friendlytargets`,
+        `effects`, `faction`, `ismoving`, `ismining`, `attackrange`,
+        `friendlyrange`, `canregen`, `inventory`, `proto`
+      );
+      INSERT INTO `old_characters`
+        SELECT `id`, `owner`, `x`, `y`, `inbuilding`, `enterbuilding`,
+               `volatilemv`, `hp`, `regendata`, `target`, `friendlytargets`,
+               `effects`, `faction`, `ismoving`, `ismining`, `attackrange`,
+               `friendlyrange`, `canregen`, `inventory`, `proto`
+          FROM `characters`;
+      DROP TABLE `characters`;
+      ALTER TABLE `old_characters` RENAME TO `characters`;
+    )");
+  }
+
+  /**
+   * Inserts a character in the pre-migration format, with the given
+   * main proto (possibly including combat data).
+   */
+  void
+  InsertLegacyCharacter (const Database::IdT id, const proto::Character& pb)
+  {
+    auto stmt = (*db).Prepare (R"(
+      INSERT INTO `characters`
+        (`id`, `owner`, `x`, `y`, `volatilemv`, `hp`, `regendata`,
+         `friendlytargets`, `faction`, `ismoving`, `ismining`, `canregen`,
+         `inventory`, `proto`, `attackrange`)
+        VALUES (?1, 'domob', 0, 0, x'', x'', x'', 0, 1, 0, 0, 0, x'', ?2, ?3)
+    )");
+
+    std::string data;
+    CHECK (pb.SerializeToString (&data));
+    stmt.Bind (1, id);
+    stmt.BindBlob (2, data);
+    if (pb.combat_data ().attacks_size () > 0)
+      stmt.Bind (3, pb.combat_data ().attacks (0).range ());
+    else
+      stmt.BindNull (3);
+    stmt.Execute ();
+  }
+
+};
 
 TEST_F (SchemaTests, Works)
 {
@@ -40,5 +110,112 @@ TEST_F (SchemaTests, TwiceIsOk)
   SetupDatabaseSchema (*db);
 }
 
+TEST_F (SchemaTests, CharacterCombatDataMigration)
+{
+  SetupDatabaseSchema (*db);
+  RevertCombatDataColumn ();
+
+  proto::Character withCombat;
+  withCombat.set_speed (42);
+  withCombat.mutable_combat_data ()->add_attacks ()->set_range (5);
+  InsertLegacyCharacter (1, withCombat);
+
+  proto::Character withoutCombat;
+  withoutCombat.set_speed (10);
+  InsertLegacyCharacter (2, withoutCombat);
+
+  SetupDatabaseSchema (*db);
+
+  CharacterTable tbl(db);
+  auto c = tbl.GetById (1);
+  EXPECT_EQ (c->GetProto ().speed (), 42);
+  EXPECT_FALSE (c->GetProto ().has_combat_data ());
+  ASSERT_EQ (c->GetCombatData ().attacks_size (), 1);
+  EXPECT_EQ (c->GetCombatData ().attacks (0).range (), 5);
+  c.reset ();
+
+  c = tbl.GetById (2);
+  EXPECT_EQ (c->GetProto ().speed (), 10);
+  EXPECT_EQ (c->GetCombatData ().attacks_size (), 0);
+}
+
+/**
+ * Callback for sqlite3changeset_apply that aborts on any conflict.
+ */
+int
+AbortOnConflict (void* ctx, const int type, sqlite3_changeset_iter* iter)
+{
+  LOG (FATAL) << "Conflict applying changeset: " << type;
+  return SQLITE_CHANGESET_ABORT;
+}
+
+TEST_F (SchemaTests, CombatDataFromPreMigrationUndo)
+{
+  SetupDatabaseSchema (*db);
+  RevertCombatDataColumn ();
+
+  proto::Character pb;
+  pb.set_speed (42);
+  pb.mutable_combat_data ()->add_attacks ()->set_range (5);
+  InsertLegacyCharacter (1, pb);
+
+  /* Record undo data (in the way libxayagame does) for a block before the
+     migration, in which the character is killed.  */
+  sqlite3* handle;
+  {
+    auto stmt = (*db).Prepare ("SELECT 1");
+    handle = sqlite3_db_handle (*stmt);
+  }
+
+  sqlite3_session* session;
+  ASSERT_EQ (sqlite3session_create (handle, "main", &session), SQLITE_OK);
+  ASSERT_EQ (sqlite3session_attach (session, nullptr), SQLITE_OK);
+  (*db).Execute ("DELETE FROM `characters` WHERE `id` = 1");
+
+  int changesetSize, undoSize;
+  void* changeset;
+  void* undo;
+  ASSERT_EQ (sqlite3session_changeset (session, &changesetSize, &changeset),
+             SQLITE_OK);
+  sqlite3session_delete (session);
+  ASSERT_EQ (sqlite3changeset_invert (changesetSize, changeset,
+                                      &undoSize, &undo),
+             SQLITE_OK);
+  sqlite3_free (changeset);
+
+  /* Migrate the database, and then detach the block by applying the
+     undo data from before the migration.  */
+  SetupDatabaseSchema (*db);
+  ASSERT_EQ (sqlite3changeset_apply (handle, undoSize, undo, nullptr,
+                                     &AbortOnConflict, nullptr),
+             SQLITE_OK);
+  sqlite3_free (undo);
+
+  CharacterTable tbl(db);
+  auto c = tbl.GetById (1);
+  EXPECT_EQ (c->GetProto ().speed (), 42);
+  EXPECT_FALSE (c->GetProto ().has_combat_data ());
+  ASSERT_EQ (c->GetCombatData ().attacks_size (), 1);
+  EXPECT_EQ (c->GetCombatData ().attacks (0).range (), 5);
+  EXPECT_EQ (c->GetAttackRange (false), 5);
+
+  /* When the character is written back, it is stored in the new form.  */
+  c->MutableProto ().set_speed (43);
+  c.reset ();
+
+  auto stmt = (*db).Prepare (R"(
+    SELECT `proto`, LENGTH (`combatdata`)
+      FROM `characters`
+      WHERE `id` = 1
+  )");
+  ASSERT_TRUE (stmt.Step ());
+  proto::Character stored;
+  CHECK (stored.ParseFromArray (sqlite3_column_blob (stmt.ro (), 0),
+                                sqlite3_column_bytes (stmt.ro (), 0)));
+  EXPECT_EQ (stored.speed (), 43);
+  EXPECT_FALSE (stored.has_combat_data ());
+  EXPECT_GT (stmt.Get<int> (1), 0);
+}
+
 } // anonymous namespace
 } // namespace pxd
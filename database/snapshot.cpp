@@ -0,0 +1,699 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "snapshot.hpp"
+
+#include "schema.hpp"
+#include "statehash.hpp"
+
+#include <glog/logging.h>
+
+#include <sqlite3.h>
+
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace pxd
+{
+
+namespace
+{
+
+/** Magic string at the start of snapshot files.  */
+const std::string MAGIC = "taurion-snapshot";
+
+/** Version of the snapshot format.  */
+constexpr uint64_t VERSION = 1;
+
+/**
+ * Upper limit for the length of strings and blobs we accept when reading
+ * a snapshot.  This prevents huge allocations for malformed data.
+ */
+constexpr uint64_t MAX_BYTES_LENGTH = 1 << 30;
+
+/* Markers for the records in the snapshot stream.  */
+constexpr char RECORD_TABLE = 'T';
+constexpr char RECORD_ROW = 'R';
+constexpr char RECORD_TABLE_END = 'E';
+constexpr char RECORD_SCHEMA = 'S';
+constexpr char RECORD_END = 'Z';
+
+/**
+ * Helper class for writing the binary encoding of a snapshot.
+ */
+class SnapshotWriter
+{
+
+private:
+
+  /** The stream we write to.  */
+  std::ostream& out;
+
+public:
+
+  explicit SnapshotWriter (std::ostream& o)
+    : out(o)
+  {}
+
+  SnapshotWriter () = delete;
+  SnapshotWriter (const SnapshotWriter&) = delete;
+  void operator= (const SnapshotWriter&) = delete;
+
+  void
+  WriteByte (const char val)
+  {
+    out.put (val);
+  }
+
+  /**
+   * Writes an integer as fixed-length big-endian byte string.
+   */
+  void
+  WriteInt (const uint64_t val)
+  {
+    for (size_t i = 0; i < sizeof (val); ++i)
+      WriteByte (static_cast<char> ((val >> (8 * (sizeof (val) - 1 - i)))
+                                      & 0xFF));
+  }
+
+  /**
+   * Writes a variable-length string with a length prefix.
+   */
+  void
+  WriteBytes (const std::string& data)
+  {
+    WriteInt (data.size ());
+    out.write (data.data (), data.size ());
+  }
+
+  void
+  WriteHash (const xaya::uint256& val)
+  {
+    out.write (reinterpret_cast<const char*> (val.GetBlobData ()),
+               xaya::uint256::NUM_BYTES);
+  }
+
+  /**
+   * Writes the value of the given column in the current row
+   * of a statement.
+   */
+  void
+  WriteColumn (sqlite3_stmt* stmt, const int i)
+  {
+    const int type = sqlite3_column_type (stmt, i);
+    WriteByte (static_cast<char> (type));
+    switch (type)
+      {
+      case SQLITE_NULL:
+        break;
+
+      case SQLITE_INTEGER:
+        WriteInt (sqlite3_column_int64 (stmt, i));
+        break;
+
+      case SQLITE_FLOAT:
+        {
+          const double val = sqlite3_column_double (stmt, i);
+          uint64_t bits;
+          static_assert (sizeof (bits) == sizeof (val),
+                         "unexpected size of double");
+          std::memcpy (&bits, &val, sizeof (val));
+          WriteInt (bits);
+          break;
+        }
+
+      case SQLITE_TEXT:
+      case SQLITE_BLOB:
+        {
+          const auto* data
+              = static_cast<const char*> (sqlite3_column_blob (stmt, i));
+          const int len = sqlite3_column_bytes (stmt, i);
+          WriteBytes (std::string (data, len));
+          break;
+        }
+
+      default:
+        LOG (FATAL) << "Unexpected SQLite column type: " << type;
+      }
+  }
+
+};
+
+/**
+ * Helper class for reading back the binary encoding of a snapshot.
+ * All methods return false if the data is truncated or invalid.
+ */
+class SnapshotReader
+{
+
+private:
+
+  /** The stream we read from.  */
+  std::istream& in;
+
+public:
+
+  explicit SnapshotReader (std::istream& i)
+    : in(i)
+  {}
+
+  SnapshotReader () = delete;
+  SnapshotReader (const SnapshotReader&) = delete;
+  void operator= (const SnapshotReader&) = delete;
+
+  bool
+  ReadByte (char& val)
+  {
+    return static_cast<bool> (in.get (val));
+  }
+
+  bool
+  ReadInt (uint64_t& val)
+  {
+    val = 0;
+    for (size_t i = 0; i < sizeof (val); ++i)
+      {
+        char c;
+        if (!ReadByte (c))
+          return false;
+        val = (val << 8) | static_cast<unsigned char> (c);
+      }
+    return true;
+  }
+
+  bool
+  ReadBytes (std::string& data)
+  {
+    uint64_t len;
+    if (!ReadInt (len) || len > MAX_BYTES_LENGTH)
+      return false;
+
+    data.resize (len);
+    return len == 0 || static_cast<bool> (in.read (&data[0], len));
+  }
+
+  bool
+  ReadHash (xaya::uint256& val)
+  {
+    unsigned char data[xaya::uint256::NUM_BYTES];
+    if (!in.read (reinterpret_cast<char*> (data), sizeof (data)))
+      return false;
+    val.FromBlob (data);
+    return true;
+  }
+
+  /**
+   * Reads a column value and binds it to the given parameter
+   * of a statement.
+   */
+  bool
+  ReadAndBind (sqlite3_stmt* stmt, const int i)
+  {
+    char type;
+    if (!ReadByte (type))
+      return false;
+
+    int rc;
+    switch (type)
+      {
+      case SQLITE_NULL:
+        rc = sqlite3_bind_null (stmt, i);
+        break;
+
+      case SQLITE_INTEGER:
+        {
+          uint64_t val;
+          if (!ReadInt (val))
+            return false;
+          rc = sqlite3_bind_int64 (stmt, i, static_cast<int64_t> (val));
+          break;
+        }
+
+      case SQLITE_FLOAT:
+        {
+          uint64_t bits;
+          if (!ReadInt (bits))
+            return false;
+          double val;
+          std::memcpy (&val, &bits, sizeof (val));
+          rc = sqlite3_bind_double (stmt, i, val);
+          break;
+        }
+
+      case SQLITE_TEXT:
+      case SQLITE_BLOB:
+        {
+          std::string data;
+          if (!ReadBytes (data))
+            return false;
+          if (type == SQLITE_TEXT)
+            rc = sqlite3_bind_text (stmt, i, data.data (), data.size (),
+                                    SQLITE_TRANSIENT);
+          else
+            rc = sqlite3_bind_blob (stmt, i, data.data (), data.size (),
+                                    SQLITE_TRANSIENT);
+          break;
+        }
+
+      default:
+        LOG (WARNING) << "Invalid column type in snapshot: "
+                      << static_cast<int> (type);
+        return false;
+      }
+
+    CHECK_EQ (rc, SQLITE_OK);
+    return true;
+  }
+
+};
+
+/**
+ * Returns the block hash stored by libxayagame as current state, or
+ * an empty string if there is none.
+ */
+std::string
+GetCurrentBlock (Database& db)
+{
+  auto check = (*db).PrepareRo (R"(
+    SELECT COUNT (*)
+      FROM `sqlite_master`
+      WHERE `type` = 'table' AND `name` = 'xayagame_current'
+  )");
+  CHECK (check.Step ());
+  if (check.Get<int64_t> (0) == 0)
+    return "";
+
+  auto stmt = (*db).PrepareRo (R"(
+    SELECT `value`
+      FROM `xayagame_current`
+      WHERE `key` = 'blockhash'
+  )");
+  if (!stmt.Step ())
+    return "";
+
+  CHECK_EQ (sqlite3_column_bytes (stmt.ro (), 0),
+            static_cast<int> (xaya::uint256::NUM_BYTES));
+  xaya::uint256 hash;
+  hash.FromBlob (static_cast<const unsigned char*> (
+      sqlite3_column_blob (stmt.ro (), 0)));
+
+  return hash.ToHex ();
+}
+
+/**
+ * Returns the number of columns of a table.
+ */
+size_t
+GetNumColumns (Database& db, const std::string& table)
+{
+  auto stmt = (*db).PrepareRo ("PRAGMA table_info(`" + table + "`)");
+  size_t res = 0;
+  while (stmt.Step ())
+    ++res;
+  return res;
+}
+
+/** Prefix of the names of the internal tables of libxayagame.  */
+const std::string XAYAGAME_PREFIX = "xayagame_";
+
+/**
+ * Returns the SQL of all schema objects in the database (except for the
+ * internal ones of SQLite itself), keyed by name.
+ */
+std::map<std::string, std::string>
+GetSchemaObjects (Database& db)
+{
+  auto stmt = (*db).PrepareRo (R"(
+    SELECT `name`, `sql`
+      FROM `sqlite_master`
+      WHERE `name` NOT LIKE 'sqlite\_%' ESCAPE '\'
+  )");
+
+  std::map<std::string, std::string> res;
+  while (stmt.Step ())
+    res.emplace (stmt.Get<std::string> (0), stmt.Get<std::string> (1));
+
+  return res;
+}
+
+/**
+ * Executes a schema statement read from a snapshot, if it is one of the
+ * allowed kinds (as per the given prefixes).  Returns false otherwise.
+ */
+bool
+ExecuteSchemaSql (Database& db, const std::string& sql,
+                  const std::vector<std::string>& allowedPrefixes)
+{
+  bool allowed = false;
+  for (const auto& prefix : allowedPrefixes)
+    if (sql.compare (0, prefix.size (), prefix) == 0)
+      allowed = true;
+
+  if (!allowed)
+    {
+      LOG (WARNING) << "Invalid schema statement in snapshot: " << sql;
+      return false;
+    }
+
+  /* Prepare only compiles the first statement of the string, so that
+     nothing else can be smuggled in.  */
+  auto stmt = (*db).Prepare (sql);
+  stmt.Execute ();
+
+  return true;
+}
+
+/**
+ * Verifies that all schema objects in the database after importing are
+ * either those of our game schema, or tables and indices for the
+ * internal tables of libxayagame.
+ */
+bool
+VerifyImportedSchema (Database& db,
+                      const std::map<std::string, std::string>& gameSchema)
+{
+  auto stmt = (*db).PrepareRo (R"(
+    SELECT `type`, `name`, `tbl_name`
+      FROM `sqlite_master`
+      WHERE `name` NOT LIKE 'sqlite\_%' ESCAPE '\'
+  )");
+  while (stmt.Step ())
+    {
+      const auto type = stmt.Get<std::string> (0);
+      const auto name = stmt.Get<std::string> (1);
+      const auto table = stmt.Get<std::string> (2);
+
+      if (gameSchema.count (name) > 0)
+        continue;
+
+      if ((type == "table" || type == "index")
+            && table.compare (0, XAYAGAME_PREFIX.size (), XAYAGAME_PREFIX) == 0)
+        continue;
+
+      LOG (WARNING)
+          << "Snapshot contains unexpected " << type << " " << name
+          << " on table " << table;
+      return false;
+    }
+
+  return true;
+}
+
+/**
+ * Reads the snapshot data after the header and inserts it into
+ * the database.
+ */
+bool
+ReadSnapshotData (SnapshotReader& reader, Database& db,
+                  const std::map<std::string, std::string>& gameSchema,
+                  SnapshotInfo& info)
+{
+  while (true)
+    {
+      char record;
+      if (!reader.ReadByte (record))
+        return false;
+
+      switch (record)
+        {
+        case RECORD_END:
+          return true;
+
+        case RECORD_SCHEMA:
+          {
+            std::string sql;
+            if (!reader.ReadBytes (sql))
+              return false;
+
+            /* Indices of the game schema have been created already.  Other
+               than those, only indices (on the libxayagame tables, as
+               verified at the end) are allowed.  */
+            bool known = false;
+            for (const auto& entry : gameSchema)
+              if (entry.second == sql)
+                known = true;
+
+            if (!known
+                  && !ExecuteSchemaSql (db, sql, {"CREATE INDEX ",
+                                                  "CREATE UNIQUE INDEX "}))
+              return false;
+            break;
+          }
+
+        case RECORD_TABLE:
+          {
+            std::string name, sql;
+            uint64_t numColumns;
+            if (!reader.ReadBytes (name) || !reader.ReadBytes (sql)
+                  || !reader.ReadInt (numColumns))
+              return false;
+
+            /* Tables of the game schema have been created already (and
+               may have a different SQL in the snapshot, e.g. due to
+               migrations).  Other than those, only the internal tables
+               of libxayagame are allowed.  */
+            if (gameSchema.count (name) == 0
+                  && (name.compare (0, XAYAGAME_PREFIX.size (),
+                                    XAYAGAME_PREFIX) != 0
+                        || !ExecuteSchemaSql (db, sql, {"CREATE TABLE "})))
+              {
+                LOG (WARNING) << "Unexpected table in snapshot: " << name;
+                return false;
+              }
+
+            /* SetupDatabaseSchema may have inserted some initial data,
+               which is replaced by the one from the snapshot.  */
+            if (gameSchema.count (name) > 0)
+              (*db).Execute ("DELETE FROM `" + name + "`");
+
+            if (numColumns == 0 || GetNumColumns (db, name) != numColumns)
+              {
+                LOG (WARNING)
+                    << "Column count mismatch for table " << name
+                    << " in snapshot";
+                return false;
+              }
+
+            std::ostringstream insertSql;
+            insertSql << "INSERT INTO `" << name << "` VALUES (";
+            for (size_t i = 1; i <= numColumns; ++i)
+              {
+                if (i > 1)
+                  insertSql << ", ";
+                insertSql << '?' << i;
+              }
+            insertSql << ")";
+            auto stmt = (*db).Prepare (insertSql.str ());
+
+            uint64_t rows = 0;
+            while (true)
+              {
+                if (!reader.ReadByte (record))
+                  return false;
+                if (record != RECORD_ROW)
+                  break;
+
+                stmt.Reset ();
+                for (size_t i = 1; i <= numColumns; ++i)
+                  if (!reader.ReadAndBind (*stmt, i))
+                    return false;
+                stmt.Execute ();
+                ++rows;
+              }
+
+            uint64_t expectedRows;
+            xaya::uint256 expectedHash;
+            if (record != RECORD_TABLE_END || !reader.ReadInt (expectedRows)
+                  || !reader.ReadHash (expectedHash))
+              return false;
+
+            if (rows != expectedRows)
+              {
+                LOG (WARNING)
+                    << "Snapshot has " << rows << " rows for table " << name
+                    << ", expected " << expectedRows;
+                return false;
+              }
+
+            const auto hash = ComputeTableHash (db, name);
+            if (hash != expectedHash)
+              {
+                LOG (WARNING)
+                    << "Hash mismatch for table " << name << " in snapshot:"
+                    << "\n  Expected: " << expectedHash.ToHex ()
+                    << "\n  Actual:   " << hash.ToHex ();
+                return false;
+              }
+
+            VLOG (1) << "Imported " << rows << " rows into " << name;
+            info.tableHashes.emplace (name, hash);
+            break;
+          }
+
+        default:
+          LOG (WARNING) << "Invalid record in snapshot: "
+                        << static_cast<int> (record);
+          return false;
+        }
+    }
+}
+
+} // anonymous namespace
+
+void
+ExportSnapshot (Database& db, std::ostream& out)
+{
+  /* All data must come from the same state, even if the database is
+     written to concurrently (e.g. by a running tauriond).  Thus we do
+     everything inside a read transaction.  A savepoint is used, so that
+     this also works if the caller has a transaction open already.  */
+  (*db).Execute ("SAVEPOINT `pxd-export`");
+
+  SnapshotWriter writer(out);
+  writer.WriteBytes (MAGIC);
+  writer.WriteInt (VERSION);
+  writer.WriteBytes (GetCurrentBlock (db));
+
+  /* Tables are written first, and all other schema objects (i.e. mostly
+     indices) afterwards.  That way, the import does not need to
+     update indices for every row inserted.  */
+
+  auto tables = (*db).PrepareRo (R"(
+    SELECT `name`, `sql`
+      FROM `sqlite_master`
+      WHERE `type` = 'table'
+        AND `name` NOT LIKE 'sqlite\_%' ESCAPE '\'
+      ORDER BY `name`
+  )");
+  while (tables.Step ())
+    {
+      const auto name = tables.Get<std::string> (0);
+      const size_t numColumns = GetNumColumns (db, name);
+
+      writer.WriteByte (RECORD_TABLE);
+      writer.WriteBytes (name);
+      writer.WriteBytes (tables.Get<std::string> (1));
+      writer.WriteInt (numColumns);
+
+      auto stmt = (*db).PrepareRo ("SELECT * FROM `" + name + "`");
+      uint64_t rows = 0;
+      while (stmt.Step ())
+        {
+          writer.WriteByte (RECORD_ROW);
+          for (size_t i = 0; i < numColumns; ++i)
+            writer.WriteColumn (stmt.ro (), i);
+          ++rows;
+        }
+
+      writer.WriteByte (RECORD_TABLE_END);
+      writer.WriteInt (rows);
+      writer.WriteHash (ComputeTableHash (db, name));
+
+      VLOG (1) << "Exported " << rows << " rows from " << name;
+    }
+
+  auto schema = (*db).PrepareRo (R"(
+    SELECT `sql`
+      FROM `sqlite_master`
+      WHERE `type` != 'table' AND `sql` IS NOT NULL
+        AND `name` NOT LIKE 'sqlite\_%' ESCAPE '\'
+      ORDER BY `type`, `name`
+  )");
+  while (schema.Step ())
+    {
+      writer.WriteByte (RECORD_SCHEMA);
+      writer.WriteBytes (schema.Get<std::string> (0));
+    }
+
+  writer.WriteByte (RECORD_END);
+  CHECK (out) << "Failed to write snapshot";
+
+  (*db).Execute (R"(
+    ROLLBACK TO `pxd-export`;
+    RELEASE `pxd-export`;
+  )");
+}
+
+bool
+ImportSnapshot (std::istream& in, Database& db, SnapshotInfo& info)
+{
+  {
+    auto stmt = (*db).PrepareRo (R"(
+      SELECT COUNT (*)
+        FROM `sqlite_master`
+        WHERE `name` NOT LIKE 'sqlite\_%' ESCAPE '\'
+    )");
+    CHECK (stmt.Step ());
+    CHECK_EQ (stmt.Get<int64_t> (0), 0)
+        << "Snapshots can only be imported into an empty database";
+  }
+
+  SnapshotReader reader(in);
+
+  std::string magic;
+  uint64_t version;
+  if (!reader.ReadBytes (magic) || magic != MAGIC
+        || !reader.ReadInt (version))
+    {
+      LOG (WARNING) << "Data is not a Taurion state snapshot";
+      return false;
+    }
+  if (version != VERSION)
+    {
+      LOG (WARNING) << "Unsupported snapshot version: " << version;
+      return false;
+    }
+
+  info = SnapshotInfo ();
+  if (!reader.ReadBytes (info.block))
+    return false;
+
+  /* The game schema is set up as usual, and the snapshot can only provide
+     data for it.  This ensures that it cannot contain anything else (like
+     triggers) that would then be run by tauriond.  */
+  (*db).Execute ("SAVEPOINT `pxd-snapshot`");
+  SetupDatabaseSchema (*db);
+  const auto gameSchema = GetSchemaObjects (db);
+
+  if (!ReadSnapshotData (reader, db, gameSchema, info)
+        || !VerifyImportedSchema (db, gameSchema))
+    {
+      LOG (WARNING) << "Failed to import snapshot, rolling back";
+      (*db).Execute (R"(
+        ROLLBACK TO `pxd-snapshot`;
+        RELEASE `pxd-snapshot`;
+      )");
+      return false;
+    }
+
+  /* The incremental hashes are not verified against the data, so a snapshot
+     could make them (and thus the state hashes reported by tauriond)
+     inconsistent with the actual state.  Clear them, so that they are
+     recomputed from the imported tables when tauriond starts.  */
+  (*db).Execute ("DELETE FROM `statehash_tables`");
+  (*db).Execute ("RELEASE `pxd-snapshot`");
+
+  LOG (INFO)
+      << "Imported snapshot with " << info.tableHashes.size ()
+      << " tables at block " << info.block;
+  return true;
+}
+
+} // namespace pxd
@@ -0,0 +1,87 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATABASE_SNAPSHOT_HPP
+#define DATABASE_SNAPSHOT_HPP
+
+#include "database.hpp"
+
+#include <xayautil/uint256.hpp>
+
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace pxd
+{
+
+/**
+ * Basic data about a state snapshot, as read back when importing it.
+ */
+struct SnapshotInfo
+{
+
+  /**
+   * The block hash (as hex) the snapshot is for, as recorded by libxayagame
+   * in the database.  Empty if the database had no current block.
+   */
+  std::string block;
+
+  /** The content hash of each table in the snapshot.  */
+  std::map<std::string, xaya::uint256> tableHashes;
+
+};
+
+/**
+ * Writes a snapshot of the full database (all tables including the internal
+ * ones of libxayagame, as well as the indices) in a compact binary format
+ * to the given stream.  Each table is followed by its content hash
+ * as per ComputeTableHash, so that the data can be verified on import.
+ *
+ * The snapshot can be loaded into a fresh data directory, from where
+ * tauriond will continue syncing at the snapshot's block instead of
+ * processing the whole chain from the initial state.
+ *
+ * All data is read within a single transaction, so that the snapshot is
+ * consistent even if the database is modified concurrently through
+ * another connection.
+ */
+void ExportSnapshot (Database& db, std::ostream& out);
+
+/**
+ * Loads a snapshot written by ExportSnapshot into the given database,
+ * which must be empty.  The content hash of each table is recomputed
+ * after inserting the data and compared to the one stored in the snapshot.
+ *
+ * The schema is set up with SetupDatabaseSchema rather than taken from the
+ * snapshot.  Besides data for it, the snapshot may only contain tables and
+ * indices for the internal tables of libxayagame.  Their data (e.g. undo
+ * data) is taken as-is, as it is not part of the state hash.
+ *
+ * The incrementally maintained hashes in statehash_tables are not
+ * trusted and cleared after the import, so that tauriond recomputes them
+ * from the imported data.
+ *
+ * Returns false if the data is malformed or a hash does not match.
+ * In that case, all changes to the database are rolled back.
+ */
+bool ImportSnapshot (std::istream& in, Database& db, SnapshotInfo& info);
+
+} // namespace pxd
+
+#endif // DATABASE_SNAPSHOT_HPP
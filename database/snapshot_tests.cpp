@@ -0,0 +1,320 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "snapshot.hpp"
+
+#include "dbtest.hpp"
+#include "schema.hpp"
+#include "statehash.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+
+namespace pxd
+{
+namespace
+{
+
+class SnapshotTests : public testing::Test
+{
+
+protected:
+
+  /** The database we export from.  */
+  TestDatabase source;
+
+  /** The database we import into.  */
+  TestDatabase target;
+
+  SnapshotTests ()
+  {
+    SetupDatabaseSchema (*source);
+
+    Exec (source, R"(
+      CREATE TABLE `xayagame_current` (
+        `key` TEXT PRIMARY KEY,
+        `value` BLOB NOT NULL
+      )
+    )");
+    Exec (source, R"(
+      CREATE TABLE `xayagame_undo` (
+        `hash` BLOB PRIMARY KEY,
+        `data` BLOB NOT NULL,
+        `height` INTEGER NOT NULL
+      )
+    )");
+    Exec (source, R"(
+      CREATE INDEX `xayagame_undo_height` ON `xayagame_undo` (`height`)
+    )");
+
+    Exec (source, R"(
+      INSERT INTO `accounts` (`name`, `faction`, `proto`)
+        VALUES ('hello world', 1, x'00ff'), ('domob', NULL, x'')
+    )");
+    Exec (source, R"(
+      INSERT INTO `xayagame_undo` (`hash`, `data`, `height`)
+        VALUES (x'01', x'1234', 10), (x'02', x'', 11)
+    )");
+  }
+
+  /**
+   * Executes an SQL statement on the given database.
+   */
+  static void
+  Exec (Database& db, const std::string& sql)
+  {
+    auto stmt = db.Prepare (sql);
+    stmt.Execute ();
+  }
+
+  /**
+   * Exports the source database and returns the snapshot data.
+   */
+  std::string
+  Export ()
+  {
+    std::ostringstream out;
+    ExportSnapshot (source, out);
+    return out.str ();
+  }
+
+  /**
+   * Imports the given data into the target database.
+   */
+  bool
+  Import (const std::string& data, SnapshotInfo& info)
+  {
+    std::istringstream in(data);
+    return ImportSnapshot (in, target, info);
+  }
+
+  /**
+   * Returns the number of schema objects (tables and indices)
+   * in the given database.
+   */
+  static int
+  CountSchema (Database& db)
+  {
+    auto stmt = (*db).PrepareRo (R"(
+      SELECT COUNT (*)
+        FROM `sqlite_master`
+        WHERE `name` NOT LIKE 'sqlite\_%' ESCAPE '\'
+    )");
+    CHECK (stmt.Step ());
+    return stmt.Get<int64_t> (0);
+  }
+
+  int
+  CountTargetSchema ()
+  {
+    return CountSchema (target);
+  }
+
+  /**
+   * Returns the number of tables in the source database.
+   */
+  int
+  CountSourceTables ()
+  {
+    auto stmt = (*source).PrepareRo (R"(
+      SELECT COUNT (*)
+        FROM `sqlite_master`
+        WHERE `type` = 'table' AND `name` NOT LIKE 'sqlite\_%' ESCAPE '\'
+    )");
+    CHECK (stmt.Step ());
+    return stmt.Get<int64_t> (0);
+  }
+
+};
+
+TEST_F (SnapshotTests, RoundTrip)
+{
+  SnapshotInfo info;
+  ASSERT_TRUE (Import (Export (), info));
+
+  EXPECT_EQ (info.block, "");
+  EXPECT_EQ (info.tableHashes.size (), CountSourceTables ());
+  EXPECT_EQ (info.tableHashes.at ("accounts"),
+             ComputeTableHash (source, "accounts"));
+
+  EXPECT_EQ (ComputeTableHashes (target), ComputeTableHashes (source));
+  EXPECT_EQ (ComputeStateHash (target), ComputeStateHash (source));
+  EXPECT_EQ (ComputeTableHash (target, "xayagame_undo"),
+             ComputeTableHash (source, "xayagame_undo"));
+  EXPECT_EQ (CountTargetSchema (), CountSchema (source));
+
+  /* Importing another snapshot on top is not allowed.  */
+  EXPECT_DEATH (Import (Export (), info), "empty database");
+}
+
+TEST_F (SnapshotTests, ExportInsideTransaction)
+{
+  Exec (source, "BEGIN");
+  const std::string data = Export ();
+  Exec (source, R"(
+    INSERT INTO `accounts` (`name`, `proto`) VALUES ('andy', x'')
+  )");
+  Exec (source, "COMMIT");
+
+  SnapshotInfo info;
+  ASSERT_TRUE (Import (data, info));
+  EXPECT_NE (ComputeTableHash (target, "accounts"),
+             ComputeTableHash (source, "accounts"));
+  EXPECT_EQ (ComputeTableHash (target, "xayagame_undo"),
+             ComputeTableHash (source, "xayagame_undo"));
+}
+
+TEST_F (SnapshotTests, BlockHash)
+{
+  const std::string hash
+      = "0000000000000000000000000000000000000000000000000000000000000abc";
+  Exec (source, R"(
+    INSERT INTO `xayagame_current` (`key`, `value`)
+      VALUES ('blockhash', x')" + hash + R"(')
+  )");
+
+  SnapshotInfo info;
+  ASSERT_TRUE (Import (Export (), info));
+  EXPECT_EQ (info.block, hash);
+  EXPECT_EQ (ComputeTableHash (target, "xayagame_current"),
+             ComputeTableHash (source, "xayagame_current"));
+}
+
+TEST_F (SnapshotTests, IncrementalHashesCleared)
+{
+  /* The incremental hash of accounts is made inconsistent with the actual
+     data.  It must not be imported, but recomputed afterwards.  */
+  SetupIncrementalStateHash (*source);
+  Exec (source, R"(
+    UPDATE `statehash_tables`
+      SET `hash` = zeroblob (32)
+      WHERE `name` = 'accounts'
+  )");
+
+  SnapshotInfo info;
+  ASSERT_TRUE (Import (Export (), info));
+  EXPECT_TRUE (GetIncrementalTableHashes (target).empty ());
+
+  SetupIncrementalStateHash (*target);
+  EXPECT_EQ (GetIncrementalTableHashes (target),
+             ComputeIncrementalTableHashes (target));
+  EXPECT_NE (GetIncrementalTableHashes (target),
+             GetIncrementalTableHashes (source));
+}
+
+TEST_F (SnapshotTests, InvalidData)
+{
+  SnapshotInfo info;
+  EXPECT_FALSE (Import ("", info));
+  EXPECT_FALSE (Import ("not a snapshot", info));
+  EXPECT_EQ (CountTargetSchema (), 0);
+}
+
+TEST_F (SnapshotTests, Truncated)
+{
+  const std::string data = Export ();
+
+  SnapshotInfo info;
+  EXPECT_FALSE (Import (data.substr (0, data.size () - 1), info));
+  EXPECT_FALSE (Import (data.substr (0, data.size () / 2), info));
+  EXPECT_EQ (CountTargetSchema (), 0);
+}
+
+TEST_F (SnapshotTests, HashMismatch)
+{
+  std::string data = Export ();
+  const size_t pos = data.find ("hello world");
+  ASSERT_NE (pos, std::string::npos);
+  data.replace (pos, 5, "HELLO");
+
+  SnapshotInfo info;
+  EXPECT_FALSE (Import (data, info));
+  EXPECT_EQ (CountTargetSchema (), 0);
+}
+
+TEST_F (SnapshotTests, InvalidSchemaStatement)
+{
+  std::string data = Export ();
+  const size_t pos = data.find ("CREATE INDEX");
+  ASSERT_NE (pos, std::string::npos);
+  data.replace (pos, 6, "DELETE");
+
+  SnapshotInfo info;
+  EXPECT_FALSE (Import (data, info));
+  EXPECT_EQ (CountTargetSchema (), 0);
+}
+
+TEST_F (SnapshotTests, MigratedTable)
+{
+  /* Simulate a table that has been migrated with ALTER TABLE, so that its
+     SQL in the snapshot differs from the one of a fresh schema.  */
+  Exec (source, "DROP TABLE `accounts`");
+  Exec (source, R"(
+    CREATE TABLE `accounts` (
+      `name` TEXT PRIMARY KEY,
+      `faction` INTEGER NULL
+    )
+  )");
+  Exec (source, "ALTER TABLE `accounts` ADD COLUMN `proto` BLOB NOT NULL");
+  Exec (source, R"(
+    INSERT INTO `accounts` (`name`, `proto`) VALUES ('domob', x'')
+  )");
+
+  SnapshotInfo info;
+  ASSERT_TRUE (Import (Export (), info));
+  EXPECT_EQ (ComputeTableHash (target, "accounts"),
+             ComputeTableHash (source, "accounts"));
+}
+
+TEST_F (SnapshotTests, UnexpectedTable)
+{
+  Exec (source, "CREATE TABLE `foo` (`x` INTEGER)");
+
+  SnapshotInfo info;
+  EXPECT_FALSE (Import (Export (), info));
+  EXPECT_EQ (CountTargetSchema (), 0);
+}
+
+TEST_F (SnapshotTests, UnexpectedIndex)
+{
+  Exec (source, "CREATE INDEX `accounts_by_proto` ON `accounts` (`proto`)");
+
+  SnapshotInfo info;
+  EXPECT_FALSE (Import (Export (), info));
+  EXPECT_EQ (CountTargetSchema (), 0);
+}
+
+TEST_F (SnapshotTests, TriggerNotAllowed)
+{
+  Exec (source, R"(
+    CREATE TRIGGER `xayagame_trigger`
+      AFTER INSERT ON `xayagame_undo`
+      BEGIN
+        DELETE FROM `accounts`;
+      END
+  )");
+
+  SnapshotInfo info;
+  EXPECT_FALSE (Import (Export (), info));
+  EXPECT_EQ (CountTargetSchema (), 0);
+}
+
+} // anonymous namespace
+} // namespace pxd
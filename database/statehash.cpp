@@ -0,0 +1,523 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "statehash.hpp"
+
+#include <xayautil/hash.hpp>
+
+#include <glog/logging.h>
+
+#include <sqlite3.h>
+
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+namespace pxd
+{
+
+namespace
+{
+
+/**
+ * Encodes an integer as fixed-length big-endian byte string.
+ */
+std::string
+EncodeInt (const uint64_t val)
+{
+  std::string res(sizeof (val), '\0');
+  for (size_t i = 0; i < sizeof (val); ++i)
+    res[i] = static_cast<char> ((val >> (8 * (sizeof (val) - 1 - i))) & 0xFF);
+  return res;
+}
+
+/**
+ * Encodes a variable-length string with a length prefix.
+ */
+std::string
+EncodeBytes (const std::string& data)
+{
+  return EncodeInt (data.size ()) + data;
+}
+
+/**
+ * Returns the names of all game-state tables, in sorted order.  The tables
+ * tracking entity changes for clients are not part of the consensus state,
+ * so they are excluded.  So are the incrementally maintained hashes, which
+ * are derived from the other tables.
+ */
+std::vector<std::string>
+GetTableNames (const xaya::SQLiteDatabase& db)
+{
+  auto stmt = db.PrepareRo (R"(
+    SELECT `name`
+      FROM `sqlite_master`
+      WHERE `type` = 'table'
+        AND `name` NOT LIKE 'sqlite\_%' ESCAPE '\'
+        AND `name` NOT LIKE 'xayagame\_%' ESCAPE '\'
+        AND `name` NOT LIKE 'changes\_%' ESCAPE '\'
+        AND `name` NOT LIKE 'statehash\_%' ESCAPE '\'
+      ORDER BY `name`
+  )");
+
+  std::vector<std::string> res;
+  while (stmt.Step ())
+    res.push_back (stmt.Get<std::string> (0));
+
+  return res;
+}
+
+/**
+ * Returns the column names of the given table, in order.
+ */
+std::vector<std::string>
+GetColumns (const xaya::SQLiteDatabase& db, const std::string& table)
+{
+  auto stmt = db.PrepareRo ("PRAGMA table_info(`" + table + "`)");
+
+  std::vector<std::string> res;
+  while (stmt.Step ())
+    res.push_back (stmt.Get<std::string> (1));
+
+  return res;
+}
+
+/* ************************************************************************** */
+
+/* The incremental state hash is a multiset hash:  Each row is hashed
+   on its own, and the table hash is the sum of all row hashes modulo 2^256.
+   This means that rows can be added and removed from the hash in any order
+   with constant effort, which we do through SQLite triggers on the tables.
+   Since the triggers also fire when libxayagame applies undo data, the
+   hashes stay correct across reorgs.
+
+   Unlike ComputeTableHash, the result does not depend on the column names,
+   but the column values are hashed with the same encoding.  */
+
+/** Name of the SQL function adding a row to a table hash.  */
+constexpr const char* FCN_ADD = "pxd_statehash_add";
+/** Name of the SQL function removing a row from a table hash.  */
+constexpr const char* FCN_SUB = "pxd_statehash_sub";
+
+/**
+ * Encodes a single SQLite value with its type.
+ */
+std::string
+EncodeValue (sqlite3_value* val)
+{
+  const int type = sqlite3_value_type (val);
+  std::string res(1, static_cast<char> (type));
+  switch (type)
+    {
+    case SQLITE_NULL:
+      break;
+
+    case SQLITE_INTEGER:
+      res += EncodeInt (sqlite3_value_int64 (val));
+      break;
+
+    case SQLITE_FLOAT:
+      {
+        const double d = sqlite3_value_double (val);
+        uint64_t bits;
+        static_assert (sizeof (bits) == sizeof (d),
+                       "unexpected size of double");
+        std::memcpy (&bits, &d, sizeof (d));
+        res += EncodeInt (bits);
+        break;
+      }
+
+    case SQLITE_TEXT:
+    case SQLITE_BLOB:
+      {
+        const auto* data = static_cast<const char*> (sqlite3_value_blob (val));
+        const int len = sqlite3_value_bytes (val);
+        res += EncodeBytes (std::string (data, len));
+        break;
+      }
+
+    default:
+      LOG (FATAL) << "Unexpected SQLite value type: " << type;
+    }
+
+  return res;
+}
+
+/**
+ * Computes the hash of a single row of the given table.
+ */
+xaya::uint256
+HashRow (const std::string& table, sqlite3_value** vals, const int n)
+{
+  xaya::SHA256 hasher;
+  hasher << EncodeBytes (table) << EncodeInt (n);
+  for (int i = 0; i < n; ++i)
+    hasher << EncodeValue (vals[i]);
+  return hasher.Finalise ();
+}
+
+/**
+ * Adds or subtracts b to / from a (as 256-bit big-endian numbers).
+ */
+void
+AddHash (unsigned char* a, const xaya::uint256& b, const bool subtract)
+{
+  const unsigned char* bData = b.GetBlobData ();
+  int carry = 0;
+  for (int i = xaya::uint256::NUM_BYTES - 1; i >= 0; --i)
+    {
+      int val;
+      if (subtract)
+        val = static_cast<int> (a[i]) - bData[i] - carry;
+      else
+        val = static_cast<int> (a[i]) + bData[i] + carry;
+
+      carry = (val < 0 || val > 0xFF ? 1 : 0);
+      a[i] = static_cast<unsigned char> (val & 0xFF);
+    }
+}
+
+/**
+ * Implementation of the SQL functions that add or remove a row to / from
+ * the hash of a table.  The arguments are the current table hash,
+ * the table name and then all column values of the row.
+ */
+template <bool Subtract>
+  void
+  UpdateHashFunction (sqlite3_context* ctx, const int argc,
+                      sqlite3_value** argv)
+{
+  if (argc < 2 || sqlite3_value_type (argv[0]) != SQLITE_BLOB
+        || sqlite3_value_bytes (argv[0]) != xaya::uint256::NUM_BYTES
+        || sqlite3_value_type (argv[1]) != SQLITE_TEXT)
+    {
+      sqlite3_result_error (ctx, "invalid arguments for state-hash update",
+                            -1);
+      return;
+    }
+
+  unsigned char acc[xaya::uint256::NUM_BYTES];
+  std::memcpy (acc, sqlite3_value_blob (argv[0]), sizeof (acc));
+
+  const std::string table(
+      reinterpret_cast<const char*> (sqlite3_value_text (argv[1])),
+      sqlite3_value_bytes (argv[1]));
+  AddHash (acc, HashRow (table, argv + 2, argc - 2), Subtract);
+
+  sqlite3_result_blob (ctx, acc, sizeof (acc), SQLITE_TRANSIENT);
+}
+
+/**
+ * Computes the incremental hash of a table from scratch.
+ */
+xaya::uint256
+ComputeMultisetHash (const xaya::SQLiteDatabase& db, const std::string& table)
+{
+  const int numColumns = GetColumns (db, table).size ();
+
+  unsigned char acc[xaya::uint256::NUM_BYTES] = {};
+  auto stmt = db.PrepareRo ("SELECT * FROM `" + table + "`");
+  std::vector<sqlite3_value*> vals(numColumns);
+  while (stmt.Step ())
+    {
+      for (int i = 0; i < numColumns; ++i)
+        vals[i] = sqlite3_column_value (stmt.ro (), i);
+      AddHash (acc, HashRow (table, vals.data (), numColumns), false);
+    }
+
+  xaya::uint256 res;
+  res.FromBlob (acc);
+  return res;
+}
+
+/**
+ * Builds the SQL argument list of a row for the update functions.
+ */
+std::string
+RowArguments (const std::string& table,
+              const std::vector<std::string>& columns, const std::string& row)
+{
+  std::ostringstream res;
+  res << '\'' << table << '\'';
+  for (const auto& c : columns)
+    res << ", " << row << ".`" << c << '`';
+  return res.str ();
+}
+
+/**
+ * (Re)creates the triggers that update the incremental hash of a table
+ * on each change, and initialises its hash from the current content.
+ */
+void
+InitialiseTableHash (xaya::SQLiteDatabase& db, const std::string& table,
+                     const std::vector<std::string>& columns,
+                     const std::string& columnsStr)
+{
+  LOG (INFO) << "Initialising incremental state hash for " << table;
+
+  const std::string oldArgs = RowArguments (table, columns, "OLD");
+  const std::string newArgs = RowArguments (table, columns, "NEW");
+  const std::string where = " WHERE `name` = '" + table + "'";
+
+  std::ostringstream sql;
+  for (const std::string op : {"insert", "update", "delete"})
+    sql << "DROP TRIGGER IF EXISTS `statehash_" << op << "_" << table << "`;";
+
+  sql << "CREATE TRIGGER `statehash_insert_" << table << "`"
+      << " AFTER INSERT ON `" << table << "` BEGIN"
+      << " UPDATE `statehash_tables`"
+      << " SET `hash` = " << FCN_ADD << " (`hash`, " << newArgs << ")"
+      << where << "; END;";
+  sql << "CREATE TRIGGER `statehash_update_" << table << "`"
+      << " AFTER UPDATE ON `" << table << "` BEGIN"
+      << " UPDATE `statehash_tables`"
+      << " SET `hash` = " << FCN_ADD << " (" << FCN_SUB
+      << " (`hash`, " << oldArgs << "), " << newArgs << ")"
+      << where << "; END;";
+  sql << "CREATE TRIGGER `statehash_delete_" << table << "`"
+      << " AFTER DELETE ON `" << table << "` BEGIN"
+      << " UPDATE `statehash_tables`"
+      << " SET `hash` = " << FCN_SUB << " (`hash`, " << oldArgs << ")"
+      << where << "; END;";
+
+  db.Execute (sql.str ());
+
+  const auto hash = ComputeMultisetHash (db, table);
+  {
+    auto stmt = db.Prepare (R"(
+      DELETE FROM `statehash_tables`
+        WHERE `name` = ?1
+    )");
+    stmt.Bind (1, table);
+    stmt.Execute ();
+  }
+
+  auto stmt = db.Prepare (R"(
+    INSERT INTO `statehash_tables`
+      (`name`, `columns`, `hash`)
+      VALUES (?1, ?2, ?3)
+  )");
+  stmt.Bind (1, table);
+  stmt.Bind (2, columnsStr);
+  stmt.BindBlob (3, std::string (
+      reinterpret_cast<const char*> (hash.GetBlobData ()),
+      xaya::uint256::NUM_BYTES));
+  stmt.Execute ();
+}
+
+} // anonymous namespace
+
+xaya::uint256
+ComputeTableHash (Database& db, const std::string& table)
+{
+  /* First query the columns, so that we can order by all of them.  */
+  const auto columns = GetColumns (*db, table);
+  CHECK (!columns.empty ()) << "Table " << table << " has no columns";
+
+  xaya::SHA256 hasher;
+  hasher << EncodeBytes (table) << EncodeInt (columns.size ());
+
+  std::ostringstream sql;
+  sql << "SELECT ";
+  for (size_t i = 0; i < columns.size (); ++i)
+    {
+      hasher << EncodeBytes (columns[i]);
+      if (i > 0)
+        sql << ", ";
+      sql << '`' << columns[i] << '`';
+    }
+  sql << " FROM `" << table << "` ORDER BY ";
+  for (size_t i = 1; i <= columns.size (); ++i)
+    {
+      if (i > 1)
+        sql << ", ";
+      sql << i;
+    }
+
+  auto stmt = (*db).PrepareRo (sql.str ());
+  sqlite3_stmt* raw = stmt.ro ();
+  uint64_t rows = 0;
+  while (stmt.Step ())
+    {
+      ++rows;
+      for (size_t i = 0; i < columns.size (); ++i)
+        {
+          const int type = sqlite3_column_type (raw, i);
+          hasher << std::string (1, static_cast<char> (type));
+          switch (type)
+            {
+            case SQLITE_NULL:
+              break;
+
+            case SQLITE_INTEGER:
+              hasher << EncodeInt (sqlite3_column_int64 (raw, i));
+              break;
+
+            case SQLITE_FLOAT:
+              {
+                const double val = sqlite3_column_double (raw, i);
+                uint64_t bits;
+                static_assert (sizeof (bits) == sizeof (val),
+                               "unexpected size of double");
+                std::memcpy (&bits, &val, sizeof (val));
+                hasher << EncodeInt (bits);
+                break;
+              }
+
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+              {
+                const auto* data
+                    = static_cast<const char*> (sqlite3_column_blob (raw, i));
+                const int len = sqlite3_column_bytes (raw, i);
+                hasher << EncodeBytes (std::string (data, len));
+                break;
+              }
+
+            default:
+              LOG (FATAL) << "Unexpected SQLite column type: " << type;
+            }
+        }
+    }
+
+  hasher << EncodeInt (rows);
+  return hasher.Finalise ();
+}
+
+std::map<std::string, xaya::uint256>
+ComputeTableHashes (Database& db)
+{
+  std::map<std::string, xaya::uint256> res;
+  for (const auto& table : GetTableNames (*db))
+    res.emplace (table, ComputeTableHash (db, table));
+  return res;
+}
+
+xaya::uint256
+CombineTableHashes (const std::map<std::string, xaya::uint256>& hashes)
+{
+  xaya::SHA256 hasher;
+  for (const auto& entry : hashes)
+    hasher << EncodeBytes (entry.first) << entry.second;
+  return hasher.Finalise ();
+}
+
+xaya::uint256
+ComputeStateHash (Database& db)
+{
+  return CombineTableHashes (ComputeTableHashes (db));
+}
+
+void
+SetupIncrementalStateHash (xaya::SQLiteDatabase& db)
+{
+  /* The functions have to be registered on every connection that writes
+     to the database, since the triggers call them.  */
+  for (const auto* fcn : {FCN_ADD, FCN_SUB})
+    {
+      const bool sub = (std::string (fcn) == FCN_SUB);
+      const int rc = sqlite3_create_function_v2 (
+          *db, fcn, -1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr,
+          sub ? &UpdateHashFunction<true> : &UpdateHashFunction<false>,
+          nullptr, nullptr, nullptr);
+      CHECK_EQ (rc, SQLITE_OK) << "Failed to register " << fcn;
+    }
+
+  /* "INSERT OR REPLACE" only fires the delete triggers for replaced rows
+     with recursive triggers enabled.  Without them, the replaced rows
+     would not be removed from the hashes.  */
+  db.Execute ("PRAGMA `recursive_triggers` = ON");
+
+  db.Execute ("SAVEPOINT `pxd-statehash`");
+
+  std::map<std::string, std::string> known;
+  {
+    auto stmt = db.Prepare (R"(
+      SELECT `name`, `columns`
+        FROM `statehash_tables`
+    )");
+    while (stmt.Step ())
+      known.emplace (stmt.Get<std::string> (0), stmt.Get<std::string> (1));
+  }
+
+  /* Triggers and hashes are (re)initialised for all tables that are new or
+     whose columns have changed (e.g. through a schema migration).  */
+  for (const auto& table : GetTableNames (db))
+    {
+      const auto columns = GetColumns (db, table);
+      std::string columnsStr;
+      for (const auto& c : columns)
+        {
+          if (!columnsStr.empty ())
+            columnsStr += ",";
+          columnsStr += c;
+        }
+
+      const auto mit = known.find (table);
+      if (mit == known.end () || mit->second != columnsStr)
+        InitialiseTableHash (db, table, columns, columnsStr);
+
+      if (mit != known.end ())
+        known.erase (mit);
+    }
+
+  for (const auto& entry : known)
+    {
+      auto stmt = db.Prepare (R"(
+        DELETE FROM `statehash_tables`
+          WHERE `name` = ?1
+      )");
+      stmt.Bind (1, entry.first);
+      stmt.Execute ();
+    }
+
+  db.Execute ("RELEASE `pxd-statehash`");
+}
+
+std::map<std::string, xaya::uint256>
+GetIncrementalTableHashes (Database& db)
+{
+  auto stmt = (*db).PrepareRo (R"(
+    SELECT `name`, `hash`
+      FROM `statehash_tables`
+  )");
+
+  std::map<std::string, xaya::uint256> res;
+  while (stmt.Step ())
+    {
+      CHECK_EQ (sqlite3_column_bytes (stmt.ro (), 1),
+                static_cast<int> (xaya::uint256::NUM_BYTES));
+      xaya::uint256 hash;
+      hash.FromBlob (static_cast<const unsigned char*> (
+          sqlite3_column_blob (stmt.ro (), 1)));
+      res.emplace (stmt.Get<std::string> (0), hash);
+    }
+
+  return res;
+}
+
+std::map<std::string, xaya::uint256>
+ComputeIncrementalTableHashes (Database& db)
+{
+  std::map<std::string, xaya::uint256> res;
+  for (const auto& table : GetTableNames (*db))
+    res.emplace (table, ComputeMultisetHash (*db, table));
+  return res;
+}
+
+} // namespace pxd
@@ -0,0 +1,91 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATABASE_STATEHASH_HPP
+#define DATABASE_STATEHASH_HPP
+
+#include "database.hpp"
+
+#include <xayagame/sqlitestorage.hpp>
+#include <xayautil/uint256.hpp>
+
+#include <map>
+#include <string>
+
+namespace pxd
+{
+
+/**
+ * Computes the hash of a single table's content, covering the column names
+ * and all rows in a canonical order (sorted by all columns).  This works
+ * for any table in the database, including internal ones.
+ */
+xaya::uint256 ComputeTableHash (Database& db, const std::string& table);
+
+/**
+ * Computes a hash of the full content of each game-state table in the
+ * database.  Internal tables of SQLite and libxayagame are excluded.
+ * The hash covers the column names and all rows in a canonical order
+ * (sorted by all columns), so that it only depends on the logical
+ * content and not e.g. the order in which rows were inserted.
+ */
+std::map<std::string, xaya::uint256> ComputeTableHashes (Database& db);
+
+/**
+ * Computes a single hash over the entire game state, combining the
+ * per-table hashes.  This can be used to check that two databases
+ * (e.g. from a replay and from a node) hold the same state.
+ */
+xaya::uint256 ComputeStateHash (Database& db);
+
+/**
+ * Combines per-table hashes into a single hash, as done by
+ * ComputeStateHash.  This can also be used with the incremental hashes.
+ */
+xaya::uint256 CombineTableHashes (
+    const std::map<std::string, xaya::uint256>& hashes);
+
+/**
+ * Sets up the incrementally maintained state hash on the given database
+ * connection.  Each game-state table has a multiset hash (the sum of the
+ * hashes of all its rows) stored in the statehash_tables table, which
+ * is kept up-to-date through triggers whenever a row is inserted, updated
+ * or deleted.  This makes it cheap to compare states every block.
+ *
+ * This must be called on every connection that writes to the database,
+ * since it registers the SQL functions used by the triggers.  Triggers
+ * and hashes for tables that are new or whose columns changed are
+ * initialised from the current content.
+ */
+void SetupIncrementalStateHash (xaya::SQLiteDatabase& db);
+
+/**
+ * Returns the incrementally maintained hashes of all tables.
+ */
+std::map<std::string, xaya::uint256> GetIncrementalTableHashes (Database& db);
+
+/**
+ * Recomputes the incremental hashes of all tables from scratch.  They must
+ * match the ones returned by GetIncrementalTableHashes.
+ */
+std::map<std::string, xaya::uint256> ComputeIncrementalTableHashes (
+    Database& db);
+
+} // namespace pxd
+
+#endif // DATABASE_STATEHASH_HPP
@@ -0,0 +1,251 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "statehash.hpp"
+
+#include "dbtest.hpp"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+
+namespace pxd
+{
+namespace
+{
+
+class StateHashTests : public testing::Test
+{
+
+protected:
+
+  /** Two databases whose states we compare.  */
+  TestDatabase db1;
+  TestDatabase db2;
+
+  StateHashTests ()
+  {
+    for (auto* db : {&db1, &db2})
+      {
+        Exec (*db, R"(
+          CREATE TABLE `foo` (
+            `id` INTEGER PRIMARY KEY,
+            `value` TEXT NULL
+          )
+        )");
+        Exec (*db, R"(
+          CREATE TABLE `bar` (
+            `key` TEXT NOT NULL,
+            `number` REAL NOT NULL
+          )
+        )");
+      }
+  }
+
+  /**
+   * Executes an SQL statement on the given database.
+   */
+  static void
+  Exec (Database& db, const std::string& sql)
+  {
+    auto stmt = db.Prepare (sql);
+    stmt.Execute ();
+  }
+
+};
+
+TEST_F (StateHashTests, InsertionOrder)
+{
+  Exec (db1, "INSERT INTO `foo` (`id`, `value`) VALUES (1, 'a'), (2, NULL)");
+  Exec (db1, "INSERT INTO `bar` (`key`, `number`) VALUES ('x', 1.5)");
+  Exec (db1, "INSERT INTO `bar` (`key`, `number`) VALUES ('y', 2)");
+
+  Exec (db2, "INSERT INTO `bar` (`key`, `number`) VALUES ('y', 2)");
+  Exec (db2, "INSERT INTO `foo` (`id`, `value`) VALUES (2, NULL), (1, 'a')");
+  Exec (db2, "INSERT INTO `bar` (`key`, `number`) VALUES ('x', 1.5)");
+
+  EXPECT_EQ (ComputeTableHashes (db1), ComputeTableHashes (db2));
+  EXPECT_EQ (ComputeStateHash (db1), ComputeStateHash (db2));
+}
+
+TEST_F (StateHashTests, ContentChanges)
+{
+  Exec (db1, "INSERT INTO `foo` (`id`, `value`) VALUES (1, 'a')");
+  Exec (db2, "INSERT INTO `foo` (`id`, `value`) VALUES (1, 'a')");
+  const auto before = ComputeTableHashes (db1);
+  ASSERT_EQ (before.size (), 2);
+  EXPECT_EQ (before, ComputeTableHashes (db2));
+
+  Exec (db2, "UPDATE `foo` SET `value` = 'b'");
+  const auto after = ComputeTableHashes (db2);
+  EXPECT_NE (before.at ("foo"), after.at ("foo"));
+  EXPECT_EQ (before.at ("bar"), after.at ("bar"));
+  EXPECT_NE (ComputeStateHash (db1), ComputeStateHash (db2));
+}
+
+TEST_F (StateHashTests, TypesAreDistinguished)
+{
+  Exec (db1, "INSERT INTO `foo` (`id`, `value`) VALUES (1, NULL)");
+  Exec (db2, "INSERT INTO `foo` (`id`, `value`) VALUES (1, '')");
+  EXPECT_NE (ComputeStateHash (db1), ComputeStateHash (db2));
+}
+
+TEST_F (StateHashTests, InternalTablesIgnored)
+{
+  Exec (db1, R"(
+    CREATE TABLE `xayagame_test` (`value` INTEGER NOT NULL)
+  )");
+  Exec (db1, "INSERT INTO `xayagame_test` (`value`) VALUES (42)");
+  Exec (db1, R"(
+    CREATE TABLE `changes_test` (`value` INTEGER NOT NULL)
+  )");
+  Exec (db1, "INSERT INTO `changes_test` (`value`) VALUES (42)");
+
+  EXPECT_EQ (ComputeTableHashes (db1).count ("xayagame_test"), 0);
+  EXPECT_EQ (ComputeTableHashes (db1).count ("changes_test"), 0);
+  EXPECT_EQ (ComputeStateHash (db1), ComputeStateHash (db2));
+}
+
+class IncrementalStateHashTests : public DBTestWithSchema
+{
+
+protected:
+
+  IncrementalStateHashTests ()
+  {
+    Exec (R"(
+      CREATE TABLE `foo` (
+        `id` INTEGER PRIMARY KEY,
+        `value` TEXT NULL
+      )
+    )");
+    Exec ("INSERT INTO `foo` (`id`, `value`) VALUES (1, 'a'), (2, NULL)");
+    SetupIncrementalStateHash (*db);
+  }
+
+  /**
+   * Executes an SQL statement on the test database.
+   */
+  void
+  Exec (const std::string& sql)
+  {
+    auto stmt = db.Prepare (sql);
+    stmt.Execute ();
+  }
+
+  /**
+   * Returns the stored incremental hash of the foo table.
+   */
+  xaya::uint256
+  GetFooHash ()
+  {
+    return GetIncrementalTableHashes (db).at ("foo");
+  }
+
+  /**
+   * Expects that the stored incremental hashes match the actual content.
+   */
+  void
+  ExpectConsistent ()
+  {
+    EXPECT_EQ (GetIncrementalTableHashes (db),
+               ComputeIncrementalTableHashes (db));
+  }
+
+};
+
+TEST_F (IncrementalStateHashTests, InitialisedFromContent)
+{
+  const auto hashes = GetIncrementalTableHashes (db);
+  EXPECT_EQ (hashes.count ("foo"), 1);
+  EXPECT_EQ (hashes.count ("characters"), 1);
+  EXPECT_EQ (hashes.count ("statehash_tables"), 0);
+  EXPECT_EQ (hashes.count ("changes_characters"), 0);
+  ExpectConsistent ();
+}
+
+TEST_F (IncrementalStateHashTests, UpdatedOnChanges)
+{
+  xaya::uint256 last = GetFooHash ();
+  for (const std::string sql : {
+      "INSERT INTO `foo` (`id`, `value`) VALUES (3, 'b')",
+      "UPDATE `foo` SET `value` = 'x' WHERE `id` = 1",
+      "INSERT OR REPLACE INTO `foo` (`id`, `value`) VALUES (2, 'c')",
+      "DELETE FROM `foo` WHERE `id` = 3",
+    })
+    {
+      Exec (sql);
+      EXPECT_NE (GetFooHash (), last) << sql;
+      last = GetFooHash ();
+      ExpectConsistent ();
+    }
+
+  Exec ("DELETE FROM `foo`");
+  EXPECT_TRUE (GetFooHash ().IsNull ());
+  ExpectConsistent ();
+}
+
+TEST_F (IncrementalStateHashTests, OrderIndependent)
+{
+  Exec ("INSERT INTO `foo` (`id`, `value`) VALUES (3, 'b'), (4, 'c')");
+  const auto before = GetFooHash ();
+
+  Exec ("DELETE FROM `foo`");
+  Exec ("INSERT INTO `foo` (`id`, `value`) VALUES (4, 'c'), (2, NULL)");
+  Exec ("INSERT INTO `foo` (`id`, `value`) VALUES (3, 'b'), (1, 'a')");
+  EXPECT_EQ (GetFooHash (), before);
+}
+
+TEST_F (IncrementalStateHashTests, Rollback)
+{
+  const auto before = GetFooHash ();
+
+  Exec ("SAVEPOINT `test`");
+  Exec ("UPDATE `foo` SET `value` = 'x'");
+  EXPECT_NE (GetFooHash (), before);
+  Exec ("ROLLBACK TO `test`");
+  Exec ("RELEASE `test`");
+
+  EXPECT_EQ (GetFooHash (), before);
+}
+
+TEST_F (IncrementalStateHashTests, SchemaChanges)
+{
+  Exec ("ALTER TABLE `foo` ADD COLUMN `other` INTEGER NOT NULL DEFAULT 5");
+  SetupIncrementalStateHash (*db);
+  ExpectConsistent ();
+
+  Exec ("UPDATE `foo` SET `other` = 10 WHERE `id` = 1");
+  ExpectConsistent ();
+
+  Exec ("DROP TABLE `foo`");
+  SetupIncrementalStateHash (*db);
+  EXPECT_EQ (GetIncrementalTableHashes (db).count ("foo"), 0);
+  ExpectConsistent ();
+}
+
+TEST_F (IncrementalStateHashTests, CombinedHash)
+{
+  const auto before = CombineTableHashes (GetIncrementalTableHashes (db));
+  Exec ("UPDATE `foo` SET `value` = 'x' WHERE `id` = 1");
+  EXPECT_NE (CombineTableHashes (GetIncrementalTableHashes (db)), before);
+}
+
+} // anonymous namespace
+} // namespace pxd
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -18,6 +18,8 @@
 
 #include "target.hpp"
 
+#include "tracing.hpp"
+
 namespace pxd
 {
 
@@ -41,6 +43,8 @@ TargetFinder::ProcessL1Targets (const HexCoord& centre,
                                 const bool enemies, const bool friendlies,
                                 const ProcessingFcn& cb) const
 {
+  PXD_TRACE_SPAN ("TargetFinder::ProcessL1Targets");
+
   CHECK (enemies || friendlies)
       << "Neither enemy nor friendly targets requested?";
 
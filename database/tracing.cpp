@@ -0,0 +1,106 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "tracing.hpp"
+
+#include <atomic>
+
+namespace pxd
+{
+
+namespace
+{
+
+/** Counter for assigning numbers to threads.  */
+std::atomic<unsigned> nextThreadNumber(1);
+
+/**
+ * Whether or not a shared collector is set.  This allows a cheap check
+ * before locking sharedMut.
+ */
+std::atomic<bool> hasShared(false);
+
+/** Lock for the shared collector.  */
+std::mutex sharedMut;
+
+/** The currently shared collector (if any).  */
+std::shared_ptr<TraceCollector> shared;
+
+} // anonymous namespace
+
+TraceCollector::TraceCollector (const size_t maxEv)
+  : origin(Clock::now ()), maxEvents(maxEv)
+{}
+
+void
+TraceCollector::Add (TraceEvent&& ev, const Clock::time_point start,
+                     const Clock::time_point end)
+{
+  ev.thread = ThreadNumber ();
+  ev.start = start - origin;
+  ev.duration = end - start;
+
+  std::lock_guard<std::mutex> lock(mut);
+  if (events.size () >= maxEvents)
+    {
+      ++dropped;
+      return;
+    }
+  events.push_back (std::move (ev));
+}
+
+std::vector<TraceEvent>
+TraceCollector::GetEvents () const
+{
+  std::lock_guard<std::mutex> lock(mut);
+  return events;
+}
+
+uint64_t
+TraceCollector::GetDropped () const
+{
+  std::lock_guard<std::mutex> lock(mut);
+  return dropped;
+}
+
+unsigned
+TraceCollector::ThreadNumber ()
+{
+  static thread_local unsigned num = nextThreadNumber++;
+  return num;
+}
+
+void
+TraceCollector::SetShared (std::shared_ptr<TraceCollector> c)
+{
+  std::lock_guard<std::mutex> lock(sharedMut);
+  hasShared = (c != nullptr);
+  shared = std::move (c);
+}
+
+std::shared_ptr<TraceCollector>
+TraceCollector::GetShared ()
+{
+  if (!hasShared)
+    return nullptr;
+
+  std::lock_guard<std::mutex> lock(sharedMut);
+  return shared;
+}
+
+} // namespace pxd
@@ -0,0 +1,307 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATABASE_TRACING_HPP
+#define DATABASE_TRACING_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pxd
+{
+
+/**
+ * A single recorded span of a trace.
+ */
+struct TraceEvent
+{
+
+  /** Name of the span (e.g. the function it covers).  */
+  std::string name;
+
+  /** Number of the thread the span was recorded on.  */
+  unsigned thread;
+
+  /** Start time relative to the start of the trace.  */
+  std::chrono::nanoseconds start;
+
+  /** Duration of the span.  */
+  std::chrono::nanoseconds duration;
+
+  /** If true, then the span has an associated ID (e.g. of a character).  */
+  bool hasId = false;
+
+  /** The ID associated to the span, if any.  */
+  int64_t id = 0;
+
+  /** Free-form detail text (e.g. account name), if any.  */
+  std::string detail;
+
+};
+
+/**
+ * Collection of trace events, e.g. for the processing of one block.
+ * Spans are only recorded while a collector is activated on the current
+ * thread (see TraceActivation), so that the spans placed in hot code
+ * cost just a thread-local lookup while no trace is being taken.
+ *
+ * Events may be added from multiple threads concurrently.
+ */
+class TraceCollector
+{
+
+public:
+
+  using Clock = std::chrono::steady_clock;
+
+private:
+
+  /** Time at which the trace started.  */
+  const Clock::time_point origin;
+
+  /** Maximum number of events we record.  */
+  const size_t maxEvents;
+
+  /** Lock for the events.  */
+  mutable std::mutex mut;
+
+  /** All events recorded so far.  */
+  std::vector<TraceEvent> events;
+
+  /** Number of events dropped because maxEvents was reached.  */
+  uint64_t dropped = 0;
+
+public:
+
+  /** Default limit on the number of events.  */
+  static constexpr size_t DEFAULT_MAX_EVENTS = 1'000'000;
+
+  explicit TraceCollector (size_t maxEv = DEFAULT_MAX_EVENTS);
+
+  TraceCollector (const TraceCollector&) = delete;
+  void operator= (const TraceCollector&) = delete;
+
+  /**
+   * Records a finished span with the given data.  The event's thread and
+   * start are filled in from the current thread and the given time points.
+   */
+  void Add (TraceEvent&& ev, Clock::time_point start, Clock::time_point end);
+
+  /**
+   * Returns a copy of all events recorded so far.
+   */
+  std::vector<TraceEvent> GetEvents () const;
+
+  /**
+   * Returns the number of events dropped so far because the limit
+   * was reached.
+   */
+  uint64_t GetDropped () const;
+
+  /**
+   * Returns the slot for the collector that is active on the current thread.
+   * This is null while no trace is taken.
+   */
+  static TraceCollector*&
+  ForThread ()
+  {
+    static thread_local TraceCollector* current = nullptr;
+    return current;
+  }
+
+  /**
+   * Returns a small number identifying the current thread in traces.
+   */
+  static unsigned ThreadNumber ();
+
+  /**
+   * Sets the collector that spans on other threads should record into,
+   * e.g. RPC handlers running while a block is traced (see SharedTraceSpan).
+   * Can be set to null to disable it again.
+   */
+  static void SetShared (std::shared_ptr<TraceCollector> c);
+
+  /**
+   * Returns the currently shared collector, or null if there is none.
+   */
+  static std::shared_ptr<TraceCollector> GetShared ();
+
+};
+
+/**
+ * RAII helper that activates a collector on the current thread while
+ * it is in scope.  The collector may be null, in which case tracing is
+ * disabled for the scope.
+ */
+class TraceActivation
+{
+
+private:
+
+  /** The previously active collector, which is restored at the end.  */
+  TraceCollector* const previous;
+
+public:
+
+  explicit TraceActivation (TraceCollector* c)
+    : previous(TraceCollector::ForThread ())
+  {
+    TraceCollector::ForThread () = c;
+  }
+
+  ~TraceActivation ()
+  {
+    TraceCollector::ForThread () = previous;
+  }
+
+  TraceActivation () = delete;
+  TraceActivation (const TraceActivation&) = delete;
+  void operator= (const TraceActivation&) = delete;
+
+};
+
+/**
+ * RAII span that is recorded into the current thread's collector (if there
+ * is one) when it goes out of scope.  Names should be string literals.
+ * If no trace is being taken, this does nothing beyond the check for an
+ * active collector.
+ */
+class TraceSpan
+{
+
+private:
+
+  /** The collector we record into, or null if not tracing.  */
+  TraceCollector* const collector;
+
+  /** The event data (except for the timing).  */
+  TraceEvent ev;
+
+  /** Time when the span started.  */
+  TraceCollector::Clock::time_point start;
+
+  /**
+   * Starts the timing if we are tracing.
+   */
+  void
+  Start (const char* name)
+  {
+    ev.name = name;
+    start = TraceCollector::Clock::now ();
+  }
+
+public:
+
+  explicit TraceSpan (const char* name)
+    : collector(TraceCollector::ForThread ())
+  {
+    if (collector != nullptr)
+      Start (name);
+  }
+
+  explicit TraceSpan (const char* name, const int64_t id)
+    : collector(TraceCollector::ForThread ())
+  {
+    if (collector != nullptr)
+      {
+        ev.hasId = true;
+        ev.id = id;
+        Start (name);
+      }
+  }
+
+  explicit TraceSpan (const char* name, const std::string& detail)
+    : collector(TraceCollector::ForThread ())
+  {
+    if (collector != nullptr)
+      {
+        ev.detail = detail;
+        Start (name);
+      }
+  }
+
+  ~TraceSpan ()
+  {
+    if (collector != nullptr)
+      collector->Add (std::move (ev), start, TraceCollector::Clock::now ());
+  }
+
+  TraceSpan () = delete;
+  TraceSpan (const TraceSpan&) = delete;
+  void operator= (const TraceSpan&) = delete;
+
+};
+
+/**
+ * Span for code running outside of block processing, e.g. RPC handlers.
+ * If a shared collector is set (while a block is being traced), then it
+ * is activated on the current thread for the lifetime of this instance, and
+ * the span itself as well as all nested ones are recorded into it.
+ */
+class SharedTraceSpan
+{
+
+private:
+
+  /** The shared collector, keeping it alive while we use it.  */
+  const std::shared_ptr<TraceCollector> collector;
+
+  /** Activation of the collector on our thread.  */
+  TraceActivation activation;
+
+  /** The span itself.  */
+  TraceSpan span;
+
+public:
+
+  explicit SharedTraceSpan (const char* name)
+    : collector(TraceCollector::GetShared ()),
+      activation(collector.get ()),
+      span(name)
+  {}
+
+  SharedTraceSpan () = delete;
+  SharedTraceSpan (const SharedTraceSpan&) = delete;
+  void operator= (const SharedTraceSpan&) = delete;
+
+};
+
+} // namespace pxd
+
+/* The macros below should be used to place spans into the code, so that
+   they can be removed completely at compile time (with --disable-tracing).
+   PXD_TRACE_SPAN accepts the same arguments as the TraceSpan constructors,
+   and PXD_TRACE_SHARED_SPAN those of SharedTraceSpan.  */
+
+#ifdef DISABLE_TRACING
+# define PXD_TRACE_SPAN(...) do {} while (false)
+# define PXD_TRACE_SHARED_SPAN(...) do {} while (false)
+#else // DISABLE_TRACING
+# define PXD_TRACE_CONCAT2(a, b) a ## b
+# define PXD_TRACE_CONCAT(a, b) PXD_TRACE_CONCAT2(a, b)
+# define PXD_TRACE_SPAN(...) \
+    pxd::TraceSpan PXD_TRACE_CONCAT(pxdTraceSpan, __LINE__) (__VA_ARGS__)
+# define PXD_TRACE_SHARED_SPAN(...) \
+    pxd::SharedTraceSpan PXD_TRACE_CONCAT(pxdTraceSpan, __LINE__) (__VA_ARGS__)
+#endif // DISABLE_TRACING
+
+#endif // DATABASE_TRACING_HPP
@@ -0,0 +1,125 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "tracing.hpp"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace pxd
+{
+namespace
+{
+
+using TracingTests = testing::Test;
+
+TEST_F (TracingTests, NotActive)
+{
+  TraceCollector trace;
+
+  {
+    TraceSpan span("foo");
+  }
+  {
+    TraceActivation act(nullptr);
+    TraceSpan span("bar", 42);
+  }
+
+  EXPECT_EQ (TraceCollector::ForThread (), nullptr);
+  EXPECT_TRUE (trace.GetEvents ().empty ());
+}
+
+TEST_F (TracingTests, NestedSpans)
+{
+  TraceCollector trace;
+
+  {
+    TraceActivation act(&trace);
+    TraceSpan outer("outer", std::string ("domob"));
+    {
+      TraceSpan inner("inner", 42);
+    }
+  }
+  EXPECT_EQ (TraceCollector::ForThread (), nullptr);
+
+  const auto events = trace.GetEvents ();
+  ASSERT_EQ (events.size (), 2);
+
+  /* Events are recorded when spans end, so the inner one is first.  */
+  const auto& inner = events[0];
+  const auto& outer = events[1];
+
+  EXPECT_EQ (inner.name, "inner");
+  EXPECT_TRUE (inner.hasId);
+  EXPECT_EQ (inner.id, 42);
+  EXPECT_EQ (inner.detail, "");
+
+  EXPECT_EQ (outer.name, "outer");
+  EXPECT_FALSE (outer.hasId);
+  EXPECT_EQ (outer.detail, "domob");
+
+  EXPECT_EQ (inner.thread, outer.thread);
+  EXPECT_LE (outer.start, inner.start);
+  EXPECT_GE (outer.start + outer.duration, inner.start + inner.duration);
+}
+
+TEST_F (TracingTests, MaxEvents)
+{
+  TraceCollector trace(2);
+  TraceActivation act(&trace);
+
+  for (unsigned i = 0; i < 5; ++i)
+    TraceSpan span("foo", i);
+
+  const auto events = trace.GetEvents ();
+  ASSERT_EQ (events.size (), 2);
+  EXPECT_EQ (events[0].id, 0);
+  EXPECT_EQ (events[1].id, 1);
+  EXPECT_EQ (trace.GetDropped (), 3);
+}
+
+TEST_F (TracingTests, SharedSpans)
+{
+  /* Without shared collector, shared spans do nothing.  */
+  std::thread ([] ()
+    {
+      SharedTraceSpan span("rpc");
+      EXPECT_EQ (TraceCollector::ForThread (), nullptr);
+    }).join ();
+
+  auto trace = std::make_shared<TraceCollector> ();
+  TraceCollector::SetShared (trace);
+  std::thread ([] ()
+    {
+      SharedTraceSpan span("rpc");
+      TraceSpan inner("inner");
+    }).join ();
+  TraceCollector::SetShared (nullptr);
+  EXPECT_EQ (TraceCollector::GetShared (), nullptr);
+
+  const auto events = trace->GetEvents ();
+  ASSERT_EQ (events.size (), 2);
+  EXPECT_EQ (events[0].name, "inner");
+  EXPECT_EQ (events[1].name, "rpc");
+  EXPECT_EQ (events[0].thread, events[1].thread);
+  EXPECT_NE (events[0].thread, TraceCollector::ThreadNumber ());
+}
+
+} // anonymous namespace
+} // namespace pxd
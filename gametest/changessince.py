@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+
+#   GSP for the Taurion blockchain game
+#   Copyright (C) 2021  Autonomous Worlds Ltd
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""
+Tests the getchangessince RPC for syncing the state incrementally.
+"""
+
+from pxtest import PXTest
+
+
+class ChangesSinceTest (PXTest):
+
+  def getChanges (self, h):
+    """
+    Queries for the changes since the given height, and returns the
+    account names and character IDs in the result as sets, as well as
+    the full result.
+    """
+
+    data = self.getRpc ("getchangessince", fromheight=h)
+    accounts = set ([a["name"] for a in data["accounts"]])
+    chars = set ([c["id"] for c in data["characters"]])
+
+    return accounts, chars, data
+
+  def run (self):
+    self.collectPremine ()
+
+    self.initAccount ("domob", "r")
+    self.initAccount ("andy", "g")
+    self.generate (1)
+    h1 = self.rpc.xaya.getblockcount () + 1
+    self.createCharacters ("domob")
+    self.createCharacters ("andy")
+    self.generate (1)
+
+    chars = self.getCharacters ()
+    idDomob = chars["domob"].getId ()
+    idAndy = chars["andy"].getId ()
+
+    self.mainLogger.info ("Testing modified entities...")
+    accounts, ids, data = self.getChanges (h1)
+    self.assertEqual (accounts, set (["domob", "andy"]))
+    self.assertEqual (ids, set ([idDomob, idAndy]))
+    fullState = self.getGameState ()
+    for c in data["characters"]:
+      self.assertEqual ([c], [
+        d for d in fullState["characters"] if d["id"] == c["id"]
+      ])
+
+    self.generate (5)
+    h2 = self.rpc.xaya.getblockcount () + 1
+    self.moveCharactersTo ({"domob": {"x": 10, "y": -5}})
+    accounts, ids, data = self.getChanges (h2)
+    self.assertEqual (accounts, set ())
+    self.assertEqual (ids, set ([idDomob]))
+    self.assertEqual (data["characters"][0]["position"], {"x": 10, "y": -5})
+    self.assertEqual (data["deleted"]["characters"], [])
+
+    accounts, ids, _ = self.getChanges (self.rpc.xaya.getblockcount () + 1)
+    self.assertEqual (accounts, set ())
+    self.assertEqual (ids, set ())
+
+    self.mainLogger.info ("Testing tombstone window...")
+    self.stopGameDaemon ()
+    self.startGameDaemon (extraArgs=["--changes_tombstone_blocks=10"])
+    self.generate (20)
+    self.expectError (6, ".*too low for current block height.*",
+                      self.getChanges, h2)
+    self.getChanges (self.rpc.xaya.getblockcount () - 5)
+
+
+if __name__ == "__main__":
+  ChangesSinceTest ().main ()
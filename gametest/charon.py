@@ -213,6 +213,19 @@ class CharonTest (PXTest):
         "accounts": [],
       })
 
+      self.mainLogger.info ("Testing response cache...")
+      blk = self.rpc.xaya.getbestblockhash ()
+      self.assertEqual (client.rpc.waitforchange (""), blk)
+      chars = client.rpc.getcharacters ()
+      self.assertEqual (chars["blockhash"], blk)
+      self.assertEqual (client.rpc.getcharacters (), chars)
+      self.generate (1)
+      blk = client.rpc.waitforchange (blk)
+      self.assertEqual (blk, self.rpc.xaya.getbestblockhash ())
+      chars = client.rpc.getcharacters ()
+      self.assertEqual (chars["blockhash"], blk)
+      self.assertEqual (chars, self.rpc.game.getcharacters ())
+
 
 if __name__ == "__main__":
   CharonTest ().main ()
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+
+#   GSP for the Taurion blockchain game
+#   Copyright (C) 2021  Autonomous Worlds Ltd
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""
+Tests the streaming of per-block state deltas (--delta_stream_port).
+"""
+
+from pxtest import PXTest
+
+import json
+import urllib.error
+import urllib.request
+
+
+class DeltaStreamClient:
+  """
+  Simple client for the Server-Sent Events stream of deltas.
+  """
+
+  def __init__ (self, url):
+    self.stream = urllib.request.urlopen (url, timeout=60)
+
+  def close (self):
+    self.stream.close ()
+
+  def next (self):
+    """
+    Reads the next block event and returns its ID and parsed data.
+    """
+
+    eventId = None
+    data = None
+    while True:
+      line = self.stream.readline ().decode ("utf-8").rstrip ("\n")
+      if line.startswith ("id: "):
+        eventId = line[4:]
+      elif line.startswith ("data: "):
+        data = json.loads (line[6:])
+      elif line == "" and data is not None:
+        return eventId, data
+
+
+class DeltaStreamTest (PXTest):
+
+  def run (self):
+    self.collectPremine ()
+
+    self.initAccount ("domob", "r")
+    self.generate (1)
+
+    port = next (self.ports)
+    url = "http://localhost:%d/deltas" % port
+
+    self.stopGameDaemon ()
+    self.startGameDaemon (extraArgs=["--delta_stream_port=%d" % port])
+
+    self.mainLogger.info ("Testing live deltas...")
+    client = DeltaStreamClient (url)
+    self.createCharacters ("domob")
+    self.generate (1)
+    eventId, data = client.next ()
+    height = self.rpc.xaya.getblockcount ()
+    blk = self.rpc.xaya.getbestblockhash ()
+    self.assertEqual (eventId, "%d:%s" % (height, blk))
+    self.assertEqual (data["height"], height)
+    self.assertEqual (data["hash"], blk)
+    self.assertEqual (data["changes"]["characters"],
+                      self.getRpc ("getcharacters"))
+    client.close ()
+
+    self.mainLogger.info ("Testing resume...")
+    self.generate (2)
+    self.syncGame ()
+    client = DeltaStreamClient ("%s?from=%d&hash=%s" % (url, height, blk))
+    _, data = client.next ()
+    self.assertEqual (data["height"], height + 1)
+    self.assertEqual (data["parent"], blk)
+    _, data = client.next ()
+    self.assertEqual (data["height"], height + 2)
+    client.close ()
+
+    try:
+      DeltaStreamClient ("%s?from=%d&hash=%s" % (url, height, "00" * 32))
+      raise AssertionError ("expected resume to fail")
+    except urllib.error.HTTPError as exc:
+      self.assertEqual (exc.code, 410)
+
+    self.mainLogger.info ("Testing client limit...")
+    self.stopGameDaemon ()
+    self.startGameDaemon (extraArgs=[
+      "--delta_stream_port=%d" % port,
+      "--delta_stream_max_clients=1",
+    ])
+    client = DeltaStreamClient (url)
+    try:
+      DeltaStreamClient (url)
+      raise AssertionError ("expected second client to be rejected")
+    except urllib.error.HTTPError as exc:
+      self.assertEqual (exc.code, 503)
+    client.close ()
+
+
+if __name__ == "__main__":
+  DeltaStreamTest ().main ()
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+
+#   GSP for the Taurion blockchain game
+#   Copyright (C) 2021  Autonomous Worlds Ltd
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""
+Tests the state RPCs when they are served from the pool of read-only
+database connections (--rpc_read_connections).
+"""
+
+from pxtest import PXTest
+
+
+class ReadPoolTest (PXTest):
+
+  def expectBlock (self, res):
+    """
+    Verifies that the block hash and height of an RPC result correspond
+    to the current best block.
+    """
+
+    self.assertEqual (res["state"], "up-to-date")
+    self.assertEqual (res["blockhash"], self.rpc.xaya.getbestblockhash ())
+    self.assertEqual (res["height"], self.rpc.xaya.getblockcount ())
+
+  def run (self):
+    self.collectPremine ()
+
+    self.initAccount ("domob", "r")
+    self.createCharacters ("domob")
+    self.generate (1)
+    self.build ("checkmark", None, {"x": -100, "y": 200}, rot=0)
+    self.generate (1)
+
+    self.mainLogger.info ("Restarting with read-only connections...")
+    self.stopGameDaemon ()
+    self.startGameDaemon (extraArgs=["--rpc_read_connections=4"])
+
+    self.mainLogger.info ("Testing data of state RPCs...")
+    state = self.getGameState ()
+    self.assertEqual (self.getRpc ("getaccounts"), state["accounts"])
+    self.assertEqual (self.getRpc ("getbuildings"), state["buildings"])
+    self.assertEqual (self.getRpc ("getcharacters"), state["characters"])
+
+    self.mainLogger.info ("Testing reported blocks...")
+    self.expectBlock (self.rpc.game.getcurrentstate ())
+    self.expectBlock (self.rpc.game.getaccounts ())
+    self.generate (5)
+    self.syncGame ()
+    self.expectBlock (self.rpc.game.getcurrentstate ())
+    self.expectBlock (self.rpc.game.getbuildings ())
+
+    self.mainLogger.info ("Testing reorg...")
+    oldState = self.getGameState ()
+    reorgBlock = self.rpc.xaya.getbestblockhash ()
+    self.createCharacters ("domob")
+    self.generate (2)
+    self.syncGame ()
+    self.assertEqual (len (self.getRpc ("getcharacters")),
+                      len (oldState["characters"]) + 1)
+    self.rpc.xaya.invalidateblock (self.rpc.xaya.getblockhash (
+        self.rpc.xaya.getblockcount () - 1))
+    self.syncGame ()
+    self.expectBlock (self.rpc.game.getcharacters ())
+    self.assertEqual (self.rpc.xaya.getbestblockhash (), reorgBlock)
+    self.assertEqual (self.getRpc ("getcharacters"), oldState["characters"])
+
+
+if __name__ == "__main__":
+  ReadPoolTest ().main ()
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+
+#   GSP for the Taurion blockchain game
+#   Copyright (C) 2021  Autonomous Worlds Ltd
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""
+Tests the precomputed state snapshots served with --snapshot_port.
+"""
+
+from pxtest import PXTest
+
+import gzip
+import json
+import time
+import urllib.error
+import urllib.request
+
+
+class SnapshotsTest (PXTest):
+
+  def getSnapshot (self, name, etag=None):
+    """
+    Requests the given snapshot, optionally with an If-None-Match header.
+    Returns the HTTP status, ETag and decoded body (or None for a 304).
+    """
+
+    req = urllib.request.Request ("%s/snapshot/%s" % (self.url, name))
+    if etag is not None:
+      req.add_header ("If-None-Match", etag)
+
+    try:
+      with urllib.request.urlopen (req) as resp:
+        self.assertEqual (resp.headers["Content-Encoding"], "gzip")
+        body = json.loads (gzip.decompress (resp.read ()))
+        return resp.status, resp.headers["ETag"], body
+    except urllib.error.HTTPError as exc:
+      if exc.code != 304:
+        raise
+      return exc.code, exc.headers["ETag"], None
+
+  def waitForBlock (self, name):
+    """
+    Polls the given snapshot until it corresponds to the current best
+    block, and returns the result of getSnapshot.
+    """
+
+    blk = self.rpc.xaya.getbestblockhash ()
+    while True:
+      try:
+        res = self.getSnapshot (name)
+        if res[2]["blockhash"] == blk:
+          return res
+      except urllib.error.HTTPError as exc:
+        if exc.code != 503:
+          raise
+      time.sleep (0.1)
+
+  def run (self):
+    self.collectPremine ()
+
+    self.initAccount ("domob", "r")
+    self.createCharacters ("domob")
+    self.generate (1)
+
+    port = next (self.ports)
+    self.url = "http://localhost:%d" % port
+    self.stopGameDaemon ()
+    self.startGameDaemon (extraArgs=["--snapshot_port=%d" % port])
+
+    self.mainLogger.info ("Testing snapshot data...")
+    state = self.getGameState ()
+    for name in ["accounts", "buildings", "characters"]:
+      status, _, body = self.waitForBlock (name)
+      self.assertEqual (status, 200)
+      self.assertEqual (body["data"], state[name])
+      self.assertEqual (body["height"], self.rpc.xaya.getblockcount ())
+    _, _, body = self.waitForBlock ("orderbooks")
+    self.assertEqual (body["data"], [])
+
+    self.mainLogger.info ("Testing conditional requests...")
+    status, etag, _ = self.getSnapshot ("characters")
+    self.assertEqual (etag, '"%s"' % self.rpc.xaya.getbestblockhash ())
+    status, etag2, body = self.getSnapshot ("characters", etag)
+    self.assertEqual ((status, etag2, body), (304, etag, None))
+
+    self.generate (1)
+    self.waitForBlock ("characters")
+    status, etag2, _ = self.getSnapshot ("characters", etag)
+    self.assertEqual (status, 200)
+    self.assertEqual (etag2, '"%s"' % self.rpc.xaya.getbestblockhash ())
+
+    self.mainLogger.info ("Testing invalid snapshot...")
+    try:
+      self.getSnapshot ("invalid")
+      raise AssertionError ("expected invalid snapshot to fail")
+    except urllib.error.HTTPError as exc:
+      self.assertEqual (exc.code, 404)
+
+
+if __name__ == "__main__":
+  SnapshotsTest ().main ()
@@ -1,7 +1,7 @@
 #!/usr/bin/env python3
 
 #   GSP for the Taurion blockchain game
-#   Copyright (C) 2019-2020  Autonomous Worlds Ltd
+#   Copyright (C) 2019-2021  Autonomous Worlds Ltd
 #
 #   This program is free software: you can redistribute it and/or modify
 #   it under the terms of the GNU General Public License as published by
@@ -82,6 +82,25 @@ class SplitStateRpcsTest (PXTest):
     self.assertEqual (moneySupply, state["moneysupply"])
     self.assertEqual (prizes, state["prizes"])
 
+    # Test the area queries against the full lists.
+    centre = {"x": 100, "y": -100}
+    self.assertEqual (
+        self.getRpc ("getcharactersinarea", centre=centre, l1range=10,
+                     owner=""),
+        [c for c in characters if c["owner"] == "prospector"])
+    self.assertEqual (
+        self.getRpc ("getcharactersinarea", centre=centre, l1range=10,
+                     owner="killed"),
+        [])
+    self.assertEqual (
+        self.getRpc ("getbuildingsinarea", centre={"x": -100, "y": 200},
+                     l1range=0, owner=""),
+        [b for b in buildings if b["centre"] == {"x": -100, "y": 200}])
+    self.assertEqual (
+        self.getRpc ("getbuildingsinarea", centre={"x": 0, "y": 0},
+                     l1range=5000, owner="prospector"),
+        [])
+
     # Test the bootstrap data.
     self.assertEqual (self.getRpc ("getbootstrapdata"), {
       "regions": regions,
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+
+#   GSP for the Taurion blockchain game
+#   Copyright (C) 2021  Autonomous Worlds Ltd
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""
+Tests the incrementally maintained state hash (getstatehash), in particular
+that it stays consistent across reorgs.
+"""
+
+from pxtest import PXTest
+
+
+class StateHashTest (PXTest):
+
+  def run (self):
+    self.collectPremine ()
+
+    self.initAccount ("domob", "r")
+    self.createCharacters ("domob")
+    self.generate (1)
+
+    self.mainLogger.info ("Basic state hash...")
+    before = self.getRpc ("getstatehash")
+    for table in ["accounts", "characters", "regions"]:
+      assert table in before["tables"]
+    assert "statehash_tables" not in before["tables"]
+    assert "changes_characters" not in before["tables"]
+
+    self.mainLogger.info ("Changes to the state...")
+    reorgBlock = self.rpc.xaya.getbestblockhash ()
+    self.moveCharactersTo ({"domob": {"x": 10, "y": -5}})
+    after = self.getRpc ("getstatehash")
+    assert after["statehash"] != before["statehash"]
+    assert after["tables"]["characters"] != before["tables"]["characters"]
+
+    self.mainLogger.info ("Reorg...")
+    blk = self.rpc.xaya.getblockhash (
+        self.rpc.xaya.getblock (reorgBlock)["height"] + 1)
+    self.rpc.xaya.invalidateblock (blk)
+    self.assertEqual (self.getRpc ("getstatehash"), before)
+    self.rpc.xaya.reconsiderblock (blk)
+    self.assertEqual (self.getRpc ("getstatehash"), after)
+
+
+if __name__ == "__main__":
+  StateHashTest ().main ()
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -29,25 +29,121 @@
 
 #include <glog/logging.h>
 
+#include <array>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 namespace pxd
 {
 
+namespace
+{
+
+/** Number of distinct rotations of a building shape.  */
+constexpr int NUM_ROTATIONS = 6;
+
+/**
+ * The shape tiles (relative to the centre) of all building types of
+ * a given chain, precomputed for each possible rotation.  This avoids
+ * looking up the roconfig and rotating every tile each time we need
+ * the shape of some building.
+ */
+class RotatedShapes
+{
+
+private:
+
+  /** Shape tiles for each rotation step.  */
+  using ShapeArray = std::array<std::vector<HexCoord>, NUM_ROTATIONS>;
+
+  /** The shapes for each building type.  */
+  std::unordered_map<std::string, ShapeArray> shapes;
+
+  explicit RotatedShapes (const xaya::Chain chain)
+  {
+    const RoConfig cfg(chain);
+    for (const auto& entry : cfg->building_types ())
+      {
+        auto& cur = shapes[entry.first];
+        for (int rot = 0; rot < NUM_ROTATIONS; ++rot)
+          {
+            cur[rot].reserve (entry.second.shape_tiles ().size ());
+            for (const auto& pbTile : entry.second.shape_tiles ())
+              cur[rot].push_back (CoordFromProto (pbTile).RotateCW (rot));
+          }
+      }
+  }
+
+public:
+
+  RotatedShapes () = delete;
+  RotatedShapes (const RotatedShapes&) = delete;
+  void operator= (const RotatedShapes&) = delete;
+
+  /**
+   * Returns the instance for the given chain.  It is constructed on first
+   * use and then kept around for the lifetime of the process.
+   */
+  static const RotatedShapes&
+  Get (const xaya::Chain chain)
+  {
+    switch (chain)
+      {
+      case xaya::Chain::MAIN:
+        {
+          static const RotatedShapes mainnet(chain);
+          return mainnet;
+        }
+      case xaya::Chain::TEST:
+        {
+          static const RotatedShapes testnet(chain);
+          return testnet;
+        }
+      case xaya::Chain::REGTEST:
+        {
+          static const RotatedShapes regtest(chain);
+          return regtest;
+        }
+      default:
+        LOG (FATAL) << "Unexpected chain: " << static_cast<int> (chain);
+      }
+  }
+
+  /**
+   * Returns the relative shape tiles of a building type with the
+   * given number of rotation steps applied.
+   */
+  const std::vector<HexCoord>&
+  Lookup (const std::string& type, const int rot) const
+  {
+    const auto mit = shapes.find (type);
+    CHECK (mit != shapes.end ()) << "Unknown building: " << type;
+
+    int steps = rot % NUM_ROTATIONS;
+    if (steps < 0)
+      steps += NUM_ROTATIONS;
+
+    return mit->second[steps];
+  }
+
+};
+
+} // anonymous namespace
+
 std::vector<HexCoord>
 GetBuildingShape (const std::string& type,
                   const proto::ShapeTransformation& trafo,
                   const HexCoord& pos, const xaya::Chain chain)
 {
-  const auto& roData = RoConfig (chain).Building (type);
+  const auto& tiles = RotatedShapes::Get (chain).Lookup (
+      type, trafo.rotation_steps ());
 
   std::vector<HexCoord> res;
-  res.reserve (roData.shape_tiles ().size ());
-  for (const auto& pbTile : roData.shape_tiles ())
-    {
-      HexCoord c = CoordFromProto (pbTile);
-      c = c.RotateCW (trafo.rotation_steps ()); 
-      c += pos;
-      res.push_back (c);
-    }
+  res.reserve (tiles.size ());
+  for (const auto& c : tiles)
+    res.push_back (c + pos);
 
   return res;
 }
@@ -180,14 +276,60 @@ ProcessEnterBuildings (Database& db, DynObstacles& dyn, const Context& ctx)
 {
   BuildingsTable buildings(db);
   CharacterTable characters(db);
-  auto res = characters.QueryForEnterBuilding ();
+
+  /* Most characters with an intent are typically far away from their
+     building.  Thus we first go through just the positions and building
+     centres, and only construct full handles for the characters that may
+     actually be able to enter (or whose building no longer exists).  */
+
+  /** Enter radius and centre of a building.  */
+  struct BuildingData
+  {
+    bool exists;
+    HexCoord centre;
+    unsigned radius = 0;
+  };
+  std::map<Database::IdT, BuildingData> buildingData;
 
   unsigned processed = 0;
+  std::vector<Database::IdT> candidates;
+  characters.ProcessEnterBuildingIntents (
+    [&] (const Database::IdT id, const HexCoord& pos,
+         const Database::IdT buildingId)
+      {
+        ++processed;
+
+        auto mit = buildingData.find (buildingId);
+        if (mit == buildingData.end ())
+          {
+            BuildingData data;
+            std::string type;
+            data.exists = buildings.GetTypeAndCentre (buildingId, type,
+                                                      data.centre);
+            if (data.exists)
+              data.radius = ctx.RoConfig ().Building (type).enter_radius ();
+            mit = buildingData.emplace (buildingId, data).first;
+          }
+
+        const auto& data = mit->second;
+        if (data.exists)
+          {
+            const unsigned dist = HexCoord::DistanceL1 (pos, data.centre);
+            if (dist > data.radius)
+              {
+                /* This is probably the most common case, no log spam.  */
+                return;
+              }
+          }
+
+        candidates.push_back (id);
+      });
+
   unsigned entered = 0;
-  while (res.Step ())
+  for (const auto id : candidates)
     {
-      ++processed;
-      auto c = characters.GetFromResult (res);
+      auto c = characters.GetById (id);
+      CHECK (c != nullptr);
 
       if (c->IsBusy ())
         {
@@ -214,11 +356,7 @@ ProcessEnterBuildings (Database& db, DynObstacles& dyn, const Context& ctx)
 
       const unsigned dist
           = HexCoord::DistanceL1 (c->GetPosition (), b->GetCentre ());
-      if (dist > ctx.RoConfig ().Building (b->GetType ()).enter_radius ())
-        {
-          /* This is probably the most common case, no log spam here.  */
-          continue;
-        }
+      CHECK_LE (dist, ctx.RoConfig ().Building (b->GetType ()).enter_radius ());
 
       LOG (INFO)
           << "Character " << c->GetId () << " is entering " << buildingId;
@@ -18,6 +18,7 @@
 
 #include "buildings.hpp"
 
+#include "protoutils.hpp"
 #include "testutils.hpp"
 
 #include "database/character.hpp"
@@ -73,17 +74,36 @@ TEST_F (BuildingsTests, GetBuildingShape)
   EXPECT_DEATH (GetBuildingShape (*tbl.GetById (id2), ctx), "Unknown building");
 }
 
+TEST_F (BuildingsTests, GetBuildingShapeAllRotations)
+{
+  const HexCoord pos(10, -3);
+  for (const auto& entry : ctx.RoConfig ()->building_types ())
+    for (int rot = 0; rot < 12; ++rot)
+      {
+        proto::ShapeTransformation trafo;
+        trafo.set_rotation_steps (rot);
+
+        std::vector<HexCoord> expected;
+        for (const auto& pbTile : entry.second.shape_tiles ())
+          expected.push_back (CoordFromProto (pbTile).RotateCW (rot) + pos);
+
+        EXPECT_EQ (GetBuildingShape (entry.first, trafo, pos, ctx.Chain ()),
+                   expected)
+            << entry.first << " rotated by " << rot;
+      }
+}
+
 TEST_F (BuildingsTests, UpdateBuildingStats)
 {
   auto h = tbl.CreateNew ("r rt", "domob", Faction::RED);
   UpdateBuildingStats (*h, ctx.Chain ());
-  EXPECT_EQ (h->GetProto ().combat_data ().attacks_size (), 1);
+  EXPECT_EQ (h->GetCombatData ().attacks_size (), 1);
   EXPECT_EQ (h->GetRegenData ().max_hp ().armour (), 1'000);
   EXPECT_EQ (h->GetHP ().armour (), 1'000);
 
   h->MutableProto ().set_foundation (true);
   UpdateBuildingStats (*h, ctx.Chain ());
-  EXPECT_EQ (h->GetProto ().combat_data ().attacks_size (), 0);
+  EXPECT_EQ (h->GetCombatData ().attacks_size (), 0);
   EXPECT_EQ (h->GetRegenData ().max_hp ().armour (), 100);
   EXPECT_EQ (h->GetHP ().armour (), 100);
 }
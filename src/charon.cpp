@@ -22,6 +22,7 @@
 
 #include "pxrpcserver.hpp"
 #include "rest.hpp"
+#include "rpccache.hpp"
 
 #include <charon/notifications.hpp>
 #include <charon/rpcserver.hpp>
@@ -40,6 +41,7 @@
 #include <condition_variable>
 #include <map>
 #include <mutex>
+#include <set>
 #include <string>
 
 namespace pxd
@@ -65,6 +67,9 @@ DEFINE_string (charon_pubsub_service, "",
 DEFINE_int32 (charon_timeout_ms, 3000,
               "Timeout in ms that the Charon client will wait"
               " for a server response");
+DEFINE_int32 (charon_cache_max_age_ms, 60'000,
+              "Maximum age in ms of responses cached by the Charon client"
+              " for the current block (zero for no limit)");
 
 DEFINE_string (rest_endpoint, "https://rest.taurion.io",
                "URL for the REST API that is used in the Charon client");
@@ -116,9 +121,13 @@ const std::map<std::string, PXRpcMethod> CHARON_METHODS = {
   {"getaccounts", &PXRpcServer::getaccountsI},
   {"getbuildings", &PXRpcServer::getbuildingsI},
   {"getcharacters", &PXRpcServer::getcharactersI},
+  {"getbuildingsinarea", &PXRpcServer::getbuildingsinareaI},
+  {"getcharactersinarea", &PXRpcServer::getcharactersinareaI},
   {"getgroundloot", &PXRpcServer::getgroundlootI},
   {"getongoings", &PXRpcServer::getongoingsI},
   {"getregions", &PXRpcServer::getregionsI},
+  {"getchangessince", &PXRpcServer::getchangessinceI},
+  {"getstatehash", &PXRpcServer::getstatehashI},
   {"getmoneysupply", &PXRpcServer::getmoneysupplyI},
   {"getprizestats", &PXRpcServer::getprizestatsI},
   {"gettradehistory", &PXRpcServer::gettradehistoryI},
@@ -128,6 +137,15 @@ const std::map<std::string, PXRpcMethod> CHARON_METHODS = {
   {"getversion", &PXRpcServer::getversionI},
 };
 
+/**
+ * Methods forwarded through Charon whose results must not be cached by the
+ * client.  The cache is only invalidated on new blocks, but the pending
+ * state changes in between.
+ */
+const std::set<std::string> UNCACHED_METHODS = {
+  "getpendingstate",
+};
+
 /**
  * UpdateWaiter implementation that forwards wait calls to a given call
  * on a PXRpcServer instance.
@@ -388,6 +406,13 @@ private:
   /** The REST client.  */
   RestClient rest;
 
+  /**
+   * Cache for state methods forwarded through Charon (except for those
+   * in UNCACHED_METHODS).  The current block is updated from the results
+   * of waitforchange.
+   */
+  CoalescingRpcCache cache;
+
   /** The RPC server, if one has been started / set up.  */
   std::unique_ptr<RpcServer> rpc;
 
@@ -406,7 +431,8 @@ public:
                              const std::string& clientJid,
                              const std::string& password)
     : client(serverJid, GetBackendVersion (), clientJid, password),
-      rest(FLAGS_rest_endpoint)
+      rest(FLAGS_rest_endpoint),
+      cache(std::chrono::milliseconds (FLAGS_charon_cache_max_age_ms))
   {
     if (!FLAGS_charon_cafile.empty ())
       client.SetRootCA (FLAGS_charon_cafile);
@@ -440,6 +466,8 @@ const std::map<std::string, RealCharonClient::RpcServer::NonStateMethod>
     {"setpathdata", &NonStateRpcServer::setpathdataI},
     {"findpath", &NonStateRpcServer::findpathI},
     {"encodewaypoints", &NonStateRpcServer::encodewaypointsI},
+    {"encodewaypointscompact",
+     &NonStateRpcServer::encodewaypointscompactI},
     {"getregionat", &NonStateRpcServer::getregionatI},
     {"getbuildingshape", &NonStateRpcServer::getbuildingshapeI},
   };
@@ -489,7 +517,14 @@ RealCharonClient::RpcServer::HandleMethodCall (jsonrpc::Procedure& proc,
   if (CHARON_METHODS.find (method) != CHARON_METHODS.end ())
     {
       VLOG (1) << "Forwarding method " << method << " through Charon";
-      result = parent.client.ForwardMethod (method, params);
+      const auto fetch = [this, &method, &params] ()
+        {
+          return parent.client.ForwardMethod (method, params);
+        };
+      if (UNCACHED_METHODS.count (method) > 0)
+        result = fetch ();
+      else
+        result = parent.cache.Get (method, params, fetch);
 
       /* getversion is a special case, where we want to return both the
          result of the server and the local one from nonstate.  */
@@ -522,6 +557,11 @@ RealCharonClient::RpcServer::HandleMethodCall (jsonrpc::Procedure& proc,
             "wait method expects a single positional argument");
 
       result = parent.client.WaitForChange (mitWait->second, params[0]);
+
+      /* The new block hash tells us when cached results become stale.  */
+      if (method == "waitforchange" && result.isString ())
+        parent.cache.SetBlock (result.asString ());
+
       return;
     }
 
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -25,9 +25,11 @@
 #include "database/character.hpp"
 #include "database/dex.hpp"
 #include "database/fighter.hpp"
+#include "database/idbatch.hpp"
 #include "database/ongoing.hpp"
 #include "database/region.hpp"
 #include "database/target.hpp"
+#include "database/tracing.hpp"
 #include "hexagonal/coord.hpp"
 
 #include <algorithm>
@@ -52,29 +54,6 @@ constexpr unsigned BUILDING_INVENTORY_DROP_PERCENT = 30;
  */
 constexpr unsigned EQUIPPED_FITMENT_DROP_PERCENT = 20;
 
-/**
- * Modifications to combat-related stats.
- */
-struct CombatModifier
-{
-
-  /** Modification of combat damage.  */
-  StatModifier damage;
-
-  /** Modifiction of range.  */
-  StatModifier range;
-
-  /** Modification of hit chance for attacks of this fighter.  */
-  StatModifier hitChance;
-
-  CombatModifier () = default;
-  CombatModifier (CombatModifier&&) = default;
-
-  CombatModifier (const CombatModifier&) = delete;
-  void operator= (const CombatModifier&) = delete;
-
-};
-
 /**
  * Computes the modifier to apply for a given entity (composed of base
  * modifiers, low-HP boosts and effects).
@@ -124,6 +103,44 @@ TargetKey::ToProto () const
   return res;
 }
 
+void
+CombatModifierMemo::Clear ()
+{
+  height = Context::NO_HEIGHT;
+  modifiers.clear ();
+}
+
+void
+CombatModifierMemo::Start (const unsigned h)
+{
+  Clear ();
+  height = h;
+}
+
+void
+CombatModifierMemo::Add (const TargetKey& id, CombatModifier&& mod)
+{
+  CHECK_NE (height, Context::NO_HEIGHT);
+  CHECK (modifiers.emplace (id, std::move (mod)).second);
+}
+
+bool
+CombatModifierMemo::Take (const unsigned h, const TargetKey& id,
+                          CombatModifier& mod)
+{
+  if (height == Context::NO_HEIGHT || height + 1 != h)
+    return false;
+
+  auto mit = modifiers.find (id);
+  if (mit == modifiers.end ())
+    return false;
+
+  mod = std::move (mit->second);
+  modifiers.erase (mit);
+
+  return true;
+}
+
 /* ************************************************************************** */
 
 namespace
@@ -187,6 +204,9 @@ private:
   xaya::Random& rnd;
   const Context& ctx;
 
+  /** If not null, memo into which we record the computed modifiers.  */
+  CombatModifierMemo* memo;
+
   /**
    * Runs target finding for the normal attacks, setting (or clearing)
    * the target field in the result.
@@ -216,11 +236,12 @@ private:
 
 public:
 
-  TargetFindingProcessor (Database& db, xaya::Random& r, const Context& c)
+  TargetFindingProcessor (Database& db, xaya::Random& r, const Context& c,
+                          CombatModifierMemo* m)
     : buildings(db), characters(db),
       fighters(buildings, characters),
       targets(db),
-      rnd(r), ctx(c)
+      rnd(r), ctx(c), memo(m)
   {}
 
   /**
@@ -352,6 +373,9 @@ TargetFindingProcessor::SelectFriendlyTargets (const CombatModifier& mod,
 TargetFindingProcessor::TargetingResult
 TargetFindingProcessor::SelectTarget (FighterTable::Handle f)
 {
+  PXD_TRACE_SPAN ("TargetFindingProcessor::SelectTarget",
+                  f->GetIdAsTarget ().id ());
+
   TargetingResult res(std::move (f));
 
   if (ctx.Map ().SafeZones ().IsNoCombat (res.f->GetCombatPosition ()))
@@ -370,6 +394,9 @@ TargetFindingProcessor::SelectTarget (FighterTable::Handle f)
   SelectNormalTarget (mod, res);
   SelectFriendlyTargets (mod, res);
 
+  if (memo != nullptr)
+    memo->Add (res.id, std::move (mod));
+
   return res;
 }
 
@@ -401,7 +428,17 @@ TargetFindingProcessor::ProcessAll ()
 void
 FindCombatTargets (Database& db, xaya::Random& rnd, const Context& ctx)
 {
-  TargetFindingProcessor proc(db, rnd, ctx);
+  FindCombatTargets (db, rnd, ctx, nullptr);
+}
+
+void
+FindCombatTargets (Database& db, xaya::Random& rnd, const Context& ctx,
+                   CombatModifierMemo* memo)
+{
+  if (memo != nullptr)
+    memo->Start (ctx.Height ());
+
+  TargetFindingProcessor proc(db, rnd, ctx, memo);
   proc.ProcessAll ();
 }
 
@@ -438,6 +475,9 @@ private:
   xaya::Random& rnd;
   const Context& ctx;
 
+  /** If not null, memo of modifiers from the previous target finding.  */
+  CombatModifierMemo* memo;
+
   BuildingsTable buildings;
   CharacterTable characters;
   FighterTable fighters;
@@ -547,8 +587,9 @@ private:
 public:
 
   explicit DamageProcessor (Database& db, DamageLists& lst,
-                            xaya::Random& r, const Context& c)
-    : dl(lst), rnd(r), ctx(c),
+                            xaya::Random& r, const Context& c,
+                            CombatModifierMemo* m)
+    : dl(lst), rnd(r), ctx(c), memo(m),
       buildings(db), characters(db),
       fighters(buildings, characters),
       targets(db)
@@ -785,6 +826,8 @@ void
 DamageProcessor::DealDamage (FighterTable::Handle f, const bool forGainHp,
                              std::set<TargetKey>& newDead)
 {
+  PXD_TRACE_SPAN ("DamageProcessor::DealDamage", f->GetIdAsTarget ().id ());
+
   const auto& cd = f->GetCombatData ();
   const auto& pos = f->GetCombatPosition ();
   CHECK (!ctx.Map ().SafeZones ().IsNoCombat (pos));
@@ -898,11 +941,30 @@ DamageProcessor::Process ()
   modifiers.clear ();
   fighters.ProcessWithTarget ([&] (FighterTable::Handle f)
     {
+      const TargetKey id(f->GetIdAsTarget ());
+
       CombatModifier mod;
-      ComputeModifier (*f, mod);
-      CHECK (modifiers.emplace (f->GetIdAsTarget (), std::move (mod)).second);
+      if (memo == nullptr || !memo->Take (ctx.Height (), id, mod))
+        ComputeModifier (*f, mod);
+#ifdef ENABLE_SLOW_ASSERTS
+      else
+        {
+          CombatModifier fresh;
+          ComputeModifier (*f, fresh);
+          CHECK (fresh == mod)
+              << "Memoised combat modifier mismatch for "
+              << id.ToProto ().DebugString ();
+        }
+#endif // ENABLE_SLOW_ASSERTS
+
+      CHECK (modifiers.emplace (id, std::move (mod)).second);
     });
 
+  /* The remaining entries (if any) are not needed anymore.  Clear them
+     so that they are not used for any later block by accident.  */
+  if (memo != nullptr)
+    memo->Clear ();
+
   std::set<TargetKey> newDead;
 
   /* We first process all attacks with gain_hp, and only later all without.
@@ -1033,7 +1095,15 @@ std::set<TargetKey>
 DealCombatDamage (Database& db, DamageLists& dl,
                   xaya::Random& rnd, const Context& ctx)
 {
-  DamageProcessor proc(db, dl, rnd, ctx);
+  return DealCombatDamage (db, dl, rnd, ctx, nullptr);
+}
+
+std::set<TargetKey>
+DealCombatDamage (Database& db, DamageLists& dl,
+                  xaya::Random& rnd, const Context& ctx,
+                  CombatModifierMemo* memo)
+{
+  DamageProcessor proc(db, dl, rnd, ctx, memo);
   proc.Process ();
   return proc.GetDead ();
 }
@@ -1045,12 +1115,32 @@ namespace
 
 /**
  * Utility class that handles processing of killed characters and buildings.
+ * The kills are processed in batches:  All dead entities of one type are
+ * loaded with a few bulk queries (in ID order), and the loot they drop as
+ * well as cancelled prospections are aggregated in memory.  Those are then
+ * written to the database in Finish, so that each affected ground-loot
+ * tile and region is updated exactly once.
  */
 class KillProcessor
 {
 
 private:
 
+  /**
+   * Data about a destroyed building that is collected from the various
+   * tables before the building's loot is dropped.
+   */
+  struct DestroyedBuilding
+  {
+
+    /** The building's centre, where the loot will be dropped.  */
+    HexCoord centre;
+
+    /** The combined inventory of everything in the building.  */
+    Inventory totalInv;
+
+  };
+
   xaya::Random& rnd;
   const Context& ctx;
 
@@ -1065,6 +1155,15 @@ private:
   OngoingsTable ongoings;
   RegionsTable regions;
 
+  /** Loot that will be dropped, aggregated by ground tile.  */
+  std::map<HexCoord, Inventory> droppedLoot;
+
+  /**
+   * Regions whose prospection has to be cancelled, mapped to the ID of the
+   * killed character that was prospecting them.
+   */
+  std::map<RegionMap::IdT, Database::IdT> cancelledProspections;
+
   /**
    * Deletes a character from the database in all tables.  Takes ownership
    * of and destructs the handle to it.
@@ -1079,6 +1178,16 @@ private:
     characters.DeleteById (id);
   }
 
+  /**
+   * Processes a killed character loaded from the database.
+   */
+  void ProcessCharacter (CharacterTable::Handle c);
+
+  /**
+   * Processes a batch of at most ID_BATCH_SIZE destroyed buildings.
+   */
+  void ProcessBuildingBatch (const std::vector<Database::IdT>& ids);
+
 public:
 
   explicit KillProcessor (Database& db, DamageLists& dl, GroundLootTable& l,
@@ -1093,21 +1202,31 @@ public:
   void operator= (const KillProcessor&) = delete;
 
   /**
-   * Processes everything for a character killed in combat.
+   * Processes everything for characters killed in combat.  The IDs
+   * must be sorted in ascending order.
    */
-  void ProcessCharacter (const Database::IdT id);
+  void ProcessCharacters (const std::vector<Database::IdT>& ids);
 
   /**
-   * Processes everything for a building that has been destroyed.
+   * Processes everything for buildings that have been destroyed.  The IDs
+   * must be sorted in ascending order.
    */
-  void ProcessBuilding (const Database::IdT id);
+  void ProcessBuildings (const std::vector<Database::IdT>& ids);
+
+  /**
+   * Writes the aggregated loot and region updates to the database.
+   * This must be called after all kills have been processed.
+   */
+  void Finish ();
 
 };
 
 void
-KillProcessor::ProcessCharacter (const Database::IdT id)
+KillProcessor::ProcessCharacter (CharacterTable::Handle c)
 {
-  auto c = characters.GetById (id);
+  const auto id = c->GetId ();
+  PXD_TRACE_SPAN ("KillProcessor::ProcessCharacter", id);
+
   const auto& pb = c->GetProto ();
   const auto& pos = c->GetPosition ();
 
@@ -1124,10 +1243,8 @@ KillProcessor::ProcessCharacter (const Database::IdT id)
               << "Killed character " << id
               << " was prospecting region " << regionId
               << ", cancelling";
-
-          auto r = regions.GetById (regionId);
-          CHECK_EQ (r->GetProto ().prospecting_character (), id);
-          r->MutableProto ().clear_prospecting_character ();
+          CHECK (cancelledProspections.emplace (regionId, id).second)
+              << "Multiple killed characters prospecting region " << regionId;
         }
     }
 
@@ -1144,22 +1261,32 @@ KillProcessor::ProcessCharacter (const Database::IdT id)
       LOG (INFO)
           << "Killed character " << id
           << " has non-empty inventory/fitments, dropping loot at " << pos;
+      droppedLoot[pos] += inv;
+    }
 
-      auto ground = loot.GetByCoord (pos);
-      auto& groundInv = ground->GetInventory ();
-      for (const auto& entry : inv.GetFungible ())
+  DeleteCharacter (std::move (c));
+}
+
+void
+KillProcessor::ProcessCharacters (const std::vector<Database::IdT>& ids)
+{
+  PXD_TRACE_SPAN ("KillProcessor::ProcessCharacters", ids.size ());
+
+  for (const auto& batch : SplitIdBatches (ids))
+    {
+      size_t found = 0;
+      auto res = characters.QueryForIds (batch);
+      while (res.Step ())
         {
-          VLOG (1)
-              << "Dropping " << entry.second << " of " << entry.first;
-          groundInv.AddFungibleCount (entry.first, entry.second);
+          ProcessCharacter (characters.GetFromResult (res));
+          ++found;
         }
+      CHECK_EQ (found, batch.size ()) << "Killed non-existant character";
     }
-
-  DeleteCharacter (std::move (c));
 }
 
 void
-KillProcessor::ProcessBuilding (const Database::IdT id)
+KillProcessor::ProcessBuildingBatch (const std::vector<Database::IdT>& ids)
 {
   /* Some of the buildings inventory will be dropped on the floor, so we
      need to compute a "combined inventory" of everything that is inside
@@ -1171,19 +1298,37 @@ KillProcessor::ProcessBuilding (const Database::IdT id)
 
      In addition to that, we destroy all characters inside the building.  */
 
-  Inventory totalInv;
+  std::map<Database::IdT, DestroyedBuilding> destroyed;
 
   {
-    auto res = inventories.QueryForBuilding (id);
+    auto res = buildings.QueryForIds (ids);
     while (res.Step ())
-      totalInv += inventories.GetFromResult (res)->GetInventory ();
+      {
+        auto b = buildings.GetFromResult (res);
+        auto& entry = destroyed[b->GetId ()];
+        entry.centre = b->GetCentre ();
+        if (b->GetProto ().has_construction_inventory ())
+          entry.totalInv += Inventory (b->GetProto ().construction_inventory ());
+      }
   }
+  for (const auto id : ids)
+    CHECK (destroyed.count (id) > 0) << "Killed non-existant building " << id;
 
   {
-    auto res = characters.QueryForBuilding (id);
+    auto res = inventories.QueryForBuildings (ids);
+    while (res.Step ())
+      {
+        auto h = inventories.GetFromResult (res);
+        destroyed.at (h->GetBuildingId ()).totalInv += h->GetInventory ();
+      }
+  }
+
+  {
+    auto res = characters.QueryForBuildings (ids);
     while (res.Step ())
       {
         auto c = characters.GetFromResult (res);
+        auto& totalInv = destroyed.at (c->GetBuildingId ()).totalInv;
         totalInv += c->GetInventory ();
         const auto& pb = c->GetProto ();
         /* Normally the character always has a vehicle, but in some tests
@@ -1196,79 +1341,118 @@ KillProcessor::ProcessBuilding (const Database::IdT id)
       }
   }
 
-  {
-    auto res = ongoings.QueryForBuilding (id);
-    while (res.Step ())
-      {
-        auto op = ongoings.GetFromResult (res);
+  for (auto& entry : destroyed)
+    {
+      const auto id = entry.first;
+      PXD_TRACE_SPAN ("KillProcessor::ProcessBuilding", id);
 
-        if (op->GetProto ().has_blueprint_copy ())
-          {
-            const auto& type
-                = op->GetProto ().blueprint_copy ().original_type ();
-            totalInv.AddFungibleCount (type, 1);
-            continue;
-          }
+      auto& totalInv = entry.second.totalInv;
 
-        if (op->GetProto ().has_item_construction ())
-          {
-            const auto& c = op->GetProto ().item_construction ();
-            if (c.has_original_type ())
-              totalInv.AddFungibleCount (c.original_type (), 1);
-            continue;
-          }
-      }
-  }
+      for (const auto opId : ongoings.GetIdsForBuilding (id))
+        {
+          auto op = ongoings.GetById (opId);
+          CHECK (op != nullptr);
 
-  for (const auto& entry : orders.GetReservedCoins (id))
-    {
-      auto a = accounts.GetByName (entry.first);
-      CHECK (a != nullptr);
-      a->AddBalance (entry.second);
-      VLOG (1)
-          << "Refunded " << entry.second << " coins to " << entry.first
-          << " for open bids in destroyed building " << id;
+          if (op->GetProto ().has_blueprint_copy ())
+            {
+              const auto& type
+                  = op->GetProto ().blueprint_copy ().original_type ();
+              totalInv.AddFungibleCount (type, 1);
+              continue;
+            }
+
+          if (op->GetProto ().has_item_construction ())
+            {
+              const auto& c = op->GetProto ().item_construction ();
+              if (c.has_original_type ())
+                totalInv.AddFungibleCount (c.original_type (), 1);
+              continue;
+            }
+        }
+
+      for (const auto& reserved : orders.GetReservedCoins (id))
+        {
+          auto a = accounts.GetByName (reserved.first);
+          CHECK (a != nullptr);
+          a->AddBalance (reserved.second);
+          VLOG (1)
+              << "Refunded " << reserved.second << " coins to "
+              << reserved.first
+              << " for open bids in destroyed building " << id;
+        }
+      for (const auto& reserved : orders.GetReservedQuantities (id))
+        totalInv += reserved.second;
+
+      /* The underlying proto map does not have a well-defined order.  Since
+         the random rolls depend on the other, make sure to explicitly sort
+         the list of inventory positions.  */
+      const auto& protoInvMap = totalInv.GetFungible ();
+      const std::map<std::string, Quantity> invItems (protoInvMap.begin (),
+                                                      protoInvMap.end ());
+
+      const auto& pos = entry.second.centre;
+      for (const auto& item : invItems)
+        {
+          CHECK_GT (item.second, 0);
+          if (!rnd.ProbabilityRoll (BUILDING_INVENTORY_DROP_PERCENT, 100))
+            {
+              VLOG (1)
+                  << "Not dropping " << item.second << " " << item.first
+                  << " from destroyed building " << id;
+              continue;
+            }
+
+          VLOG (1)
+              << "Dropping " << item.second << " " << item.first
+              << " from destroyed building " << id << " at " << pos;
+          droppedLoot[pos].AddFungibleCount (item.first, item.second);
+        }
+
+      inventories.RemoveBuilding (id);
+      ongoings.DeleteForBuilding (id);
+      orders.DeleteForBuilding (id);
+      buildings.DeleteById (id);
     }
-  for (const auto& entry : orders.GetReservedQuantities (id))
-    totalInv += entry.second;
+}
 
-  auto b = buildings.GetById (id);
-  CHECK (b != nullptr) << "Killed non-existant building " << id;
-  if (b->GetProto ().has_construction_inventory ())
-    totalInv += Inventory (b->GetProto ().construction_inventory ());
+void
+KillProcessor::ProcessBuildings (const std::vector<Database::IdT>& ids)
+{
+  PXD_TRACE_SPAN ("KillProcessor::ProcessBuildings", ids.size ());
 
-  /* The underlying proto map does not have a well-defined order.  Since the
-     random rolls depend on the other, make sure to explicitly sort the
-     the list of inventory positions.  */
-  const auto& protoInvMap = totalInv.GetFungible ();
-  const std::map<std::string, Quantity> invItems (protoInvMap.begin (),
-                                                  protoInvMap.end ());
+  for (const auto& batch : SplitIdBatches (ids))
+    ProcessBuildingBatch (batch);
+}
 
-  auto lootHandle = loot.GetByCoord (b->GetCentre ());
-  b.reset ();
+void
+KillProcessor::Finish ()
+{
+  PXD_TRACE_SPAN ("KillProcessor::Finish");
 
-  for (const auto& entry : invItems)
+  for (const auto& entry : cancelledProspections)
     {
-      CHECK_GT (entry.second, 0);
-      if (!rnd.ProbabilityRoll (BUILDING_INVENTORY_DROP_PERCENT, 100))
+      auto r = regions.GetById (entry.first);
+      CHECK_EQ (r->GetProto ().prospecting_character (), entry.second);
+      r->MutableProto ().clear_prospecting_character ();
+    }
+  cancelledProspections.clear ();
+
+  for (const auto& entry : droppedLoot)
+    {
+      if (entry.second.IsEmpty ())
+        continue;
+
+      auto ground = loot.GetByCoord (entry.first);
+      auto& groundInv = ground->GetInventory ();
+      for (const auto& item : entry.second.GetFungible ())
         {
           VLOG (1)
-              << "Not dropping " << entry.second << " " << entry.first
-              << " from destroyed building " << id;
-          continue;
+              << "Dropping " << item.second << " of " << item.first
+              << " at " << entry.first;
+          groundInv.AddFungibleCount (item.first, item.second);
         }
-
-      VLOG (1)
-          << "Dropping " << entry.second << " " << entry.first
-          << " from destroyed building " << id
-          << " at " << lootHandle->GetPosition ();
-      lootHandle->GetInventory ().AddFungibleCount (entry.first, entry.second);
     }
-
-  inventories.RemoveBuilding (id);
-  ongoings.DeleteForBuilding (id);
-  orders.DeleteForBuilding (id);
-  buildings.DeleteById (id);
+  droppedLoot.clear ();
 }
 
 } // anonymous namespace
@@ -1278,23 +1462,30 @@ ProcessKills (Database& db, DamageLists& dl, GroundLootTable& loot,
               const std::set<TargetKey>& dead,
               xaya::Random& rnd, const Context& ctx)
 {
-  KillProcessor proc(db, dl, loot, rnd, ctx);
-
+  /* The dead set is ordered by type and then ID, so the ID lists we
+     collect here are sorted.  Buildings come before characters, which
+     is the order in which the random rolls are done.  */
+  std::vector<Database::IdT> deadBuildings, deadCharacters;
   for (const auto& id : dead)
     switch (id.first)
       {
       case proto::TargetId::TYPE_CHARACTER:
-        proc.ProcessCharacter (id.second);
+        deadCharacters.push_back (id.second);
         break;
 
       case proto::TargetId::TYPE_BUILDING:
-        proc.ProcessBuilding (id.second);
+        deadBuildings.push_back (id.second);
         break;
 
       default:
         LOG (FATAL)
             << "Invalid target type killed: " << static_cast<int> (id.first);
       }
+
+  KillProcessor proc(db, dl, loot, rnd, ctx);
+  proc.ProcessBuildings (deadBuildings);
+  proc.ProcessCharacters (deadCharacters);
+  proc.Finish ();
 }
 
 /* ************************************************************************** */
@@ -1332,10 +1523,13 @@ RegenerateHpType (const unsigned max, const unsigned mhpRate,
  * Applies HP regeneration (if any) to a given fighter.
  */
 void
-RegenerateFighterHP (FighterTable::Handle f)
+RegenerateFighterHP (CombatEntity& f)
 {
-  const auto& regen = f->GetRegenData ();
-  const auto& hp = f->GetHP ();
+  const auto& regen = f.GetRegenData ();
+
+  /* The HP are copied, since MutableHP may change what GetHP returns
+     (in particular with lazy regeneration).  */
+  const proto::HP hp = f.GetHP ();
 
   unsigned cur, milli;
 
@@ -1343,11 +1537,11 @@ RegenerateFighterHP (FighterTable::Handle f)
           regen.max_hp ().armour (), regen.regeneration_mhp ().armour (),
           hp.armour (), hp.mhp ().armour (), cur, milli))
     {
-      f->MutableHP ().set_armour (cur);
-      f->MutableHP ().mutable_mhp ()->set_armour (milli);
+      f.MutableHP ().set_armour (cur);
+      f.MutableHP ().mutable_mhp ()->set_armour (milli);
     }
 
-  const StatModifier shieldRegenMod(f->GetEffects ().shield_regen ());
+  const StatModifier shieldRegenMod(f.GetEffects ().shield_regen ());
   const unsigned shieldRate
       = shieldRegenMod (regen.regeneration_mhp ().shield ());
 
@@ -1355,8 +1549,8 @@ RegenerateFighterHP (FighterTable::Handle f)
           regen.max_hp ().shield (), shieldRate,
           hp.shield (), hp.mhp ().shield (), cur, milli))
     {
-      f->MutableHP ().set_shield (cur);
-      f->MutableHP ().mutable_mhp ()->set_shield (milli);
+      f.MutableHP ().set_shield (cur);
+      f.MutableHP ().mutable_mhp ()->set_shield (milli);
     }
 }
 
@@ -1371,17 +1565,75 @@ RegenerateHP (Database& db)
 
   fighters.ProcessForRegen ([] (FighterTable::Handle f)
     {
-      RegenerateFighterHP (std::move (f));
+      RegenerateFighterHP (*f);
     });
 }
 
+void
+RegenerateHpLazily (Database& db, const bool all, const Context& ctx)
+{
+  CHECK_EQ (db.GetLazyRegenHeight (), ctx.Height () - 1);
+
+  BuildingsTable buildings(db);
+  CharacterTable characters(db);
+  FighterTable fighters(buildings, characters);
+
+  /* For each fighter we process here, the HP are computed as of the last
+     block (which is the current lazy-regeneration height), then one step
+     of regeneration is applied explicitly and the HP are anchored at the
+     current block.  */
+  const auto cb = [all] (FighterTable::Handle f)
+    {
+      if (!all && !f->GetEffects ().has_shield_regen ())
+        return;
+
+      RegenerateFighterHP (*f);
+      f->AdvanceHpRegenHeight ();
+    };
+
+  if (all)
+    fighters.ProcessForRegen (cb);
+  else
+    fighters.ProcessForRegenWithEffects (cb);
+
+  db.SetLazyRegenHeight (ctx.Height ());
+}
+
 /* ************************************************************************** */
 
 void
 AllHpUpdates (Database& db, FameUpdater& fame, xaya::Random& rnd,
               const Context& ctx)
 {
-  const auto dead = DealCombatDamage (db, fame.GetDamageLists (), rnd, ctx);
+  AllHpUpdates (db, fame, rnd, ctx, nullptr);
+}
+
+void
+AllHpUpdates (Database& db, FameUpdater& fame, xaya::Random& rnd,
+              const Context& ctx, CombatModifierMemo* memo)
+{
+  /* With lazy regeneration, all HP changes done during damage and kills
+     are based on the HP after regeneration of the previous block.  */
+  const bool lazyRegen = ctx.Forks ().IsActive (Fork::LazyRegen);
+  bool regenAll = false;
+  if (lazyRegen)
+    {
+      const unsigned oldHeight = db.GetLazyRegenHeight ();
+      if (oldHeight == Database::NO_LAZY_REGEN)
+        {
+          LOG (INFO)
+              << "Switching to lazy HP regeneration at height "
+              << ctx.Height ();
+          regenAll = true;
+        }
+      else
+        CHECK_LT (oldHeight, ctx.Height ());
+
+      db.SetLazyRegenHeight (ctx.Height () - 1);
+    }
+
+  const auto dead
+      = DealCombatDamage (db, fame.GetDamageLists (), rnd, ctx, memo);
 
   for (const auto& id : dead)
     fame.UpdateForKill (id.ToProto ());
@@ -1389,7 +1641,10 @@ AllHpUpdates (Database& db, FameUpdater& fame, xaya::Random& rnd,
   GroundLootTable loot(db);
   ProcessKills (db, fame.GetDamageLists (), loot, dead, rnd, ctx);
 
-  RegenerateHP (db);
+  if (lazyRegen)
+    RegenerateHpLazily (db, regenAll, ctx);
+  else
+    RegenerateHP (db);
 }
 
 } // namespace pxd
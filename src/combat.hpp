@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -21,6 +21,7 @@
 
 #include "context.hpp"
 #include "fame.hpp"
+#include "modifier.hpp"
 
 #include "database/damagelists.hpp"
 #include "database/database.hpp"
@@ -30,6 +31,7 @@
 
 #include <xayautil/random.hpp>
 
+#include <map>
 #include <set>
 #include <utility>
 
@@ -62,11 +64,112 @@ public:
 
 };
 
+/**
+ * Modifications to combat-related stats.
+ */
+struct CombatModifier
+{
+
+  /** Modification of combat damage.  */
+  StatModifier damage;
+
+  /** Modifiction of range.  */
+  StatModifier range;
+
+  /** Modification of hit chance for attacks of this fighter.  */
+  StatModifier hitChance;
+
+  CombatModifier () = default;
+  CombatModifier (CombatModifier&&) = default;
+  CombatModifier& operator= (CombatModifier&&) = default;
+
+  CombatModifier (const CombatModifier&) = delete;
+  void operator= (const CombatModifier&) = delete;
+
+  bool
+  operator== (const CombatModifier& m) const
+  {
+    return damage == m.damage && range == m.range && hitChance == m.hitChance;
+  }
+
+};
+
+/**
+ * Memo of the combat modifiers computed for fighters during target finding.
+ * Nothing that influences them (HP, combat data and effects) changes between
+ * target finding at the end of one block and damage processing at the
+ * beginning of the next block, so the damage step can reuse them from here
+ * rather than recomputing.
+ *
+ * Entries are only used for damage processing at the height right after
+ * the one they were recorded for.  If an instance is kept across blocks,
+ * it must be cleared whenever blocks are not processed in sequence
+ * (e.g. when the parent block does not match).
+ */
+class CombatModifierMemo
+{
+
+private:
+
+  /** The block height at which the entries were recorded.  */
+  unsigned height = Context::NO_HEIGHT;
+
+  /** The memoised modifiers by fighter.  */
+  std::map<TargetKey, CombatModifier> modifiers;
+
+public:
+
+  CombatModifierMemo () = default;
+
+  CombatModifierMemo (const CombatModifierMemo&) = delete;
+  void operator= (const CombatModifierMemo&) = delete;
+
+  /**
+   * Removes all entries.
+   */
+  void Clear ();
+
+  /**
+   * Clears the memo and starts recording entries for the given height.
+   */
+  void Start (unsigned h);
+
+  /**
+   * Records the modifier for a given fighter.
+   */
+  void Add (const TargetKey& id, CombatModifier&& mod);
+
+  /**
+   * Tries to retrieve the modifier for the given fighter, for use in
+   * damage processing at the given height.  If there is a matching
+   * entry, it is moved into mod and removed from the memo, and true
+   * is returned.
+   */
+  bool Take (unsigned h, const TargetKey& id, CombatModifier& mod);
+
+  /**
+   * Returns the number of entries currently in the memo.
+   */
+  size_t
+  GetSize () const
+  {
+    return modifiers.size ();
+  }
+
+};
+
 /**
  * Finds combat targets for each fighter entity.
  */
 void FindCombatTargets (Database& db, xaya::Random& rnd, const Context& ctx);
 
+/**
+ * Finds combat targets and records the computed combat modifiers
+ * in the given memo (if not null).
+ */
+void FindCombatTargets (Database& db, xaya::Random& rnd, const Context& ctx,
+                        CombatModifierMemo* memo);
+
 /**
  * Computes the base (without stat modifiers) hit/miss chance for a given
  * target and applied damage.  Returned is the chance to hit in percent.
@@ -82,6 +185,14 @@ unsigned BaseHitChance (const proto::CombatData& target,
 std::set<TargetKey> DealCombatDamage (Database& db, DamageLists& dl,
                                       xaya::Random& rnd, const Context& ctx);
 
+/**
+ * Deals combat damage, reusing modifiers from the memo (if not null)
+ * where possible.
+ */
+std::set<TargetKey> DealCombatDamage (Database& db, DamageLists& dl,
+                                      xaya::Random& rnd, const Context& ctx,
+                                      CombatModifierMemo* memo);
+
 /**
  * Processes killed fighers from the given list, actually performing the
  * necessary database changes for having them dead.
@@ -95,6 +206,16 @@ void ProcessKills (Database& db, DamageLists& dl, GroundLootTable& loot,
  */
 void RegenerateHP (Database& db);
 
+/**
+ * Handles HP regeneration for the current block when lazy regeneration
+ * is active.  Only fighters whose regeneration differs from the closed-form
+ * computation (i.e. those with a shield-regeneration effect) are processed
+ * explicitly, unless all is set.  That is used when switching to lazy
+ * regeneration, so that all fighters get their HP anchored.  Afterwards,
+ * the lazy-regeneration height is advanced to the current block.
+ */
+void RegenerateHpLazily (Database& db, bool all, const Context& ctx);
+
 /**
  * Runs the three coupled steps to update HP at the beginning of computing
  * a block:  Dealing damage, handling kills and regenerating.
@@ -102,6 +223,13 @@ void RegenerateHP (Database& db);
 void AllHpUpdates (Database& db, FameUpdater& fame, xaya::Random& rnd,
                    const Context& ctx);
 
+/**
+ * Runs all HP updates, using the given memo of combat modifiers (if not null)
+ * for the damage step.
+ */
+void AllHpUpdates (Database& db, FameUpdater& fame, xaya::Random& rnd,
+                   const Context& ctx, CombatModifierMemo* memo);
+
 } // namespace pxd
 
 #endif // PXD_COMBAT_HPP
@@ -61,7 +61,7 @@ InsertCharacters (Database& db, const unsigned numIdle,
   for (unsigned i = 0; i < numIdle; ++i)
     {
       auto c = tbl.CreateNew ("red", Faction::RED);
-      c->MutableProto ().mutable_combat_data ();
+      c->MutableCombatData ();
       c.reset ();
     }
 
@@ -76,7 +76,7 @@ InsertCharacters (Database& db, const unsigned numIdle,
       c.reset ();
 
       c = tbl.CreateNew ("red", Faction::RED);
-      auto* cd = c->MutableProto ().mutable_combat_data ();
+      auto* cd = &c->MutableCombatData ();
       for (unsigned j = 0; j < numAttacks; ++j)
         {
           auto* attack = cd->add_attacks ();
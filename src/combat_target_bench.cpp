@@ -64,8 +64,7 @@ InsertCharacters (Database& db, const Context& ctx, const Faction f,
           {
             auto c = tbl.CreateNew (nm, f);
             c->SetPosition (pos);
-            auto& pb = c->MutableProto ();
-            auto* attack = pb.mutable_combat_data ()->add_attacks ();
+            auto* attack = c->MutableCombatData ().add_attacks ();
             attack->set_range (10);
             c.reset ();
           }
@@ -30,6 +30,7 @@
 #include "database/fighter.hpp"
 #include "database/ongoing.hpp"
 #include "database/region.hpp"
+#include "database/schema.hpp"
 #include "database/target.hpp"
 #include "hexagonal/coord.hpp"
 #include "proto/combat.pb.h"
@@ -44,6 +45,7 @@
 
 #include <algorithm>
 #include <map>
+#include <set>
 #include <vector>
 
 namespace pxd
@@ -97,7 +99,7 @@ protected:
     static proto::Attack&
     AddAttack (T& h)
   {
-    return *h.MutableProto ().mutable_combat_data ()->add_attacks ();
+    return *h.MutableCombatData ().add_attacks ();
   }
 
   /**
@@ -108,7 +110,7 @@ protected:
     static proto::Attack&
     AddFriendlyAttack (T& h)
   {
-    auto* res = h.MutableProto ().mutable_combat_data ()->add_attacks ();
+    auto* res = h.MutableCombatData ().add_attacks ();
     res->set_friendlies (true);
     return *res;
   }
@@ -120,7 +122,7 @@ protected:
   static void
   NoAttacks (Character& c)
   {
-    c.MutableProto ().mutable_combat_data ();
+    c.MutableCombatData ();
   }
 
   /**
@@ -149,7 +151,7 @@ protected:
     boost.mutable_range ()->set_percent (boostPercent);
     boost.mutable_damage ()->set_percent (boostPercent);
 
-    *c.MutableProto ().mutable_combat_data ()->add_low_hp_boosts () = boost;
+    *c.MutableCombatData ().add_low_hp_boosts () = boost;
   }
 
   /**
@@ -158,7 +160,7 @@ protected:
   static proto::SelfDestruct&
   AddSelfDestruct (Character& c, const unsigned area, const unsigned dmg)
   {
-    auto* sd = c.MutableProto ().mutable_combat_data ()->add_self_destructs ();
+    auto* sd = c.MutableCombatData ().add_self_destructs ();
     sd->set_area (area);
     sd->mutable_damage ()->set_min (dmg);
     sd->mutable_damage ()->set_max (dmg);
@@ -1017,8 +1019,8 @@ TEST_F (DealDamageTests, HitMissChance)
   constexpr unsigned eps = (trials * 5) / 100;
 
   auto c = characters.CreateNew ("attacker", Faction::RED);
-  c->MutableProto ().mutable_combat_data ()
-      ->mutable_hit_chance_modifier ()->set_percent (100);
+  c->MutableCombatData ()
+      .mutable_hit_chance_modifier ()->set_percent (100);
   AddAreaAttack (*c, 10, 1, 1).mutable_damage ()->set_weapon_size (16);
   AddAttack (*c, 5, 1, 1).mutable_damage ()->set_weapon_size (8);
   c.reset ();
@@ -1026,7 +1028,7 @@ TEST_F (DealDamageTests, HitMissChance)
   c = characters.CreateNew ("green", Faction::GREEN);
   const auto idTarget = c->GetId ();
   c->SetPosition (HexCoord (1, 0));
-  c->MutableProto ().mutable_combat_data ()->set_target_size (1);
+  c->MutableCombatData ().set_target_size (1);
   NoAttacks (*c);
   SetHp (*c, 0, maxHp, 0, maxHp);
   c.reset ();
@@ -1034,7 +1036,7 @@ TEST_F (DealDamageTests, HitMissChance)
   c = characters.CreateNew ("green", Faction::GREEN);
   const auto idArea = c->GetId ();
   c->SetPosition (HexCoord (10, 0));
-  c->MutableProto ().mutable_combat_data ()->set_target_size (2);
+  c->MutableCombatData ().set_target_size (2);
   NoAttacks (*c);
   SetHp (*c, 0, maxHp, 0, maxHp);
   c.reset ();
@@ -1068,22 +1070,22 @@ TEST_F (DealDamageTests, HitMissOutOfBounds)
 
   auto c = characters.CreateNew ("attacker 1", Faction::RED);
   c->SetPosition (HexCoord (0, 1));
-  c->MutableProto ().mutable_combat_data ()
-      ->mutable_hit_chance_modifier ()->set_percent (100);
+  c->MutableCombatData ()
+      .mutable_hit_chance_modifier ()->set_percent (100);
   AddAttack (*c, 1, 1, 1).mutable_damage ()->set_weapon_size (10);
   c.reset ();
 
   c = characters.CreateNew ("attacker 2", Faction::RED);
   c->SetPosition (HexCoord (0, -1));
-  c->MutableProto ().mutable_combat_data ()
-      ->mutable_hit_chance_modifier ()->set_percent (-200);
+  c->MutableCombatData ()
+      .mutable_hit_chance_modifier ()->set_percent (-200);
   AddAttack (*c, 1, 3, 3);
   c.reset ();
 
   c = characters.CreateNew ("target", Faction::GREEN);
   const auto idTarget = c->GetId ();
   c->SetPosition (HexCoord (0, 0));
-  c->MutableProto ().mutable_combat_data ()->set_target_size (9);
+  c->MutableCombatData ().set_target_size (9);
   NoAttacks (*c);
   SetHp (*c, 0, maxHp, 0, maxHp);
   c.reset ();
@@ -1155,7 +1157,7 @@ TEST_F (DealDamageTests, ReceivedDamageModifier)
   const auto idTarget = c->GetId ();
   NoAttacks (*c);
   SetHp (*c, 7, 100, 0, 100);
-  auto* cd = c->MutableProto ().mutable_combat_data ();
+  auto* cd = &c->MutableCombatData ();
   cd->mutable_received_damage_modifier ()->set_percent (-50);
   c.reset ();
 
@@ -1374,7 +1376,7 @@ TEST_F (DealDamageTests, HpReduction)
   for (const auto t : tests)
     {
       c = characters.GetById (idAttacker);
-      c->MutableProto ().clear_combat_data ();
+      c->MutableCombatData ().Clear ();
       auto& a = AddAttack (*c, 1, t.dmg, t.dmg);
       if (t.shieldPercent != 100)
         a.mutable_damage ()->set_shield_percent (t.shieldPercent);
@@ -1856,6 +1858,74 @@ TEST_F (LowHpBoostTests, BasedOnOriginalHp)
 
 /* ************************************************************************** */
 
+using CombatModifierMemoTests = DealDamageTests;
+
+TEST_F (CombatModifierMemoTests, OnlyUsedForNextHeight)
+{
+  const TargetKey id(proto::TargetId::TYPE_CHARACTER, 42);
+
+  CombatModifierMemo memo;
+  memo.Start (10);
+
+  memo.Add (id, CombatModifier ());
+  EXPECT_EQ (memo.GetSize (), 1);
+
+  CombatModifier mod;
+  EXPECT_FALSE (memo.Take (10, id, mod));
+  EXPECT_FALSE (memo.Take (12, id, mod));
+  EXPECT_FALSE (memo.Take (11, TargetKey (proto::TargetId::TYPE_BUILDING, 42),
+                           mod));
+  EXPECT_TRUE (memo.Take (11, id, mod));
+  EXPECT_FALSE (memo.Take (11, id, mod));
+  EXPECT_EQ (memo.GetSize (), 0);
+}
+
+TEST_F (CombatModifierMemoTests, Clear)
+{
+  const TargetKey id(proto::TargetId::TYPE_CHARACTER, 42);
+
+  CombatModifierMemo memo;
+  memo.Start (10);
+  memo.Add (id, CombatModifier ());
+  memo.Clear ();
+
+  CombatModifier mod;
+  EXPECT_EQ (memo.GetSize (), 0);
+  EXPECT_FALSE (memo.Take (11, id, mod));
+}
+
+TEST_F (CombatModifierMemoTests, UsedForDamage)
+{
+  auto c = characters.CreateNew ("red", Faction::RED);
+  SetHp (*c, 0, 10, 0, 100);
+  AddAttack (*c, 5, 1, 1);
+  AddLowHpBoost (*c, 10, 100);
+  AddLowHpBoost (*c, 10, 100);
+  AddLowHpBoost (*c, 20, 100);
+  c.reset ();
+
+  c = characters.CreateNew ("green", Faction::GREEN);
+  const auto idTarget = c->GetId ();
+  c->SetPosition (HexCoord (20, 0));
+  SetHp (*c, 0, 100, 0, 100);
+  NoAttacks (*c);
+  c.reset ();
+
+  CombatModifierMemo memo;
+
+  ctx.SetHeight (10);
+  FindCombatTargets (db, rnd, ctx, &memo);
+  EXPECT_EQ (memo.GetSize (), 1);
+
+  ctx.SetHeight (11);
+  DealCombatDamage (db, dl, rnd, ctx, &memo);
+  EXPECT_EQ (memo.GetSize (), 0);
+
+  EXPECT_EQ (characters.GetById (idTarget)->GetHP ().armour (), 96);
+}
+
+/* ************************************************************************** */
+
 using SelfDestructTests = DealDamageTests;
 
 TEST_F (SelfDestructTests, Basic)
@@ -1937,7 +2007,7 @@ TEST_F (SelfDestructTests, HitMissChance)
   c = characters.CreateNew ("red", Faction::RED);
   const auto idHit = c->GetId ();
   c->SetPosition (HexCoord (15, 0));
-  c->MutableProto ().mutable_combat_data ()->set_target_size (1'000);
+  c->MutableCombatData ().set_target_size (1'000);
   SetHp (*c, 0, 100, 0, 100);
   NoAttacks (*c);
   c.reset ();
@@ -1945,7 +2015,7 @@ TEST_F (SelfDestructTests, HitMissChance)
   c = characters.CreateNew ("red", Faction::RED);
   const auto idMissed = c->GetId ();
   c->SetPosition (HexCoord (15, 0));
-  c->MutableProto ().mutable_combat_data ()->set_target_size (1);
+  c->MutableCombatData ().set_target_size (1);
   SetHp (*c, 0, 100, 0, 100);
   NoAttacks (*c);
   c.reset ();
@@ -2225,7 +2295,7 @@ TEST_F (DamagingRandomRollsTests, SureMiss)
 
   c = characters.CreateNew ("target", Faction::GREEN);
   c->SetPosition (HexCoord (5, 0));
-  c->MutableProto ().mutable_combat_data ()->set_target_size (1);
+  c->MutableCombatData ().set_target_size (1);
   NoAttacks (*c);
   c.reset ();
 
@@ -2239,14 +2309,14 @@ TEST_F (DamagingRandomRollsTests, ModifierSureHit)
 
   auto c = characters.CreateNew ("attacker", Faction::RED);
   c->SetPosition (HexCoord (0, 0));
-  c->MutableProto ().mutable_combat_data ()
-      ->mutable_hit_chance_modifier ()->set_percent (100);
+  c->MutableCombatData ()
+      .mutable_hit_chance_modifier ()->set_percent (100);
   AddAttack (*c, 10, 1, 1).mutable_damage ()->set_weapon_size (10);
   c.reset ();
 
   c = characters.CreateNew ("target", Faction::GREEN);
   c->SetPosition (HexCoord (5, 0));
-  c->MutableProto ().mutable_combat_data ()->set_target_size (5);
+  c->MutableCombatData ().set_target_size (5);
   NoAttacks (*c);
   c.reset ();
 
@@ -2267,7 +2337,7 @@ TEST_F (DamagingRandomRollsTests, HitMissForEachTarget)
     {
       c = characters.CreateNew ("target", Faction::GREEN);
       c->SetPosition (HexCoord (5, 0));
-      c->MutableProto ().mutable_combat_data ()->set_target_size (1);
+      c->MutableCombatData ().set_target_size (1);
       NoAttacks (*c);
       c.reset ();
     }
@@ -2287,7 +2357,7 @@ TEST_F (DamagingRandomRollsTests, HitMissRolledForZeroDamage)
 
   c = characters.CreateNew ("target", Faction::GREEN);
   c->SetPosition (HexCoord (5, 0));
-  auto* cd = c->MutableProto ().mutable_combat_data ();
+  auto* cd = &c->MutableCombatData ();
   cd->set_target_size (1);
   cd->mutable_received_damage_modifier ()->set_percent (-100);
   NoAttacks (*c);
@@ -2314,14 +2384,14 @@ TEST_F (DamagingRandomRollsTests, NoRollForAlreadyDead)
 
   c = characters.CreateNew ("already dead", Faction::BLUE);
   c->SetPosition (HexCoord (1, 0));
-  c->MutableProto ().mutable_combat_data ()->set_target_size (1);
+  c->MutableCombatData ().set_target_size (1);
   SetHp (*c, 0, 1, 0, 1);
   NoAttacks (*c);
   c.reset ();
 
   c = characters.CreateNew ("still alive", Faction::BLUE);
   c->SetPosition (HexCoord (2, 0));
-  c->MutableProto ().mutable_combat_data ()->set_target_size (1);
+  c->MutableCombatData ().set_target_size (1);
   SetHp (*c, 0, 100, 0, 100);
   NoAttacks (*c);
   c.reset ();
@@ -2588,6 +2658,37 @@ TEST_F (ProcessKillsCharacterTests, DropsInventory)
   EXPECT_EQ (ground->GetInventory ().GetFungibleCount ("bar"), 10);
 }
 
+TEST_F (ProcessKillsCharacterTests, ManyKillsAggregateLoot)
+{
+  const HexCoord pos1(-42, 100);
+  const HexCoord pos2(10, 20);
+  loot.GetByCoord (pos1)->GetInventory ().SetFungibleCount ("foo", 5);
+
+  /* Kill more characters than fit into a single query batch, with some
+     dropping their loot onto the same tile.  */
+  constexpr unsigned num = 2 * ID_BATCH_SIZE + 5;
+  std::set<TargetKey> dead;
+  for (unsigned i = 0; i < num; ++i)
+    {
+      auto c = characters.CreateNew ("domob", Faction::RED);
+      c->MutableProto ().set_cargo_space (1000);
+      c->SetPosition (i % 2 == 0 ? pos1 : pos2);
+      c->GetInventory ().SetFungibleCount ("foo", 1);
+      dead.emplace (proto::TargetId::TYPE_CHARACTER, c->GetId ());
+    }
+  const auto aliveId = characters.CreateNew ("domob", Faction::RED)->GetId ();
+
+  ProcessKills (db, dl, loot, dead, rnd, ctx);
+
+  for (const auto& d : dead)
+    EXPECT_TRUE (characters.GetById (d.second) == nullptr);
+  EXPECT_TRUE (characters.GetById (aliveId) != nullptr);
+  EXPECT_EQ (loot.GetByCoord (pos1)->GetInventory ().GetFungibleCount ("foo"),
+             5 + (num + 1) / 2);
+  EXPECT_EQ (loot.GetByCoord (pos2)->GetInventory ().GetFungibleCount ("foo"),
+             num / 2);
+}
+
 TEST_F (ProcessKillsCharacterTests, MaybeDropsFitments)
 {
   constexpr HexCoord pos(-42, 100);
@@ -3172,6 +3273,160 @@ TEST_F (RegenerateHpTests, RateModifierEffect)
   EXPECT_EQ (c->GetHP ().shield (), 10 + 15);
 }
 
+class RegenerateHpLazilyTests : public CombatTests
+{
+
+protected:
+
+  /**
+   * Creates a character with 100 max shield HP, 10 current and a regeneration
+   * rate of 10 HP per block.  Optionally adds a +50% shield regen effect.
+   */
+  Database::IdT
+  CreateRegenerating (const bool withEffect)
+  {
+    auto c = characters.CreateNew ("domob", Faction::RED);
+    c->MutableHP ().set_shield (10);
+    auto* regen = &c->MutableRegenData ();
+    regen->mutable_max_hp ()->set_shield (100);
+    regen->mutable_regeneration_mhp ()->set_shield (10'000);
+    if (withEffect)
+      c->MutableEffects ().mutable_shield_regen ()->set_percent (50);
+    return c->GetId ();
+  }
+
+};
+
+TEST_F (RegenerateHpLazilyTests, SwitchProcessesAll)
+{
+  const auto id = CreateRegenerating (false);
+
+  db.SetLazyRegenHeight (9);
+  ctx.SetHeight (10);
+  RegenerateHpLazily (db, true, ctx);
+
+  EXPECT_EQ (db.GetLazyRegenHeight (), 10);
+  EXPECT_EQ (characters.GetById (id)->GetHP ().shield (), 20);
+
+  db.SetLazyRegenHeight (15);
+  EXPECT_EQ (characters.GetById (id)->GetHP ().shield (), 70);
+}
+
+TEST_F (RegenerateHpLazilyTests, OnlyEffectsProcessed)
+{
+  db.SetLazyRegenHeight (9);
+  const auto idPlain = CreateRegenerating (false);
+  const auto idEffect = CreateRegenerating (true);
+
+  ctx.SetHeight (10);
+  RegenerateHpLazily (db, false, ctx);
+
+  EXPECT_EQ (db.GetLazyRegenHeight (), 10);
+  EXPECT_EQ (characters.GetById (idPlain)->GetHP ().shield (), 20);
+  EXPECT_EQ (characters.GetById (idEffect)->GetHP ().shield (), 25);
+
+  ctx.SetHeight (11);
+  RegenerateHpLazily (db, false, ctx);
+
+  EXPECT_EQ (characters.GetById (idPlain)->GetHP ().shield (), 30);
+  EXPECT_EQ (characters.GetById (idEffect)->GetHP ().shield (), 40);
+}
+
+TEST_F (RegenerateHpLazilyTests, OldAnchorWithEffect)
+{
+  /* The fighter's HP are anchored a few blocks before the current
+     lazy-regeneration height, and both armour and shield (with an effect)
+     regenerate in the explicit step.  */
+  db.SetLazyRegenHeight (5);
+  Database::IdT id;
+  {
+    auto c = characters.CreateNew ("domob", Faction::RED);
+    id = c->GetId ();
+    c->MutableHP ().set_armour (10);
+    c->MutableHP ().set_shield (10);
+    auto* regen = &c->MutableRegenData ();
+    regen->mutable_max_hp ()->set_armour (100);
+    regen->mutable_max_hp ()->set_shield (100);
+    regen->mutable_regeneration_mhp ()->set_armour (1'000);
+    regen->mutable_regeneration_mhp ()->set_shield (10'000);
+    c->MutableEffects ().mutable_shield_regen ()->set_percent (50);
+  }
+
+  db.SetLazyRegenHeight (9);
+  ctx.SetHeight (10);
+  RegenerateHpLazily (db, false, ctx);
+
+  /* Blocks 6 to 9 are regenerated lazily at the base rate, and block 10
+     explicitly with the effect applied.  */
+  auto c = characters.GetById (id);
+  EXPECT_EQ (c->GetHP ().armour (), 10 + 4 + 1);
+  EXPECT_EQ (c->GetHP ().shield (), 10 + 4 * 10 + 15);
+  EXPECT_EQ (c->GetHP ().regen_height (), 10);
+}
+
+TEST_F (RegenerateHpLazilyTests, MatchesEagerRegeneration)
+{
+  /* Fighters with fractional regeneration rates and different shield-regen
+     effects are regenerated eagerly (as before the fork) in a second
+     database, and lazily in the test database.  Their HP must agree
+     after every block.  */
+  TestDatabase eagerDb;
+  SetupDatabaseSchema (*eagerDb);
+  CharacterTable eagerCharacters(eagerDb);
+
+  constexpr unsigned startHeight = 10;
+  db.SetLazyRegenHeight (startHeight);
+
+  const auto create = [] (CharacterTable& tbl, const int percent)
+    {
+      auto c = tbl.CreateNew ("domob", Faction::RED);
+      c->MutableHP ().set_armour (3);
+      c->MutableHP ().mutable_mhp ()->set_armour (999);
+      c->MutableHP ().set_shield (7);
+      c->MutableHP ().mutable_mhp ()->set_shield (1);
+      auto* regen = &c->MutableRegenData ();
+      regen->mutable_max_hp ()->set_armour (500);
+      regen->mutable_max_hp ()->set_shield (300);
+      regen->mutable_regeneration_mhp ()->set_armour (123);
+      regen->mutable_regeneration_mhp ()->set_shield (456);
+      if (percent != 0)
+        c->MutableEffects ().mutable_shield_regen ()->set_percent (percent);
+      return c->GetId ();
+    };
+
+  std::vector<Database::IdT> ids;
+  for (const int percent : {0, 37, -20, 150})
+    {
+      const auto id = create (characters, percent);
+      ASSERT_EQ (create (eagerCharacters, percent), id);
+      ids.push_back (id);
+    }
+
+  for (unsigned h = startHeight + 1; h <= startHeight + 2'000; ++h)
+    {
+      RegenerateHP (eagerDb);
+
+      ctx.SetHeight (h);
+      RegenerateHpLazily (db, false, ctx);
+
+      for (const auto id : ids)
+        {
+          const auto lazyChar = characters.GetById (id);
+          const auto eagerChar = eagerCharacters.GetById (id);
+          const auto& lazy = lazyChar->GetHP ();
+          const auto& eager = eagerChar->GetHP ();
+          ASSERT_EQ (lazy.armour (), eager.armour ())
+              << "Character " << id << " at height " << h;
+          ASSERT_EQ (lazy.mhp ().armour (), eager.mhp ().armour ())
+              << "Character " << id << " at height " << h;
+          ASSERT_EQ (lazy.shield (), eager.shield ())
+              << "Character " << id << " at height " << h;
+          ASSERT_EQ (lazy.mhp ().shield (), eager.mhp ().shield ())
+              << "Character " << id << " at height " << h;
+        }
+    }
+}
+
 /* ************************************************************************** */
 
 } // anonymous namespace
@@ -0,0 +1,132 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "connectionpool.hpp"
+
+#include <glog/logging.h>
+
+namespace pxd
+{
+
+ReadOnlyDatabase::ReadOnlyDatabase (const std::string& file)
+  : db(file, SQLITE_OPEN_READONLY)
+{
+  SetDatabase (db);
+}
+
+Database::IdT
+ReadOnlyDatabase::GetNextId ()
+{
+  LOG (FATAL) << "Read-only database cannot give out IDs";
+  return EMPTY_ID;
+}
+
+Database::IdT
+ReadOnlyDatabase::GetLogId ()
+{
+  LOG (FATAL) << "Read-only database cannot give out IDs";
+  return EMPTY_ID;
+}
+
+/* ************************************************************************** */
+
+ReadConnectionPool::ReadConnectionPool (const std::string& f, const size_t n)
+  : file(f), maxConnections(n)
+{
+  CHECK_GT (maxConnections, 0);
+  LOG (INFO)
+      << "Using up to " << maxConnections
+      << " read-only connections to " << file;
+}
+
+ReadConnectionPool::Handle
+ReadConnectionPool::Acquire ()
+{
+  std::unique_ptr<ReadOnlyDatabase> db;
+  {
+    std::unique_lock<std::mutex> lock(mut);
+    while (available.empty () && numOpened >= maxConnections)
+      cvReturned.wait (lock);
+
+    if (available.empty ())
+      ++numOpened;
+    else
+      {
+        db = std::move (available.back ());
+        available.pop_back ();
+      }
+  }
+
+  /* Opening a new connection is done without holding the lock.  */
+  if (db == nullptr)
+    {
+      VLOG (1) << "Opening new read-only connection to " << file;
+      db = std::make_unique<ReadOnlyDatabase> (file);
+    }
+
+  /* The snapshot of a read transaction is only fixed with its first read,
+     so we do a dummy one to pin it to the state at the time of Acquire.  */
+  db->Prepare ("BEGIN").Execute ();
+  db->ClearCachedState ();
+  auto stmt = (**db).PrepareRo ("SELECT COUNT (*) FROM `sqlite_master`");
+  CHECK (stmt.Step ());
+
+  return Handle (*this, std::move (db));
+}
+
+void
+ReadConnectionPool::Return (std::unique_ptr<ReadOnlyDatabase> db)
+{
+  db->Prepare ("ROLLBACK").Execute ();
+
+  /* The next user will see a different snapshot, so nothing read in
+     this one must be kept around.  All handles obtained through the
+     connection are gone by now, so the arena can be freed as well.  */
+  db->ClearCachedState ();
+  db->ResetArena ();
+
+  std::lock_guard<std::mutex> lock(mut);
+  available.push_back (std::move (db));
+  cvReturned.notify_one ();
+}
+
+size_t
+ReadConnectionPool::GetNumOpened ()
+{
+  std::lock_guard<std::mutex> lock(mut);
+  return numOpened;
+}
+
+ReadConnectionPool::Handle::Handle (ReadConnectionPool& p,
+                                    std::unique_ptr<ReadOnlyDatabase> d)
+  : pool(&p), db(std::move (d))
+{}
+
+ReadConnectionPool::Handle::Handle (Handle&& o)
+  : pool(o.pool), db(std::move (o.db))
+{
+  o.pool = nullptr;
+}
+
+ReadConnectionPool::Handle::~Handle ()
+{
+  if (pool != nullptr)
+    pool->Return (std::move (db));
+}
+
+} // namespace pxd
@@ -0,0 +1,165 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PXD_CONNECTIONPOOL_HPP
+#define PXD_CONNECTIONPOOL_HPP
+
+#include "database/database.hpp"
+
+#include <xayagame/sqlitestorage.hpp>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pxd
+{
+
+/**
+ * Database instance that is a read-only connection to a game-state
+ * database file.  This is used for reading the state (e.g. for validation
+ * or RPC calls) on other threads, independently of the main connection.
+ */
+class ReadOnlyDatabase : public Database
+{
+
+private:
+
+  /** The underlying SQLite connection.  */
+  xaya::SQLiteDatabase db;
+
+public:
+
+  explicit ReadOnlyDatabase (const std::string& file);
+
+  IdT GetNextId () override;
+  IdT GetLogId () override;
+
+};
+
+/**
+ * Pool of read-only connections to a game-state database file, which
+ * allows multiple readers to access the state in parallel to each other
+ * and to block processing on the main connection.  Connections are opened
+ * on demand up to a fixed maximum; if all are in use, acquiring one
+ * waits until another is released.
+ *
+ * While a connection is acquired, a read transaction is open on it.  Thus
+ * (with SQLite's WAL mode) each user sees a consistent snapshot of the
+ * latest committed state for the whole time.  Values cached by the
+ * Database instance (e.g. the lazy-regeneration height) are discarded
+ * whenever a connection is acquired or returned.
+ */
+class ReadConnectionPool
+{
+
+private:
+
+  /** The database file.  */
+  const std::string file;
+
+  /** Maximum number of connections.  */
+  const size_t maxConnections;
+
+  /** Lock for the pool state.  */
+  std::mutex mut;
+
+  /** Signalled when a connection is returned to the pool.  */
+  std::condition_variable cvReturned;
+
+  /** Connections that are currently available.  */
+  std::vector<std::unique_ptr<ReadOnlyDatabase>> available;
+
+  /** Number of connections opened in total.  */
+  size_t numOpened = 0;
+
+  /**
+   * Returns a connection to the pool.
+   */
+  void Return (std::unique_ptr<ReadOnlyDatabase> db);
+
+public:
+
+  class Handle;
+
+  explicit ReadConnectionPool (const std::string& f, size_t n);
+
+  ReadConnectionPool () = delete;
+  ReadConnectionPool (const ReadConnectionPool&) = delete;
+  void operator= (const ReadConnectionPool&) = delete;
+
+  /**
+   * Acquires a connection from the pool, waiting for one to become available
+   * if necessary, and starts a read transaction on it.
+   */
+  Handle Acquire ();
+
+  /**
+   * Returns the number of connections opened so far.
+   */
+  size_t GetNumOpened ();
+
+};
+
+/**
+ * A connection acquired from the pool.  When destructed, the read
+ * transaction is ended and the connection returned.
+ */
+class ReadConnectionPool::Handle
+{
+
+private:
+
+  /** The pool this is from, or null if moved from.  */
+  ReadConnectionPool* pool;
+
+  /** The database connection.  */
+  std::unique_ptr<ReadOnlyDatabase> db;
+
+  explicit Handle (ReadConnectionPool& p, std::unique_ptr<ReadOnlyDatabase> d);
+
+  friend class ReadConnectionPool;
+
+public:
+
+  Handle (Handle&& o);
+  ~Handle ();
+
+  Handle () = delete;
+  Handle (const Handle&) = delete;
+  void operator= (const Handle&) = delete;
+
+  Database&
+  operator* ()
+  {
+    return *db;
+  }
+
+  Database*
+  operator-> ()
+  {
+    return db.get ();
+  }
+
+};
+
+} // namespace pxd
+
+#endif // PXD_CONNECTIONPOOL_HPP
@@ -0,0 +1,199 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "connectionpool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <glog/logging.h>
+
+#include <sqlite3.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+namespace pxd
+{
+namespace
+{
+
+class ReadConnectionPoolTests : public testing::Test
+{
+
+protected:
+
+  /** The temporary database file.  */
+  std::string file;
+
+  /** Writable connection to the file.  */
+  sqlite3* writer;
+
+  ReadConnectionPoolTests ()
+  {
+    char name[] = "/tmp/taurion-connectionpool-XXXXXX";
+    const int fd = mkstemp (name);
+    CHECK_GE (fd, 0);
+    close (fd);
+    file = name;
+
+    CHECK_EQ (sqlite3_open (file.c_str (), &writer), SQLITE_OK);
+    Execute ("PRAGMA `journal_mode` = WAL");
+    Execute ("CREATE TABLE `test` (`value` INTEGER)");
+    Execute ("INSERT INTO `test` (`value`) VALUES (1)");
+  }
+
+  ~ReadConnectionPoolTests ()
+  {
+    CHECK_EQ (sqlite3_close (writer), SQLITE_OK);
+    for (const std::string suffix : {"", "-wal", "-shm"})
+      std::remove ((file + suffix).c_str ());
+  }
+
+  /**
+   * Executes an SQL statement on the writable connection.
+   */
+  void
+  Execute (const std::string& sql)
+  {
+    CHECK_EQ (sqlite3_exec (writer, sql.c_str (), nullptr, nullptr, nullptr),
+              SQLITE_OK)
+        << sqlite3_errmsg (writer);
+  }
+
+  /**
+   * Reads the sum of values in the test table through the given handle.
+   */
+  static int
+  ReadSum (ReadConnectionPool::Handle& h)
+  {
+    auto stmt = (**h).PrepareRo ("SELECT SUM (`value`) FROM `test`");
+    CHECK (stmt.Step ());
+    return stmt.Get<int> (0);
+  }
+
+};
+
+TEST_F (ReadConnectionPoolTests, ReusesConnections)
+{
+  ReadConnectionPool pool(file, 2);
+  EXPECT_EQ (pool.GetNumOpened (), 0);
+
+  {
+    auto h = pool.Acquire ();
+    EXPECT_EQ (ReadSum (h), 1);
+  }
+  {
+    auto h = pool.Acquire ();
+    EXPECT_EQ (ReadSum (h), 1);
+  }
+  EXPECT_EQ (pool.GetNumOpened (), 1);
+
+  auto h1 = pool.Acquire ();
+  auto h2 = pool.Acquire ();
+  EXPECT_EQ (pool.GetNumOpened (), 2);
+}
+
+TEST_F (ReadConnectionPoolTests, Snapshot)
+{
+  ReadConnectionPool pool(file, 2);
+
+  auto before = pool.Acquire ();
+  Execute ("INSERT INTO `test` (`value`) VALUES (10)");
+  auto after = pool.Acquire ();
+
+  EXPECT_EQ (ReadSum (before), 1);
+  EXPECT_EQ (ReadSum (after), 11);
+
+  Execute ("INSERT INTO `test` (`value`) VALUES (100)");
+  EXPECT_EQ (ReadSum (before), 1);
+  EXPECT_EQ (ReadSum (after), 11);
+}
+
+TEST_F (ReadConnectionPoolTests, ReleasedConnectionSeesNewState)
+{
+  ReadConnectionPool pool(file, 1);
+
+  {
+    auto h = pool.Acquire ();
+    EXPECT_EQ (ReadSum (h), 1);
+  }
+
+  Execute ("INSERT INTO `test` (`value`) VALUES (10)");
+
+  auto h = pool.Acquire ();
+  EXPECT_EQ (ReadSum (h), 11);
+  EXPECT_EQ (pool.GetNumOpened (), 1);
+}
+
+TEST_F (ReadConnectionPoolTests, CachedStateNotReused)
+{
+  Execute (R"(
+    CREATE TABLE `lazy_regen` (
+      `id` INTEGER PRIMARY KEY,
+      `height` INTEGER NOT NULL
+    )
+  )");
+  Execute ("INSERT INTO `lazy_regen` (`id`, `height`) VALUES (1, 10)");
+
+  ReadConnectionPool pool(file, 1);
+
+  {
+    auto h = pool.Acquire ();
+    EXPECT_EQ (h->GetLazyRegenHeight (), 10);
+  }
+
+  Execute ("UPDATE `lazy_regen` SET `height` = 11");
+
+  auto h = pool.Acquire ();
+  EXPECT_EQ (h->GetLazyRegenHeight (), 11);
+  EXPECT_EQ (pool.GetNumOpened (), 1);
+}
+
+TEST_F (ReadConnectionPoolTests, WaitsForAvailable)
+{
+  ReadConnectionPool pool(file, 1);
+
+  auto h = std::make_unique<ReadConnectionPool::Handle> (pool.Acquire ());
+
+  std::atomic<bool> acquired(false);
+  std::thread other([&] ()
+    {
+      auto h2 = pool.Acquire ();
+      acquired = true;
+      EXPECT_EQ (ReadSum (h2), 11);
+    });
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (10));
+  EXPECT_FALSE (acquired);
+
+  /* The waiting thread gets the connection only when we release it,
+     at which point it starts a fresh snapshot.  */
+  Execute ("INSERT INTO `test` (`value`) VALUES (10)");
+  h.reset ();
+  other.join ();
+
+  EXPECT_TRUE (acquired);
+  EXPECT_EQ (pool.GetNumOpened (), 1);
+}
+
+} // anonymous namespace
+} // namespace pxd
@@ -0,0 +1,299 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "deltaserver.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace pxd
+{
+
+namespace
+{
+
+/**
+ * Interval in which connection threads check whether the server is
+ * being stopped while waiting for new deltas.
+ */
+constexpr auto POLL_INTERVAL = std::chrono::seconds (1);
+
+/**
+ * Interval after which we send a comment line to idle clients, so that
+ * proxies do not close the connection.
+ */
+constexpr auto KEEPALIVE_INTERVAL = std::chrono::seconds (15);
+
+/**
+ * Number of connections the daemon accepts on top of the streaming clients,
+ * so that excess clients (and invalid requests) can still be answered with
+ * an error rather than having their connection dropped.
+ */
+constexpr unsigned EXTRA_CONNECTIONS = 8;
+
+/**
+ * Parses a resume position of the form "<height>" or "<height>:<hash>",
+ * as used for the "from" parameter and the event IDs.  Returns false
+ * if the string is invalid.
+ */
+bool
+ParseResumePosition (const std::string& str, unsigned& height,
+                     std::string& hash)
+{
+  const size_t colon = str.find (':');
+  const std::string heightStr = str.substr (0, colon);
+  if (heightStr.empty () || heightStr.size () > 9
+        || heightStr.find_first_not_of ("0123456789") != std::string::npos)
+    return false;
+
+  height = std::stoul (heightStr);
+  hash = (colon == std::string::npos ? "" : str.substr (colon + 1));
+
+  return true;
+}
+
+} // anonymous namespace
+
+/**
+ * State of a single streaming client connection.
+ */
+class DeltaStreamServer::Connection
+{
+
+private:
+
+  /** The server this is for.  */
+  DeltaStreamServer& server;
+
+  /** The subscription to the stream.  */
+  std::shared_ptr<DeltaStream::Subscription> sub;
+
+  /** Data that is formatted but has not been sent yet.  */
+  std::string pending;
+
+  /** Offset into pending of what has been sent already.  */
+  size_t offset = 0;
+
+  /** Time when we last sent something.  */
+  std::chrono::steady_clock::time_point lastWrite;
+
+  /**
+   * Fills in the pending buffer with the next event or keepalive comment.
+   * Returns false if the stream is finished.
+   */
+  bool
+  FillPending ()
+  {
+    while (!server.shouldStop)
+      {
+        auto delta = sub->Next (POLL_INTERVAL);
+        if (delta != nullptr)
+          {
+            pending = "id: " + std::to_string (delta->height)
+                        + ":" + delta->hash + "\n"
+                      + "event: block\n"
+                      + "data: " + delta->data + "\n\n";
+            return true;
+          }
+
+        if (sub->IsFinished ())
+          return false;
+
+        if (std::chrono::steady_clock::now () - lastWrite
+              >= KEEPALIVE_INTERVAL)
+          {
+            pending = ": keepalive\n\n";
+            return true;
+          }
+      }
+
+    return false;
+  }
+
+public:
+
+  /**
+   * Constructs the state for a new client.  The caller must have reserved
+   * a slot in the server's client count already, which is released when
+   * the connection is destructed.
+   */
+  explicit Connection (DeltaStreamServer& s,
+                       std::shared_ptr<DeltaStream::Subscription> su)
+    : server(s), sub(std::move (su)),
+      lastWrite(std::chrono::steady_clock::now ())
+  {
+    /* Send an initial comment, so that the client sees the stream
+       has been established even before the next block.  */
+    pending = ": connected\n\n";
+  }
+
+  ~Connection ()
+  {
+    --server.numClients;
+  }
+
+  Connection () = delete;
+  Connection (const Connection&) = delete;
+  void operator= (const Connection&) = delete;
+
+  /**
+   * Content-reader callback for the response, which blocks until the next
+   * data is available and copies it into MHD's buffer.
+   */
+  static ssize_t
+  Read (void* cls, const uint64_t pos, char* buf, const size_t max)
+  {
+    auto* self = static_cast<Connection*> (cls);
+
+    if (self->offset == self->pending.size ())
+      {
+        if (!self->FillPending ())
+          return MHD_CONTENT_READER_END_OF_STREAM;
+        self->offset = 0;
+      }
+
+    const size_t len = std::min (max, self->pending.size () - self->offset);
+    std::memcpy (buf, self->pending.data () + self->offset, len);
+    self->offset += len;
+    self->lastWrite = std::chrono::steady_clock::now ();
+
+    return len;
+  }
+
+  /**
+   * Callback for freeing the connection state when the response is done.
+   */
+  static void
+  Free (void* cls)
+  {
+    delete static_cast<Connection*> (cls);
+  }
+
+};
+
+DeltaStreamServer::~DeltaStreamServer ()
+{
+  CHECK (daemon == nullptr) << "DeltaStreamServer has not been stopped";
+}
+
+MhdResult
+DeltaStreamServer::RequestCallback (void* data, struct MHD_Connection* conn,
+                                    const char* url, const char* method,
+                                    const char* version,
+                                    const char* upload, size_t* uploadSize,
+                                    void** connData)
+{
+  auto* self = static_cast<DeltaStreamServer*> (data);
+
+  if (std::string (method) != "GET")
+    return QueueTextResponse (conn, MHD_HTTP_METHOD_NOT_ALLOWED,
+                              "only GET is supported");
+  if (std::string (url) != "/deltas")
+    return QueueTextResponse (conn, MHD_HTTP_NOT_FOUND,
+                              "invalid endpoint: " + std::string (url));
+
+  const char* from = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
+                                                  "from");
+  const char* hash = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
+                                                  "hash");
+  if (from == nullptr)
+    from = MHD_lookup_connection_value (conn, MHD_HEADER_KIND,
+                                        "Last-Event-ID");
+
+  std::shared_ptr<DeltaStream::Subscription> sub;
+  if (from == nullptr)
+    sub = self->stream.Subscribe ();
+  else
+    {
+      unsigned fromHeight;
+      std::string fromHash;
+      if (!ParseResumePosition (from, fromHeight, fromHash))
+        return QueueTextResponse (conn, MHD_HTTP_BAD_REQUEST,
+                                  "invalid resume position: "
+                                    + std::string (from));
+      if (hash != nullptr)
+        fromHash = hash;
+
+      sub = self->stream.Subscribe (fromHeight, fromHash);
+      if (sub == nullptr)
+        return QueueTextResponse (conn, MHD_HTTP_GONE,
+                                  "cannot resume from " + std::string (from)
+                                    + ", resync through /changes");
+    }
+
+  if (++self->numClients > self->maxClients)
+    {
+      --self->numClients;
+      LOG_EVERY_N (WARNING, 100)
+          << "Rejecting delta-stream client, limit of " << self->maxClients
+          << " reached";
+      return QueueTextResponse (conn, MHD_HTTP_SERVICE_UNAVAILABLE,
+                                "too many delta-stream clients");
+    }
+
+  VLOG (1) << "New delta-stream client, resuming from " << (from ? from : "-");
+
+  auto* state = new Connection (*self, std::move (sub));
+  struct MHD_Response* resp = MHD_create_response_from_callback (
+      MHD_SIZE_UNKNOWN, 4'096, &Connection::Read, state, &Connection::Free);
+  CHECK (resp != nullptr);
+  MHD_add_response_header (resp, "Content-Type", "text/event-stream");
+  MHD_add_response_header (resp, "Cache-Control", "no-cache");
+
+  const auto res = MHD_queue_response (conn, MHD_HTTP_OK, resp);
+  MHD_destroy_response (resp);
+
+  return res;
+}
+
+void
+DeltaStreamServer::Start ()
+{
+  CHECK (daemon == nullptr) << "DeltaStreamServer is already running";
+  shouldStop = false;
+
+  LOG (INFO)
+      << "Starting delta-stream server on port " << port
+      << " for up to " << maxClients << " clients";
+  daemon = MHD_start_daemon (
+      MHD_USE_THREAD_PER_CONNECTION | MHD_USE_INTERNAL_POLLING_THREAD,
+      port, nullptr, nullptr, &RequestCallback, this,
+      MHD_OPTION_CONNECTION_LIMIT,
+        static_cast<unsigned> (maxClients + EXTRA_CONNECTIONS),
+      MHD_OPTION_END);
+  CHECK (daemon != nullptr) << "Failed to start delta-stream server";
+}
+
+void
+DeltaStreamServer::Stop ()
+{
+  CHECK (daemon != nullptr) << "DeltaStreamServer is not running";
+
+  /* Connection threads notice this within the poll interval and end
+     their streams, which lets MHD_stop_daemon join them.  */
+  shouldStop = true;
+  MHD_stop_daemon (daemon);
+  daemon = nullptr;
+}
+
+} // namespace pxd
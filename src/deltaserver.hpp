@@ -0,0 +1,99 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PXD_DELTASERVER_HPP
+#define PXD_DELTASERVER_HPP
+
+#include "deltastream.hpp"
+#include "mhdutils.hpp"
+
+#include <xayagame/game.hpp>
+
+#include <atomic>
+
+namespace pxd
+{
+
+/**
+ * HTTP server that pushes the per-block state deltas from a DeltaStream
+ * to clients as Server-Sent Events.  The REST API from libxayagame only
+ * supports fully buffered responses, so this runs as its own
+ * libmicrohttpd daemon on a separate port.
+ *
+ * The only endpoint is /deltas.  Clients can pass the height of the
+ * last block they have seen as "from" query parameter (or through the
+ * standard Last-Event-ID header when reconnecting), optionally with the
+ * block's hash as "hash" to detect reorgs.
+ *
+ * Since each client holds a connection thread, the number of concurrent
+ * clients is limited.  Further clients get a 503 response.
+ */
+class DeltaStreamServer : public xaya::GameComponent
+{
+
+private:
+
+  class Connection;
+
+  /** The stream we serve.  */
+  DeltaStream& stream;
+
+  /** The port to listen on.  */
+  const int port;
+
+  /** Maximum number of concurrently streaming clients.  */
+  const unsigned maxClients;
+
+  /** Number of currently streaming clients.  */
+  std::atomic<unsigned> numClients{0};
+
+  /** The underlying daemon, if running.  */
+  struct MHD_Daemon* daemon = nullptr;
+
+  /** Set to true when the server is being stopped.  */
+  std::atomic<bool> shouldStop{false};
+
+  /**
+   * Handler function for requests to the daemon.
+   */
+  static MhdResult RequestCallback (void* data, struct MHD_Connection* conn,
+                                    const char* url, const char* method,
+                                    const char* version,
+                                    const char* upload, size_t* uploadSize,
+                                    void** connData);
+
+public:
+
+  explicit DeltaStreamServer (DeltaStream& s, const int p, const unsigned m)
+    : stream(s), port(p), maxClients(m)
+  {}
+
+  ~DeltaStreamServer ();
+
+  DeltaStreamServer () = delete;
+  DeltaStreamServer (const DeltaStreamServer&) = delete;
+  void operator= (const DeltaStreamServer&) = delete;
+
+  void Start () override;
+  void Stop () override;
+
+};
+
+} // namespace pxd
+
+#endif // PXD_DELTASERVER_HPP
@@ -0,0 +1,184 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "deltastream.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+namespace pxd
+{
+
+DeltaStream::DeltaStream (const size_t history, const size_t buffer)
+  : historySize(history), bufferSize(buffer)
+{
+  CHECK_GT (historySize, 0);
+  CHECK_GT (bufferSize, 0);
+}
+
+void
+DeltaStream::Publish (const unsigned height, const std::string& hash,
+                      const std::string& parent, std::string data)
+{
+  auto delta = std::make_shared<Delta> ();
+  delta->height = height;
+  delta->hash = hash;
+  delta->parent = parent;
+  delta->data = std::move (data);
+
+  std::lock_guard<std::mutex> lock(mut);
+
+  const bool reorg = !history.empty () && history.back ()->hash != parent;
+  if (reorg)
+    {
+      LOG (INFO)
+          << "Delta stream for block " << height << " does not extend "
+          << history.back ()->hash << ", closing subscriptions";
+      while (!history.empty () && history.back ()->height >= height)
+        history.pop_back ();
+      if (!history.empty () && history.back ()->hash != parent)
+        history.clear ();
+    }
+
+  history.push_back (delta);
+  while (history.size () > historySize)
+    history.pop_front ();
+
+  std::vector<std::weak_ptr<Subscription>> active;
+  for (auto& weak : subscriptions)
+    {
+      auto sub = weak.lock ();
+      if (sub == nullptr)
+        continue;
+
+      if (reorg)
+        sub->closed = true;
+      else if (!sub->closed)
+        {
+          if (sub->queue.size () >= bufferSize)
+            {
+              LOG (WARNING)
+                  << "Delta stream subscriber is too slow at block " << height
+                  << ", closing its subscription";
+              sub->closed = true;
+            }
+          else
+            sub->queue.push_back (delta);
+        }
+
+      if (!sub->closed)
+        active.push_back (std::move (weak));
+    }
+  subscriptions = std::move (active);
+
+  cvUpdate.notify_all ();
+}
+
+std::shared_ptr<DeltaStream::Subscription>
+DeltaStream::CreateSubscription ()
+{
+  std::shared_ptr<Subscription> res(new Subscription (*this));
+  subscriptions.push_back (res);
+  return res;
+}
+
+std::shared_ptr<DeltaStream::Subscription>
+DeltaStream::Subscribe ()
+{
+  std::lock_guard<std::mutex> lock(mut);
+  return CreateSubscription ();
+}
+
+std::shared_ptr<DeltaStream::Subscription>
+DeltaStream::Subscribe (const unsigned fromHeight, const std::string& hash)
+{
+  std::lock_guard<std::mutex> lock(mut);
+
+  if (history.empty ())
+    {
+      VLOG (1) << "No delta history, cannot resume from " << fromHeight;
+      return nullptr;
+    }
+
+  /* The client is already at our latest block, so there is nothing
+     to replay.  */
+  if (fromHeight == history.back ()->height
+        && (hash.empty () || hash == history.back ()->hash))
+    return CreateSubscription ();
+
+  /* Otherwise we need the delta for the next block, and it must build
+     on the client's block.  */
+  auto mit = std::find_if (history.begin (), history.end (),
+      [fromHeight] (const std::shared_ptr<const Delta>& d)
+        {
+          return d->height == fromHeight + 1;
+        });
+  if (mit == history.end () || (!hash.empty () && (*mit)->parent != hash))
+    {
+      VLOG (1)
+          << "Cannot resume delta stream from height " << fromHeight
+          << " and block " << hash;
+      return nullptr;
+    }
+
+  auto res = CreateSubscription ();
+  res->queue.assign (mit, history.end ());
+
+  return res;
+}
+
+size_t
+DeltaStream::GetNumSubscribers ()
+{
+  std::lock_guard<std::mutex> lock(mut);
+
+  size_t res = 0;
+  for (const auto& weak : subscriptions)
+    if (!weak.expired ())
+      ++res;
+
+  return res;
+}
+
+std::shared_ptr<const DeltaStream::Delta>
+DeltaStream::Subscription::Next (const std::chrono::milliseconds timeout)
+{
+  std::unique_lock<std::mutex> lock(stream.mut);
+  stream.cvUpdate.wait_for (lock, timeout, [this] ()
+    {
+      return closed || !queue.empty ();
+    });
+
+  if (queue.empty ())
+    return nullptr;
+
+  auto res = std::move (queue.front ());
+  queue.pop_front ();
+
+  return res;
+}
+
+bool
+DeltaStream::Subscription::IsFinished ()
+{
+  std::lock_guard<std::mutex> lock(stream.mut);
+  return closed && queue.empty ();
+}
+
+} // namespace pxd
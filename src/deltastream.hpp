@@ -0,0 +1,194 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PXD_DELTASTREAM_HPP
+#define PXD_DELTASTREAM_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pxd
+{
+
+/**
+ * Broadcaster for the per-block state deltas that are pushed to streaming
+ * clients.  Block processing publishes one delta for each attached block,
+ * and each subscriber receives them through its own bounded queue.
+ *
+ * A number of recent deltas are kept in memory, so that clients which
+ * reconnect can resume from the last block they have seen.  The history
+ * always forms a chain of blocks (each delta's parent is the previous one),
+ * so that resuming is safe with respect to reorgs if the client also
+ * specifies the hash of its last block.
+ *
+ * All methods are thread-safe.
+ */
+class DeltaStream
+{
+
+public:
+
+  /**
+   * Data for a single published block delta.
+   */
+  struct Delta
+  {
+
+    /** The block height.  */
+    unsigned height;
+
+    /** The block hash as hex string.  */
+    std::string hash;
+
+    /** The parent block's hash as hex string.  */
+    std::string parent;
+
+    /** The serialised JSON data for the delta.  */
+    std::string data;
+
+  };
+
+  class Subscription;
+
+private:
+
+  /** Maximum number of deltas kept in the history.  */
+  const size_t historySize;
+
+  /** Maximum number of deltas buffered for each subscriber.  */
+  const size_t bufferSize;
+
+  /** Recent deltas, with the oldest one first.  */
+  std::deque<std::shared_ptr<const Delta>> history;
+
+  /**
+   * All currently active subscriptions.  They are owned by the consumers,
+   * and we prune the expired ones as we go.
+   */
+  std::vector<std::weak_ptr<Subscription>> subscriptions;
+
+  /** Lock for all the data, including the subscriptions' queues.  */
+  std::mutex mut;
+
+  /** Condition variable notified when new data is published.  */
+  std::condition_variable cvUpdate;
+
+  /**
+   * Creates a new subscription and registers it.  Must be called with
+   * the lock held.
+   */
+  std::shared_ptr<Subscription> CreateSubscription ();
+
+public:
+
+  explicit DeltaStream (size_t history, size_t buffer);
+
+  DeltaStream () = delete;
+  DeltaStream (const DeltaStream&) = delete;
+  void operator= (const DeltaStream&) = delete;
+
+  /**
+   * Publishes a new block delta to all subscribers.  If the parent does not
+   * match the latest block published (i.e. a reorg happened), all existing
+   * subscriptions are closed after the data already in their queues,
+   * since their clients need to resync.  History entries for detached
+   * blocks are removed as well.
+   */
+  void Publish (unsigned height, const std::string& hash,
+                const std::string& parent, std::string data);
+
+  /**
+   * Subscribes to deltas for new blocks from now on.
+   */
+  std::shared_ptr<Subscription> Subscribe ();
+
+  /**
+   * Subscribes to deltas for all blocks after the given height, replaying
+   * the missing ones from the history first.  If a hash is given (i.e.
+   * it is not empty), it must be the hash of the client's block at that
+   * height, and is checked against our chain.
+   *
+   * Returns null if we cannot resume from that height, e.g. because it is
+   * too old for our history or the block hash does not match.  In that case,
+   * the client has to resync in another way.
+   */
+  std::shared_ptr<Subscription> Subscribe (unsigned fromHeight,
+                                           const std::string& hash);
+
+  /**
+   * Returns the number of active subscriptions.
+   */
+  size_t GetNumSubscribers ();
+
+};
+
+/**
+ * A single subscriber to the delta stream.  Deltas are queued up for it
+ * when published, up to the configured buffer size.  If the queue is full
+ * when a new delta arrives (i.e. the client is too slow to keep up), the
+ * subscription is closed instead; the client can reconnect and resume from
+ * the last block it received.
+ */
+class DeltaStream::Subscription
+{
+
+private:
+
+  /** The stream this is for.  */
+  DeltaStream& stream;
+
+  /** Deltas queued for this subscriber.  */
+  std::deque<std::shared_ptr<const Delta>> queue;
+
+  /** Set to true when no more deltas will be added.  */
+  bool closed = false;
+
+  explicit Subscription (DeltaStream& s)
+    : stream(s)
+  {}
+
+  friend class DeltaStream;
+
+public:
+
+  Subscription () = delete;
+  Subscription (const Subscription&) = delete;
+  void operator= (const Subscription&) = delete;
+
+  /**
+   * Returns the next delta, waiting up to the given timeout for one
+   * to be published.  Returns null if the timeout expires first, or if the
+   * subscription is closed and all its deltas have been consumed.
+   */
+  std::shared_ptr<const Delta> Next (std::chrono::milliseconds timeout);
+
+  /**
+   * Returns true if the subscription is closed and has no more data.
+   */
+  bool IsFinished ();
+
+};
+
+} // namespace pxd
+
+#endif // PXD_DELTASTREAM_HPP
@@ -0,0 +1,215 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "deltastream.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pxd
+{
+namespace
+{
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+/** Timeout used when we expect data to be available immediately.  */
+constexpr auto NO_WAIT = std::chrono::milliseconds (0);
+
+class DeltaStreamTests : public testing::Test
+{
+
+protected:
+
+  DeltaStream stream;
+
+  DeltaStreamTests ()
+    : stream(3, 2)
+  {}
+
+  /**
+   * Publishes a delta for a block whose hash and parent are derived from
+   * the given height (with an optional branch suffix).
+   */
+  void
+  Publish (const unsigned height, const std::string& branch = "",
+           const std::string& parentBranch = "")
+  {
+    stream.Publish (height,
+                    "block " + std::to_string (height) + branch,
+                    "block " + std::to_string (height - 1) + parentBranch,
+                    "data " + std::to_string (height) + branch);
+  }
+
+  /**
+   * Returns the data of all deltas currently available
+   * for the subscription.
+   */
+  static std::vector<std::string>
+  Drain (DeltaStream::Subscription& sub)
+  {
+    std::vector<std::string> res;
+    while (true)
+      {
+        auto d = sub.Next (NO_WAIT);
+        if (d == nullptr)
+          return res;
+        res.push_back (d->data);
+      }
+  }
+
+};
+
+TEST_F (DeltaStreamTests, LiveSubscription)
+{
+  Publish (10);
+  auto sub = stream.Subscribe ();
+  EXPECT_THAT (Drain (*sub), IsEmpty ());
+
+  Publish (11);
+  Publish (12);
+  EXPECT_THAT (Drain (*sub), ElementsAre ("data 11", "data 12"));
+  Publish (13);
+  EXPECT_THAT (Drain (*sub), ElementsAre ("data 13"));
+  EXPECT_FALSE (sub->IsFinished ());
+}
+
+TEST_F (DeltaStreamTests, WaitsForData)
+{
+  auto sub = stream.Subscribe ();
+
+  std::thread publisher([this] ()
+    {
+      std::this_thread::sleep_for (std::chrono::milliseconds (10));
+      Publish (10);
+    });
+
+  auto d = sub->Next (std::chrono::seconds (10));
+  publisher.join ();
+
+  ASSERT_NE (d, nullptr);
+  EXPECT_EQ (d->height, 10);
+  EXPECT_EQ (d->hash, "block 10");
+  EXPECT_EQ (d->parent, "block 9");
+  EXPECT_EQ (d->data, "data 10");
+}
+
+TEST_F (DeltaStreamTests, SlowSubscriberIsClosed)
+{
+  auto sub = stream.Subscribe ();
+  Publish (10);
+  Publish (11);
+  Publish (12);
+  Publish (13);
+
+  EXPECT_EQ (stream.GetNumSubscribers (), 0);
+  EXPECT_FALSE (sub->IsFinished ());
+  EXPECT_THAT (Drain (*sub), ElementsAre ("data 10", "data 11"));
+  EXPECT_TRUE (sub->IsFinished ());
+}
+
+TEST_F (DeltaStreamTests, ExpiredSubscriptions)
+{
+  auto sub = stream.Subscribe ();
+  EXPECT_EQ (stream.GetNumSubscribers (), 1);
+  sub.reset ();
+  EXPECT_EQ (stream.GetNumSubscribers (), 0);
+  Publish (10);
+}
+
+TEST_F (DeltaStreamTests, Resume)
+{
+  EXPECT_EQ (stream.Subscribe (9, ""), nullptr);
+
+  Publish (10);
+  Publish (11);
+  Publish (12);
+  Publish (13);
+
+  EXPECT_EQ (stream.Subscribe (9, ""), nullptr);
+  EXPECT_EQ (stream.Subscribe (14, ""), nullptr);
+
+  /* Replaying from history is not limited by the buffer size.  */
+  auto sub = stream.Subscribe (10, "");
+  ASSERT_NE (sub, nullptr);
+  EXPECT_THAT (Drain (*sub), ElementsAre ("data 11", "data 12", "data 13"));
+
+  sub = stream.Subscribe (11, "");
+  ASSERT_NE (sub, nullptr);
+  EXPECT_THAT (Drain (*sub), ElementsAre ("data 12", "data 13"));
+
+  sub = stream.Subscribe (13, "block 13");
+  ASSERT_NE (sub, nullptr);
+  EXPECT_THAT (Drain (*sub), IsEmpty ());
+
+  sub = stream.Subscribe (12, "block 12");
+  ASSERT_NE (sub, nullptr);
+  Publish (14);
+  EXPECT_THAT (Drain (*sub), ElementsAre ("data 13", "data 14"));
+
+  EXPECT_EQ (stream.Subscribe (12, "other"), nullptr);
+  EXPECT_EQ (stream.Subscribe (14, "other"), nullptr);
+}
+
+TEST_F (DeltaStreamTests, Reorg)
+{
+  Publish (10);
+  Publish (11);
+  Publish (12);
+  auto sub = stream.Subscribe ();
+
+  Publish (11, "b");
+  EXPECT_TRUE (sub->IsFinished ());
+  EXPECT_EQ (stream.GetNumSubscribers (), 0);
+  Publish (12, "b", "b");
+
+  EXPECT_EQ (stream.Subscribe (11, "block 11"), nullptr);
+  EXPECT_EQ (stream.Subscribe (12, "block 12"), nullptr);
+
+  sub = stream.Subscribe (10, "block 10");
+  ASSERT_NE (sub, nullptr);
+  EXPECT_THAT (Drain (*sub), ElementsAre ("data 11b", "data 12b"));
+}
+
+TEST_F (DeltaStreamTests, DeepReorg)
+{
+  Publish (10);
+  Publish (11);
+  Publish (12);
+
+  Publish (5, "b");
+  EXPECT_EQ (stream.Subscribe (10, ""), nullptr);
+  EXPECT_EQ (stream.Subscribe (3, ""), nullptr);
+
+  auto sub = stream.Subscribe (5, "block 5b");
+  ASSERT_NE (sub, nullptr);
+  EXPECT_THAT (Drain (*sub), IsEmpty ());
+
+  sub = stream.Subscribe (4, "block 4");
+  ASSERT_NE (sub, nullptr);
+  EXPECT_THAT (Drain (*sub), ElementsAre ("data 5b"));
+}
+
+} // anonymous namespace
+} // namespace pxd
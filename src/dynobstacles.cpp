@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -26,11 +26,11 @@ namespace pxd
 {
 
 DynObstacles::DynObstacles (const xaya::Chain c)
-  : chain(c), vehicles(0), buildings(false)
+  : chain(c), vehicles(0), buildings(Database::EMPTY_ID)
 {}
 
 DynObstacles::DynObstacles (Database& db, const Context& ctx)
-  : chain(ctx.Chain ()), vehicles(0), buildings(false)
+  : chain(ctx.Chain ()), vehicles(0), buildings(Database::EMPTY_ID)
 {
   {
     CharacterTable tbl(db);
@@ -43,25 +43,32 @@ DynObstacles::DynObstacles (Database& db, const Context& ctx)
 
   {
     BuildingsTable tbl(db);
-    auto res = tbl.QueryAll ();
-    while (res.Step ())
-      AddBuilding (*tbl.GetFromResult (res));
+    tbl.ProcessAllShapes ([this] (const Database::IdT id,
+                                  const std::string& type,
+                                  const proto::ShapeTransformation& trafo,
+                                  const HexCoord& centre)
+      {
+        std::vector<HexCoord> shape;
+        CHECK (AddBuilding (id, type, trafo, centre, shape))
+            << "Error adding building " << id;
+      });
   }
 }
 
 bool
-DynObstacles::AddBuilding (const std::string& type,
+DynObstacles::AddBuilding (const Database::IdT id, const std::string& type,
                            const proto::ShapeTransformation& trafo,
                            const HexCoord& pos,
                            std::vector<HexCoord>& shape)
 {
+  CHECK_NE (id, Database::EMPTY_ID);
+
   shape = GetBuildingShape (type, trafo, pos, chain);
   for (const auto& c : shape)
     {
-      auto ref = buildings.Access (c);
-      if (ref)
+      if (IsBuilding (c))
         return false;
-      ref = true;
+      buildings.Set (c, id);
     }
   return true;
 }
@@ -70,8 +77,8 @@ void
 DynObstacles::AddBuilding (const Building& b)
 {
   std::vector<HexCoord> shape;
-  CHECK (AddBuilding (b.GetType (), b.GetProto ().shape_trafo (),
-                      b.GetCentre (), shape))
+  CHECK (AddBuilding (b.GetId (), b.GetType (),
+                      b.GetProto ().shape_trafo (), b.GetCentre (), shape))
       << "Error adding building " << b.GetId ();
 }
 
@@ -26,7 +26,6 @@
 #include "database/faction.hpp"
 #include "hexagonal/coord.hpp"
 #include "mapdata/basemap.hpp"
-#include "mapdata/dyntiles.hpp"
 #include "mapdata/sparsemap.hpp"
 #include "proto/building.pb.h"
 
@@ -50,8 +49,11 @@ private:
   /** Vehicles (of any faction) on the map.  */
   SparseTileMap<unsigned> vehicles;
 
-  /** Buildings in general.  */
-  DynTiles<bool> buildings;
+  /**
+   * Buildings in general.  This is a footprint index that maps each
+   * tile covered by a building to the building's ID.
+   */
+  SparseTileMap<Database::IdT> buildings;
 
 public:
 
@@ -76,6 +78,12 @@ public:
    */
   bool IsBuilding (const HexCoord& c) const;
 
+  /**
+   * Returns the ID of the building covering the given tile, or EMPTY_ID
+   * if there is none.
+   */
+  Database::IdT GetBuildingId (const HexCoord& c) const;
+
   /**
    * Checks if the given tile has any vehicle.
    */
@@ -102,7 +110,7 @@ public:
    * Also exposes the building's shape to the caller for further processing.
    * Returns false if adding failed, e.g. because the buildings overlap.
    */
-  bool AddBuilding (const std::string& type,
+  bool AddBuilding (Database::IdT id, const std::string& type,
                     const proto::ShapeTransformation& trafo,
                     const HexCoord& pos,
                     std::vector<HexCoord>& shape);
@@ -25,6 +25,12 @@ namespace pxd
 
 inline bool
 DynObstacles::IsBuilding (const HexCoord& c) const
+{
+  return buildings.Get (c) != Database::EMPTY_ID;
+}
+
+inline Database::IdT
+DynObstacles::GetBuildingId (const HexCoord& c) const
 {
   return buildings.Get (c);
 }
@@ -38,7 +44,7 @@ DynObstacles::HasVehicle (const HexCoord& c) const
 inline bool
 DynObstacles::IsFree (const HexCoord& c) const
 {
-  return !buildings.Get (c) && !HasVehicle (c);
+  return !IsBuilding (c) && !HasVehicle (c);
 }
 
 inline void
@@ -72,6 +72,24 @@ TEST_F (DynObstaclesTests, BuildingsFromDb)
   EXPECT_FALSE (dyn.IsBuilding (HexCoord (2, 0)));
 }
 
+TEST_F (DynObstaclesTests, BuildingIds)
+{
+  const auto id1 = buildings.CreateNew ("checkmark", "", Faction::ANCIENT)
+                      ->GetId ();
+  auto b2 = buildings.CreateNew ("checkmark", "", Faction::RED);
+  b2->SetCentre (HexCoord (10, 5));
+  const auto id2 = b2->GetId ();
+  b2.reset ();
+
+  DynObstacles dyn(db, ctx);
+
+  EXPECT_EQ (dyn.GetBuildingId (HexCoord (0, 0)), id1);
+  EXPECT_EQ (dyn.GetBuildingId (HexCoord (0, 2)), id1);
+  EXPECT_EQ (dyn.GetBuildingId (HexCoord (10, 5)), id2);
+  EXPECT_EQ (dyn.GetBuildingId (HexCoord (10, 7)), id2);
+  EXPECT_EQ (dyn.GetBuildingId (HexCoord (2, 0)), Database::EMPTY_ID);
+}
+
 TEST_F (DynObstaclesTests, Modifications)
 {
   const HexCoord c(42, 0);
@@ -107,15 +125,16 @@ TEST_F (DynObstaclesTests, AddingBuildings)
   {
     DynObstacles dyn(ctx.Chain ());
     std::vector<HexCoord> shape;
-    ASSERT_TRUE (dyn.AddBuilding (b1->GetType (),
+    ASSERT_TRUE (dyn.AddBuilding (b1->GetId (), b1->GetType (),
                                   b1->GetProto ().shape_trafo (),
                                   b1->GetCentre (), shape));
-    ASSERT_TRUE (dyn.AddBuilding (b2->GetType (),
+    ASSERT_TRUE (dyn.AddBuilding (b2->GetId (), b2->GetType (),
                                   b2->GetProto ().shape_trafo (),
                                   b2->GetCentre (), shape));
-    ASSERT_FALSE (dyn.AddBuilding (b1->GetType (),
+    ASSERT_FALSE (dyn.AddBuilding (b1->GetId (), b1->GetType (),
                                    b1->GetProto ().shape_trafo (),
                                    b1->GetCentre (), shape));
+    EXPECT_EQ (dyn.GetBuildingId (HexCoord (10, 5)), b2->GetId ());
   }
 }
 
@@ -69,8 +69,8 @@ FameUpdater::UpdateForKill (const Database::IdT victim,
   VLOG (1) << "Updating fame for killing of character " << victim;
 
   /* Determine the victim's fame level.  */
-  auto victimCharacter = characters.GetById (victim);
-  const std::string& victimOwner = victimCharacter->GetOwner ();
+  std::string victimOwner;
+  CHECK (characters.GetOwnerById (victim, victimOwner));
   auto victimAccount = accounts.GetByName (victimOwner);
   CHECK (victimAccount != nullptr);
   const unsigned victimFame = victimAccount->GetProto ().fame ();
@@ -83,9 +83,9 @@ FameUpdater::UpdateForKill (const Database::IdT victim,
   std::set<std::string> owners;
   for (const auto attackerId : attackers)
     {
-      auto c = characters.GetById (attackerId);
-      CHECK (c != nullptr);
-      owners.insert (c->GetOwner ());
+      std::string owner;
+      CHECK (characters.GetOwnerById (attackerId, owner));
+      owners.insert (owner);
     }
 
   /* Process the killer accounts in a first round.  We update the kills counter
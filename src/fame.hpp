@@ -89,6 +89,15 @@ public:
     : dl(db, ctx.Height ()), characters(db), accounts(db)
   {}
 
+  /**
+   * Constructs the instance with the DamageLists operating on
+   * the given in-memory cache.
+   */
+  explicit FameUpdater (Database& db, DamageListsCache& dlCache,
+                        const Context& ctx)
+    : dl(db, ctx.Height (), dlCache), characters(db), accounts(db)
+  {}
+
   virtual ~FameUpdater ();
 
   FameUpdater () = delete;
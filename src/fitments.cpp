@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -25,6 +25,8 @@
 #include <google/protobuf/util/message_differencer.h>
 
 #include <map>
+#include <mutex>
+#include <utility>
 
 namespace pxd
 {
@@ -125,42 +127,77 @@ namespace
 {
 
 /**
- * Initialises the character stats from the base values with the
- * given vehicle.
+ * Maximum number of distinct loadouts for which we keep derived stats
+ * cached.  If this is exceeded, the cache is simply cleared.  Typically
+ * there are only few loadouts in use, but we want to make sure the memory
+ * usage is bounded in any case.
+ */
+constexpr size_t MAX_CACHED_LOADOUTS = 10'000;
+
+/**
+ * The "derived" stats of a character based on its loadout (vehicle type
+ * and fitments).  These depend only on the loadout and the (immutable)
+ * RoConfig data, and thus can be cached.
+ */
+struct DerivedStats
+{
+
+  /** Character proto that just holds all the derived fields.  */
+  proto::Character pb;
+
+  /** The derived regeneration data.  */
+  proto::RegenData regen;
+
+};
+
+/**
+ * Key for the derived-stats cache, i.e. the vehicle type and list of
+ * fitments.  The fitments are in the order they are on the character,
+ * as that determines e.g. the order of attacks in the combat data.
+ */
+using LoadoutKey = std::pair<std::string, std::vector<std::string>>;
+
+/** Lock for the derived-stats cache.  */
+std::mutex mutDerivedStats;
+
+/**
+ * Cache of derived stats for each chain and loadout we have computed
+ * them for already.
+ */
+std::map<xaya::Chain, std::map<LoadoutKey, DerivedStats>> derivedStatsCache;
+
+/**
+ * Initialises the stats from the base values with the given vehicle.
  */
 void
-InitCharacterStats (Character& c, const proto::VehicleData& data)
+InitCharacterStats (DerivedStats& stats, const proto::VehicleData& data)
 {
-  auto& pb = c.MutableProto ();
+  auto& pb = stats.pb;
 
   pb.set_cargo_space (data.cargo_space ());
   pb.set_speed (data.speed ());
   *pb.mutable_combat_data () = data.combat_data ();
-  c.MutableRegenData () = data.regen_data ();
+  stats.regen = data.regen_data ();
 
   if (data.has_mining_rate ())
     *pb.mutable_mining ()->mutable_rate () = data.mining_rate ();
-  else
-    pb.clear_mining ();
 
   if (data.has_prospecting_blocks ())
     {
       pb.set_prospecting_blocks (data.prospecting_blocks ());
       CHECK_GT (pb.prospecting_blocks (), 0);
     }
-  else
-    pb.clear_prospecting_blocks ();
 
   /* By default, no vehicle can refine (without a fitment).  */
-  pb.clear_refining ();
 }
 
 /**
- * Applies all fitments from the character proto onto the base stats
+ * Applies all fitments from the loadout onto the base stats
  * in there already.
  */
 void
-ApplyFitments (Character& c, const Context& ctx)
+ApplyFitments (DerivedStats& stats, const std::vector<std::string>& fitments,
+               const Context& ctx)
 {
   /* Boosts from stat modifiers are not compounding.  Thus we total up
      each modifier first and only apply them at the end.  */
@@ -176,13 +213,13 @@ ApplyFitments (Character& c, const Context& ctx)
   bool hasRefinery = false;
   proto::MobileRefinery refinery;
 
-  auto& pb = c.MutableProto ();
+  auto& pb = stats.pb;
   auto* cd = pb.mutable_combat_data ();
-  for (const auto& f : pb.fitments ())
+  for (const auto& f : fitments)
     {
-      const auto fItemData = ctx.RoConfig ().Item (f);
+      const auto& fItemData = ctx.RoConfig ().Item (f);
       CHECK (fItemData.has_fitment ())
-          << "Non-fitment type " << f << " on character " << c.GetId ();
+          << "Non-fitment type " << f << " in loadout";
       const auto& fitment = fItemData.fitment ();
 
       if (fitment.has_attack ())
@@ -256,7 +293,7 @@ ApplyFitments (Character& c, const Context& ctx)
   if (hasRefinery)
     *pb.mutable_refining () = refinery;
 
-  auto& regen = c.MutableRegenData ();
+  auto& regen = stats.regen;
   regen.mutable_max_hp ()->set_armour (maxArmour (regen.max_hp ().armour ()));
   regen.mutable_max_hp ()->set_shield (maxShield (regen.max_hp ().shield ()));
 
@@ -291,18 +328,73 @@ ApplyFitments (Character& c, const Context& ctx)
     }
 }
 
+/**
+ * Computes the derived stats for the given loadout.
+ */
+void
+ComputeDerivedStats (const std::string& vehicle,
+                     const std::vector<std::string>& fitments,
+                     const Context& ctx, DerivedStats& stats)
+{
+  const auto& vehicleItemData = ctx.RoConfig ().Item (vehicle);
+  CHECK (vehicleItemData.has_vehicle ())
+      << "Non-vehicle used as vehicle: " << vehicle;
+
+  InitCharacterStats (stats, vehicleItemData.vehicle ());
+  ApplyFitments (stats, fitments, ctx);
+}
+
 } // anonymous namespace
 
 void
 DeriveCharacterStats (Character& c, const Context& ctx)
 {
-  const auto& vehicleItemData = ctx.RoConfig ().Item (c.GetProto ().vehicle ());
-  CHECK (vehicleItemData.has_vehicle ())
-      << "Character " << c.GetId ()
-      << " is in non-vehicle: " << c.GetProto ().vehicle ();
-
-  InitCharacterStats (c, vehicleItemData.vehicle ());
-  ApplyFitments (c, ctx);
+  const auto& charPb = c.GetProto ();
+  LoadoutKey key(charPb.vehicle (), {});
+  key.second.assign (charPb.fitments ().begin (), charPb.fitments ().end ());
+
+  {
+    std::lock_guard<std::mutex> lock(mutDerivedStats);
+
+    auto& chainCache = derivedStatsCache[ctx.Chain ()];
+    auto mit = chainCache.find (key);
+    if (mit == chainCache.end ())
+      {
+        if (chainCache.size () >= MAX_CACHED_LOADOUTS)
+          {
+            LOG (WARNING)
+                << "Clearing derived-stats cache with "
+                << chainCache.size () << " entries";
+            chainCache.clear ();
+          }
+
+        DerivedStats stats;
+        ComputeDerivedStats (key.first, key.second, ctx, stats);
+        mit = chainCache.emplace (std::move (key), std::move (stats)).first;
+      }
+    const auto& stats = mit->second;
+
+    auto& pb = c.MutableProto ();
+    pb.set_cargo_space (stats.pb.cargo_space ());
+    pb.set_speed (stats.pb.speed ());
+    c.MutableCombatData () = stats.pb.combat_data ();
+    c.MutableRegenData () = stats.regen;
+
+    if (stats.pb.has_mining ())
+      *pb.mutable_mining ()->mutable_rate () = stats.pb.mining ().rate ();
+    else
+      pb.clear_mining ();
+
+    if (stats.pb.has_prospecting_blocks ())
+      pb.set_prospecting_blocks (stats.pb.prospecting_blocks ());
+    else
+      pb.clear_prospecting_blocks ();
+
+    if (stats.pb.has_refining ())
+      *pb.mutable_refining () = stats.pb.refining ();
+    else
+      pb.clear_refining ();
+  }
 
   /* Reset the current HP back to maximum, which might have changed.  This is
      fine as we only allow fitment changes for fully repaired vehicles
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -38,7 +38,8 @@ bool CheckVehicleFitments (const std::string& vehicle,
 
 /**
  * Updates the "derived" stats of the character based on the vehicle and
- * fitments it is equipped with.
+ * fitments it is equipped with.  The stats for each loadout are computed
+ * only once and then cached in memory.
  */
 void DeriveCharacterStats (Character& c, const Context& ctx);
 
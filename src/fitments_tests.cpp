@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -22,6 +22,8 @@
 
 #include "database/dbtest.hpp"
 
+#include <google/protobuf/util/message_differencer.h>
+
 #include <gtest/gtest.h>
 
 namespace pxd
@@ -29,6 +31,8 @@ namespace pxd
 namespace
 {
 
+using google::protobuf::util::MessageDifferencer;
+
 /* ************************************************************************** */
 
 class CheckVehicleFitmentsTests : public testing::Test
@@ -135,7 +139,7 @@ TEST_F (DeriveCharacterStatsTests, BaseVehicleStats)
   const auto& pb = c->GetProto ();
   EXPECT_EQ (pb.cargo_space (), 1'000);
   EXPECT_EQ (pb.speed (), 1'000);
-  EXPECT_EQ (pb.combat_data ().attacks_size (), 2);
+  EXPECT_EQ (c->GetCombatData ().attacks_size (), 2);
   EXPECT_EQ (pb.mining ().rate ().max (), 100);
   EXPECT_EQ (c->GetRegenData ().max_hp ().armour (), 1'000);
   EXPECT_EQ (c->GetRegenData ().max_hp ().shield (), 1'00);
@@ -162,7 +166,7 @@ TEST_F (DeriveCharacterStatsTests, HpAreReset)
 TEST_F (DeriveCharacterStatsTests, FitmentAttacks)
 {
   auto c = Derive ("chariot", {"lf bomb"});
-  const auto& attacks = c->GetProto ().combat_data ().attacks ();
+  const auto& attacks = c->GetCombatData ().attacks ();
   ASSERT_EQ (attacks.size (), 3);
   EXPECT_EQ (attacks[0].range (), 100);
   EXPECT_EQ (attacks[1].area (), 10);
@@ -172,7 +176,7 @@ TEST_F (DeriveCharacterStatsTests, FitmentAttacks)
 TEST_F (DeriveCharacterStatsTests, FitmentLowHpBoosts)
 {
   auto c = Derive ("chariot", {"lf lowhpboost", "lf lowhpboost"});
-  const auto& boosts = c->GetProto ().combat_data ().low_hp_boosts ();
+  const auto& boosts = c->GetCombatData ().low_hp_boosts ();
   ASSERT_EQ (boosts.size (), 2);
   for (const auto& b : boosts)
     {
@@ -192,7 +196,7 @@ TEST_F (DeriveCharacterStatsTests, FitmentSelfDestructs)
       "lf rangeext",
       "lf dmgext",
     });
-  const auto& sd = c->GetProto ().combat_data ().self_destructs ();
+  const auto& sd = c->GetCombatData ().self_destructs ();
   ASSERT_EQ (sd.size (), 2);
   for (const auto& s : sd)
     {
@@ -245,13 +249,13 @@ TEST_F (DeriveCharacterStatsTests, RangeDamage)
 {
   auto c = Derive ("chariot", {"lf rangeext", "lf dmgext", "lf dmgext"});
 
-  const auto* a = &c->GetProto ().combat_data ().attacks (0);
+  const auto* a = &c->GetCombatData ().attacks (0);
   EXPECT_FALSE (a->has_area ());
   EXPECT_EQ (a->range (), 110);
   EXPECT_EQ (a->damage ().min (), 11);
   EXPECT_EQ (a->damage ().max (), 110);
 
-  a = &c->GetProto ().combat_data ().attacks (1);
+  a = &c->GetCombatData ().attacks (1);
   EXPECT_FALSE (a->has_range ());
   EXPECT_EQ (a->area (), 11);
 }
@@ -259,11 +263,11 @@ TEST_F (DeriveCharacterStatsTests, RangeDamage)
 TEST_F (DeriveCharacterStatsTests, ReceivedDamageAndHitChance)
 {
   auto c = Derive ("chariot", {});
-  EXPECT_FALSE (c->GetProto ().combat_data ().has_received_damage_modifier ());
-  EXPECT_FALSE (c->GetProto ().combat_data ().has_hit_chance_modifier ());
+  EXPECT_FALSE (c->GetCombatData ().has_received_damage_modifier ());
+  EXPECT_FALSE (c->GetCombatData ().has_hit_chance_modifier ());
 
   c = Derive ("chariot", {"lf dmgred", "lf dmgred", "lf hitext"});
-  const auto& cd = c->GetProto ().combat_data ();
+  const auto& cd = c->GetCombatData ();
   EXPECT_EQ (cd.received_damage_modifier ().percent (), -10);
   EXPECT_EQ (cd.hit_chance_modifier ().percent (), 10);
 }
@@ -281,7 +285,7 @@ TEST_F (DeriveCharacterStatsTests, FitmentAttacksAlsoBoosted)
       "lf bomb",
       "lf dmgext", "lf dmgext", "lf dmgext",
     });
-  const auto& a = c->GetProto ().combat_data ().attacks (2);
+  const auto& a = c->GetCombatData ().attacks (2);
   EXPECT_EQ (a.damage ().max (), 10);
 }
 
@@ -294,6 +298,47 @@ TEST_F (DeriveCharacterStatsTests, MobileRefinery)
   EXPECT_FALSE (c->GetProto ().has_refining ());
 }
 
+TEST_F (DeriveCharacterStatsTests, RepeatedLoadouts)
+{
+  auto a = Derive ("chariot", {"lf bomb", "vhf refinery"});
+  auto b = Derive ("chariot", {"lf bomb", "vhf refinery"});
+  EXPECT_TRUE (MessageDifferencer::Equals (a->GetProto (), b->GetProto ()));
+  EXPECT_TRUE (MessageDifferencer::Equals (a->GetRegenData (),
+                                           b->GetRegenData ()));
+
+  UpdateStats (*b, "basetank", {});
+  EXPECT_FALSE (b->GetProto ().has_refining ());
+  EXPECT_FALSE (b->GetProto ().has_prospecting_blocks ());
+  EXPECT_FALSE (b->GetProto ().has_mining ());
+
+  UpdateStats (*b, "chariot", {"lf bomb", "vhf refinery"});
+  EXPECT_TRUE (MessageDifferencer::Equals (a->GetProto (), b->GetProto ()));
+  EXPECT_TRUE (MessageDifferencer::Equals (a->GetRegenData (),
+                                           b->GetRegenData ()));
+}
+
+TEST_F (DeriveCharacterStatsTests, MiningStateKept)
+{
+  auto c = Derive ("chariot", {});
+  c->MutableProto ().mutable_mining ()->set_active (true);
+  UpdateStats (*c, "chariot", {"lf bomb"});
+  EXPECT_TRUE (c->GetProto ().mining ().active ());
+  EXPECT_EQ (c->GetProto ().mining ().rate ().max (), 100);
+}
+
+TEST_F (DeriveCharacterStatsTests, FitmentOrderMatters)
+{
+  auto a = Derive ("chariot", {"lf bomb", "lf gun"});
+  auto b = Derive ("chariot", {"lf gun", "lf bomb"});
+
+  const auto& attacksA = a->GetCombatData ().attacks ();
+  const auto& attacksB = b->GetCombatData ().attacks ();
+  ASSERT_EQ (attacksA.size (), 4);
+  ASSERT_EQ (attacksB.size (), 4);
+  EXPECT_TRUE (MessageDifferencer::Equals (attacksA[2], attacksB[3]));
+  EXPECT_TRUE (MessageDifferencer::Equals (attacksA[3], attacksB[2]));
+}
+
 /* ************************************************************************** */
 
 } // anonymous namespace
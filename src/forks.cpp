@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -30,6 +30,10 @@ namespace pxd
    and access (modify) them for unit tests.  */
 DEFINE_int32 (fork_height_gamestart, -1,
               "if set, override the fork height for \"game start\"");
+DEFINE_int32 (fork_height_lazyregen, -1,
+              "if set, override the fork height for \"lazy regen\"");
+DEFINE_int32 (fork_height_compactwaypoints, -1,
+              "if set, override the fork height for \"compact waypoints\"");
 
 namespace
 {
@@ -40,7 +44,10 @@ namespace
 struct ForkData
 {
 
-  /** The activation heights by chain.  */
+  /**
+   * The activation heights by chain.  If a chain is missing, then the
+   * fork is not (yet) scheduled there and never active.
+   */
   std::unordered_map<xaya::Chain, unsigned> heights;
 
   /**
@@ -76,6 +83,26 @@ const std::unordered_map<Fork, ForkData> FORK_HEIGHTS =
         &FLAGS_fork_height_gamestart,
       }
     },
+    {
+      Fork::LazyRegen,
+      {
+        {
+          {xaya::Chain::TEST, 150'000},
+          {xaya::Chain::REGTEST, 1'000},
+        },
+        &FLAGS_fork_height_lazyregen,
+      }
+    },
+    {
+      Fork::CompactWaypoints,
+      {
+        {
+          {xaya::Chain::TEST, 150'000},
+          {xaya::Chain::REGTEST, 1'000},
+        },
+        &FLAGS_fork_height_compactwaypoints,
+      }
+    },
   };
 
 } // anonymous namespace
@@ -92,9 +119,8 @@ ForkHandler::IsActive (const Fork f) const
     return static_cast<int> (height) >= *data.overrideFlag;
 
   const auto mit2 = data.heights.find (chain);
-  CHECK (mit2 != data.heights.end ())
-      << "Fork " << static_cast<int> (f)
-      << " does not define height for chain " << static_cast<int> (chain);
+  if (mit2 == data.heights.end ())
+    return false;
   return height >= mit2->second;
 }
 
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -43,6 +43,20 @@ enum class Fork
    */
   GameStart,
 
+  /**
+   * Fork after which HP regeneration is done lazily:  Instead of updating
+   * the HP of all damaged fighters in each block, HP are stored together
+   * with the height they were last updated at, and regeneration since then
+   * is computed in closed form when they are accessed.
+   */
+  LazyRegen,
+
+  /**
+   * Fork after which character updates can specify waypoints in the
+   * compact binary encoding (instead of compressed JSON).
+   */
+  CompactWaypoints,
+
 };
 
 /**
@@ -55,5 +55,15 @@ TEST_F (ForksTests, IsActive)
   EXPECT_TRUE (ctx.Forks ().IsActive (Fork::Dummy));
 }
 
+TEST_F (ForksTests, Unscheduled)
+{
+  ctx.SetChain (xaya::Chain::MAIN);
+  ctx.SetHeight (100'000'000);
+  EXPECT_FALSE (ctx.Forks ().IsActive (Fork::LazyRegen));
+
+  ctx.SetChain (xaya::Chain::REGTEST);
+  EXPECT_TRUE (ctx.Forks ().IsActive (Fork::LazyRegen));
+}
+
 } // anonymous namespace
 } // namespace pxd
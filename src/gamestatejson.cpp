@@ -21,21 +21,26 @@
 #include "buildings.hpp"
 #include "jsonutils.hpp"
 #include "modifier.hpp"
+#include "ongoings.hpp"
 #include "protoutils.hpp"
 #include "services.hpp"
 
 #include "database/account.hpp"
 #include "database/building.hpp"
+#include "database/changes.hpp"
 #include "database/character.hpp"
 #include "database/faction.hpp"
 #include "database/itemcounts.hpp"
 #include "database/moneysupply.hpp"
 #include "database/ongoing.hpp"
 #include "database/region.hpp"
+#include "database/statehash.hpp"
 #include "hexagonal/pathfinder.hpp"
 #include "proto/character.pb.h"
 
 #include <algorithm>
+#include <set>
+#include <vector>
 
 namespace pxd
 {
@@ -493,12 +498,6 @@ template <>
   if (op.GetBuildingId () != Database::EMPTY_ID)
     res["buildingid"] = IntToJson (op.GetBuildingId ());
 
-  /* For some operations, the actual end height is not the height of the
-     operation, because it will be processed multiple times before it is
-     complete (e.g. blueprint copies).  For them, we add an operation-specific
-     delta onto the operation height.  */
-  unsigned endDelta = 0;
-
   switch (pb.op_case ())
     {
     case proto::OngoingOperation::kProspection:
@@ -521,10 +520,6 @@ template <>
         output[cp.copy_type ()] = IntToJson (cp.num_copies ());
         res["output"] = output;
 
-        CHECK_GE (cp.num_copies (), 1);
-        endDelta += (cp.num_copies () - 1)
-                      * GetBpCopyBlocks (cp.copy_type (), ctx);
-
         break;
       }
 
@@ -540,13 +535,7 @@ template <>
         res["output"] = output;
 
         if (c.has_original_type ())
-          {
-            res["original"] = c.original_type ();
-
-            CHECK_GE (c.num_items (), 1);
-            endDelta += (c.num_items () - 1)
-                          * GetConstructionBlocks (c.output_type (), ctx);
-          }
+          res["original"] = c.original_type ();
 
         break;
       }
@@ -564,7 +553,13 @@ template <>
       LOG (FATAL) << "Unexpected ongoing operation case: " << pb.op_case ();
     }
 
-  res["end_height"] = IntToJson (op.GetHeight () + endDelta);
+  /* If we have an up-to-date schedule of the operations, it already knows
+     the end heights.  Otherwise compute them directly.  */
+  const auto* schedule = db.GetOngoingsSchedule ();
+  if (schedule != nullptr)
+    res["end_height"] = IntToJson (schedule->GetEndHeight (op.GetId ()));
+  else
+    res["end_height"] = IntToJson (GetOngoingEndHeight (op, ctx));
 
   return res;
 }
@@ -713,15 +708,11 @@ GameStateJson::PrizeStats ()
   return res;
 }
 
-Json::Value
-GameStateJson::Accounts ()
+void
+GameStateJson::AddReservedCoins (Json::Value& accounts) const
 {
-  AccountsTable tbl(db);
-  Json::Value res = ResultsAsArray (tbl, tbl.QueryAll ());
-
-  /* Add in also the Cubit balances reserved in open bids.  */
   const auto reserved = orders.GetReservedCoins ();
-  for (auto& entry : res)
+  for (auto& entry : accounts)
     {
       const auto& nmVal = entry["name"];
       CHECK (nmVal.isString ());
@@ -738,6 +729,16 @@ GameStateJson::Accounts ()
       bal["reserved"] = IntToJson (cur);
       bal["total"] = IntToJson (cur + bal["available"].asInt64 ());
     }
+}
+
+Json::Value
+GameStateJson::Accounts ()
+{
+  AccountsTable tbl(db);
+  Json::Value res = ResultsAsArray (tbl, tbl.QueryAll ());
+
+  /* Add in also the Cubit balances reserved in open bids.  */
+  AddReservedCoins (res);
 
   return res;
 }
@@ -749,6 +750,17 @@ GameStateJson::Buildings ()
   return ResultsAsArray (tbl, tbl.QueryAll ());
 }
 
+Json::Value
+GameStateJson::BuildingsInArea (const HexCoord& centre,
+                                const HexCoord::IntT l1range,
+                                const std::string& owner)
+{
+  BuildingsTable tbl(db);
+  if (owner.empty ())
+    return ResultsAsArray (tbl, tbl.QueryInArea (centre, l1range));
+  return ResultsAsArray (tbl, tbl.QueryInArea (centre, l1range, owner));
+}
+
 Json::Value
 GameStateJson::Characters ()
 {
@@ -756,6 +768,17 @@ GameStateJson::Characters ()
   return ResultsAsArray (tbl, tbl.QueryAll ());
 }
 
+Json::Value
+GameStateJson::CharactersInArea (const HexCoord& centre,
+                                 const HexCoord::IntT l1range,
+                                 const std::string& owner)
+{
+  CharacterTable tbl(db);
+  if (owner.empty ())
+    return ResultsAsArray (tbl, tbl.QueryInArea (centre, l1range));
+  return ResultsAsArray (tbl, tbl.QueryInArea (centre, l1range, owner));
+}
+
 Json::Value
 GameStateJson::GroundLoot ()
 {
@@ -770,6 +793,26 @@ GameStateJson::OngoingOperations ()
   return ResultsAsArray (tbl, tbl.QueryAll ());
 }
 
+Json::Value
+GameStateJson::OrderBooks ()
+{
+  std::set<Database::IdT> buildings;
+  auto res = orders.QueryAll ();
+  while (res.Step ())
+    buildings.insert (orders.GetFromResult (res)->GetBuilding ());
+
+  Json::Value books(Json::arrayValue);
+  for (const auto id : buildings)
+    {
+      Json::Value cur(Json::objectValue);
+      cur["building"] = IntToJson (id);
+      cur["orderbook"] = GetOrderbookInBuilding (orders, id);
+      books.append (cur);
+    }
+
+  return books;
+}
+
 Json::Value
 GameStateJson::Regions (const unsigned h)
 {
@@ -777,6 +820,78 @@ GameStateJson::Regions (const unsigned h)
   return ResultsAsArray (tbl, tbl.QueryModifiedSince (h));
 }
 
+namespace
+{
+
+/**
+ * Converts a list of entity IDs to a JSON array.
+ */
+Json::Value
+IdsToJson (const std::vector<Database::IdT>& ids)
+{
+  Json::Value res(Json::arrayValue);
+  for (const auto id : ids)
+    res.append (IntToJson (id));
+  return res;
+}
+
+} // anonymous namespace
+
+Json::Value
+GameStateJson::ChangesSince (const unsigned h)
+{
+  Json::Value res(Json::objectValue);
+
+  AccountsTable accounts(db);
+  res["accounts"] = ResultsAsArray (accounts, accounts.QueryModifiedSince (h));
+  AddReservedCoins (res["accounts"]);
+
+  BuildingsTable buildings(db);
+  res["buildings"]
+      = ResultsAsArray (buildings, buildings.QueryModifiedSince (h));
+
+  CharacterTable characters(db);
+  res["characters"]
+      = ResultsAsArray (characters, characters.QueryModifiedSince (h));
+
+  GroundLootTable loot(db);
+  res["groundloot"] = ResultsAsArray (loot, loot.QueryModifiedSince (h));
+
+  OngoingsTable ongoings(db);
+  res["ongoings"] = ResultsAsArray (ongoings, ongoings.QueryModifiedSince (h));
+
+  res["regions"] = Regions (h);
+
+  EntityChanges changes(db);
+  Json::Value deleted(Json::objectValue);
+  deleted["buildings"] = IdsToJson (changes.GetDeletedBuildings (h));
+  deleted["characters"] = IdsToJson (changes.GetDeletedCharacters (h));
+  deleted["ongoings"] = IdsToJson (changes.GetDeletedOngoings (h));
+  Json::Value emptied(Json::arrayValue);
+  for (const auto& pos : changes.GetEmptiedGroundLoot (h))
+    emptied.append (CoordToJson (pos));
+  deleted["groundloot"] = emptied;
+  res["deleted"] = deleted;
+
+  return res;
+}
+
+Json::Value
+GameStateJson::StateHash ()
+{
+  const auto hashes = GetIncrementalTableHashes (db);
+
+  Json::Value tables(Json::objectValue);
+  for (const auto& entry : hashes)
+    tables[entry.first] = entry.second.ToHex ();
+
+  Json::Value res(Json::objectValue);
+  res["statehash"] = CombineTableHashes (hashes).ToHex ();
+  res["tables"] = tables;
+
+  return res;
+}
+
 Json::Value
 GameStateJson::TradeHistory (const std::string& item,
                              const Database::IdT building)
@@ -25,11 +25,14 @@
 #include "database/database.hpp"
 #include "database/dex.hpp"
 #include "database/inventory.hpp"
+#include "hexagonal/coord.hpp"
 #include "mapdata/basemap.hpp"
 #include "proto/building.pb.h"
 
 #include <json/json.h>
 
+#include <string>
+
 namespace pxd
 {
 
@@ -70,6 +73,12 @@ private:
   template <typename T, typename R>
     Json::Value ResultsAsArray (T& tbl, Database::Result<R> res) const;
 
+  /**
+   * Adds the Cubit balances reserved in open bids to the JSON objects
+   * of the given array of accounts.
+   */
+  void AddReservedCoins (Json::Value& accounts) const;
+
 public:
 
   explicit GameStateJson (Database& d, const Context& c)
@@ -104,11 +113,28 @@ public:
    */
   Json::Value Buildings ();
 
+  /**
+   * Returns the JSON data representing all buildings whose centre is within
+   * the given L1 range around some coordinate.  If owner is non-empty,
+   * only buildings of that account are returned.
+   */
+  Json::Value BuildingsInArea (const HexCoord& centre, HexCoord::IntT l1range,
+                               const std::string& owner);
+
   /**
    * Returns the JSON data representing all characters in the game state.
    */
   Json::Value Characters ();
 
+  /**
+   * Returns the JSON data representing all characters on the map within
+   * the given L1 range around a coordinate, optionally only those with
+   * the given owner (if non-empty).
+   */
+  Json::Value CharactersInArea (const HexCoord& centre,
+                                HexCoord::IntT l1range,
+                                const std::string& owner);
+
   /**
    * Returns the JSON data representing all ground loot.
    */
@@ -119,12 +145,25 @@ public:
    */
   Json::Value OngoingOperations ();
 
+  /**
+   * Returns the DEX order books of all buildings that have open orders.
+   */
+  Json::Value OrderBooks ();
+
   /**
    * Returns the JSON data representing all regions in the game state which
    * where modified after the given block height.
    */
   Json::Value Regions (unsigned h);
 
+  /**
+   * Returns the JSON data of all accounts, buildings, characters, ground
+   * loot, ongoing operations and regions that have been changed at or after
+   * the given block height, as well as the IDs of entities that have been
+   * deleted (and positions of ground loot that has been emptied) since.
+   */
+  Json::Value ChangesSince (unsigned h);
+
   /**
    * Returns the JSON data about money supply and burnsale stats.
    */
@@ -136,6 +175,12 @@ public:
    */
   Json::Value PrizeStats ();
 
+  /**
+   * Returns the incrementally maintained state hash, both combined and
+   * per table.  This allows cheap comparison of the state between nodes.
+   */
+  Json::Value StateHash ();
+
   /**
    * Returns the trade history for a given item and building.
    */
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -24,9 +24,11 @@
 
 #include "database/account.hpp"
 #include "database/building.hpp"
+#include "database/changes.hpp"
 #include "database/character.hpp"
 #include "database/dbtest.hpp"
 #include "database/dex.hpp"
+#include "database/dirtyids.hpp"
 #include "database/inventory.hpp"
 #include "database/itemcounts.hpp"
 #include "database/moneysupply.hpp"
@@ -240,7 +242,7 @@ TEST_F (CharacterJsonTests, Target)
 TEST_F (CharacterJsonTests, Attacks)
 {
   auto c = tbl.CreateNew ("domob", Faction::RED);
-  auto* cd = c->MutableProto ().mutable_combat_data ();
+  auto* cd = &c->MutableCombatData ();
 
   auto* attack = cd->add_attacks ();
   attack->set_range (5);
@@ -520,6 +522,27 @@ TEST_F (CharacterJsonTests, Busy)
   })");
 }
 
+TEST_F (CharacterJsonTests, InArea)
+{
+  tbl.CreateNew ("domob", Faction::RED)->SetPosition (HexCoord (1, 0));
+  tbl.CreateNew ("andy", Faction::RED)->SetPosition (HexCoord (-1, 0));
+  tbl.CreateNew ("domob", Faction::RED)->SetPosition (HexCoord (10, 0));
+  tbl.CreateNew ("domob", Faction::RED)->SetBuildingId (100);
+
+  const auto full = converter.Characters ();
+  ASSERT_EQ (full.size (), 4);
+
+  Json::Value expected(Json::arrayValue);
+  expected.append (full[0]);
+  expected.append (full[1]);
+  EXPECT_EQ (converter.CharactersInArea (HexCoord (0, 0), 1, ""), expected);
+
+  expected = Json::Value (Json::arrayValue);
+  expected.append (full[0]);
+  EXPECT_EQ (converter.CharactersInArea (HexCoord (0, 0), 1, "domob"),
+             expected);
+}
+
 /* ************************************************************************** */
 
 class AccountJsonTests : public GameStateJsonTests
@@ -866,6 +889,43 @@ TEST_F (BuildingJsonTests, Orderbook)
   })");
 }
 
+TEST_F (BuildingJsonTests, OrderBooks)
+{
+  tbl.CreateNew ("checkmark", "", Faction::ANCIENT);
+  tbl.CreateNew ("checkmark", "", Faction::ANCIENT);
+  tbl.CreateNew ("checkmark", "", Faction::ANCIENT);
+
+  db.SetNextId (101);
+  DexOrderTable orders(db);
+  orders.CreateNew (3, "domob", DexOrder::Type::BID, "foo", 2, 2);
+  orders.CreateNew (1, "andy", DexOrder::Type::ASK, "bar", 1, 5);
+
+  ASSERT_TRUE (PartialJsonEqual (converter.OrderBooks (), ParseJson (R"([
+    {
+      "building": 1,
+      "orderbook":
+        {
+          "bar":
+            {
+              "bids": [],
+              "asks": [{"id": 102, "account": "andy"}]
+            }
+        }
+    },
+    {
+      "building": 3,
+      "orderbook":
+        {
+          "foo":
+            {
+              "bids": [{"id": 101, "account": "domob"}],
+              "asks": []
+            }
+        }
+    }
+  ])")));
+}
+
 TEST_F (BuildingJsonTests, ConfiguredFees)
 {
   auto b = tbl.CreateNew ("checkmark", "daniel", Faction::RED);
@@ -954,7 +1014,7 @@ TEST_F (BuildingJsonTests, CombatData)
 
   auto h = tbl.CreateNew ("checkmark", "daniel", Faction::RED);
   ASSERT_EQ (h->GetId (), 2);
-  auto* att = h->MutableProto ().mutable_combat_data ()->add_attacks ();
+  auto* att = h->MutableCombatData ().add_attacks ();
   att->set_range (5);
   att->mutable_damage ()->set_min (1);
   att->mutable_damage ()->set_max (2);
@@ -1590,5 +1650,132 @@ TEST_F (TradeHistoryJsonTests, ForItemAndBuilding)
 
 /* ************************************************************************** */
 
+class ChangesSinceJsonTests : public GameStateJsonTests
+{
+
+protected:
+
+  DirtyIds dirty;
+
+  AccountsTable accounts;
+  CharacterTable characters;
+  GroundLootTable loot;
+  DexOrderTable orders;
+
+  ChangesSinceJsonTests ()
+    : accounts(db), characters(db), loot(db), orders(db)
+  {
+    db.SetNextId (101);
+    db.SetDirtyIds (&dirty);
+  }
+
+  ~ChangesSinceJsonTests ()
+  {
+    db.SetDirtyIds (nullptr);
+  }
+
+  /**
+   * Records the changes marked so far at the given height.
+   */
+  void
+  Record (const unsigned height)
+  {
+    EntityChanges (db).Record (dirty, height);
+    dirty.Clear ();
+  }
+
+  /**
+   * Expects that the changes since the given height match the expected
+   * (partial) JSON value.
+   */
+  void
+  ExpectChanges (const unsigned h, const std::string& expectedStr)
+  {
+    const Json::Value actual = converter.ChangesSince (h);
+    VLOG (1) << "Actual JSON for the changes:\n" << actual;
+    ASSERT_TRUE (PartialJsonEqual (actual, ParseJson (expectedStr)));
+  }
+
+};
+
+TEST_F (ChangesSinceJsonTests, Empty)
+{
+  ExpectChanges (0, R"({
+    "accounts": [],
+    "buildings": [],
+    "characters": [],
+    "groundloot": [],
+    "ongoings": [],
+    "regions": [],
+    "deleted":
+      {
+        "buildings": [],
+        "characters": [],
+        "groundloot": [],
+        "ongoings": []
+      }
+  })");
+}
+
+TEST_F (ChangesSinceJsonTests, ModifiedAndDeleted)
+{
+  accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+  characters.CreateNew ("domob", Faction::RED);
+  characters.CreateNew ("domob", Faction::RED);
+  loot.GetByCoord (HexCoord (1, 2))->GetInventory ()
+      .AddFungibleCount ("foo", 5);
+  Record (10);
+
+  characters.DeleteById (101);
+  characters.GetById (102)->SetPosition (HexCoord (3, 4));
+  loot.GetByCoord (HexCoord (1, 2))->GetInventory ()
+      .SetFungibleCount ("foo", 0);
+  Record (11);
+
+  ExpectChanges (10, R"({
+    "accounts": [{"name": "domob"}],
+    "characters": [{"id": 102, "position": {"x": 3, "y": 4}}],
+    "groundloot": [],
+    "deleted":
+      {
+        "characters": [101],
+        "groundloot": [{"x": 1, "y": 2}]
+      }
+  })");
+
+  ExpectChanges (11, R"({
+    "accounts": [],
+    "characters": [{"id": 102}],
+    "deleted": {"characters": [101]}
+  })");
+
+  ExpectChanges (12, R"({
+    "accounts": [],
+    "characters": [],
+    "deleted": {"characters": [], "groundloot": []}
+  })");
+}
+
+TEST_F (ChangesSinceJsonTests, ReservedCoins)
+{
+  accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+  Record (10);
+
+  orders.CreateNew (42, "domob", DexOrder::Type::BID, "foo", 2, 3);
+  Record (11);
+
+  ExpectChanges (11, R"({
+    "accounts":
+      [
+        {
+          "name": "domob",
+          "balance": {"available": 0, "reserved": 6, "total": 6}
+        }
+      ]
+  })");
+}
+
+/* ************************************************************************** */
+
 } // anonymous namespace
 } // namespace pxd
@@ -0,0 +1,183 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Tool that writes a synthetic game-state database of configurable size,
+   e.g. to be used as starting point for replaybench.  */
+
+#include "buildings.hpp"
+#include "testutils.hpp"
+#include "worldgen.hpp"
+
+#include "database/dbtest.hpp"
+#include "database/moneysupply.hpp"
+#include "database/schema.hpp"
+
+#include <xayautil/hash.hpp>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <sqlite3.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace
+{
+
+DEFINE_string (output, "", "the SQLite file to write (must not exist yet)");
+DEFINE_string (chain, "main",
+               "the chain for which to generate (main, test or regtest)");
+DEFINE_int32 (height, 1'000, "the block height of the generated state");
+DEFINE_string (seed, "", "seed for the random generator");
+
+DEFINE_int32 (accounts, 30, "number of accounts to create");
+DEFINE_int32 (characters_per_faction, 100,
+              "number of characters to create per faction");
+DEFINE_int32 (buildings, 10, "number of buildings to place");
+DEFINE_int32 (dex_orders, 100, "number of DEX orders to create");
+DEFINE_int32 (ongoings, 10, "number of ongoing operations to create");
+DEFINE_int32 (hotspots, 0,
+              "if positive, cluster everything into that many hotspots");
+DEFINE_int32 (hotspot_radius, 20, "radius of each hotspot");
+DEFINE_int32 (spread_radius, 2'000,
+              "radius around the origin to spread things in without hotspots");
+
+/**
+ * Parses the chain from its name as given in the flag.
+ */
+xaya::Chain
+ParseChain (const std::string& name)
+{
+  if (name == "main")
+    return xaya::Chain::MAIN;
+  if (name == "test")
+    return xaya::Chain::TEST;
+  if (name == "regtest")
+    return xaya::Chain::REGTEST;
+
+  LOG (FATAL) << "Invalid chain: " << name;
+}
+
+/**
+ * Stores the next auto IDs of the test database into the database itself,
+ * in the same format as SQLiteGame does.  That way, tauriond (or
+ * replaybench) can continue from the generated state.
+ */
+void
+StoreAutoIds (pxd::TestDatabase& db)
+{
+  db.Prepare (R"(
+    CREATE TABLE `xayagame_ids` (
+      `namespace` TEXT PRIMARY KEY,
+      `next` INTEGER NOT NULL
+    )
+  )").Execute ();
+
+  auto stmt = db.Prepare (R"(
+    INSERT INTO `xayagame_ids`
+      (`namespace`, `next`) VALUES (?1, ?2)
+  )");
+
+  stmt.Bind (1, std::string ("pxd"));
+  stmt.Bind (2, db.GetNextId ());
+  stmt.Execute ();
+
+  stmt.Reset ();
+  stmt.Bind (1, std::string ("log"));
+  stmt.Bind (2, db.GetLogId ());
+  stmt.Execute ();
+}
+
+/**
+ * Writes the in-memory database to the given file.
+ */
+void
+WriteToFile (pxd::TestDatabase& db, const std::string& file)
+{
+  sqlite3* target;
+  const int rc = sqlite3_open_v2 (file.c_str (), &target,
+                                  SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                                  nullptr);
+  CHECK_EQ (rc, SQLITE_OK)
+      << "Failed to open " << file << ": " << sqlite3_errmsg (target);
+
+  sqlite3_backup* backup
+      = sqlite3_backup_init (target, "main", **db, "main");
+  CHECK (backup != nullptr)
+      << "Failed to copy database: " << sqlite3_errmsg (target);
+  CHECK_EQ (sqlite3_backup_step (backup, -1), SQLITE_DONE);
+  CHECK_EQ (sqlite3_backup_finish (backup), SQLITE_OK);
+  CHECK_EQ (sqlite3_close (target), SQLITE_OK);
+}
+
+} // anonymous namespace
+
+int
+main (int argc, char** argv)
+{
+  google::InitGoogleLogging (argv[0]);
+
+  gflags::SetUsageMessage ("Generate a synthetic game state for testing");
+  gflags::ParseCommandLineFlags (&argc, &argv, true);
+
+  if (FLAGS_output.empty ())
+    {
+      std::cerr << "--output must be given" << std::endl;
+      return EXIT_FAILURE;
+    }
+  if (std::ifstream (FLAGS_output))
+    {
+      std::cerr << FLAGS_output << " exists already" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  pxd::WorldGenParams params;
+  params.accounts = FLAGS_accounts;
+  params.charactersPerFaction = FLAGS_characters_per_faction;
+  params.buildings = FLAGS_buildings;
+  params.dexOrders = FLAGS_dex_orders;
+  params.ongoings = FLAGS_ongoings;
+  params.hotspots = FLAGS_hotspots;
+  params.hotspotRadius = FLAGS_hotspot_radius;
+  params.spreadRadius = FLAGS_spread_radius;
+
+  pxd::ContextForTesting ctx;
+  ctx.SetChain (ParseChain (FLAGS_chain));
+  ctx.SetHeight (FLAGS_height);
+
+  xaya::Random rnd;
+  rnd.Seed (xaya::SHA256::Hash ("genworld " + FLAGS_seed));
+
+  pxd::TestDatabase db;
+  pxd::SetupDatabaseSchema (*db);
+  pxd::MoneySupply (db).InitialiseDatabase ();
+  pxd::InitialiseBuildings (db, ctx.Chain ());
+
+  pxd::WorldGenerator gen(db, ctx, rnd, params);
+  gen.Generate ();
+  pxd::WorldGenerator::Validate (db, ctx);
+
+  StoreAutoIds (db);
+  WriteToFile (db, FLAGS_output);
+  LOG (INFO) << "Wrote generated state to " << FLAGS_output;
+
+  return EXIT_SUCCESS;
+}
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -21,22 +21,72 @@
 #include "buildings.hpp"
 #include "combat.hpp"
 #include "dynobstacles.hpp"
+#include "jsonutils.hpp"
 #include "mining.hpp"
 #include "movement.hpp"
 #include "moveprocessor.hpp"
 #include "ongoings.hpp"
 
-#include "database/account.hpp"
-#include "database/building.hpp"
-#include "database/dex.hpp"
+#include "database/changes.hpp"
+#include "database/character.hpp"
 #include "database/moneysupply.hpp"
 #include "database/schema.hpp"
+#include "database/statehash.hpp"
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <sstream>
+
 namespace pxd
 {
 
+namespace
+{
+
+DEFINE_string (record_blocks, "",
+               "if set, append the data of all attached blocks to this file"
+               " (one JSON object per line) for use with replaybench;"
+               " blocks detached later are not removed, but skipped when"
+               " replaying");
+
+DEFINE_string (trace_dir, "",
+               "if set, traces of blocks requested through the traceblocks"
+               " RPC method are written as JSON files to this directory");
+
+DEFINE_int32 (rpc_read_connections, 0,
+              "if positive, process state RPCs on up to that many read-only"
+              " database connections in parallel");
+
+DEFINE_int32 (validate_state_every, 0,
+              "if positive, validate the full game state every that many"
+              " blocks");
+DEFINE_bool (validate_state_incremental, false,
+             "if true, validate the entities touched in each block (except"
+             " those for which the full state is validated)");
+DEFINE_int32 (validate_state_threads, 0,
+              "if positive, run the state validation asynchronously on that"
+              " many threads, overlapping with processing of the next block");
+
+DEFINE_int32 (changes_tombstone_blocks, 2 * 60 * 24 * 3,
+              "number of blocks for which deletions of entities are"
+              " remembered for getchangessince");
+
+DEFINE_int32 (delta_stream_history, 100,
+              "number of recent blocks for which state deltas are kept, so"
+              " that streaming clients can resume from them");
+DEFINE_int32 (delta_stream_buffer, 32,
+              "maximum number of state deltas buffered for a streaming"
+              " client before it is disconnected");
+
+/** Number of blocks for which we keep performance data.  */
+constexpr size_t PERF_STATS_BLOCKS = 100;
+
+/** Number of recent blocks for which we remember the height.  */
+constexpr size_t RECENT_BLOCK_HEIGHTS = 1'000;
+
+} // anonymous namespace
+
 SQLiteGameDatabase::SQLiteGameDatabase (xaya::SQLiteDatabase& d, PXLogic& g)
   : game(g)
 {
@@ -55,6 +105,10 @@ SQLiteGameDatabase::GetLogId ()
   return game.Ids ("log").GetNext ();
 }
 
+PXLogic::PXLogic ()
+  : perfStats(PERF_STATS_BLOCKS)
+{}
+
 const BaseMap&
 PXLogic::GetBaseMap ()
 {
@@ -75,6 +129,17 @@ void
 PXLogic::UpdateState (Database& db, xaya::Random& rnd,
                       const xaya::Chain chain, const BaseMap& map,
                       const Json::Value& blockData)
+{
+  UpdateState (db, rnd, chain, map, nullptr, nullptr, nullptr, blockData);
+}
+
+void
+PXLogic::UpdateState (Database& db, xaya::Random& rnd,
+                      const xaya::Chain chain, const BaseMap& map,
+                      DamageListsCache* dlCache,
+                      CombatModifierMemo* modMemo,
+                      BlockPerfStats* perf,
+                      const Json::Value& blockData)
 {
   const auto& blockMeta = blockData["block"];
   CHECK (blockMeta.isObject ());
@@ -87,45 +152,188 @@ PXLogic::UpdateState (Database& db, xaya::Random& rnd,
 
   Context ctx(chain, map, height, timestamp);
 
-  FameUpdater fame(db, ctx);
-  UpdateState (db, fame, rnd, ctx, blockData);
+  std::unique_ptr<FameUpdater> fame;
+  if (dlCache == nullptr)
+    fame = std::make_unique<FameUpdater> (db, ctx);
+  else
+    fame = std::make_unique<FameUpdater> (db, *dlCache, ctx);
+
+  UpdateState (db, *fame, rnd, ctx, modMemo, perf, blockData);
 }
 
 void
 PXLogic::UpdateState (Database& db, FameUpdater& fame, xaya::Random& rnd,
                       const Context& ctx, const Json::Value& blockData)
 {
+  UpdateState (db, fame, rnd, ctx, nullptr, nullptr, blockData);
+}
+
+void
+PXLogic::UpdateState (Database& db, FameUpdater& fame, xaya::Random& rnd,
+                      const Context& ctx, CombatModifierMemo* modMemo,
+                      BlockPerfStats* perf,
+                      const Json::Value& blockData)
+{
+  const auto phase = [perf] (const char* name)
+    {
+      if (perf != nullptr)
+        perf->StartPhase (name);
+    };
+
+  phase ("damagelists");
   fame.GetDamageLists ().RemoveOld (
       ctx.RoConfig ()->params ().damage_list_blocks ());
 
-  AllHpUpdates (db, fame, rnd, ctx);
+  /* Protos extracted from the database are allocated on its arena, which
+     would otherwise grow throughout the whole block.  We reset it between
+     the processing phases, when all database handles are gone.  */
+
+  phase ("hp");
+  AllHpUpdates (db, fame, rnd, ctx, modMemo);
+  db.ResetArena ();
+
+  phase ("ongoings");
   ProcessAllOngoings (db, rnd, ctx);
+  db.ResetArena ();
 
+  phase ("obstacles");
   DynObstacles dyn(db, ctx);
+
+  phase ("moves");
   MoveProcessor mvProc(db, dyn, rnd, ctx);
   mvProc.ProcessAdmin (blockData["admin"]);
   mvProc.ProcessAll (blockData["moves"]);
+  db.ResetArena ();
 
+  phase ("mining");
   ProcessAllMining (db, rnd, ctx);
+  phase ("movement");
   ProcessAllMovement (db, dyn, ctx);
+  db.ResetArena ();
 
   /* Entering buildings should be after moves and movement, so that players
      enter as soon as possible (perhaps in the same instant the move for it
      gets confirmed).  It should be before combat targets, so that players
      entering a building won't be attacked any more.  */
+  phase ("enterbuildings");
   ProcessEnterBuildings (db, dyn, ctx);
 
-  FindCombatTargets (db, rnd, ctx);
+  phase ("targets");
+  FindCombatTargets (db, rnd, ctx, modMemo);
+  db.ResetArena ();
+
+  phase ("flush");
+  fame.GetDamageLists ().Flush ();
 
 #ifdef ENABLE_SLOW_ASSERTS
+  phase ("validate");
   ValidateStateSlow (db, ctx);
 #endif // ENABLE_SLOW_ASSERTS
+
+  if (perf != nullptr)
+    perf->EndPhase ();
+}
+
+void
+PXLogic::RecordBlock (const Json::Value& blockData)
+{
+  if (blockRecorder == nullptr)
+    {
+      LOG (INFO) << "Recording block data to " << FLAGS_record_blocks;
+      blockRecorder = std::make_unique<std::ofstream> (
+          FLAGS_record_blocks, std::ios::app);
+      CHECK (*blockRecorder) << "Failed to open " << FLAGS_record_blocks;
+    }
+
+  Json::StreamWriterBuilder wbuilder;
+  wbuilder["commentStyle"] = "None";
+  wbuilder["indentation"] = "";
+  *blockRecorder << Json::writeString (wbuilder, blockData) << std::endl;
+}
+
+bool
+PXLogic::TraceNextBlocks (const unsigned count)
+{
+#ifdef DISABLE_TRACING
+  LOG (WARNING) << "Tracing has been disabled at compile time";
+  return false;
+#else // DISABLE_TRACING
+  if (FLAGS_trace_dir.empty ())
+    {
+      LOG (WARNING) << "Tracing is not possible without --trace_dir";
+      return false;
+    }
+
+  LOG (INFO) << "Tracing the next " << count << " blocks";
+  blocksToTrace = count;
+  return true;
+#endif // DISABLE_TRACING
+}
+
+bool
+PXLogic::ConsumeTraceRequest ()
+{
+  unsigned cur = blocksToTrace;
+  while (cur > 0 && !blocksToTrace.compare_exchange_weak (cur, cur - 1))
+    continue;
+  return cur > 0;
+}
+
+void
+PXLogic::WriteTrace (const TraceCollector& trace, const BlockPerfStats& perf)
+{
+  Json::Value val = TraceToJson (trace);
+  val["otherData"]["height"] = IntToJson (perf.GetHeight ());
+  val["otherData"]["hash"] = perf.GetHash ();
+
+  std::ostringstream file;
+  file
+      << FLAGS_trace_dir << "/trace-" << perf.GetHeight ()
+      << "-" << perf.GetHash () << ".json";
+
+  std::ofstream out(file.str ());
+  if (!out)
+    {
+      LOG (WARNING) << "Failed to open " << file.str () << " for the trace";
+      return;
+    }
+
+  Json::StreamWriterBuilder wbuilder;
+  wbuilder["commentStyle"] = "None";
+  wbuilder["indentation"] = "";
+  out << Json::writeString (wbuilder, val) << std::endl;
+
+  LOG (INFO)
+      << "Wrote trace of block " << perf.GetHeight ()
+      << " with " << val["traceEvents"].size () << " events to "
+      << file.str ();
 }
 
 void
 PXLogic::SetupSchema (xaya::SQLiteDatabase& db)
 {
   SetupDatabaseSchema (db);
+
+  /* Read-only connections (for RPCs) are only possible with a database
+     file, and require WAL mode so that they see consistent snapshots
+     without blocking writes on the main connection.  */
+  const char* file = sqlite3_db_filename (*db, "main");
+  if (file == nullptr || *file == '\0')
+    return;
+
+  auto stmt = db.PrepareRo ("PRAGMA `journal_mode`");
+  CHECK (stmt.Step ());
+  const auto mode = stmt.Get<std::string> (0);
+  if (mode != "wal")
+    {
+      LOG (WARNING)
+          << "The game-state database uses journal mode " << mode
+          << ", read-only connections are not possible";
+      return;
+    }
+
+  std::lock_guard<std::mutex> lock(mutReadPool);
+  dbFile = file;
 }
 
 void
@@ -178,392 +386,448 @@ PXLogic::InitialiseState (xaya::SQLiteDatabase& db)
 void
 PXLogic::UpdateState (xaya::SQLiteDatabase& db, const Json::Value& blockData)
 {
+  const auto& blockMeta = blockData["block"];
+  CHECK (blockMeta.isObject ());
+
+  std::unique_lock<std::shared_timed_mutex> lock(mutCaches);
+
+  if (ongoingsSchedule == nullptr)
+    {
+      /* The end heights only depend on the configuration and not the
+         block, so a single context without height is enough.  */
+      auto cfgCtx = std::make_shared<const Context> (
+          GetChain (), GetBaseMap (),
+          Context::NO_HEIGHT, Context::NO_TIMESTAMP);
+      ongoingsSchedule = std::make_unique<OngoingsSchedule> (
+          [cfgCtx] (const OngoingOperation& op)
+            {
+              return GetOngoingEndHeight (op, *cfgCtx);
+            });
+    }
+
+  const auto& parentVal = blockMeta["parent"];
+  CHECK (parentVal.isString ());
+  const bool parentMismatch = (parentVal.asString () != cachedBlockHash);
+  if (parentMismatch)
+    {
+      VLOG (1)
+          << "Parent block " << parentVal.asString ()
+          << " does not match cached state for " << cachedBlockHash
+          << ", invalidating caches";
+      damageListsCache.Invalidate ();
+      ongoingsSchedule->Invalidate ();
+      combatModifiers.Clear ();
+    }
+
+  if (pendingValidation != nullptr)
+    {
+      /* The previous block has usually been committed now, so we can start
+         its validation unless it has been detached again in the mean time.
+         The validator itself checks that the committed state is really
+         the one of that block, since libxayagame may batch blocks.  */
+      if (parentVal.asString () == pendingValidation->hash)
+        asyncValidator->Start (pendingValidation->hash,
+                               pendingValidation->height,
+                               pendingValidation->timestamp,
+                               std::move (pendingValidation->dirty));
+      pendingValidation.reset ();
+    }
+
+  if (!FLAGS_record_blocks.empty ())
+    RecordBlock (blockData);
+
+  const auto& hashVal = blockMeta["hash"];
+  CHECK (hashVal.isString ());
+  const auto& heightVal = blockMeta["height"];
+  CHECK (heightVal.isUInt64 ());
+  BlockPerfStats perf(heightVal.asUInt64 (), hashVal.asString ());
+
+  /* If the block is traced, RPC calls processed concurrently are recorded
+     into the trace as well.  */
+  std::shared_ptr<TraceCollector> trace;
+  if (ConsumeTraceRequest ())
+    {
+      trace = std::make_shared<TraceCollector> ();
+      TraceCollector::SetShared (trace);
+    }
+  TraceActivation traceActivation(trace.get ());
+
   SQLiteGameDatabase dbObj(db, *this);
+  if (!ongoingsSchedule->IsLoaded ())
+    {
+      perf.StartPhase ("loadongoings");
+      ongoingsSchedule->Load (dbObj);
+      perf.EndPhase ();
+    }
+  dbObj.SetOngoingsSchedule (ongoingsSchedule.get ());
+
+  /* The touched entities are always recorded, since we need them for
+     tracking changes (and possibly for incremental validation).  */
+  auto dirty = std::make_unique<DirtyIds> ();
+  dbObj.SetDirtyIds (dirty.get ());
+
+  /* Detaching blocks (which always leads to a parent mismatch here, as does
+     a restart) may have restored character rows from undo data recorded
+     before the combat data had its own column.  Those are converted in the
+     database itself, so that the state (and its hash) matches the one of
+     nodes that never detached the blocks.  */
+  if (parentMismatch)
+    {
+      perf.StartPhase ("legacycombat");
+      CharacterTable (dbObj).NormaliseLegacyCombatData ();
+      perf.EndPhase ();
+    }
+
   UpdateState (dbObj, GetContext ().GetRandom (),
-               GetChain (), GetBaseMap (), blockData);
+               GetChain (), GetBaseMap (), &damageListsCache, &combatModifiers,
+               &perf, blockData);
+  dbObj.SetDirtyIds (nullptr);
+
+  perf.StartPhase ("changes");
+  EntityChanges changes(dbObj);
+  changes.Record (*dirty, perf.GetHeight ());
+  if (perf.GetHeight () > GetChangesWindow ())
+    changes.PruneTombstones (perf.GetHeight () - GetChangesWindow ());
+  perf.EndPhase ();
+
+  if (deltaStream != nullptr)
+    {
+      perf.StartPhase ("deltastream");
+      PublishDelta (dbObj, blockMeta, perf.GetHeight ());
+      perf.EndPhase ();
+    }
+
+  const bool validateFull
+      = FLAGS_validate_state_every > 0
+          && perf.GetHeight () % FLAGS_validate_state_every == 0;
+  if (validateFull)
+    ValidateBlock (db, dbObj, blockMeta, nullptr, perf);
+  else if (FLAGS_validate_state_incremental)
+    ValidateBlock (db, dbObj, blockMeta, std::move (dirty), perf);
+
+  LOG (INFO)
+      << "Processed block " << perf.GetHeight () << " in "
+      << std::chrono::duration_cast<std::chrono::milliseconds> (
+            perf.GetTotalDuration ()).count ()
+      << " ms";
+
+  if (trace != nullptr)
+    {
+      TraceCollector::SetShared (nullptr);
+      WriteTrace (*trace, perf);
+    }
+
+  RecordBlockHeight (hashVal.asString (), perf.GetHeight ());
+  perfStats.Add (std::move (perf));
+
+  cachedBlockHash = hashVal.asString ();
 }
 
-Json::Value
-PXLogic::GetStateAsJson (const xaya::SQLiteDatabase& db)
+unsigned
+PXLogic::GetChangesWindow ()
+{
+  CHECK_GT (FLAGS_changes_tombstone_blocks, 0);
+  return FLAGS_changes_tombstone_blocks;
+}
+
+void
+PXLogic::PublishDelta (Database& dbObj, const Json::Value& blockMeta,
+                       const unsigned height)
 {
-  SQLiteGameDatabase dbObj(const_cast<xaya::SQLiteDatabase&> (db), *this);
   const Context ctx(GetChain (), GetBaseMap (),
                     Context::NO_HEIGHT, Context::NO_TIMESTAMP);
   GameStateJson gsj(dbObj, ctx);
 
-  return gsj.FullState ();
+  Json::Value delta(Json::objectValue);
+  delta["height"] = IntToJson (height);
+  delta["hash"] = blockMeta["hash"];
+  delta["parent"] = blockMeta["parent"];
+  delta["changes"] = gsj.ChangesSince (height);
+
+  Json::StreamWriterBuilder wbuilder;
+  wbuilder["commentStyle"] = "None";
+  wbuilder["indentation"] = "";
+
+  deltaStream->Publish (height, blockMeta["hash"].asString (),
+                        blockMeta["parent"].asString (),
+                        Json::writeString (wbuilder, delta));
 }
 
-Json::Value
-PXLogic::GetCustomStateData (xaya::Game& game, const JsonStateFromRawDb& cb)
+DeltaStream&
+PXLogic::EnableDeltaStream ()
 {
-  return SQLiteGame::GetCustomStateData (game, "data",
-      [this, &cb] (const xaya::SQLiteDatabase& db, const xaya::uint256& hash,
-                   const unsigned height)
-        {
-          SQLiteGameDatabase dbObj(const_cast<xaya::SQLiteDatabase&> (db),
-                                   *this);
-          return cb (dbObj, hash, height);
-        });
+  if (deltaStream == nullptr)
+    {
+      CHECK_GT (FLAGS_delta_stream_history, 0);
+      CHECK_GT (FLAGS_delta_stream_buffer, 0);
+      deltaStream = std::make_unique<DeltaStream> (FLAGS_delta_stream_history,
+                                                   FLAGS_delta_stream_buffer);
+    }
+
+  return *deltaStream;
 }
 
 Json::Value
-PXLogic::GetCustomStateData (xaya::Game& game,
-                             const JsonStateFromDatabaseWithBlock& cb)
+PXLogic::GetStateAsJson (const xaya::SQLiteDatabase& db)
 {
-  return GetCustomStateData (game,
-    [this, &cb] (Database& db, const xaya::uint256& hash, const unsigned height)
-        {
-          const Context ctx(GetChain (), GetBaseMap (),
-                            Context::NO_HEIGHT, Context::NO_TIMESTAMP);
-          GameStateJson gsj(db, ctx);
-          return cb (gsj, hash, height);
-        });
+  SQLiteGameDatabase dbObj(const_cast<xaya::SQLiteDatabase&> (db), *this);
+  const Context ctx(GetChain (), GetBaseMap (),
+                    Context::NO_HEIGHT, Context::NO_TIMESTAMP);
+  GameStateJson gsj(dbObj, ctx);
+
+  return gsj.FullState ();
 }
 
-Json::Value
-PXLogic::GetCustomStateData (xaya::Game& game, const JsonStateFromDatabase& cb)
+void
+PXLogic::RecordBlockHeight (const std::string& hash, const unsigned height)
 {
-  return GetCustomStateData (game,
-    [&cb] (GameStateJson& gsj, const xaya::uint256& hash, const unsigned height)
+  std::lock_guard<std::mutex> lock(mutReadPool);
+
+  if (recentHeights.emplace (hash, height).second)
+    recentHeightsOrder.push_back (hash);
+
+  while (recentHeightsOrder.size () > RECENT_BLOCK_HEIGHTS)
     {
-      return cb (gsj);
-    });
+      recentHeights.erase (recentHeightsOrder.front ());
+      recentHeightsOrder.pop_front ();
+    }
 }
 
-namespace
+ReadConnectionPool*
+PXLogic::GetReadPool ()
 {
+  if (FLAGS_rpc_read_connections <= 0)
+    return nullptr;
 
-/**
- * Verifies general consistency of buildings.
- */
-void
-ValidateBuildings (Database& db, const Context& ctx)
-{
-  BuildingsTable buildings(db);
-  auto res = buildings.QueryAll ();
-  while (res.Step ())
+  std::lock_guard<std::mutex> lock(mutReadPool);
+  if (readPool == nullptr)
     {
-      auto b = buildings.GetFromResult (res);
-      const auto& pb = b->GetProto ();
-
-      CHECK (pb.age_data ().has_founded_height ())
-          << "Building " << b->GetId () << " has no founded height";
-      CHECK_LE (pb.age_data ().founded_height (), ctx.Height ())
-          << "Building " << b->GetId () << " is founded in the future";
-
-      if (pb.foundation ())
-        CHECK (!pb.age_data ().has_finished_height ())
-            << "Foundation " << b->GetId () << " has already finished height";
-      else
+      if (dbFile.empty ())
         {
-          CHECK (pb.age_data ().has_finished_height ())
-              << "Building " << b->GetId () << " has no finished height";
-          CHECK_GE (pb.age_data ().finished_height (),
-                    pb.age_data ().founded_height ())
-              << "Building " << b->GetId ()
-              << " was finished before being founded";
-          CHECK_LE (pb.age_data ().finished_height (), ctx.Height ())
-              << "Building " << b->GetId () << " is finished in the future";
+          LOG_FIRST_N (WARNING, 1)
+              << "The game-state database is not a file in WAL mode,"
+              << " not using read-only connections for RPCs";
+          return nullptr;
         }
 
-      const auto& ro = ctx.RoConfig ().Building (b->GetType ());
-      const auto& constr = ro.construction ();
-      if (constr.has_faction ())
-        {
-          const auto roFaction = FactionFromString (constr.faction ());
-          CHECK (b->GetFaction () == roFaction)
-              << "Building " << b->GetId ()
-              << " is of faction " << FactionToString (b->GetFaction ())
-              << " but the base data requires faction "
-              << FactionToString (roFaction);
-        }
+      readPool = std::make_unique<ReadConnectionPool> (
+          dbFile, FLAGS_rpc_read_connections);
     }
+
+  return readPool.get ();
 }
 
-/**
- * Verifies that each character's and building's faction in the database
- * matches the owner's faction.
- */
-void
-ValidateCharacterBuildingFactions (Database& db)
+bool
+PXLogic::GetStateFromReadPool (xaya::Game& game, const std::string& jsonField,
+                               const RawStateCallback& cb, Json::Value& res)
 {
-  std::unordered_map<std::string, Faction> accountFactions;
+  auto* pool = GetReadPool ();
+  if (pool == nullptr)
+    return false;
+
+  /* The general fields (like game ID and sync state) are taken from
+     libxayagame, and just the block and data are replaced by those
+     of our snapshot.  If there is no current state at all (e.g. before
+     the initial block), we leave it to libxayagame.  */
+  res = game.GetNullJsonState ();
+  if (!res.isMember ("blockhash"))
+    return false;
+
+  auto db = pool->Acquire ();
+
+  /* libxayagame stores the current block hash in the same transaction
+     as the game-state updates, so this is consistent with the snapshot.  */
+  xaya::uint256 hash;
   {
-    AccountsTable accounts(db);
-    auto res = accounts.QueryInitialised ();
-    while (res.Step ())
-      {
-        auto a = accounts.GetFromResult (res);
-        const auto f = a->GetFaction ();
-        CHECK (f != Faction::INVALID && f != Faction::ANCIENT)
-            << "Account " << a->GetName () << " has invalid faction";
-        auto insert = accountFactions.emplace (a->GetName (), f);
-        CHECK (insert.second) << "Duplicate account name " << a->GetName ();
-      }
+    auto stmt = (**db).PrepareRo (R"(
+      SELECT `value`
+        FROM `xayagame_current`
+        WHERE `key` = 'blockhash'
+    )");
+    if (!stmt.Step ())
+      return false;
+
+    CHECK_EQ (sqlite3_column_bytes (stmt.ro (), 0),
+              static_cast<int> (xaya::uint256::NUM_BYTES));
+    hash.FromBlob (static_cast<const unsigned char*> (
+        sqlite3_column_blob (stmt.ro (), 0)));
   }
+  const std::string hashHex = hash.ToHex ();
 
-  {
-    CharacterTable characters(db);
-    auto res = characters.QueryAll ();
-    while (res.Step ())
-      {
-        auto h = characters.GetFromResult (res);
-        const auto mit = accountFactions.find (h->GetOwner ());
-        CHECK (mit != accountFactions.end ())
-            << "Character " << h->GetId ()
-            << " owned by uninitialised account " << h->GetOwner ();
-        CHECK (h->GetFaction () == mit->second)
-            << "Faction mismatch between character " << h->GetId ()
-            << " and owner account " << h->GetOwner ();
-      }
-  }
+  unsigned height;
+  if (res["blockhash"].asString () == hashHex && res["height"].isUInt ())
+    height = res["height"].asUInt ();
+  else
+    {
+      std::lock_guard<std::mutex> lock(mutReadPool);
+      const auto mit = recentHeights.find (hashHex);
+      if (mit == recentHeights.end ())
+        {
+          VLOG (1) << "Unknown height for snapshot block " << hashHex;
+          return false;
+        }
+      height = mit->second;
+    }
 
-  {
-    BuildingsTable buildings(db);
-    auto res = buildings.QueryAll ();
-    while (res.Step ())
-      {
-        auto h = buildings.GetFromResult (res);
-        if (h->GetFaction () == Faction::ANCIENT)
-          continue;
-        const auto mit = accountFactions.find (h->GetOwner ());
-        CHECK (mit != accountFactions.end ())
-            << "Building " << h->GetId ()
-            << " owned by uninitialised account " << h->GetOwner ();
-        CHECK (h->GetFaction () == mit->second)
-            << "Faction mismatch between building " << h->GetId ()
-            << " and owner account " << h->GetOwner ();
-      }
-  }
+  res["blockhash"] = hashHex;
+  res["height"] = height;
+  res[jsonField] = cb (*db, hash, height, true);
+
+  return true;
 }
 
-/**
- * Verifies that each account has at most the maximum allowed number of
- * characters in the database.
- */
-void
-ValidateCharacterLimit (Database& db, const Context& ctx)
+Json::Value
+PXLogic::GetStateData (xaya::Game& game, const std::string& jsonField,
+                       const RawStateCallback& cb)
 {
-  CharacterTable characters(db);
-  AccountsTable accounts(db);
+  Json::Value res;
+  if (GetStateFromReadPool (game, jsonField, cb, res))
+    return res;
 
-  auto res = accounts.QueryInitialised ();
-  while (res.Step ())
-    {
-      auto a = accounts.GetFromResult (res);
-      CHECK_LE (characters.CountForOwner (a->GetName ()),
-                ctx.RoConfig ()->params ().character_limit ())
-          << "Account " << a->GetName () << " has too many characters";
-    }
+  return SQLiteGame::GetCustomStateData (game, jsonField,
+      [this, &cb] (const xaya::SQLiteDatabase& db, const xaya::uint256& hash,
+                   const unsigned height)
+        {
+          SQLiteGameDatabase dbObj(const_cast<xaya::SQLiteDatabase&> (db),
+                                   *this);
+          return cb (dbObj, hash, height, false);
+        });
 }
 
-/**
- * Verifies general assumptions about characters.
- */
-void
-ValidateCharacters (Database& db, const Context& ctx)
+Json::Value
+PXLogic::GetCurrentJsonState (xaya::Game& game)
 {
-  BuildingsTable buildings(db);
-  CharacterTable characters(db);
-
-  auto res = characters.QueryAll ();
-  while (res.Step ())
-    {
-      auto c = characters.GetFromResult (res);
-      const auto& pb = c->GetProto ();
+  if (GetReadPool () == nullptr)
+    return game.GetCurrentJsonState ();
 
-      /* Check cargo space limit.  */
-      CHECK_LE (c->UsedCargoSpace (ctx.RoConfig ()), pb.cargo_space ())
-          << "Character " << c->GetId () << " exceeds cargo limit";
+  return GetStateData (game, "gamestate",
+      [this] (Database& db, const xaya::uint256& hash, const unsigned height,
+              const bool snapshot)
+        {
+          const Context ctx(GetChain (), GetBaseMap (),
+                            Context::NO_HEIGHT, Context::NO_TIMESTAMP);
+          GameStateJson gsj(db, ctx);
+          return gsj.FullState ();
+        });
+}
 
-      /* If the character is inside a building, check that it is matching
-         their faction or ancient.  */
-      if (c->IsInBuilding ())
+Json::Value
+PXLogic::GetCustomStateData (xaya::Game& game, const JsonStateFromRawDb& cb)
+{
+  return GetStateData (game, "data",
+      [&cb] (Database& db, const xaya::uint256& hash, const unsigned height,
+             const bool snapshot)
         {
-          const auto id = c->GetBuildingId ();
-          auto b = buildings.GetById (id);
-          CHECK (b != nullptr)
-              << "Character " << c->GetId ()
-              << " is in non-existant building " << id;
-
-          if (b->GetFaction () != Faction::ANCIENT)
-            CHECK (c->GetFaction () == b->GetFaction ())
-                << "Character " << c->GetId ()
-                << " is in building " << id
-                << " of opposing faction";
-        }
-    }
+          return cb (db, hash, height);
+        });
 }
 
-/**
- * Verifies that all "in building" inventories have an existing
- * building and account association.  No inventories may be inside a foundation.
- */
-void
-ValidateBuildingInventories (Database& db)
+Json::Value
+PXLogic::GetCustomStateData (xaya::Game& game,
+                             const JsonStateFromDatabaseWithBlock& cb)
 {
-  BuildingInventoriesTable inv(db);
-  AccountsTable accounts(db);
-  BuildingsTable buildings(db);
+  return GetStateData (game, "data",
+    [this, &cb] (Database& db, const xaya::uint256& hash,
+                 const unsigned height, const bool snapshot)
+        {
+          /* If the state we are looking at is the one our in-memory
+             caches correspond to, make them available for the (read-only)
+             GameStateJson request.  This is not done for snapshots from the
+             read pool, since those are processed concurrently to block
+             processing (which updates the caches).  */
+          std::shared_lock<std::shared_timed_mutex> lock(mutCaches,
+                                                         std::defer_lock);
+          if (!snapshot)
+            {
+              lock.lock ();
+              if (ongoingsSchedule != nullptr && ongoingsSchedule->IsLoaded ()
+                    && hash.ToHex () == cachedBlockHash)
+                db.SetOngoingsSchedule (ongoingsSchedule.get ());
+            }
 
-  {
-    auto res = inv.QueryAll ();
-    while (res.Step ())
-      {
-        auto h = inv.GetFromResult (res);
-        auto b = buildings.GetById (h->GetBuildingId ());
-        CHECK (b != nullptr)
-            << "Inventory for non-existant building " << h->GetBuildingId ();
-        CHECK (!b->GetProto ().foundation ())
-            << "Inventory for " << h->GetAccount ()
-            << " in foundation " << h->GetBuildingId ();
-        CHECK (accounts.GetByName (h->GetAccount ()) != nullptr)
-            << "Inventory for non-existant account " << h->GetAccount ();
-      }
-  }
+          const Context ctx(GetChain (), GetBaseMap (),
+                            Context::NO_HEIGHT, Context::NO_TIMESTAMP);
+          GameStateJson gsj(db, ctx);
+          return cb (gsj, hash, height);
+        });
+}
 
-  {
-    auto res = buildings.QueryAll ();
-    while (res.Step ())
-      {
-        auto b = buildings.GetFromResult (res);
-        const auto& pb = b->GetProto ();
-        CHECK (pb.foundation () || !pb.has_construction_inventory ())
-            << "Building " << b->GetId ()
-            << " is not a foundation but has construction inventory";
-      }
-  }
+Json::Value
+PXLogic::GetCustomStateData (xaya::Game& game, const JsonStateFromDatabase& cb)
+{
+  return GetCustomStateData (game,
+    [&cb] (GameStateJson& gsj, const xaya::uint256& hash, const unsigned height)
+    {
+      return cb (gsj);
+    });
 }
 
-/**
- * Verifies that the links between characters/buildings and ongoing
- * operations are all valid.
- */
 void
-ValidateOngoingsLinks (Database& db)
+PXLogic::ValidateStateSlow (Database& db, const Context& ctx)
 {
-  BuildingsTable buildings(db);
-  CharacterTable characters(db);
-  OngoingsTable ongoings(db);
-
-  {
-    auto res = ongoings.QueryAll ();
-    while (res.Step ())
-      {
-        auto op = ongoings.GetFromResult (res);
-        const auto bId = op->GetBuildingId ();
-        const auto cId = op->GetCharacterId ();
-
-        if (bId != Database::EMPTY_ID)
-          {
-            auto b = buildings.GetById (bId);
-            CHECK (b != nullptr)
-                << "Operation " << op->GetId ()
-                << " refers to non-existing building " << bId;
-            if (op->GetProto ().has_building_construction ())
-              CHECK_EQ (b->GetProto ().ongoing_construction (), op->GetId ())
-                  << "Building " << bId
-                  << " does not refer back to ongoing " << op->GetId ();
-          }
-
-        if (cId != Database::EMPTY_ID)
-          {
-            auto c = characters.GetById (cId);
-            CHECK (c != nullptr)
-                << "Operation " << op->GetId ()
-                << " refers to non-existing character " << cId;
-            CHECK_EQ (c->GetProto ().ongoing (), op->GetId ())
-                << "Character " << cId
-                << " does not refer back to ongoing " << op->GetId ();
-          }
-      }
-  }
+  LOG (INFO) << "Performing slow validation of the game-state database...";
 
-  {
-    auto res = characters.QueryAll ();
-    while (res.Step ())
-      {
-        auto c = characters.GetFromResult (res);
-        if (!c->IsBusy ())
-          continue;
-
-        const auto opId = c->GetProto ().ongoing ();
-        const auto op = ongoings.GetById (opId);
-        CHECK (op != nullptr)
-            << "Character " << c->GetId ()
-            << " has non-existing ongoing operation " << opId;
-        CHECK_EQ (op->GetCharacterId (), c->GetId ())
-            << "Operation " << opId
-            << " does not refer back to character " << c->GetId ();
-      }
-  }
+  /* Recomputing the incremental state hash is cheap compared to the full
+     validation (it just hashes the raw rows), so do that first.  */
+  const auto stored = GetIncrementalTableHashes (db);
+  const auto actual = ComputeIncrementalTableHashes (db);
+  for (const auto& entry : actual)
+    {
+      const auto mit = stored.find (entry.first);
+      CHECK (mit != stored.end ())
+          << "No incremental state hash for table " << entry.first;
+      CHECK (mit->second == entry.second)
+          << "Incremental state hash mismatch for table " << entry.first
+          << ":\n  Stored:   " << mit->second.ToHex ()
+          << "\n  Computed: " << entry.second.ToHex ();
+    }
+  CHECK_EQ (stored.size (), actual.size ());
 
-  {
-    auto res = buildings.QueryAll ();
-    while (res.Step ())
-      {
-        auto b = buildings.GetFromResult (res);
-        if (!b->GetProto ().has_ongoing_construction ())
-          continue;
-
-        const auto opId = b->GetProto ().ongoing_construction ();
-        const auto op = ongoings.GetById (opId);
-        CHECK (op != nullptr)
-            << "Building " << b->GetId ()
-            << " has non-existing ongoing operation " << opId;
-        CHECK_EQ (op->GetBuildingId (), b->GetId ())
-            << "Operation " << opId
-            << " does not refer back to building " << b->GetId ();
-        CHECK (op->GetProto ().has_building_construction ())
-            << "Building " << b->GetId ()
-            << " refers to ongoing " << opId
-            << " that is not a building construction";
-      }
-  }
+  ValidateStateFull (db, ctx);
 }
 
-/**
- * Validates that all DEX orders refer to valid accounts and buildings.
- */
 void
-ValidateOrderLinks (Database& db)
+PXLogic::ValidateBlock (xaya::SQLiteDatabase& db, Database& dbObj,
+                        const Json::Value& blockMeta,
+                        std::unique_ptr<DirtyIds> dirty,
+                        BlockPerfStats& perf)
 {
-  AccountsTable accounts(db);
-  BuildingsTable buildings(db);
-  DexOrderTable orders(db);
+  const unsigned height = blockMeta["height"].asUInt64 ();
+  const int64_t timestamp = blockMeta["timestamp"].asInt64 ();
 
-  auto res = orders.QueryAll ();
-  while (res.Step ())
+  if (FLAGS_validate_state_threads > 0)
     {
-      auto o = orders.GetFromResult (res);
-      CHECK (accounts.GetByName (o->GetAccount ()) != nullptr)
-          << "Order " << o->GetId ()
-          << " refers to non-existing account " << o->GetAccount ();
-
-      auto b = buildings.GetById (o->GetBuilding ());
-      CHECK (b != nullptr)
-          << "Order " << o->GetId ()
-          << " refers to non-existing building " << o->GetBuilding ();
-      CHECK (!b->GetProto ().foundation ())
-          << "Order " << o->GetId ()
-          << " is in foundation " << o->GetBuilding ();
+      /* Separate connections are only possible if the database is
+         stored in a file (and not in memory, e.g. for tests).  */
+      const char* file = sqlite3_db_filename (*db, "main");
+      if (file != nullptr && *file != '\0')
+        {
+          if (asyncValidator == nullptr)
+            asyncValidator = std::make_unique<AsyncStateValidator> (
+                file, GetChain (), GetBaseMap (),
+                FLAGS_validate_state_threads);
+
+          pendingValidation = std::make_unique<PendingValidation> ();
+          pendingValidation->hash = blockMeta["hash"].asString ();
+          pendingValidation->height = height;
+          pendingValidation->timestamp = timestamp;
+          pendingValidation->dirty = std::move (dirty);
+          return;
+        }
+
+      LOG_FIRST_N (WARNING, 1)
+          << "The game-state database is not stored in a file,"
+          << " validating synchronously instead";
     }
-}
 
-} // anonymous namespace
+  const Context ctx(GetChain (), GetBaseMap (), height, timestamp);
 
-void
-PXLogic::ValidateStateSlow (Database& db, const Context& ctx)
-{
-  LOG (INFO) << "Performing slow validation of the game-state database...";
-  ValidateBuildings (db, ctx);
-  ValidateCharacters (db, ctx);
-  ValidateCharacterBuildingFactions (db);
-  ValidateCharacterLimit (db, ctx);
-  ValidateBuildingInventories (db);
-  ValidateOngoingsLinks (db);
-  ValidateOrderLinks (db);
+  perf.StartPhase ("validate");
+  if (dirty == nullptr)
+    ValidateStateSlow (dbObj, ctx);
+  else
+    ValidateStateIncremental (dbObj, ctx, *dirty);
+  perf.EndPhase ();
 }
 
 } // namespace pxd
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -19,12 +19,21 @@
 #ifndef PXD_LOGIC_HPP
 #define PXD_LOGIC_HPP
 
+#include "combat.hpp"
+#include "connectionpool.hpp"
 #include "context.hpp"
+#include "deltastream.hpp"
 #include "fame.hpp"
 #include "gamestatejson.hpp"
 #include "params.hpp"
+#include "perfstats.hpp"
+#include "validation.hpp"
 
+#include "database/damagelists.hpp"
 #include "database/database.hpp"
+#include "database/dirtyids.hpp"
+#include "database/ongoing.hpp"
+#include "database/tracing.hpp"
 #include "mapdata/basemap.hpp"
 #include "proto/character.pb.h"
 
@@ -36,8 +45,14 @@
 
 #include <sqlite3.h>
 
+#include <atomic>
+#include <deque>
+#include <fstream>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
 
 namespace pxd
@@ -86,10 +101,137 @@ private:
    */
   std::unique_ptr<const BaseMap> map;
 
+  /**
+   * In-memory cache of the damage lists, which is kept across blocks
+   * while we process them in sequence.
+   */
+  DamageListsCache damageListsCache;
+
+  /**
+   * In-memory schedule of the ongoing operations, which is kept across
+   * blocks like the damage-lists cache.  It is also used (read-only) for
+   * RPC requests on the state it corresponds to.  The instance is created
+   * on first use, when the chain is known.
+   */
+  std::unique_ptr<OngoingsSchedule> ongoingsSchedule;
+
+  /**
+   * Combat modifiers computed during target finding of the last block,
+   * which are reused for damage processing of the next one.
+   */
+  CombatModifierMemo combatModifiers;
+
+  /**
+   * The hash of the last block processed through UpdateState, i.e. the
+   * block whose state our in-memory caches correspond to.  If the next
+   * block's parent does not match this (e.g. because blocks were detached
+   * in the mean time), the caches are invalidated.
+   */
+  std::string cachedBlockHash;
+
+  /** Performance data about the most recently processed blocks.  */
+  PerfStatsRecorder perfStats;
+
+  /** If recording of blocks is enabled, the output file.  */
+  std::unique_ptr<std::ofstream> blockRecorder;
+
+  /** Number of upcoming blocks that should be traced.  */
+  std::atomic<unsigned> blocksToTrace{0};
+
+  /**
+   * The file of the game-state database, as recorded at startup.  This is
+   * empty if the database is not stored in a file (e.g. in memory) or
+   * not in WAL mode, in which case we cannot use read-only connections.
+   */
+  std::string dbFile;
+
+  /**
+   * Pool of read-only connections for state RPCs, if enabled through
+   * --rpc_read_connections.  It is created on first use.
+   */
+  std::unique_ptr<ReadConnectionPool> readPool;
+
+  /**
+   * Heights of recently processed blocks by hash.  They are used to report
+   * the height for the block of a read snapshot, which may differ from the
+   * one libxayagame considers current at that time.
+   */
+  std::map<std::string, unsigned> recentHeights;
+
+  /** Order in which recentHeights were added, for pruning the oldest.  */
+  std::deque<std::string> recentHeightsOrder;
+
+  /** Lock for dbFile, readPool and the recent heights.  */
+  std::mutex mutReadPool;
+
+  /**
+   * Data about a block whose state should be validated asynchronously,
+   * as soon as it is committed to the database.
+   */
+  struct PendingValidation
+  {
+
+    /** The block's hash.  */
+    std::string hash;
+
+    /** The block's height.  */
+    unsigned height;
+
+    /** The block's timestamp.  */
+    int64_t timestamp;
+
+    /** The entities touched by the block, or null for a full validation.  */
+    std::unique_ptr<DirtyIds> dirty;
+
+  };
+
+  /**
+   * The validation that should be run for the last block processed,
+   * if any.  With --validate_state_threads, validation runs in the
+   * background on the committed state.  Since the commit is done by
+   * SQLiteGame after UpdateState returns, we start it only when the
+   * next block is attached on top.
+   */
+  std::unique_ptr<PendingValidation> pendingValidation;
+
+  /**
+   * Runner for asynchronous state validation, created on first use.  This
+   * is declared after the basemap, so that it (and its threads using the
+   * map) is destructed before it.
+   */
+  std::unique_ptr<AsyncStateValidator> asyncValidator;
+
+  /**
+   * Lock for the in-memory caches and cachedBlockHash.  Block processing
+   * takes it exclusively, while RPC requests that read from the caches
+   * take it shared.
+   */
+  std::shared_timed_mutex mutCaches;
+
+  /**
+   * The stream to which per-block state deltas are published, if it
+   * has been enabled.
+   */
+  std::unique_ptr<DeltaStream> deltaStream;
+
   /**
    * Handles the actual logic for the game-state update.  This is extracted
    * here out of UpdateState, so that it can be accessed from unit tests
    * independently of SQLiteGame.
+   *
+   * If dlCache is not null, then it is used for the damage lists.
+   * Similarly, modMemo is used for the combat modifiers if not null,
+   * and perf records timing and counters of the processing phases.
+   */
+  static void UpdateState (Database& db, xaya::Random& rnd,
+                           xaya::Chain chain, const BaseMap& map,
+                           DamageListsCache* dlCache,
+                           CombatModifierMemo* modMemo,
+                           BlockPerfStats* perf,
+                           const Json::Value& blockData);
+
+  /**
+   * Variant of UpdateState without any in-memory caches.
    */
   static void UpdateState (Database& db, xaya::Random& rnd,
                            xaya::Chain chain, const BaseMap& map,
@@ -103,17 +245,107 @@ private:
                            const Context& ctx, const Json::Value& blockData);
 
   /**
-   * Performs (potentially slow) validations on the current database state.
+   * Updates the state with a custom FameUpdater, the given memo
+   * of combat modifiers and the performance-data recorder (both of
+   * which may be null).
+   */
+  static void UpdateState (Database& db, FameUpdater& fame, xaya::Random& rnd,
+                           const Context& ctx, CombatModifierMemo* modMemo,
+                           BlockPerfStats* perf,
+                           const Json::Value& blockData);
+
+  /**
+   * Performs (potentially slow) validations on the full database state.
    * This is used when compiled with --enable-slow-asserts after each block
-   * update, for testing purposes.  It should not be run in production builds
-   * because it may really slow down syncing.  If an error is detected, then
+   * update, for testing purposes.  In production, the --validate_state_*
+   * flags can be used to run it only every couple of blocks, and otherwise
+   * validate just the touched entities.  If an error is detected, then
    * this CHECK-fails the binary.
    */
   static void ValidateStateSlow (Database& db, const Context& ctx);
 
+  /**
+   * Validates the state after processing a block, according to the
+   * --validate_state_* flags.  If dirty is null, the full state is checked,
+   * and otherwise just the entities touched in the block.  This either
+   * runs the validation directly on dbObj or schedules it for asynchronous
+   * processing.
+   */
+  void ValidateBlock (xaya::SQLiteDatabase& db, Database& dbObj,
+                      const Json::Value& blockMeta,
+                      std::unique_ptr<DirtyIds> dirty,
+                      BlockPerfStats& perf);
+
+  /**
+   * Appends the given block data to the file set by --record_blocks,
+   * so that it can be replayed later with replaybench.  Detached blocks
+   * are not recorded or removed; FilterDetachedBlocks reconstructs the
+   * final chain from the parent links when replaying.
+   */
+  void RecordBlock (const Json::Value& blockData);
+
+  /**
+   * Checks if the current block should be traced (as requested through
+   * TraceNextBlocks), and decrements the number of outstanding blocks
+   * if so.
+   */
+  bool ConsumeTraceRequest ();
+
+  /**
+   * Writes the trace of a processed block to the directory set by
+   * --trace_dir.  Failures are logged but do not stop processing.
+   */
+  void WriteTrace (const TraceCollector& trace, const BlockPerfStats& perf);
+
+  /**
+   * Publishes the changes done by the current block (as already recorded
+   * into the changes tables) to the delta stream.
+   */
+  void PublishDelta (Database& dbObj, const Json::Value& blockMeta,
+                     unsigned height);
+
+  /**
+   * Callback used internally for retrieving state data from the database.
+   * In addition to the database, block hash and height, it receives whether
+   * the database is a snapshot from the read pool (rather than the main
+   * connection, which libxayagame locks for us).
+   */
+  using RawStateCallback
+      = std::function<Json::Value (Database& db, const xaya::uint256& hash,
+                                   unsigned height, bool snapshot)>;
+
+  /**
+   * Remembers the height of a processed block for the read snapshots.
+   */
+  void RecordBlockHeight (const std::string& hash, unsigned height);
+
+  /**
+   * Returns the pool of read-only connections, or null if it is
+   * not enabled or not possible.
+   */
+  ReadConnectionPool* GetReadPool ();
+
+  /**
+   * Tries to extract state data on a snapshot from the read pool, putting
+   * it into the given jsonField of the result (like libxayagame's
+   * GetCustomStateData).  Returns false if this is not possible and the
+   * data should be retrieved through libxayagame instead.
+   */
+  bool GetStateFromReadPool (xaya::Game& game, const std::string& jsonField,
+                             const RawStateCallback& cb, Json::Value& res);
+
+  /**
+   * Extracts state data from the read pool if possible, and otherwise
+   * through libxayagame's locked access to the main connection.
+   */
+  Json::Value GetStateData (xaya::Game& game, const std::string& jsonField,
+                            const RawStateCallback& cb);
+
+  friend class BlockReplayer;
   friend class PXLogicTests;
   friend class PXRpcServer;
   friend class SQLiteGameDatabase;
+  friend class WorldGenerator;
 
 protected:
 
@@ -146,7 +378,7 @@ public:
     = std::function<Json::Value (GameStateJson& gsj,
                                  const xaya::uint256& hash, unsigned height)>;
 
-  PXLogic () = default;
+  PXLogic ();
 
   PXLogic (const PXLogic&) = delete;
   void operator= (const PXLogic&) = delete;
@@ -157,10 +389,54 @@ public:
    */
   const BaseMap& GetBaseMap ();
 
+  /**
+   * Returns the performance data about recently processed blocks.
+   */
+  const PerfStatsRecorder&
+  GetPerfStats () const
+  {
+    return perfStats;
+  }
+
+  /**
+   * Returns the number of blocks for which deletions of entities are
+   * remembered.  Changes since a height further back than this cannot
+   * be retrieved reliably (as set by --changes_tombstone_blocks).
+   */
+  static unsigned GetChangesWindow ();
+
+  /**
+   * Turns on publishing of per-block state deltas, and returns the
+   * stream they are published to.  This must be called before the
+   * game starts processing blocks.
+   */
+  DeltaStream& EnableDeltaStream ();
+
+  /**
+   * Requests that the next count blocks processed are traced.  Each trace
+   * contains the processing phases and all spans in hot code (as well as
+   * RPC calls handled in the mean time), and is written as JSON file in the
+   * Chrome trace-event format to the directory set by --trace_dir.
+   * Returns false if tracing is not available, i.e. no directory is set
+   * or it has been disabled at compile time.
+   */
+  bool TraceNextBlocks (unsigned count);
+
+  /**
+   * Returns the full game state as JSON (like libxayagame's
+   * GetCurrentJsonState), using the read pool if it is enabled.
+   */
+  Json::Value GetCurrentJsonState (xaya::Game& game);
+
   /**
    * Returns custom game-state data as JSON, with a callback that
    * directly receives the database (and does not go through the
    * GameStateJson class).
+   *
+   * With --rpc_read_connections, the callback runs on a snapshot of the
+   * latest committed state from the read pool, so that multiple calls can
+   * be processed in parallel (also to block processing).  The block hash
+   * and height in the result are those of the snapshot.
    */
   Json::Value GetCustomStateData (xaya::Game& game,
                                   const JsonStateFromRawDb& cb);
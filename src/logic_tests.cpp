@@ -208,7 +208,7 @@ namespace
 void
 AddUnityAttack (Character& c, const HexCoord::IntT range)
 {
-  auto* attack = c.MutableProto ().mutable_combat_data ()->add_attacks ();
+  auto* attack = c.MutableCombatData ().add_attacks ();
   attack->set_range (range);
   attack->mutable_damage ()->set_min (1);
   attack->mutable_damage ()->set_max (1);
@@ -223,7 +223,6 @@ TEST_F (PXLogicTests, WaypointsBeforeMovement)
   c->MutableVolatileMv ().set_partial_step (1000);
   auto& pb = c->MutableProto ();
   pb.set_speed (750);
-  pb.mutable_combat_data ();
   pb.mutable_movement ()->add_waypoints ()->set_x (5);
   c.reset ();
 
@@ -251,7 +250,6 @@ TEST_F (PXLogicTests, MovementBeforeTargeting)
   c->SetPosition (HexCoord (11, 0));
   auto& pb = c->MutableProto ();
   pb.set_speed (750);
-  pb.mutable_combat_data ();
   c.reset ();
 
   UpdateState ("[]");
@@ -286,7 +284,7 @@ TEST_F (PXLogicTests, KilledVehicleNoLongerBlocks)
   const auto idObstacle = c->GetId ();
   c->SetPosition (HexCoord (10, 0));
   c->MutableHP ().set_armour (1);
-  c->MutableProto ().mutable_combat_data ();
+  c->MutableCombatData ();
   c.reset ();
 
   c = CreateCharacter ("moving", Faction::RED);
@@ -294,7 +292,6 @@ TEST_F (PXLogicTests, KilledVehicleNoLongerBlocks)
   c->SetPosition (HexCoord (9, 0));
   auto& pb = c->MutableProto ();
   pb.set_speed (1000);
-  pb.mutable_combat_data ();
   c.reset ();
 
   /* Process one block to allow targeting.  */
@@ -358,7 +355,7 @@ TEST_F (PXLogicTests, DamageInNextRound)
   c = CreateCharacter ("andy", Faction::GREEN);
   const auto idTarget = c->GetId ();
   c->MutableHP ().set_armour (100);
-  c->MutableProto ().mutable_combat_data ();
+  c->MutableCombatData ();
   c.reset ();
 
   UpdateState ("[]");
@@ -375,7 +372,7 @@ TEST_F (PXLogicTests, DamageKillsRegeneration)
 
   c = CreateCharacter ("andy", Faction::GREEN);
   const auto idTarget = c->GetId ();
-  c->MutableProto ().mutable_combat_data ();
+  c->MutableCombatData ();
   c.reset ();
 
   /* Progress one round forward to target.  */
@@ -407,7 +404,7 @@ TEST_F (PXLogicTests, RangeReduction)
   auto c = CreateCharacter ("domob", Faction::RED);
   const auto id1 = c->GetId ();
   c->SetPosition (HexCoord (0, 0));
-  auto* attack = c->MutableProto ().mutable_combat_data ()->add_attacks ();
+  auto* attack = c->MutableCombatData ().add_attacks ();
   attack->set_area (10);
   attack->mutable_effects ()->mutable_range ()->set_percent (-10);
   c.reset ();
@@ -415,7 +412,7 @@ TEST_F (PXLogicTests, RangeReduction)
   c = CreateCharacter ("andy", Faction::GREEN);
   const auto id2 = c->GetId ();
   c->SetPosition (HexCoord (10, 0));
-  attack = c->MutableProto ().mutable_combat_data ()->add_attacks ();
+  attack = c->MutableCombatData ().add_attacks ();
   attack->set_area (10);
   attack->mutable_effects ()->mutable_range ()->set_percent (-10);
   c.reset ();
@@ -459,7 +456,7 @@ TEST_F (PXLogicTests, MenteconAlteration)
   ASSERT_EQ (c->GetId (), 1);
   c->SetPosition (HexCoord (-10, -1));
   c->MutableProto ().set_speed (1'000);
-  auto* attack = c->MutableProto ().mutable_combat_data ()->add_attacks ();
+  auto* attack = c->MutableCombatData ().add_attacks ();
   attack->set_range (10);
   attack->mutable_effects ()->set_mentecon (true);
   c.reset ();
@@ -471,7 +468,7 @@ TEST_F (PXLogicTests, MenteconAlteration)
       ids.push_back (c->GetId ());
       c->SetPosition (HexCoord (i, 0));
       AddUnityAttack (*c, 5);
-      auto* attack = c->MutableProto ().mutable_combat_data ()->add_attacks ();
+      auto* attack = c->MutableCombatData ().add_attacks ();
       attack->set_range (10);
       attack->mutable_effects ()->set_mentecon (true);
       c->MutableHP ().set_shield (0);
@@ -573,7 +570,7 @@ TEST_F (PXLogicTests, PickUpDeadDrop)
   const auto idTarget = c->GetId ();
   c->SetPosition (pos);
   c->MutableProto ().set_cargo_space (1000);
-  c->MutableProto ().mutable_combat_data ();
+  c->MutableCombatData ();
   c->GetInventory ().SetFungibleCount ("foo", 10);
   c.reset ();
 
@@ -614,7 +611,7 @@ TEST_F (PXLogicTests, DamageLists)
 
   c = CreateCharacter ("andy", Faction::GREEN);
   const auto idTarget = c->GetId ();
-  c->MutableProto ().mutable_combat_data ();
+  c->MutableCombatData ();
   auto& regen = c->MutableRegenData ();
   regen.mutable_max_hp ()->set_shield (100);
   c->MutableHP ().set_shield (100);
@@ -632,7 +629,7 @@ TEST_F (PXLogicTests, DamageLists)
 
   /* Remove the attacks, so the damage list entry is not refreshed.  */
   c = characters.GetById (idAttacker);
-  c->MutableProto ().mutable_combat_data ()->clear_attacks ();
+  c->MutableCombatData ().clear_attacks ();
   c.reset ();
 
   /* The damage list entry should still be present 99 blocks after.  */
@@ -686,14 +683,14 @@ TEST_F (PXLogicTests, CombatEffectRetarder)
 
   auto c = CreateCharacter ("domob", Faction::RED);
   c->SetPosition (HexCoord (0, 0));
-  auto& attack = *c->MutableProto ().mutable_combat_data ()->add_attacks ();
+  auto& attack = *c->MutableCombatData ().add_attacks ();
   attack.set_range (10);
   attack.mutable_effects ()->mutable_speed ()->set_percent (-50);
   c.reset ();
 
   c = CreateCharacter ("andy", Faction::GREEN);
   const auto idTarget = c->GetId ();
-  c->MutableProto ().mutable_combat_data ();
+  c->MutableCombatData ();
   c->MutableProto ().set_speed (2'000);
   *c->MutableProto ().mutable_movement ()->add_waypoints ()
       = CoordToProto (HexCoord (20, -10));
@@ -702,7 +699,7 @@ TEST_F (PXLogicTests, CombatEffectRetarder)
 
   c = CreateCharacter ("other", Faction::RED);
   const auto idFriendly = c->GetId ();
-  c->MutableProto ().mutable_combat_data ();
+  c->MutableCombatData ();
   c->MutableProto ().set_speed (2'000);
   *c->MutableProto ().mutable_movement ()->add_waypoints ()
       = CoordToProto (HexCoord (10, 10));
@@ -757,7 +754,6 @@ TEST_F (PXLogicTests, ProspectingBeforeMovement)
   c->SetPosition (pos1);
   c->MutableVolatileMv ().set_partial_step (1000);
   auto& pb = c->MutableProto ();
-  pb.mutable_combat_data ();
   *pb.mutable_movement ()->add_waypoints () = CoordToProto (pos2);
   pb.set_prospecting_blocks (10);
   c.reset ();
@@ -796,7 +792,7 @@ TEST_F (PXLogicTests, ProspectingUserKilled)
   ASSERT_EQ (c->GetId (), 2);
   c->SetPosition (pos);
   c->MutableProto ().set_prospecting_blocks (10);
-  c->MutableProto ().mutable_combat_data ();
+  c->MutableCombatData ();
   auto& regen = c->MutableRegenData ();
   regen.mutable_max_hp ()->set_shield (100);
   c->MutableHP ().set_shield (1);
@@ -856,7 +852,7 @@ TEST_F (PXLogicTests, FinishingProspecting)
   ASSERT_EQ (c->GetId (), 1);
   c->SetPosition (pos);
   c->MutableProto ().set_prospecting_blocks (10);
-  c->MutableProto ().mutable_combat_data ();
+  c->MutableCombatData ();
   c->MutableProto ().set_speed (1000);
   c.reset ();
 
@@ -910,7 +906,7 @@ TEST_F (PXLogicTests, MiningRightAfterProspecting)
   auto c = CreateCharacter ("domob", Faction::RED);
   ASSERT_EQ (c->GetId (), 1);
   c->SetPosition (pos);
-  c->MutableProto ().mutable_combat_data ();
+  c->MutableCombatData ();
   c->MutableProto ().mutable_mining ()->mutable_rate ()->set_min (1);
   c->MutableProto ().mutable_mining ()->mutable_rate ()->set_max (1);
   c->MutableProto ().set_prospecting_blocks (10);
@@ -957,7 +953,7 @@ TEST_F (PXLogicTests, MiningAndDropping)
   auto c = CreateCharacter ("domob", Faction::RED);
   ASSERT_EQ (c->GetId (), 1);
   c->SetPosition (pos);
-  c->MutableProto ().mutable_combat_data ();
+  c->MutableCombatData ();
   c->MutableProto ().mutable_mining ()->mutable_rate ()->set_min (10);
   c->MutableProto ().mutable_mining ()->mutable_rate ()->set_max (10);
   c->MutableProto ().mutable_mining ()->set_active (true);
@@ -1009,7 +1005,7 @@ TEST_F (PXLogicTests, MiningWhenReprospected)
   auto c = CreateCharacter ("domob", Faction::RED);
   ASSERT_EQ (c->GetId (), 1);
   c->SetPosition (pos);
-  c->MutableProto ().mutable_combat_data ();
+  c->MutableCombatData ();
   c->MutableProto ().mutable_mining ()->mutable_rate ()->set_min (1);
   c->MutableProto ().mutable_mining ()->mutable_rate ()->set_max (1);
   c->MutableProto ().mutable_mining ()->set_active (true);
@@ -19,10 +19,12 @@
 #include "config.h"
 
 #include "charon.hpp"
+#include "deltaserver.hpp"
 #include "logic.hpp"
 #include "pending.hpp"
 #include "pxrpcserver.hpp"
 #include "rest.hpp"
+#include "snapshotserver.hpp"
 #include "version.hpp"
 
 #include <xayagame/defaultmain.hpp>
@@ -54,6 +56,15 @@ DEFINE_bool (game_rpc_listen_locally, true,
 
 DEFINE_int32 (rest_port, 0,
               "if non-zero, the port at which the REST interface should run");
+DEFINE_int32 (delta_stream_port, 0,
+              "if non-zero, the port at which per-block state deltas are"
+              " streamed as Server-Sent Events");
+DEFINE_int32 (delta_stream_max_clients, 64,
+              "maximum number of concurrent clients of the delta stream;"
+              " further ones are rejected with 503");
+DEFINE_int32 (snapshot_port, 0,
+              "if non-zero, the port at which precomputed gzipped snapshots"
+              " of the game state are served");
 
 DEFINE_int32 (enable_pruning, -1,
               "if non-negative (including zero), old undo data will be pruned"
@@ -80,6 +91,15 @@ private:
   /** The REST API port.  */
   int restPort = 0;
 
+  /** The port for the delta-stream server.  */
+  int deltaStreamPort = 0;
+
+  /** Maximum number of clients of the delta-stream server.  */
+  unsigned deltaStreamMaxClients = 0;
+
+  /** The port for the snapshot server.  */
+  int snapshotPort = 0;
+
 public:
 
   explicit PXInstanceFactory (pxd::PXLogic& r)
@@ -92,6 +112,19 @@ public:
     restPort = p;
   }
 
+  void
+  EnableDeltaStream (const int p, const unsigned maxClients)
+  {
+    deltaStreamPort = p;
+    deltaStreamMaxClients = maxClients;
+  }
+
+  void
+  EnableSnapshots (const int p)
+  {
+    snapshotPort = p;
+  }
+
   std::unique_ptr<xaya::RpcServerInterface>
   BuildRpcServer (xaya::Game& game,
                   jsonrpc::AbstractServerConnector& conn) override
@@ -114,6 +147,15 @@ public:
     if (restPort != 0)
       res.push_back (std::make_unique<pxd::RestApi> (game, rules, restPort));
 
+    if (deltaStreamPort != 0)
+      res.push_back (std::make_unique<pxd::DeltaStreamServer> (
+          rules.EnableDeltaStream (), deltaStreamPort,
+          deltaStreamMaxClients));
+
+    if (snapshotPort != 0)
+      res.push_back (std::make_unique<pxd::SnapshotServer> (
+          game, rules, snapshotPort));
+
     return res;
   }
 
@@ -196,6 +238,19 @@ main (int argc, char** argv)
   PXInstanceFactory instanceFact(rules);
   if (FLAGS_rest_port != 0)
     instanceFact.EnableRest (FLAGS_rest_port);
+  if (FLAGS_delta_stream_port != 0)
+    {
+      if (FLAGS_delta_stream_max_clients <= 0)
+        {
+          std::cerr << "Error: --delta_stream_max_clients must be positive"
+                    << std::endl;
+          return EXIT_FAILURE;
+        }
+      instanceFact.EnableDeltaStream (FLAGS_delta_stream_port,
+                                      FLAGS_delta_stream_max_clients);
+    }
+  if (FLAGS_snapshot_port != 0)
+    instanceFact.EnableSnapshots (FLAGS_snapshot_port);
   config.InstanceFactory = &instanceFact;
 
   pxd::PendingMoves pending(rules);
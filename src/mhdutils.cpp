@@ -0,0 +1,40 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "mhdutils.hpp"
+
+namespace pxd
+{
+
+MhdResult
+QueueTextResponse (struct MHD_Connection* conn, const unsigned status,
+                   const std::string& msg)
+{
+  const std::string body = msg + "\n";
+  struct MHD_Response* resp = MHD_create_response_from_buffer (
+      body.size (), const_cast<char*> (body.data ()),
+      MHD_RESPMEM_MUST_COPY);
+  MHD_add_response_header (resp, "Content-Type", "text/plain");
+
+  const auto res = MHD_queue_response (conn, status, resp);
+  MHD_destroy_response (resp);
+
+  return res;
+}
+
+} // namespace pxd
@@ -0,0 +1,45 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PXD_MHDUTILS_HPP
+#define PXD_MHDUTILS_HPP
+
+#include <microhttpd.h>
+
+#include <string>
+
+namespace pxd
+{
+
+/* Newer versions of libmicrohttpd return an enum from callbacks instead
+   of an int.  */
+#if MHD_VERSION >= 0x00097002
+using MhdResult = enum MHD_Result;
+#else
+using MhdResult = int;
+#endif
+
+/**
+ * Queues a plain-text response with the given status code.
+ */
+MhdResult QueueTextResponse (struct MHD_Connection* conn, unsigned status,
+                             const std::string& msg);
+
+} // namespace pxd
+
+#endif // PXD_MHDUTILS_HPP
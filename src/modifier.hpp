@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -61,6 +61,12 @@ public:
     return percent == 0 && absolute == 0;
   }
 
+  bool
+  operator== (const StatModifier& m) const
+  {
+    return percent == m.percent && absolute == m.absolute;
+  }
+
   /**
    * Adds another modifier "on top of" the current one.
    */
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -22,10 +22,16 @@
 #include "modifier.hpp"
 #include "protoutils.hpp"
 
+#include "database/tracing.hpp"
+
+#include <xayautil/base64.hpp>
 #include <xayautil/compression.hpp>
 
 #include <glog/logging.h>
 
+#include <cstdint>
+#include <limits>
+
 namespace pxd
 {
 
@@ -44,6 +50,12 @@ namespace
  */
 constexpr size_t MAX_WAYPOINT_SIZE = (1 << 20);
 
+/**
+ * Maximum number of characters of invalid encoded waypoints that we log,
+ * so that a huge move cannot flood the log.
+ */
+constexpr size_t MAX_LOGGED_WAYPOINTS = 1'024;
+
 } // anonymous namespace
 
 bool
@@ -82,7 +94,7 @@ DecodeWaypoints (const std::string& encoded, std::vector<HexCoord>& wp)
     {
       LOG (WARNING)
           << "Failed to decode waypoint string:\n"
-          << encoded.substr (0, 1'024);
+          << encoded.substr (0, MAX_LOGGED_WAYPOINTS);
       return false;
     }
 
@@ -107,6 +119,147 @@ DecodeWaypoints (const std::string& encoded, std::vector<HexCoord>& wp)
   return true;
 }
 
+namespace
+{
+
+/**
+ * Appends a signed number to the given byte string, zig-zag mapping it
+ * to an unsigned number and then writing it as varint (seven bits per byte,
+ * least-significant first, with the high bit set on all but the last byte).
+ */
+void
+AppendZigZagVarint (const int32_t val, std::string& out)
+{
+  uint32_t u;
+  if (val < 0)
+    u = 2 * static_cast<uint32_t> (-(val + 1)) + 1;
+  else
+    u = 2 * static_cast<uint32_t> (val);
+
+  while (u >= 0x80)
+    {
+      out.push_back (static_cast<char> ((u & 0x7F) | 0x80));
+      u >>= 7;
+    }
+  out.push_back (static_cast<char> (u));
+}
+
+/**
+ * Reads a zig-zag varint from the byte string at the given position,
+ * and advances the position past it.  Returns false if the data is invalid
+ * (too long or truncated).
+ */
+bool
+ReadZigZagVarint (const std::string& data, size_t& pos, int32_t& val)
+{
+  uint32_t u = 0;
+  for (unsigned shift = 0; ; shift += 7)
+    {
+      /* Our values are deltas between 16-bit coordinates, so they always
+         fit into three bytes.  Anything longer is invalid.  */
+      if (pos >= data.size () || shift > 14)
+        return false;
+
+      const auto byte = static_cast<unsigned char> (data[pos++]);
+      u |= static_cast<uint32_t> (byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0)
+        break;
+    }
+
+  if (u & 1)
+    val = -static_cast<int32_t> (u >> 1) - 1;
+  else
+    val = static_cast<int32_t> (u >> 1);
+
+  return true;
+}
+
+} // anonymous namespace
+
+std::string
+EncodeWaypointsCompact (const std::vector<HexCoord>& wp)
+{
+  std::string data;
+  int32_t prevX = 0;
+  int32_t prevY = 0;
+  for (const auto& c : wp)
+    {
+      AppendZigZagVarint (c.GetX () - prevX, data);
+      AppendZigZagVarint (c.GetY () - prevY, data);
+      prevX = c.GetX ();
+      prevY = c.GetY ();
+    }
+
+  VLOG (1)
+      << "Encoded " << wp.size () << " waypoints compactly;"
+      << " the binary size is " << data.size ();
+
+  return xaya::EncodeBase64 (data);
+}
+
+bool
+DecodeWaypointsCompact (const std::string& encoded, std::vector<HexCoord>& wp)
+{
+  std::string data;
+  if (!xaya::DecodeBase64 (encoded, data))
+    {
+      LOG (WARNING)
+          << "Invalid base64 in compact waypoints:\n"
+          << encoded.substr (0, MAX_LOGGED_WAYPOINTS);
+      return false;
+    }
+
+  using Limits = std::numeric_limits<HexCoord::IntT>;
+
+  wp.clear ();
+  int32_t x = 0;
+  int32_t y = 0;
+  size_t pos = 0;
+  while (pos < data.size ())
+    {
+      int32_t dx, dy;
+      if (!ReadZigZagVarint (data, pos, dx)
+            || !ReadZigZagVarint (data, pos, dy))
+        {
+          LOG (WARNING)
+              << "Malformed compact waypoints: "
+              << encoded.substr (0, MAX_LOGGED_WAYPOINTS);
+          return false;
+        }
+
+      x += dx;
+      y += dy;
+      if (x < Limits::min () || x > Limits::max ()
+            || y < Limits::min () || y > Limits::max ())
+        {
+          LOG (WARNING)
+              << "Compact waypoints out of range: "
+              << encoded.substr (0, MAX_LOGGED_WAYPOINTS);
+          return false;
+        }
+
+      wp.emplace_back (static_cast<HexCoord::IntT> (x),
+                       static_cast<HexCoord::IntT> (y));
+    }
+
+  return true;
+}
+
+bool
+DecodeWaypoints (const WaypointEncoding enc, const std::string& encoded,
+                 std::vector<HexCoord>& wp)
+{
+  switch (enc)
+    {
+    case WaypointEncoding::JSON:
+      return DecodeWaypoints (encoded, wp);
+    case WaypointEncoding::COMPACT:
+      return DecodeWaypointsCompact (encoded, wp);
+    default:
+      LOG (FATAL) << "Invalid waypoint encoding: " << static_cast<int> (enc);
+    }
+}
+
 /* ************************************************************************** */
 
 void
@@ -246,6 +399,8 @@ template <typename Fcn>
   void
   CharacterMovement (Character& c, const Context& ctx, Fcn edges)
 {
+  PXD_TRACE_SPAN ("CharacterMovement", c.GetId ());
+
   const auto& pb = c.GetProto ();
   CHECK (pb.has_movement ())
       << "Character " << c.GetId ()
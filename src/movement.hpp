@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -61,6 +61,45 @@ bool EncodeWaypoints (const std::vector<HexCoord>& wp,
  */
 bool DecodeWaypoints (const std::string& encoded, std::vector<HexCoord>& wp);
 
+/**
+ * The formats in which waypoints can be encoded in moves.
+ */
+enum class WaypointEncoding
+{
+
+  /** Compressed JSON, as produced by EncodeWaypoints.  */
+  JSON,
+
+  /** Compact binary format, as produced by EncodeWaypointsCompact.  */
+  COMPACT,
+
+};
+
+/**
+ * Encodes a list of waypoints in the compact binary format, which can be
+ * used in moves after the CompactWaypoints fork.
+ *
+ * Each waypoint is written as its difference to the previous one (the first
+ * one relative to the origin), with both coordinates mapped by zig-zag
+ * encoding to unsigned numbers and written as varints.  The resulting bytes
+ * are base64 encoded.  Paths are typically made up of waypoints along
+ * principal directions, so that most deltas only take a byte or two.
+ */
+std::string EncodeWaypointsCompact (const std::vector<HexCoord>& wp);
+
+/**
+ * Tries to decode waypoints in the compact binary format.  Returns true on
+ * success and false if the data is malformed.
+ */
+bool DecodeWaypointsCompact (const std::string& encoded,
+                             std::vector<HexCoord>& wp);
+
+/**
+ * Decodes waypoints in the given format.
+ */
+bool DecodeWaypoints (WaypointEncoding enc, const std::string& encoded,
+                      std::vector<HexCoord>& wp);
+
 /**
  * Computes the edge weight used for movement of a given faction character
  * on the map, not including dynamic obstacles.  This is shared between the
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -34,6 +34,7 @@
 
 #include <google/protobuf/repeated_field.h>
 
+#include <limits>
 #include <utility>
 #include <vector>
 
@@ -137,6 +138,108 @@ TEST_F (WaypointEncodingTests, InvalidDataForDecode)
 
 /* ************************************************************************** */
 
+using CompactWaypointEncodingTests = testing::Test;
+
+TEST_F (CompactWaypointEncodingTests, Roundtrip)
+{
+  using Limits = std::numeric_limits<HexCoord::IntT>;
+
+  std::vector<HexCoord> wp =
+    {
+      HexCoord (0, 0),
+      HexCoord (10, -10),
+      HexCoord (0, 0),
+      HexCoord (123, 0),
+      HexCoord (123, 456),
+      HexCoord (-123, 456),
+      HexCoord (-123, -456),
+      HexCoord (Limits::max (), Limits::min ()),
+      HexCoord (Limits::min (), Limits::max ()),
+      HexCoord (-123, 0),
+      HexCoord (0, 0),
+    };
+  for (unsigned i = 0; i < 10'000; ++i)
+    {
+      wp.push_back (HexCoord (1'000, 0));
+      wp.push_back (HexCoord (-1'000, 0));
+    }
+
+  const std::string encoded = EncodeWaypointsCompact (wp);
+
+  std::vector<HexCoord> recovered;
+  ASSERT_TRUE (DecodeWaypointsCompact (encoded, recovered));
+  EXPECT_EQ (recovered, wp);
+
+  recovered.clear ();
+  ASSERT_TRUE (DecodeWaypoints (WaypointEncoding::COMPACT, encoded, recovered));
+  EXPECT_EQ (recovered, wp);
+}
+
+TEST_F (CompactWaypointEncodingTests, EmptyList)
+{
+  const std::vector<HexCoord> wp;
+  const std::string encoded = EncodeWaypointsCompact (wp);
+
+  std::vector<HexCoord> recovered = {HexCoord (1, 2)};
+  ASSERT_TRUE (DecodeWaypointsCompact (encoded, recovered));
+  EXPECT_TRUE (recovered.empty ());
+}
+
+TEST_F (CompactWaypointEncodingTests, SmallerThanJson)
+{
+  /* A long route along principal directions, similar to what findpath
+     would return for moving across the map.  */
+  std::vector<HexCoord> wp;
+  HexCoord cur(-2'000, 1'000);
+  for (unsigned i = 0; i < 200; ++i)
+    {
+      wp.push_back (cur);
+      cur += HexCoord (7 + i % 5, 0);
+      wp.push_back (cur);
+      cur += HexCoord (0, -3 - i % 7);
+      wp.push_back (cur);
+      cur += HexCoord (4, -4);
+    }
+
+  Json::Value jsonWp;
+  std::string json;
+  ASSERT_TRUE (EncodeWaypoints (wp, jsonWp, json));
+  const std::string compact = EncodeWaypointsCompact (wp);
+  EXPECT_LT (compact.size (), json.size ());
+
+  std::vector<HexCoord> recovered;
+  ASSERT_TRUE (DecodeWaypointsCompact (compact, recovered));
+  EXPECT_EQ (recovered, wp);
+}
+
+TEST_F (CompactWaypointEncodingTests, InvalidDataForDecode)
+{
+  const std::string tests[] =
+    {
+      /* Missing y coordinate.  */
+      std::string ("\x02", 1),
+      /* Truncated varint.  */
+      std::string ("\x02\x80", 2),
+      /* Varint longer than allowed.  */
+      std::string ("\x02\xFF\xFF\xFF\x01", 5),
+      /* Coordinate out of range (x = 40'000).  */
+      std::string ("\x80\xF1\x04\x00", 4),
+      /* Second waypoint out of range only through the delta.  */
+      std::string ("\x00\xFE\xFF\x03\x00\x02", 6),
+    };
+
+  for (const auto& t : tests)
+    {
+      std::vector<HexCoord> recovered;
+      ASSERT_FALSE (DecodeWaypointsCompact (xaya::EncodeBase64 (t), recovered));
+    }
+
+  std::vector<HexCoord> recovered;
+  EXPECT_FALSE (DecodeWaypointsCompact ("invalid base64!", recovered));
+}
+
+/* ************************************************************************** */
+
 class StopCharacterTests : public DBTestWithSchema
 {
 
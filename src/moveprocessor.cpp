@@ -30,12 +30,21 @@
 #include "spawn.hpp"
 
 #include "database/faction.hpp"
+#include "database/tracing.hpp"
 #include "proto/character.pb.h"
 #include "proto/roconfig.hpp"
 
 #include <xayautil/jsonutils.hpp>
 
+#include <gflags/gflags.h>
+
+#include <algorithm>
 #include <sstream>
+#include <thread>
+
+DEFINE_int32 (move_parse_threads, 0,
+              "Number of threads to use for pre-parsing the moves of a block"
+              " (0 to use the number of CPU cores)");
 
 namespace pxd
 {
@@ -56,6 +65,41 @@ static constexpr unsigned MAX_DEX_FEE_BPS = 3'000;
 /** Airdrop of vCHI for each new character during testing.  */
 static constexpr Amount VCHI_AIRDROP = 1'000;
 
+namespace
+{
+
+/**
+ * Parses the requested waypoint format from the "wpf" field of a character
+ * update.  Without the field, the format is JSON.  Returns false if the
+ * field is present but invalid.
+ */
+bool
+ParseWaypointEncoding (const Json::Value& upd, WaypointEncoding& enc)
+{
+  if (!upd.isMember ("wpf"))
+    {
+      enc = WaypointEncoding::JSON;
+      return true;
+    }
+
+  const auto& val = upd["wpf"];
+  if (val == "json")
+    {
+      enc = WaypointEncoding::JSON;
+      return true;
+    }
+  if (val == "compact")
+    {
+      enc = WaypointEncoding::COMPACT;
+      return true;
+    }
+
+  LOG (WARNING) << "Invalid waypoint format: " << val;
+  return false;
+}
+
+} // anonymous namespace
+
 /* ************************************************************************** */
 
 BaseMoveProcessor::BaseMoveProcessor (Database& d, DynObstacles& o,
@@ -68,6 +112,136 @@ BaseMoveProcessor::BaseMoveProcessor (Database& d, DynObstacles& o,
     ongoings(db), regions(db, ctx.Height ())
 {}
 
+/* ************************************************************************** */
+
+constexpr size_t PreParsedMoves::MIN_PARALLEL_WAYPOINTS;
+
+void
+PreParsedMoves::CollectWaypoints (const Json::Value& moveObj,
+                                  std::vector<EncodedWaypoints>& out)
+{
+  if (!moveObj.isObject ())
+    return;
+
+  const auto& mv = moveObj["move"];
+  if (!mv.isObject ())
+    return;
+
+  const auto& cmd = mv["c"];
+  const auto addFromOp = [&out] (const Json::Value& op)
+    {
+      if (!op.isObject ())
+        return;
+
+      WaypointEncoding enc;
+      if (!ParseWaypointEncoding (op, enc))
+        return;
+
+      for (const auto* key : {"wp", "wpx"})
+        {
+          const auto& val = op[key];
+          if (val.isString ())
+            out.emplace_back (enc, val.asString ());
+        }
+    };
+
+  if (cmd.isArray ())
+    for (const auto& op : cmd)
+      addFromOp (op);
+  else
+    addFromOp (cmd);
+}
+
+void
+PreParsedMoves::Parse (const Json::Value& moveArray, unsigned numThreads)
+{
+  CHECK (moveArray.isArray ());
+  waypoints.clear ();
+
+  std::vector<EncodedWaypoints> encoded;
+  for (const auto& m : moveArray)
+    CollectWaypoints (m, encoded);
+
+  std::sort (encoded.begin (), encoded.end ());
+  encoded.erase (std::unique (encoded.begin (), encoded.end ()),
+                 encoded.end ());
+
+  if (encoded.size () < MIN_PARALLEL_WAYPOINTS)
+    return;
+
+  numThreads = std::max (1u, numThreads);
+  numThreads = std::min<size_t> (numThreads, encoded.size ());
+  VLOG (1)
+      << "Pre-parsing " << encoded.size () << " waypoint strings with "
+      << numThreads << " threads";
+
+  /* Each thread handles a fixed stride of entries, and writes the result
+     into its own slots of the results vector.  Thus no locking is needed.  */
+  std::vector<DecodedWaypoints> results(encoded.size ());
+  const auto worker = [&encoded, &results, numThreads] (const unsigned start)
+    {
+      for (size_t i = start; i < encoded.size (); i += numThreads)
+        results[i].valid = DecodeWaypoints (encoded[i].first,
+                                            encoded[i].second,
+                                            results[i].wp);
+    };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < numThreads; ++i)
+    threads.emplace_back (worker, i);
+  worker (0);
+  for (auto& t : threads)
+    t.join ();
+
+  for (size_t i = 0; i < encoded.size (); ++i)
+    waypoints.emplace (std::move (encoded[i]), std::move (results[i]));
+}
+
+bool
+PreParsedMoves::GetWaypoints (const WaypointEncoding enc,
+                              const std::string& encoded,
+                              bool& valid, std::vector<HexCoord>& wp) const
+{
+  const auto mit = waypoints.find (std::make_pair (enc, encoded));
+  if (mit == waypoints.end ())
+    return false;
+
+  valid = mit->second.valid;
+  wp = mit->second.wp;
+
+  return true;
+}
+
+/* ************************************************************************** */
+
+bool
+BaseMoveProcessor::GetWaypointEncoding (const Json::Value& upd,
+                                        WaypointEncoding& enc) const
+{
+  /* Before the fork, the format field is just ignored (as any other
+     unknown field would be).  */
+  if (!ctx.Forks ().IsActive (Fork::CompactWaypoints))
+    {
+      enc = WaypointEncoding::JSON;
+      return true;
+    }
+
+  return ParseWaypointEncoding (upd, enc);
+}
+
+bool
+BaseMoveProcessor::DecodeWaypointsCached (const WaypointEncoding enc,
+                                          const std::string& encoded,
+                                          std::vector<HexCoord>& wp) const
+{
+  bool valid;
+  if (preParsed != nullptr
+        && preParsed->GetWaypoints (enc, encoded, valid, wp))
+    return valid;
+
+  return DecodeWaypoints (enc, encoded, wp);
+}
+
 bool
 BaseMoveProcessor::ExtractMoveBasics (const Json::Value& moveObj,
                                       std::string& name, Json::Value& mv,
@@ -216,6 +390,9 @@ BaseMoveProcessor::TryCharacterUpdates (const std::string& name,
               continue;
             }
 
+          if (!MayUpdateCharacter (name, id))
+            continue;
+
           auto c = characters.GetById (id);
           if (c == nullptr)
             {
@@ -548,7 +725,7 @@ BaseMoveProcessor::ParseCoinTransferBurn (const Account& a,
 bool
 BaseMoveProcessor::ParseCharacterWaypoints (const Character& c,
                                             const Json::Value& upd,
-                                            std::vector<HexCoord>& wp)
+                                            std::vector<HexCoord>& wp) const
 {
   CHECK (upd.isObject ());
   if (!upd.isMember ("wp"))
@@ -585,7 +762,9 @@ BaseMoveProcessor::ParseCharacterWaypoints (const Character& c,
       return false;
     }
 
-  if (!DecodeWaypoints (wpVal.asString (), wp))
+  WaypointEncoding enc;
+  if (!GetWaypointEncoding (upd, enc)
+        || !DecodeWaypointsCached (enc, wpVal.asString (), wp))
     {
       LOG (WARNING)
           << "Invalid waypoints given for character " << c.GetId ()
@@ -601,6 +780,7 @@ BaseMoveProcessor::ParseCharacterWaypointExtension (const Character& c,
                                                     const Json::Value& upd,
                                                     const bool pendingWp,
                                                     std::vector<HexCoord>& wp)
+    const
 {
   CHECK (upd.isObject ());
   const auto& wpx = upd["wpx"];
@@ -621,7 +801,9 @@ BaseMoveProcessor::ParseCharacterWaypointExtension (const Character& c,
       return false;
     }
 
-  if (!DecodeWaypoints (wpx.asString (), wp))
+  WaypointEncoding enc;
+  if (!GetWaypointEncoding (upd, enc)
+        || !DecodeWaypointsCached (enc, wpx.asString (), wp))
     {
       LOG (WARNING)
           << "Invalid waypoints given for character " << c.GetId ()
@@ -1222,8 +1404,18 @@ MoveProcessor::ProcessAll (const Json::Value& moveArray)
   CHECK (moveArray.isArray ());
   LOG (INFO) << "Processing " << moveArray.size () << " moves...";
 
+  unsigned numThreads = FLAGS_move_parse_threads;
+  if (numThreads == 0)
+    numThreads = std::thread::hardware_concurrency ();
+
+  PreParsedMoves parsed;
+  parsed.Parse (moveArray, numThreads);
+  preParsed = &parsed;
+
   for (const auto& m : moveArray)
     ProcessOne (m);
+
+  preParsed = nullptr;
 }
 
 void
@@ -1257,6 +1449,8 @@ MoveProcessor::ProcessOne (const Json::Value& moveObj)
   if (!ExtractMoveBasics (moveObj, name, mv, paidToDev, burnt))
     return;
 
+  PXD_TRACE_SPAN ("MoveProcessor::ProcessOne", name);
+
   /* Ensure that the account database entry exists.  In other words, we
      have accounts (although perhaps uninitialised) for everyone who
      ever sent a Taurion move.  */
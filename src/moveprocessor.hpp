@@ -21,6 +21,7 @@
 
 #include "context.hpp"
 #include "dynobstacles.hpp"
+#include "movement.hpp"
 #include "services.hpp"
 #include "trading.hpp"
 
@@ -45,6 +46,7 @@
 
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace pxd
@@ -84,6 +86,89 @@ struct CoinTransferBurn
 
 };
 
+/**
+ * Results of state-independent parsing of the moves in a block, which is
+ * done up-front and in parallel for all moves.  The sequential processing
+ * of the moves then just looks up the results here, so that the consensus
+ * semantics are unchanged.
+ *
+ * Currently this holds the decoded waypoints for all encoded waypoint
+ * strings (set and extension) in character updates, as their decompression
+ * is the main cost in move parsing that does not depend on the game state.
+ */
+class PreParsedMoves
+{
+
+private:
+
+  /**
+   * Result of decoding one waypoint string.
+   */
+  struct DecodedWaypoints
+  {
+
+    /** Whether or not the string was valid.  */
+    bool valid;
+
+    /** The decoded waypoints (if valid).  */
+    std::vector<HexCoord> wp;
+
+  };
+
+  /** An encoded waypoint string together with its format.  */
+  using EncodedWaypoints = std::pair<WaypointEncoding, std::string>;
+
+  /** Decoded waypoints by their format and encoded string.  */
+  std::map<EncodedWaypoints, DecodedWaypoints> waypoints;
+
+  /**
+   * Collects all encoded waypoint strings in the character updates
+   * of the given move object.  The format is taken as requested by
+   * the update; whether or not it is actually allowed (fork) is
+   * checked only when processing the update itself.
+   */
+  static void CollectWaypoints (const Json::Value& moveObj,
+                                std::vector<EncodedWaypoints>& out);
+
+public:
+
+  /**
+   * Minimum number of encoded waypoint strings in a block for which
+   * we do the pre-parsing at all.  For fewer ones, the overhead of starting
+   * threads is not worth it, and they are just decoded when needed.
+   */
+  static constexpr size_t MIN_PARALLEL_WAYPOINTS = 8;
+
+  PreParsedMoves () = default;
+
+  PreParsedMoves (const PreParsedMoves&) = delete;
+  void operator= (const PreParsedMoves&) = delete;
+
+  /**
+   * Runs the parsing for all moves in the given array, using up
+   * to the given number of threads.
+   */
+  void Parse (const Json::Value& moveArray, unsigned numThreads);
+
+  /**
+   * Looks up the result of decoding the given waypoint string.  Returns
+   * false if it has not been pre-parsed.  Otherwise, valid is set to whether
+   * or not it was valid, and wp to the decoded waypoints.
+   */
+  bool GetWaypoints (WaypointEncoding enc, const std::string& encoded,
+                     bool& valid, std::vector<HexCoord>& wp) const;
+
+  /**
+   * Returns the number of pre-parsed waypoint strings.
+   */
+  size_t
+  GetNumWaypoints () const
+  {
+    return waypoints.size ();
+  }
+
+};
+
 /**
  * Base class for MoveProcessor (handling confirmed moves) and PendingProcessor
  * (for processing pending moves).  It holds some common stuff for both
@@ -159,8 +244,29 @@ protected:
   /** Access to the regions table.  */
   RegionsTable regions;
 
+  /**
+   * If set, the pre-parsed data for the moves being processed, which is
+   * used instead of parsing things like waypoints again.
+   */
+  const PreParsedMoves* preParsed = nullptr;
+
   explicit BaseMoveProcessor (Database& d, DynObstacles& o, const Context& c);
 
+  /**
+   * Determines the format in which the waypoints in a character update
+   * are encoded.  Returns false if the update requests a format that is
+   * invalid (or not yet enabled by the forks).
+   */
+  bool GetWaypointEncoding (const Json::Value& upd,
+                            WaypointEncoding& enc) const;
+
+  /**
+   * Decodes an encoded waypoint string, using the pre-parsed data
+   * if available.
+   */
+  bool DecodeWaypointsCached (WaypointEncoding enc, const std::string& encoded,
+                              std::vector<HexCoord>& wp) const;
+
   /**
    * Parses some basic stuff from a move JSON object.  This extracts the
    * actual move JSON value, the name and the dev payment.  The function
@@ -189,19 +295,19 @@ protected:
    * in the update JSON.  Returns true if a valid waypoint update was found,
    * in which case wp will be set accordingly.
    */
-  static bool ParseCharacterWaypoints (const Character& c,
-                                       const Json::Value& upd,
-                                       std::vector<HexCoord>& wp);
+  bool ParseCharacterWaypoints (const Character& c,
+                                const Json::Value& upd,
+                                std::vector<HexCoord>& wp) const;
 
   /**
    * Parses and verifies a potential waypoint extension for the
    * character.  If pendingWp is true, we assume that there are already
    * pending waypoints, which we accept also as "is already moving".
    */
-  static bool ParseCharacterWaypointExtension (const Character& c,
-                                               const Json::Value& upd,
-                                               bool pendingWp,
-                                               std::vector<HexCoord>& wp);
+  bool ParseCharacterWaypointExtension (const Character& c,
+                                        const Json::Value& upd,
+                                        bool pendingWp,
+                                        std::vector<HexCoord>& wp) const;
 
   /**
    * Parses and verifies a potential update to the character's
@@ -304,6 +410,19 @@ protected:
    */
   void TryDexOperations (const std::string& name, const Json::Value& mv);
 
+  /**
+   * This function is called by TryCharacterUpdates before a character is
+   * loaded for an update.  If it returns false, the update for that
+   * character is skipped.  This allows subclasses to reject updates early
+   * based on cached data; the full checks are done in any case on the
+   * loaded character.
+   */
+  virtual bool
+  MayUpdateCharacter (const std::string& name, const Database::IdT id)
+  {
+    return true;
+  }
+
   /**
    * This function is called when TryCharacterCreation found a creation that
    * is valid and should be performed.
@@ -400,13 +519,12 @@ private:
    * Sets the character's waypoints if a valid command for starting a move
    * is there.
    */
-  static void MaybeSetCharacterWaypoints (Character& c, const Json::Value& upd);
+  void MaybeSetCharacterWaypoints (Character& c, const Json::Value& upd);
 
   /**
    * Extends the character's waypoints with an wpx move.
    */
-  static void MaybeExtendCharacterWaypoints (Character& c,
-                                             const Json::Value& upd);
+  void MaybeExtendCharacterWaypoints (Character& c, const Json::Value& upd);
 
   /**
    * Processes a command to set (or clear) a character's "enter building".
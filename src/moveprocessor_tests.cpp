@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -19,6 +19,7 @@
 #include "moveprocessor.hpp"
 
 #include "jsonutils.hpp"
+#include "movement.hpp"
 #include "protoutils.hpp"
 #include "testutils.hpp"
 
@@ -36,7 +37,9 @@
 namespace pxd
 {
 
+DECLARE_int32 (fork_height_compactwaypoints);
 DECLARE_int32 (fork_height_gamestart);
+DECLARE_int32 (move_parse_threads);
 
 namespace
 {
@@ -632,6 +635,146 @@ TEST_F (CharacterCreationTests, CharacterLimit)
 
 /* ************************************************************************** */
 
+class PreParsedMovesTests : public testing::Test
+{
+
+protected:
+
+  PreParsedMoves parsed;
+
+  /**
+   * Constructs a JSON array of moves, each with a character update
+   * with the given waypoint value.  If extension is true, then the "wpx"
+   * field is used instead of "wp".
+   */
+  static Json::Value
+  MovesWithWaypoints (const std::vector<std::string>& wpStrs,
+                      const bool extension)
+  {
+    Json::Value res(Json::arrayValue);
+    for (const auto& str : wpStrs)
+      {
+        Json::Value mv(Json::objectValue);
+        mv["name"] = "domob";
+        mv["move"]["c"]["id"] = 1;
+        mv["move"]["c"][extension ? "wpx" : "wp"] = str;
+        res.append (mv);
+      }
+
+    return res;
+  }
+
+  /**
+   * Returns n distinct encoded waypoint strings.
+   */
+  static std::vector<std::string>
+  DistinctWaypoints (const unsigned n)
+  {
+    std::vector<std::string> res;
+    for (unsigned i = 0; i < n; ++i)
+      res.push_back (ParseJson (WpStr ({HexCoord (i, 0)})).asString ());
+    return res;
+  }
+
+};
+
+TEST_F (PreParsedMovesTests, TooFewWaypoints)
+{
+  const auto strs
+      = DistinctWaypoints (PreParsedMoves::MIN_PARALLEL_WAYPOINTS - 1);
+  parsed.Parse (MovesWithWaypoints (strs, false), 4);
+  EXPECT_EQ (parsed.GetNumWaypoints (), 0);
+
+  bool valid;
+  std::vector<HexCoord> wp;
+  EXPECT_FALSE (parsed.GetWaypoints (WaypointEncoding::JSON, strs[0],
+                                     valid, wp));
+}
+
+TEST_F (PreParsedMovesTests, DecodesAll)
+{
+  auto strs = DistinctWaypoints (PreParsedMoves::MIN_PARALLEL_WAYPOINTS);
+  strs.push_back ("invalid");
+  /* Duplicates are only decoded once.  */
+  strs.push_back (strs[0]);
+
+  parsed.Parse (MovesWithWaypoints (strs, true), 3);
+  EXPECT_EQ (parsed.GetNumWaypoints (),
+             PreParsedMoves::MIN_PARALLEL_WAYPOINTS + 1);
+
+  bool valid;
+  std::vector<HexCoord> wp;
+
+  ASSERT_TRUE (parsed.GetWaypoints (WaypointEncoding::JSON, strs[5],
+                                    valid, wp));
+  EXPECT_TRUE (valid);
+  EXPECT_EQ (wp, std::vector<HexCoord> ({HexCoord (5, 0)}));
+
+  ASSERT_TRUE (parsed.GetWaypoints (WaypointEncoding::JSON, "invalid",
+                                    valid, wp));
+  EXPECT_FALSE (valid);
+
+  EXPECT_FALSE (parsed.GetWaypoints (WaypointEncoding::JSON, "other",
+                                     valid, wp));
+}
+
+TEST_F (PreParsedMovesTests, CompactFormat)
+{
+  std::vector<std::string> strs;
+  for (unsigned i = 0; i <= PreParsedMoves::MIN_PARALLEL_WAYPOINTS; ++i)
+    strs.push_back (EncodeWaypointsCompact ({HexCoord (i, 0)}));
+
+  auto moves = MovesWithWaypoints (strs, false);
+  for (auto& mv : moves)
+    mv["move"]["c"]["wpf"] = "compact";
+  /* An invalid format means that the string is not collected at all.  */
+  moves[0]["move"]["c"]["wpf"] = "invalid";
+
+  parsed.Parse (moves, 2);
+  EXPECT_EQ (parsed.GetNumWaypoints (), strs.size () - 1);
+
+  bool valid;
+  std::vector<HexCoord> wp;
+
+  ASSERT_TRUE (parsed.GetWaypoints (WaypointEncoding::COMPACT, strs[3],
+                                    valid, wp));
+  EXPECT_TRUE (valid);
+  EXPECT_EQ (wp, std::vector<HexCoord> ({HexCoord (3, 0)}));
+
+  EXPECT_FALSE (parsed.GetWaypoints (WaypointEncoding::JSON, strs[3],
+                                     valid, wp));
+  EXPECT_FALSE (parsed.GetWaypoints (WaypointEncoding::COMPACT, strs[0],
+                                     valid, wp));
+}
+
+TEST_F (PreParsedMovesTests, BatchedUpdates)
+{
+  const auto strs
+      = DistinctWaypoints (PreParsedMoves::MIN_PARALLEL_WAYPOINTS);
+
+  Json::Value ops(Json::arrayValue);
+  for (const auto& str : strs)
+    {
+      Json::Value op(Json::objectValue);
+      op["id"] = 1;
+      op["wp"] = str;
+      ops.append (op);
+    }
+  ops.append (42);
+
+  Json::Value moves(Json::arrayValue);
+  moves.append (ParseJson (R"({"name": "domob", "move": 5})"));
+  Json::Value mv(Json::objectValue);
+  mv["name"] = "domob";
+  mv["move"]["c"] = ops;
+  moves.append (mv);
+
+  parsed.Parse (moves, 1);
+  EXPECT_EQ (parsed.GetNumWaypoints (), strs.size ());
+}
+
+/* ************************************************************************** */
+
 class CharacterUpdateTests : public MoveProcessorTests
 {
 
@@ -1010,6 +1153,45 @@ TEST_F (CharacterUpdateTests, BasicWaypoints)
   EXPECT_EQ (CoordFromProto (wp.Get (1)), HexCoord (5, 0));
 }
 
+TEST_F (CharacterUpdateTests, ManyWaypointMovesInParallel)
+{
+  constexpr unsigned numChars = 2 * PreParsedMoves::MIN_PARALLEL_WAYPOINTS;
+
+  for (unsigned i = 2; i <= numChars; ++i)
+    SetupCharacter (i, "domob");
+  for (unsigned i = 1; i <= numChars; ++i)
+    {
+      auto h = tbl.GetById (i);
+      h->MutableProto ().set_speed (1000);
+    }
+
+  std::ostringstream moves;
+  moves << "[";
+  for (unsigned i = 1; i <= numChars; ++i)
+    {
+      if (i > 1)
+        moves << ",";
+      moves
+          << R"({"name": "domob", "move": {"c": {"id": )" << i
+          << R"(, "wp": )" << WpStr ({HexCoord (i, -1), HexCoord (i, -2)})
+          << "}}}";
+    }
+  moves << "]";
+
+  FLAGS_move_parse_threads = 4;
+  Process (moves.str ());
+  FLAGS_move_parse_threads = 0;
+
+  for (unsigned i = 1; i <= numChars; ++i)
+    {
+      auto h = tbl.GetById (i);
+      const auto& wp = h->GetProto ().movement ().waypoints ();
+      ASSERT_EQ (wp.size (), 2);
+      EXPECT_EQ (CoordFromProto (wp.Get (0)), HexCoord (i, -1));
+      EXPECT_EQ (CoordFromProto (wp.Get (1)), HexCoord (i, -2));
+    }
+}
+
 TEST_F (CharacterUpdateTests, EmptyWaypoints)
 {
   auto h = GetTest ();
@@ -1121,6 +1303,67 @@ TEST_F (CharacterUpdateTests, WaypointExtension)
   EXPECT_EQ (CoordFromProto (wp.Get (2)), HexCoord (-4, 7));
 }
 
+TEST_F (CharacterUpdateTests, CompactWaypoints)
+{
+  FLAGS_fork_height_compactwaypoints = 100;
+  GetTest ()->MutableProto ().set_speed (1000);
+
+  const std::string compactMove = R"([{
+    "name": "domob",
+    "move": {"c": {"id": 1, "wpf": "compact", "wp": ")"
+      + EncodeWaypointsCompact ({HexCoord (-3, 4), HexCoord (5, 0)})
+      + R"("}}
+  }])";
+
+  /* Before the fork, the format field is ignored and the compact string
+     is invalid as JSON waypoints.  */
+  ctx.SetHeight (99);
+  Process (compactMove);
+  EXPECT_FALSE (GetTest ()->GetProto ().has_movement ());
+
+  /* After the fork, an invalid format makes the waypoints invalid.  */
+  ctx.SetHeight (100);
+  Process (R"([{
+    "name": "domob",
+    "move": {"c": {"id": 1, "wpf": "foo", "wp": )"
+        + WpStr ({HexCoord (-3, 4)}) + R"(}}
+  }])");
+  EXPECT_FALSE (GetTest ()->GetProto ().has_movement ());
+
+  Process (compactMove);
+  auto h = GetTest ();
+  ASSERT_EQ (h->GetProto ().movement ().waypoints_size (), 2);
+  h.reset ();
+
+  /* Extensions work in both formats.  */
+  Process (R"([{
+    "name": "domob",
+    "move": {"c": [
+      {
+        "id": 1,
+        "wpf": "compact",
+        "wpx": ")" + EncodeWaypointsCompact ({HexCoord (-4, 7)}) + R"("
+      },
+      {
+        "id": 1,
+        "wpf": "json",
+        "wpx": )" + WpStr ({HexCoord (0, 7)}) + R"(
+      }
+    ]}
+  }])");
+
+  h = GetTest ();
+  const auto& wp = h->GetProto ().movement ().waypoints ();
+  ASSERT_EQ (wp.size (), 4);
+  EXPECT_EQ (CoordFromProto (wp.Get (0)), HexCoord (-3, 4));
+  EXPECT_EQ (CoordFromProto (wp.Get (1)), HexCoord (5, 0));
+  EXPECT_EQ (CoordFromProto (wp.Get (2)), HexCoord (-4, 7));
+  EXPECT_EQ (CoordFromProto (wp.Get (3)), HexCoord (0, 7));
+  h.reset ();
+
+  FLAGS_fork_height_compactwaypoints = -1;
+}
+
 TEST_F (CharacterUpdateTests, ChosenSpeedWithoutMovement)
 {
   GetTest ()->MutableProto ().set_speed (1000);
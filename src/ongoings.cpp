@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -144,6 +144,42 @@ FinishBuildingConstruction (Building& b, const Context& ctx,
 
 } // anonymous namespace
 
+unsigned
+GetOngoingEndHeight (const OngoingOperation& op, const Context& ctx)
+{
+  const auto& pb = op.GetProto ();
+  unsigned endDelta = 0;
+
+  switch (pb.op_case ())
+    {
+    case proto::OngoingOperation::kBlueprintCopy:
+      {
+        const auto& cp = pb.blueprint_copy ();
+        CHECK_GE (cp.num_copies (), 1);
+        endDelta += (cp.num_copies () - 1)
+                      * GetBpCopyBlocks (cp.copy_type (), ctx);
+        break;
+      }
+
+    case proto::OngoingOperation::kItemConstruction:
+      {
+        const auto& c = pb.item_construction ();
+        if (c.has_original_type ())
+          {
+            CHECK_GE (c.num_items (), 1);
+            endDelta += (c.num_items () - 1)
+                          * GetConstructionBlocks (c.output_type (), ctx);
+          }
+        break;
+      }
+
+    default:
+      break;
+    }
+
+  return op.GetHeight () + endDelta;
+}
+
 void
 ProcessAllOngoings (Database& db, xaya::Random& rnd, const Context& ctx)
 {
@@ -155,10 +191,10 @@ ProcessAllOngoings (Database& db, xaya::Random& rnd, const Context& ctx)
   OngoingsTable ongoings(db);
   RegionsTable regions(db, ctx.Height ());
 
-  auto res = ongoings.QueryForHeight (ctx.Height ());
-  while (res.Step ())
+  for (const auto id : ongoings.GetIdsForHeight (ctx.Height ()))
     {
-      auto op = ongoings.GetFromResult (res);
+      auto op = ongoings.GetById (id);
+      CHECK (op != nullptr);
 
       /* The query returns all entries with height less-or-equal to the
          current one, but there shouldn't be any with less (as they should have
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2020  Autonomous Worlds Ltd
+    Copyright (C) 2020-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -22,12 +22,22 @@
 #include "context.hpp"
 
 #include "database/database.hpp"
+#include "database/ongoing.hpp"
 
 #include <xayautil/random.hpp>
 
 namespace pxd
 {
 
+/**
+ * Computes the height at which the given operation will be completely
+ * finished.  For most operations, this is just their processing height.
+ * Some operations (e.g. blueprint copies) are processed multiple times
+ * before they are done, though, and for them the remaining steps are
+ * added onto the next processing height.
+ */
+unsigned GetOngoingEndHeight (const OngoingOperation& op, const Context& ctx);
+
 /**
  * Processes ongoing operations (i.e. check which have reached the block height,
  * handle them, and then delete the ones that are done).
@@ -255,6 +255,88 @@ TEST_F (OngoingsTests, BlueprintCopy)
   EXPECT_EQ (GetNumOngoing (), 0);
 }
 
+TEST_F (OngoingsTests, BlueprintCopyWithSchedule)
+{
+  const unsigned baseDuration = GetBpCopyBlocks ("bow bpc", ctx);
+
+  OngoingsSchedule schedule([this] (const OngoingOperation& op)
+    {
+      return GetOngoingEndHeight (op, ctx);
+    });
+  schedule.Load (db);
+  db.SetOngoingsSchedule (&schedule);
+
+  auto b = buildings.CreateNew ("ancient1", "", Faction::ANCIENT);
+  const auto bId = b->GetId ();
+  auto op = AddOp (*b);
+  const auto opId = op->GetId ();
+  op->SetHeight (baseDuration);
+  auto& cp = *op->MutableProto ().mutable_blueprint_copy ();
+  cp.set_account ("domob");
+  cp.set_original_type ("bow bpo");
+  cp.set_copy_type ("bow bpc");
+  cp.set_num_copies (3);
+  op.reset ();
+  b.reset ();
+
+  EXPECT_EQ (schedule.GetEndHeight (opId), 3 * baseDuration);
+
+  for (unsigned i = 1; i < 3; ++i)
+    {
+      ctx.SetHeight (i * baseDuration);
+      ProcessAllOngoings (db, rnd, ctx);
+
+      EXPECT_EQ (schedule.GetForHeight (i * baseDuration),
+                 std::vector<Database::IdT> ({}));
+      EXPECT_EQ (schedule.GetForBuilding (bId),
+                 std::vector<Database::IdT> ({opId}));
+      EXPECT_EQ (schedule.GetEndHeight (opId), 3 * baseDuration);
+      schedule.Verify (db);
+    }
+
+  ctx.SetHeight (3 * baseDuration);
+  ProcessAllOngoings (db, rnd, ctx);
+  EXPECT_EQ (GetNumOngoing (), 0);
+  EXPECT_EQ (schedule.GetForBuilding (bId), std::vector<Database::IdT> ({}));
+  schedule.Verify (db);
+
+  auto inv = buildingInv.Get (bId, "domob");
+  EXPECT_EQ (inv->GetInventory ().GetFungibleCount ("bow bpo"), 1);
+  EXPECT_EQ (inv->GetInventory ().GetFungibleCount ("bow bpc"), 3);
+  inv.reset ();
+
+  db.SetOngoingsSchedule (nullptr);
+}
+
+TEST_F (OngoingsTests, EndHeight)
+{
+  const unsigned bpcDuration = GetBpCopyBlocks ("bow bpc", ctx);
+  const unsigned bowDuration = GetConstructionBlocks ("bow", ctx);
+
+  auto b = buildings.CreateNew ("ancient1", "", Faction::ANCIENT);
+
+  auto op = AddOp (*b);
+  op->SetHeight (100);
+  op->MutableProto ().mutable_building_construction ();
+  EXPECT_EQ (GetOngoingEndHeight (*op, ctx), 100);
+
+  op = AddOp (*b);
+  op->SetHeight (100);
+  auto* cp = op->MutableProto ().mutable_blueprint_copy ();
+  cp->set_copy_type ("bow bpc");
+  cp->set_num_copies (5);
+  EXPECT_EQ (GetOngoingEndHeight (*op, ctx), 100 + 4 * bpcDuration);
+
+  op = AddOp (*b);
+  op->SetHeight (100);
+  auto* c = op->MutableProto ().mutable_item_construction ();
+  c->set_output_type ("bow");
+  c->set_num_items (3);
+  EXPECT_EQ (GetOngoingEndHeight (*op, ctx), 100);
+  c->set_original_type ("bow bpo");
+  EXPECT_EQ (GetOngoingEndHeight (*op, ctx), 100 + 2 * bowDuration);
+}
+
 TEST_F (OngoingsTests, ItemConstructionFromOriginal)
 {
   const unsigned baseDuration = GetConstructionBlocks ("bow", ctx);
@@ -23,8 +23,17 @@
 #include "protoutils.hpp"
 #include "logic.hpp"
 
+#include "database/changes.hpp"
+
+#include <gflags/gflags.h>
+
+#include <algorithm>
 #include <type_traits>
 
+DEFINE_int32 (pending_max_move_cost, 0,
+              "if set, moves with more individual operations than this are"
+              " ignored for the pending state (0 for no limit)");
+
 namespace pxd
 {
 
@@ -632,6 +641,25 @@ PendingStateUpdater::PerformCharacterUpdate (Character& c,
   TryMobileRefining (c, upd);
 }
 
+bool
+PendingStateUpdater::MayUpdateCharacter (const std::string& name,
+                                         const Database::IdT id)
+{
+  if (lookups == nullptr)
+    return true;
+
+  const auto& owner = lookups->GetCharacterOwner (characters, id);
+  if (owner != name)
+    {
+      VLOG (1)
+          << "Character " << id << " is not owned by " << name
+          << ", ignoring pending update";
+      return false;
+    }
+
+  return true;
+}
+
 void
 PendingStateUpdater::PerformServiceOperation (ServiceOperation& op)
 {
@@ -644,15 +672,81 @@ PendingStateUpdater::PerformDexOperation (DexOperation& op)
   state.AddDexOperation (op);
 }
 
+unsigned
+PendingStateUpdater::EstimateMoveCost (const Json::Value& moveObj)
+{
+  const auto& mv = moveObj["move"];
+  if (!mv.isObject ())
+    return 1;
+
+  /* Each move counts as one, plus one for each entry in the arrays of
+     individual operations it contains.  For character updates, each
+     character ID counts separately, as batched updates are processed
+     for each of them.  */
+  unsigned res = 1;
+
+  for (const auto* key : {"nc", "b", "s", "x"})
+    {
+      const auto& val = mv[key];
+      if (val.isArray ())
+        res += val.size ();
+    }
+
+  const auto& cmd = mv["c"];
+  const auto addCharacterUpdate = [&res] (const Json::Value& op)
+    {
+      if (!op.isObject ())
+        {
+          ++res;
+          return;
+        }
+
+      const auto& ids = op["id"];
+      if (ids.isArray ())
+        res += std::max (1u, ids.size ());
+      else
+        ++res;
+    };
+  if (cmd.isArray ())
+    for (const auto& op : cmd)
+      addCharacterUpdate (op);
+  else if (cmd.isObject ())
+    addCharacterUpdate (cmd);
+
+  return res;
+}
+
 void
 PendingStateUpdater::ProcessMove (const Json::Value& moveObj)
 {
+  if (FLAGS_pending_max_move_cost > 0)
+    {
+      const unsigned cost = EstimateMoveCost (moveObj);
+      if (cost > static_cast<unsigned> (FLAGS_pending_max_move_cost))
+        {
+          LOG (WARNING)
+              << "Ignoring pending move with cost " << cost
+              << " (maximum: " << FLAGS_pending_max_move_cost << ")";
+          return;
+        }
+    }
+
   std::string name;
   Json::Value mv;
   Amount paidToDev, burnt;
   if (!ExtractMoveBasics (moveObj, name, mv, paidToDev, burnt))
     return;
 
+  if (lookups != nullptr
+        && lookups->GetAccountState (accounts, name)
+              == PendingLookupCache::AccountState::MISSING)
+    {
+      VLOG (1)
+          << "Account " << name
+          << " does not exist, ignoring pending move " << moveObj;
+      return;
+    }
+
   auto a = accounts.GetByName (name);
   if (a == nullptr)
     {
@@ -692,42 +786,154 @@ PendingStateUpdater::ProcessMove (const Json::Value& moveObj)
 
 /* ************************************************************************** */
 
+PendingLookupCache::AccountState
+PendingLookupCache::GetAccountState (AccountsTable& tbl,
+                                     const std::string& name)
+{
+  const auto mit = accounts.find (name);
+  if (mit != accounts.end ())
+    return mit->second;
+
+  /* Moves can name arbitrary accounts, so make sure that the cache does
+     not grow without bounds in a flood of moves from unknown names.  */
+  if (accounts.size () >= MAX_ENTRIES)
+    accounts.clear ();
+
+  AccountState res;
+  const auto a = tbl.GetByName (name);
+  if (a == nullptr)
+    res = AccountState::MISSING;
+  else if (a->IsInitialised ())
+    res = AccountState::INITIALISED;
+  else
+    res = AccountState::UNINITIALISED;
+
+  accounts.emplace (name, res);
+  return res;
+}
+
+const std::string&
+PendingLookupCache::GetCharacterOwner (CharacterTable& tbl,
+                                       const Database::IdT id)
+{
+  const auto mit = characterOwners.find (id);
+  if (mit != characterOwners.end ())
+    return mit->second;
+
+  if (characterOwners.size () >= MAX_ENTRIES)
+    characterOwners.clear ();
+
+  std::string owner;
+  {
+    const auto c = tbl.GetById (id);
+    if (c != nullptr)
+      owner = c->GetOwner ();
+  }
+
+  return characterOwners.emplace (id, std::move (owner)).first->second;
+}
+
+void
+PendingLookupCache::Invalidate (Database& db, const unsigned height)
+{
+  EntityChanges changes(db);
+
+  for (const auto& name : changes.GetChangedAccounts (height))
+    accounts.erase (name);
+  for (const auto id : changes.GetChangedCharacters (height))
+    characterOwners.erase (id);
+}
+
+void
+PendingLookupCache::Clear ()
+{
+  accounts.clear ();
+  characterOwners.clear ();
+}
+
+/* ************************************************************************** */
+
 PendingMoves::PendingMoves (PXLogic& rules)
   : xaya::SQLiteGame::PendingMoves(rules)
 {}
 
+PendingMoves::~PendingMoves () = default;
+
 void
 PendingMoves::Clear ()
 {
+  /* The dynamic obstacles and lookups are not reset here.  They only
+     depend on the confirmed state, and UpdateConfirmedHandles will recreate
+     them if that changed.  */
   state.Clear ();
+  cachedJson.reset ();
+}
+
+void
+PendingMoves::UpdateConfirmedHandles (Database& db)
+{
+  const auto& blk = GetConfirmedBlock ();
+  const auto& hashVal = blk["hash"];
+  CHECK (hashVal.isString ());
+  const std::string hash = hashVal.asString ();
+
+  if (dyn != nullptr && cachedBlockHash == hash)
+    return;
+
+  VLOG (1) << "Confirmed state changed to " << hash << " for pending moves";
+
+  /* The lookup cache can be updated incrementally if the new block is
+     attached directly on top of the one we had before.  Otherwise (e.g. for
+     reorgs or the first block), we just start over with an empty cache.  */
+  const auto& parentVal = blk["parent"];
+  const bool attached = (dyn != nullptr && parentVal.isString ()
+                          && parentVal.asString () == cachedBlockHash);
+
+  /* The order matters here, as the old dynamic obstacles still
+     reference the old context.  */
   dyn.reset ();
+  ctx.reset ();
+
+  const auto& heightVal = blk["height"];
+  CHECK (heightVal.isUInt ());
+
+  PXLogic& rules = dynamic_cast<PXLogic&> (GetSQLiteGame ());
+  ctx = std::make_unique<Context> (GetChain (), rules.GetBaseMap (),
+                                   heightVal.asUInt () + 1,
+                                   Context::NO_TIMESTAMP);
+  dyn = std::make_unique<DynObstacles> (db, *ctx);
+
+  if (attached)
+    lookups.Invalidate (db, heightVal.asUInt ());
+  else
+    lookups.Clear ();
+
+  cachedBlockHash = hash;
 }
 
 void
 PendingMoves::AddPendingMove (const Json::Value& mv)
 {
+  /* The database handle is created freshly for each move, since the
+     instance returned by AccessConfirmedState may change between calls.  */
   auto& db = const_cast<xaya::SQLiteDatabase&> (AccessConfirmedState ());
   PXLogic& rules = dynamic_cast<PXLogic&> (GetSQLiteGame ());
   SQLiteGameDatabase dbObj(db, rules);
 
-  const auto& blk = GetConfirmedBlock ();
-  const auto& heightVal = blk["height"];
-  CHECK (heightVal.isUInt ());
-
-  const Context ctx(GetChain (), rules.GetBaseMap (),
-                    heightVal.asUInt () + 1, Context::NO_TIMESTAMP);
+  UpdateConfirmedHandles (dbObj);
+  cachedJson.reset ();
 
-  if (dyn == nullptr)
-    dyn = std::make_unique<DynObstacles> (dbObj, ctx);
-
-  PendingStateUpdater updater(dbObj, *dyn, state, ctx);
+  PendingStateUpdater updater(dbObj, *dyn, state, *ctx, &lookups);
   updater.ProcessMove (mv);
 }
 
 Json::Value
 PendingMoves::ToJson () const
 {
-  return state.ToJson ();
+  if (cachedJson == nullptr)
+    cachedJson = std::make_unique<Json::Value> (state.ToJson ());
+
+  return *cachedJson;
 }
 
 /* ************************************************************************** */
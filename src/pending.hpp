@@ -25,6 +25,7 @@
 #include "services.hpp"
 #include "trading.hpp"
 
+#include "database/account.hpp"
 #include "database/character.hpp"
 #include "database/database.hpp"
 #include "database/faction.hpp"
@@ -38,12 +39,14 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace pxd
 {
 
 class PXLogic;
+class SQLiteGameDatabase;
 
 /**
  * The state of pending moves for a Taurion game.  (This holds just the
@@ -340,6 +343,77 @@ public:
 
 };
 
+/**
+ * Warm cache of basic data about accounts and characters in the confirmed
+ * state, which is used to reject invalid pending moves early (without
+ * loading the full account or character).  It is kept across pending moves
+ * as well as blocks; when a new block is confirmed, only the entries for
+ * accounts and characters changed in it are invalidated.
+ */
+class PendingLookupCache
+{
+
+public:
+
+  /** The state of an account as relevant for pending moves.  */
+  enum class AccountState
+  {
+    MISSING,
+    UNINITIALISED,
+    INITIALISED,
+  };
+
+private:
+
+  /**
+   * Maximum number of entries in each of the maps.  If this is exceeded,
+   * the map is cleared.
+   */
+  static constexpr size_t MAX_ENTRIES = 100'000;
+
+  /** Cached states of accounts by name.  */
+  std::unordered_map<std::string, AccountState> accounts;
+
+  /**
+   * Cached owners of characters by ID.  An empty string means that the
+   * character does not exist.
+   */
+  std::unordered_map<Database::IdT, std::string> characterOwners;
+
+public:
+
+  PendingLookupCache () = default;
+
+  PendingLookupCache (const PendingLookupCache&) = delete;
+  void operator= (const PendingLookupCache&) = delete;
+
+  /**
+   * Returns the state of the given account, looking it up in the
+   * database if it is not cached yet.
+   */
+  AccountState GetAccountState (AccountsTable& tbl, const std::string& name);
+
+  /**
+   * Returns the owner of the given character, or an empty string if
+   * there is no such character.  Looks it up in the database if it is
+   * not cached yet.
+   */
+  const std::string& GetCharacterOwner (CharacterTable& tbl, Database::IdT id);
+
+  /**
+   * Invalidates all entries for accounts and characters that have been
+   * changed at or after the given height, as recorded in the database's
+   * EntityChanges.
+   */
+  void Invalidate (Database& db, unsigned height);
+
+  /**
+   * Removes all cached entries.
+   */
+  void Clear ();
+
+};
+
 /**
  * BaseMoveProcessor class that updates the pending state.  This contains the
  * main logic for PendingMoves::AddPendingMove, and is also accessible from
@@ -356,8 +430,13 @@ private:
   /** The PendingState instance that is updated.  */
   PendingState& state;
 
+  /** If set, the cache used to reject moves early.  */
+  PendingLookupCache* lookups;
+
 protected:
 
+  bool MayUpdateCharacter (const std::string& name, Database::IdT id) override;
+
   void PerformCharacterCreation (Account& acc, Faction f) override;
   void PerformCharacterUpdate (Character& c, const Json::Value& upd) override;
 
@@ -371,10 +450,20 @@ protected:
 public:
 
   explicit PendingStateUpdater (Database& d, DynObstacles& o,
-                                PendingState& s, const Context& c)
-    : BaseMoveProcessor(d, o, c), state(s)
+                                PendingState& s, const Context& c,
+                                PendingLookupCache* l = nullptr)
+    : BaseMoveProcessor(d, o, c), state(s), lookups(l)
   {}
 
+  /**
+   * Estimates the cost of processing a given move, as the number of
+   * individual operations in it (e.g. one per character ID that is updated).
+   * Moves whose cost exceeds --pending_max_move_cost are ignored for the
+   * pending state, so that a few huge moves in the mempool cannot stall
+   * the processing of all the others.
+   */
+  static unsigned EstimateMoveCost (const Json::Value& moveObj);
+
   /**
    * Processes the given move.
    */
@@ -395,14 +484,48 @@ private:
   /** The current state of pending moves.  */
   PendingState state;
 
+  /**
+   * The confirmed block hash for which the cached data below is valid.
+   * Only data derived from the confirmed state is cached, not the database
+   * instance returned by AccessConfirmedState (which is only guaranteed
+   * to be valid during a single call).
+   */
+  std::string cachedBlockHash;
+
+  /** Context for processing pending moves on top of the confirmed block.  */
+  std::unique_ptr<Context> ctx;
+
   /**
    * A DynObstacles instance based on the confirmed database state.
    * This is costly to create, thus we create it on-demand and keep it cached
-   * for all pending moves until the next call to Clear (when the confirmed
-   * state changes).
+   * for all pending moves until the confirmed state changes.  In particular,
+   * it is kept across calls to Clear as long as the confirmed block
+   * stays the same.
    */
   std::unique_ptr<DynObstacles> dyn;
 
+  /**
+   * Cache of account and character data from the confirmed state.  It is
+   * updated incrementally when a new block is attached on top of the
+   * previous confirmed one, and cleared otherwise (e.g. on reorgs).
+   */
+  PendingLookupCache lookups;
+
+  /**
+   * The JSON representation of the current pending state, if it has been
+   * computed already for this version of the state.  This is reset
+   * whenever the state changes.
+   */
+  mutable std::unique_ptr<Json::Value> cachedJson;
+
+  /**
+   * Makes sure that ctx and dyn are set up for the current confirmed
+   * state, (re)creating them from the given database handle (for the
+   * confirmed state) if the confirmed block changed.  This also updates
+   * the lookup cache.
+   */
+  void UpdateConfirmedHandles (Database& db);
+
 protected:
 
   void Clear () override;
@@ -411,6 +534,7 @@ protected:
 public:
 
   explicit PendingMoves (PXLogic& rules);
+  ~PendingMoves ();
 
   Json::Value ToJson () const override;
 
@@ -24,16 +24,21 @@
 
 #include "database/account.hpp"
 #include "database/building.hpp"
+#include "database/changes.hpp"
 #include "database/character.hpp"
 #include "database/dbtest.hpp"
 #include "database/dex.hpp"
+#include "database/dirtyids.hpp"
 #include "database/itemcounts.hpp"
 #include "database/region.hpp"
 
 #include <xayautil/jsonutils.hpp>
 
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
 
+DECLARE_int32 (pending_max_move_cost);
+
 namespace pxd
 {
 namespace
@@ -1078,6 +1083,55 @@ TEST_F (PendingStateUpdaterTests, InvalidUpdate)
   )");
 }
 
+TEST_F (PendingStateUpdaterTests, EstimateMoveCost)
+{
+  const auto cost = [] (const std::string& mv)
+    {
+      Json::Value moveObj(Json::objectValue);
+      moveObj["name"] = "domob";
+      moveObj["move"] = ParseJson (mv);
+      return PendingStateUpdater::EstimateMoveCost (moveObj);
+    };
+
+  EXPECT_EQ (cost ("42"), 1);
+  EXPECT_EQ (cost ("{}"), 1);
+  EXPECT_EQ (cost (R"({"nc": [{}, {}], "x": "foo"})"), 3);
+  EXPECT_EQ (cost (R"({"b": [1, 2], "s": [3], "x": [4]})"), 5);
+  EXPECT_EQ (cost (R"({"c": {"id": 1, "wp": null}})"), 2);
+  EXPECT_EQ (cost (R"({"c": {"id": [1, 2, 3], "wp": null}})"), 4);
+  EXPECT_EQ (cost (R"({"c": {"id": [], "wp": null}})"), 2);
+  EXPECT_EQ (cost (R"({
+    "c": [{"id": 1}, {"id": [2, 3]}, 42],
+    "nc": [{}]
+  })"), 6);
+}
+
+TEST_F (PendingStateUpdaterTests, MaxMoveCost)
+{
+  accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+  for (unsigned i = 0; i < 3; ++i)
+    characters.CreateNew ("domob", Faction::RED);
+
+  FLAGS_pending_max_move_cost = 3;
+  Process ("domob", R"({
+    "c": {"id": [1, 2, 3], "wp": null}
+  })");
+  Process ("domob", R"({
+    "c": {"id": [1, 2], "wp": null}
+  })");
+  FLAGS_pending_max_move_cost = 0;
+
+  ExpectStateJson (R"(
+    {
+      "characters":
+        [
+          {"id": 1, "waypoints": []},
+          {"id": 2, "waypoints": []}
+        ]
+    }
+  )");
+}
+
 TEST_F (PendingStateUpdaterTests, Waypoints)
 {
   accounts.CreateNew ("domob")->SetFaction (Faction::RED);
@@ -1824,5 +1878,114 @@ TEST_F (PendingStateUpdaterTests, MobileRefining)
 
 /* ************************************************************************** */
 
+class PendingLookupCacheTests : public PendingStateTests
+{
+
+protected:
+
+  PendingLookupCache cache;
+
+  /**
+   * Records all accounts and characters marked as dirty in the
+   * database as changed at the given height.
+   */
+  void
+  Record (const DirtyIds& dirty, const unsigned height)
+  {
+    EntityChanges (db).Record (dirty, height);
+  }
+
+};
+
+TEST_F (PendingLookupCacheTests, AccountState)
+{
+  using State = PendingLookupCache::AccountState;
+
+  accounts.CreateNew ("init")->SetFaction (Faction::RED);
+  accounts.CreateNew ("uninit");
+
+  EXPECT_EQ (cache.GetAccountState (accounts, "init"), State::INITIALISED);
+  EXPECT_EQ (cache.GetAccountState (accounts, "uninit"), State::UNINITIALISED);
+  EXPECT_EQ (cache.GetAccountState (accounts, "domob"), State::MISSING);
+
+  DirtyIds dirty;
+  accounts.CreateNew ("domob");
+  dirty.MarkAccount ("domob");
+  accounts.GetByName ("uninit")->SetFaction (Faction::GREEN);
+  dirty.MarkAccount ("uninit");
+  Record (dirty, 10);
+
+  /* Until the cache is invalidated, the old states are returned.  */
+  EXPECT_EQ (cache.GetAccountState (accounts, "domob"), State::MISSING);
+  EXPECT_EQ (cache.GetAccountState (accounts, "uninit"), State::UNINITIALISED);
+
+  cache.Invalidate (db, 11);
+  EXPECT_EQ (cache.GetAccountState (accounts, "domob"), State::MISSING);
+
+  cache.Invalidate (db, 10);
+  EXPECT_EQ (cache.GetAccountState (accounts, "domob"), State::UNINITIALISED);
+  EXPECT_EQ (cache.GetAccountState (accounts, "uninit"), State::INITIALISED);
+  EXPECT_EQ (cache.GetAccountState (accounts, "init"), State::INITIALISED);
+}
+
+TEST_F (PendingLookupCacheTests, CharacterOwner)
+{
+  accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+  accounts.CreateNew ("andy")->SetFaction (Faction::RED);
+  const auto id1 = characters.CreateNew ("domob", Faction::RED)->GetId ();
+  const auto id2 = characters.CreateNew ("domob", Faction::RED)->GetId ();
+
+  EXPECT_EQ (cache.GetCharacterOwner (characters, id1), "domob");
+  EXPECT_EQ (cache.GetCharacterOwner (characters, id2), "domob");
+  EXPECT_EQ (cache.GetCharacterOwner (characters, 42), "");
+
+  DirtyIds dirty;
+  characters.GetById (id1)->SetOwner ("andy");
+  dirty.MarkCharacter (id1);
+  characters.DeleteById (id2);
+  dirty.MarkCharacter (id2);
+  Record (dirty, 10);
+
+  EXPECT_EQ (cache.GetCharacterOwner (characters, id1), "domob");
+  cache.Invalidate (db, 10);
+  EXPECT_EQ (cache.GetCharacterOwner (characters, id1), "andy");
+  EXPECT_EQ (cache.GetCharacterOwner (characters, id2), "");
+
+  cache.Clear ();
+  characters.GetById (id1)->SetOwner ("domob");
+  EXPECT_EQ (cache.GetCharacterOwner (characters, id1), "domob");
+}
+
+TEST_F (PendingLookupCacheTests, UpdaterChecksOwner)
+{
+  accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+  accounts.CreateNew ("andy")->SetFaction (Faction::RED);
+  ASSERT_EQ (characters.CreateNew ("domob", Faction::RED)->GetId (), 1);
+
+  const auto process = [&] (const std::string& name, const std::string& mv)
+    {
+      Json::Value moveObj(Json::objectValue);
+      moveObj["name"] = name;
+      moveObj["move"] = ParseJson (mv);
+
+      DynObstacles dyn(db, ctx);
+      PendingStateUpdater updater(db, dyn, state, ctx, &cache);
+      updater.ProcessMove (moveObj);
+    };
+
+  process ("andy", R"({"c": {"id": 1, "wp": null}})");
+  process ("unknown", R"({"nc": [{}]})");
+  ExpectStateJson (R"({"characters": []})");
+
+  process ("domob", R"({"c": {"id": 1, "wp": null}})");
+  ExpectStateJson (R"(
+    {
+      "characters": [{"id": 1, "waypoints": []}]
+    }
+  )");
+}
+
+/* ************************************************************************** */
+
 } // anonymous namespace
 } // namespace pxd
@@ -0,0 +1,341 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "perfstats.hpp"
+
+#include "jsonutils.hpp"
+
+#include <glog/logging.h>
+
+#include <sstream>
+
+namespace pxd
+{
+
+namespace
+{
+
+/** Per-table counts as used in PerfCounters.  */
+using TableCounts = std::map<std::string, uint64_t>;
+
+/**
+ * Converts a duration to milliseconds (as floating-point number).
+ */
+double
+ToMillis (const std::chrono::nanoseconds d)
+{
+  return std::chrono::duration<double, std::milli> (d).count ();
+}
+
+/**
+ * Converts a duration to microseconds (as floating-point number), which
+ * is the unit used in the Chrome trace-event format.
+ */
+double
+ToMicros (const std::chrono::nanoseconds d)
+{
+  return std::chrono::duration<double, std::micro> (d).count ();
+}
+
+/**
+ * Converts a per-table map of counts to JSON.
+ */
+Json::Value
+TableCountsToJson (const TableCounts& counts)
+{
+  Json::Value res(Json::objectValue);
+  for (const auto& entry : counts)
+    res[entry.first] = IntToJson (entry.second);
+  return res;
+}
+
+/**
+ * Converts a set of PerfCounters to JSON.
+ */
+Json::Value
+CountersToJson (const PerfCounters& counters)
+{
+  Json::Value res(Json::objectValue);
+  res["prepared"] = IntToJson (counters.statementsPrepared);
+  res["steps"] = IntToJson (counters.statementsStepped);
+  res["protosparsed"] = IntToJson (counters.protosParsed);
+  res["protosserialised"] = IntToJson (counters.protosSerialised);
+  res["rowsread"] = TableCountsToJson (counters.rowsRead);
+  res["rowswritten"] = TableCountsToJson (counters.rowsWritten);
+  return res;
+}
+
+} // anonymous namespace
+
+/* ************************************************************************** */
+
+BlockPerfStats::BlockPerfStats (const unsigned h, const std::string& hsh)
+  : height(h), hash(hsh)
+{}
+
+void
+BlockPerfStats::StartPhase (const std::string& name)
+{
+  EndPhase ();
+
+  CHECK (!name.empty ());
+  currentPhase = name;
+  phaseCounters = PerfCounters::ForThread ();
+  phaseStart = Clock::now ();
+}
+
+void
+BlockPerfStats::EndPhase ()
+{
+  if (currentPhase.empty ())
+    return;
+
+  const auto now = Clock::now ();
+
+  auto* trace = TraceCollector::ForThread ();
+  if (trace != nullptr)
+    {
+      TraceEvent ev;
+      ev.name = currentPhase;
+      trace->Add (std::move (ev), phaseStart, now);
+    }
+
+  PhasePerfStats phase;
+  phase.duration = now - phaseStart;
+  phase.name = std::move (currentPhase);
+  phase.counters = PerfCounters::ForThread ().Since (phaseCounters);
+
+  VLOG (1)
+      << "Phase " << phase.name << " of block " << height
+      << " took " << ToMillis (phase.duration) << " ms";
+
+  phases.push_back (std::move (phase));
+  currentPhase.clear ();
+}
+
+std::chrono::nanoseconds
+BlockPerfStats::GetTotalDuration () const
+{
+  std::chrono::nanoseconds res(0);
+  for (const auto& p : phases)
+    res += p.duration;
+  return res;
+}
+
+Json::Value
+BlockPerfStats::ToJson () const
+{
+  Json::Value res(Json::objectValue);
+  res["height"] = IntToJson (height);
+  res["hash"] = hash;
+  res["ms"] = ToMillis (GetTotalDuration ());
+
+  Json::Value phasesJson(Json::arrayValue);
+  for (const auto& p : phases)
+    {
+      Json::Value cur(Json::objectValue);
+      cur["name"] = p.name;
+      cur["ms"] = ToMillis (p.duration);
+      cur["counters"] = CountersToJson (p.counters);
+      phasesJson.append (cur);
+    }
+  res["phases"] = phasesJson;
+
+  return res;
+}
+
+/* ************************************************************************** */
+
+PerfStatsRecorder::PerfStatsRecorder (const size_t cap)
+  : capacity(cap)
+{
+  CHECK_GT (capacity, 0);
+}
+
+void
+PerfStatsRecorder::Add (BlockPerfStats&& stats)
+{
+  std::lock_guard<std::mutex> lock(mut);
+
+  for (const auto& p : stats.GetPhases ())
+    {
+      auto& t = totals[p.name];
+      ++t.count;
+      t.duration += p.duration;
+      t.counters.Add (p.counters);
+    }
+  ++numBlocks;
+
+  blocks.push_back (std::move (stats));
+  while (blocks.size () > capacity)
+    blocks.pop_front ();
+}
+
+Json::Value
+PerfStatsRecorder::ToJson () const
+{
+  std::lock_guard<std::mutex> lock(mut);
+
+  Json::Value blocksJson(Json::arrayValue);
+  for (const auto& b : blocks)
+    blocksJson.append (b.ToJson ());
+
+  Json::Value phasesJson(Json::objectValue);
+  for (const auto& entry : totals)
+    {
+      Json::Value cur(Json::objectValue);
+      cur["count"] = IntToJson (entry.second.count);
+      cur["ms"] = ToMillis (entry.second.duration);
+      cur["counters"] = CountersToJson (entry.second.counters);
+      phasesJson[entry.first] = cur;
+    }
+
+  Json::Value totalsJson(Json::objectValue);
+  totalsJson["blocks"] = IntToJson (numBlocks);
+  totalsJson["phases"] = phasesJson;
+
+  Json::Value res(Json::objectValue);
+  res["blocks"] = blocksJson;
+  res["totals"] = totalsJson;
+
+  return res;
+}
+
+std::string
+PerfStatsRecorder::ToPrometheus () const
+{
+  std::lock_guard<std::mutex> lock(mut);
+
+  std::ostringstream out;
+
+  const auto header = [&out] (const std::string& name, const std::string& help)
+    {
+      out << "# HELP " << name << " " << help << "\n"
+          << "# TYPE " << name << " counter\n";
+    };
+
+  /* Outputs a counter with one value per phase, extracted
+     from the totals through the given function.  */
+  const auto perPhase = [&] (const std::string& name, const std::string& help,
+                             const auto& extract)
+    {
+      header (name, help);
+      for (const auto& entry : totals)
+        out << name << "{phase=\"" << entry.first << "\"} "
+            << extract (entry.second) << "\n";
+    };
+
+  /* Outputs a counter with one value per phase and table.  */
+  const auto perTable = [&] (const std::string& name, const std::string& help,
+                             const auto& extract)
+    {
+      header (name, help);
+      for (const auto& entry : totals)
+        for (const auto& table : extract (entry.second.counters))
+          out << name
+              << "{phase=\"" << entry.first << "\","
+              << "table=\"" << table.first << "\"} "
+              << table.second << "\n";
+    };
+
+  header ("taurion_blocks_total", "Number of blocks processed");
+  out << "taurion_blocks_total " << numBlocks << "\n";
+
+  perPhase ("taurion_phase_seconds_total",
+            "Time spent in block-processing phases",
+            [] (const PhaseTotals& t)
+              {
+                return std::chrono::duration<double> (t.duration).count ();
+              });
+  perPhase ("taurion_sql_prepared_total", "SQL statements prepared",
+            [] (const PhaseTotals& t)
+              {
+                return t.counters.statementsPrepared;
+              });
+  perPhase ("taurion_sql_steps_total", "SQL statement steps",
+            [] (const PhaseTotals& t)
+              {
+                return t.counters.statementsStepped;
+              });
+  perPhase ("taurion_protos_parsed_total", "Protos parsed",
+            [] (const PhaseTotals& t)
+              {
+                return t.counters.protosParsed;
+              });
+  perPhase ("taurion_protos_serialised_total", "Protos serialised",
+            [] (const PhaseTotals& t)
+              {
+                return t.counters.protosSerialised;
+              });
+
+  perTable ("taurion_rows_read_total", "Database rows read",
+            [] (const PerfCounters& c) -> const TableCounts&
+              {
+                return c.rowsRead;
+              });
+  perTable ("taurion_rows_written_total", "Database rows written",
+            [] (const PerfCounters& c) -> const TableCounts&
+              {
+                return c.rowsWritten;
+              });
+
+  return out.str ();
+}
+
+/* ************************************************************************** */
+
+Json::Value
+TraceToJson (const TraceCollector& trace)
+{
+  Json::Value events(Json::arrayValue);
+  for (const auto& ev : trace.GetEvents ())
+    {
+      Json::Value cur(Json::objectValue);
+      cur["name"] = ev.name;
+      cur["cat"] = "taurion";
+      cur["ph"] = "X";
+      cur["pid"] = 1;
+      cur["tid"] = ev.thread;
+      cur["ts"] = ToMicros (ev.start);
+      cur["dur"] = ToMicros (ev.duration);
+
+      Json::Value args(Json::objectValue);
+      if (ev.hasId)
+        args["id"] = IntToJson (ev.id);
+      if (!ev.detail.empty ())
+        args["detail"] = ev.detail;
+      if (!args.empty ())
+        cur["args"] = args;
+
+      events.append (cur);
+    }
+
+  Json::Value other(Json::objectValue);
+  other["dropped"] = IntToJson (trace.GetDropped ());
+
+  Json::Value res(Json::objectValue);
+  res["traceEvents"] = events;
+  res["displayTimeUnit"] = "ms";
+  res["otherData"] = other;
+
+  return res;
+}
+
+/* ************************************************************************** */
+
+} // namespace pxd
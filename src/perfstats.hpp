@@ -0,0 +1,215 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PXD_PERFSTATS_HPP
+#define PXD_PERFSTATS_HPP
+
+#include "database/perfcounters.hpp"
+#include "database/tracing.hpp"
+
+#include <json/json.h>
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pxd
+{
+
+/**
+ * Performance data for one processing phase of a block.
+ */
+struct PhasePerfStats
+{
+
+  /** The name of the phase.  */
+  std::string name;
+
+  /** Wall-clock time the phase took.  */
+  std::chrono::nanoseconds duration;
+
+  /** Database and proto work done during the phase.  */
+  PerfCounters counters;
+
+};
+
+/**
+ * Performance data recorded while processing a single block.  The block
+ * processing marks the start of each phase, and this class measures
+ * the time and PerfCounters (of the current thread) between them.
+ * If a trace is active on the thread, each phase is also recorded
+ * as a span into it.
+ */
+class BlockPerfStats
+{
+
+private:
+
+  using Clock = std::chrono::steady_clock;
+
+  /** The block's height.  */
+  unsigned height;
+
+  /** The block's hash as hex string.  */
+  std::string hash;
+
+  /** Data for all finished phases, in order.  */
+  std::vector<PhasePerfStats> phases;
+
+  /** The name of the currently running phase, if any.  */
+  std::string currentPhase;
+
+  /** Start time of the current phase.  */
+  Clock::time_point phaseStart;
+
+  /** Snapshot of the thread's counters at the start of the current phase.  */
+  PerfCounters phaseCounters;
+
+public:
+
+  explicit BlockPerfStats (unsigned h, const std::string& hsh);
+
+  BlockPerfStats (BlockPerfStats&&) = default;
+  BlockPerfStats& operator= (BlockPerfStats&&) = default;
+
+  BlockPerfStats (const BlockPerfStats&) = delete;
+  void operator= (const BlockPerfStats&) = delete;
+
+  /**
+   * Starts a new phase with the given name, ending the current one
+   * (if there is one).
+   */
+  void StartPhase (const std::string& name);
+
+  /**
+   * Ends the currently running phase, if any.
+   */
+  void EndPhase ();
+
+  unsigned
+  GetHeight () const
+  {
+    return height;
+  }
+
+  const std::string&
+  GetHash () const
+  {
+    return hash;
+  }
+
+  const std::vector<PhasePerfStats>&
+  GetPhases () const
+  {
+    return phases;
+  }
+
+  /**
+   * Returns the total duration of all (finished) phases.
+   */
+  std::chrono::nanoseconds GetTotalDuration () const;
+
+  /**
+   * Returns the JSON representation of the data.
+   */
+  Json::Value ToJson () const;
+
+};
+
+/**
+ * Collection of performance data for the most recently processed blocks
+ * (in a ring buffer), together with cumulative totals per phase since the
+ * process started.  The data is accessed from the block-processing thread
+ * as well as RPC / REST handlers, and thus protected by a lock.
+ */
+class PerfStatsRecorder
+{
+
+private:
+
+  /**
+   * Cumulative data for one phase.
+   */
+  struct PhaseTotals
+  {
+
+    /** Number of times the phase was run.  */
+    uint64_t count = 0;
+
+    /** Total time spent in the phase.  */
+    std::chrono::nanoseconds duration{0};
+
+    /** Total database work done in the phase.  */
+    PerfCounters counters;
+
+  };
+
+  /** Maximum number of blocks kept.  */
+  const size_t capacity;
+
+  /** Lock for the data.  */
+  mutable std::mutex mut;
+
+  /** The most recent blocks, oldest first.  */
+  std::deque<BlockPerfStats> blocks;
+
+  /** Number of blocks recorded in total.  */
+  uint64_t numBlocks = 0;
+
+  /** Cumulative data by phase name.  */
+  std::map<std::string, PhaseTotals> totals;
+
+public:
+
+  explicit PerfStatsRecorder (size_t cap);
+
+  PerfStatsRecorder () = delete;
+  PerfStatsRecorder (const PerfStatsRecorder&) = delete;
+  void operator= (const PerfStatsRecorder&) = delete;
+
+  /**
+   * Adds the data for a newly processed block.  The oldest block is
+   * dropped if the buffer is full.
+   */
+  void Add (BlockPerfStats&& stats);
+
+  /**
+   * Returns the JSON representation of all the data, as returned by
+   * the getperfstats RPC method.
+   */
+  Json::Value ToJson () const;
+
+  /**
+   * Returns the cumulative totals in the Prometheus text exposition format.
+   */
+  std::string ToPrometheus () const;
+
+};
+
+/**
+ * Converts the events of a trace to JSON in the Chrome trace-event format,
+ * which can be loaded into chrome://tracing or Perfetto.
+ */
+Json::Value TraceToJson (const TraceCollector& trace);
+
+} // namespace pxd
+
+#endif // PXD_PERFSTATS_HPP
@@ -0,0 +1,220 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "perfstats.hpp"
+
+#include <gtest/gtest.h>
+
+#include <glog/logging.h>
+
+namespace pxd
+{
+namespace
+{
+
+/* ************************************************************************** */
+
+using BlockPerfStatsTests = testing::Test;
+
+TEST_F (BlockPerfStatsTests, Phases)
+{
+  BlockPerfStats perf(10, "hash");
+  perf.StartPhase ("foo");
+  PerfCounters::ForThread ().statementsPrepared += 2;
+  PerfCounters::ForThread ().rowsRead["table"] += 5;
+  perf.StartPhase ("bar");
+  PerfCounters::ForThread ().protosParsed += 3;
+  perf.EndPhase ();
+  PerfCounters::ForThread ().protosParsed += 100;
+  perf.EndPhase ();
+
+  EXPECT_EQ (perf.GetHeight (), 10);
+  const auto& phases = perf.GetPhases ();
+  ASSERT_EQ (phases.size (), 2);
+
+  EXPECT_EQ (phases[0].name, "foo");
+  EXPECT_EQ (phases[0].counters.statementsPrepared, 2);
+  EXPECT_EQ (phases[0].counters.protosParsed, 0);
+  EXPECT_EQ (phases[0].counters.rowsRead.at ("table"), 5);
+
+  EXPECT_EQ (phases[1].name, "bar");
+  EXPECT_EQ (phases[1].counters.statementsPrepared, 0);
+  EXPECT_EQ (phases[1].counters.protosParsed, 3);
+  EXPECT_TRUE (phases[1].counters.rowsRead.empty ());
+
+  EXPECT_EQ (perf.GetTotalDuration (),
+             phases[0].duration + phases[1].duration);
+}
+
+TEST_F (BlockPerfStatsTests, ToJson)
+{
+  BlockPerfStats perf(42, "abc");
+  perf.StartPhase ("foo");
+  PerfCounters::ForThread ().rowsWritten["table"] += 7;
+  perf.EndPhase ();
+
+  const Json::Value val = perf.ToJson ();
+  EXPECT_EQ (val["height"].asInt (), 42);
+  EXPECT_EQ (val["hash"].asString (), "abc");
+  ASSERT_TRUE (val["ms"].isDouble ());
+
+  const auto& phases = val["phases"];
+  ASSERT_TRUE (phases.isArray ());
+  ASSERT_EQ (phases.size (), 1);
+  EXPECT_EQ (phases[0]["name"].asString (), "foo");
+  EXPECT_EQ (phases[0]["counters"]["rowswritten"]["table"].asInt (), 7);
+  EXPECT_EQ (phases[0]["counters"]["rowsread"].size (), 0);
+}
+
+/* ************************************************************************** */
+
+class PerfStatsRecorderTests : public testing::Test
+{
+
+protected:
+
+  /**
+   * Constructs a block with one phase per given name.  Each phase
+   * prepares one statement.
+   */
+  static BlockPerfStats
+  MakeBlock (const unsigned height, const std::vector<std::string>& phases)
+  {
+    BlockPerfStats res(height, "hash");
+    for (const auto& p : phases)
+      {
+        res.StartPhase (p);
+        ++PerfCounters::ForThread ().statementsPrepared;
+        ++PerfCounters::ForThread ().rowsRead["table"];
+      }
+    res.EndPhase ();
+
+    return res;
+  }
+
+};
+
+TEST_F (PerfStatsRecorderTests, RingBuffer)
+{
+  PerfStatsRecorder rec(2);
+  rec.Add (MakeBlock (1, {"foo"}));
+  rec.Add (MakeBlock (2, {"foo"}));
+  rec.Add (MakeBlock (3, {"foo"}));
+
+  const Json::Value val = rec.ToJson ();
+  const auto& blocks = val["blocks"];
+  ASSERT_EQ (blocks.size (), 2);
+  EXPECT_EQ (blocks[0]["height"].asInt (), 2);
+  EXPECT_EQ (blocks[1]["height"].asInt (), 3);
+  EXPECT_EQ (val["totals"]["blocks"].asInt (), 3);
+}
+
+TEST_F (PerfStatsRecorderTests, Totals)
+{
+  PerfStatsRecorder rec(10);
+  rec.Add (MakeBlock (1, {"foo", "bar"}));
+  rec.Add (MakeBlock (2, {"foo"}));
+
+  const Json::Value val = rec.ToJson ();
+  const auto& phases = val["totals"]["phases"];
+  ASSERT_EQ (phases.size (), 2);
+  EXPECT_EQ (phases["foo"]["count"].asInt (), 2);
+  EXPECT_EQ (phases["foo"]["counters"]["prepared"].asInt (), 2);
+  EXPECT_EQ (phases["foo"]["counters"]["rowsread"]["table"].asInt (), 2);
+  EXPECT_EQ (phases["bar"]["count"].asInt (), 1);
+  EXPECT_EQ (phases["bar"]["counters"]["prepared"].asInt (), 1);
+}
+
+TEST_F (PerfStatsRecorderTests, Prometheus)
+{
+  PerfStatsRecorder rec(10);
+  rec.Add (MakeBlock (1, {"foo"}));
+  rec.Add (MakeBlock (2, {"foo"}));
+
+  const std::string out = rec.ToPrometheus ();
+  EXPECT_NE (out.find ("# TYPE taurion_blocks_total counter\n"),
+             std::string::npos);
+  EXPECT_NE (out.find ("\ntaurion_blocks_total 2\n"), std::string::npos);
+  EXPECT_NE (out.find ("\ntaurion_sql_prepared_total{phase=\"foo\"} 2\n"),
+             std::string::npos);
+  EXPECT_NE (out.find ("\ntaurion_rows_read_total{phase=\"foo\","
+                       "table=\"table\"} 2\n"),
+             std::string::npos);
+}
+
+/* ************************************************************************** */
+
+using TraceToJsonTests = testing::Test;
+
+TEST_F (TraceToJsonTests, PhasesAndSpans)
+{
+  TraceCollector trace;
+
+  {
+    TraceActivation act(&trace);
+    BlockPerfStats perf(10, "hash");
+    perf.StartPhase ("foo");
+    {
+      TraceSpan span("inner", 42);
+    }
+    {
+      TraceSpan span("detail", std::string ("domob"));
+    }
+    perf.EndPhase ();
+  }
+
+  const Json::Value val = TraceToJson (trace);
+  EXPECT_EQ (val["displayTimeUnit"].asString (), "ms");
+  EXPECT_EQ (val["otherData"]["dropped"].asInt (), 0);
+
+  const auto& events = val["traceEvents"];
+  ASSERT_TRUE (events.isArray ());
+  ASSERT_EQ (events.size (), 3);
+
+  EXPECT_EQ (events[0]["name"].asString (), "inner");
+  EXPECT_EQ (events[0]["ph"].asString (), "X");
+  EXPECT_EQ (events[0]["args"]["id"].asInt (), 42);
+  EXPECT_EQ (events[1]["name"].asString (), "detail");
+  EXPECT_EQ (events[1]["args"]["detail"].asString (), "domob");
+
+  const auto& phase = events[2];
+  EXPECT_EQ (phase["name"].asString (), "foo");
+  EXPECT_FALSE (phase.isMember ("args"));
+  EXPECT_EQ (phase["tid"], events[0]["tid"]);
+  ASSERT_TRUE (phase["ts"].isDouble ());
+  ASSERT_TRUE (phase["dur"].isDouble ());
+  EXPECT_LE (phase["ts"].asDouble (), events[0]["ts"].asDouble ());
+  EXPECT_GE (phase["ts"].asDouble () + phase["dur"].asDouble (),
+             events[1]["ts"].asDouble () + events[1]["dur"].asDouble ());
+}
+
+TEST_F (TraceToJsonTests, NoTraceWithoutActivation)
+{
+  TraceCollector trace;
+
+  BlockPerfStats perf(10, "hash");
+  perf.StartPhase ("foo");
+  perf.EndPhase ();
+
+  EXPECT_EQ (TraceToJson (trace)["traceEvents"].size (), 0);
+}
+
+/* ************************************************************************** */
+
+} // anonymous namespace
+} // namespace pxd
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -27,6 +27,7 @@
 #include "version.hpp"
 
 #include "database/itemcounts.hpp"
+#include "database/tracing.hpp"
 #include "proto/roconfig.hpp"
 
 #include <xayagame/gamerpcserver.hpp>
@@ -48,6 +49,9 @@ namespace
 /** Maximum number of past blocks for which getregions can be called.  */
 constexpr int MAX_REGIONS_HEIGHT_DIFFERENCE = 2 * 60 * 24 * 3;
 
+/** Maximum number of blocks that can be traced with one traceblocks call.  */
+constexpr int MAX_TRACED_BLOCKS = 100;
+
 /**
  * Error codes returned from the PX RPC server.  All values should have an
  * explicit integer number, because this also defines the RPC protocol
@@ -74,6 +78,12 @@ enum class ErrorCode
   /* Specific errors with getregions.  */
   GETREGIONS_FROM_TOO_LOW = 3,
 
+  /* Tracing has been requested but is not available.  */
+  TRACING_UNAVAILABLE = 5,
+
+  /* Specific errors with getchangessince.  */
+  GETCHANGES_FROM_TOO_LOW = 6,
+
 };
 
 /**
@@ -103,6 +113,24 @@ CheckIntBounds (const std::string& name, const int value,
   ReturnError (ErrorCode::INVALID_ARGUMENT, msg.str ());
 }
 
+/**
+ * Parses and validates the centre and L1 range arguments of the
+ * area-query RPCs, returning INVALID_ARGUMENT errors if they are invalid.
+ */
+HexCoord
+ParseAreaArguments (const Json::Value& centre, const int l1range)
+{
+  HexCoord c;
+  if (!CoordFromJson (centre, c))
+    ReturnError (ErrorCode::INVALID_ARGUMENT,
+                 "centre is not a valid coordinate");
+
+  const int maxInt = std::numeric_limits<HexCoord::IntT>::max ();
+  CheckIntBounds ("l1range", l1range, 0, maxInt);
+
+  return c;
+}
+
 } // anonymous namespace
 
 /* ************************************************************************** */
@@ -159,14 +187,11 @@ NonStateRpcServer::AddBuildingsFromJson (const Json::Value& buildings,
         return false;
 
       std::vector<HexCoord> shape;
-      if (!dyn.obstacles.AddBuilding (type, trafo, centre, shape))
+      if (!dyn.obstacles.AddBuilding (id, type, trafo, centre, shape))
         {
           LOG (WARNING) << "Adding the building failed\n" << b;
           return false;
         }
-
-      for (const auto& tile : shape)
-        CHECK (dyn.buildingIds.emplace (tile, id).second);
     }
 
   return true;
@@ -204,6 +229,7 @@ NonStateRpcServer::setpathdata (const Json::Value& buildings,
                                 const Json::Value& characters)
 {
   LOG (INFO) << "RPC method called: setpathdata";
+  PXD_TRACE_SHARED_SPAN ("NonStateRpcServer::setpathdata");
   VLOG (1) << "  Buildings data:\n" << buildings;
   VLOG (1) << "  Character data:\n" << characters;
 
@@ -242,6 +268,7 @@ NonStateRpcServer::findpath (const Json::Value& exbuildings,
       << "  source=" << source << ",\n"
       << "  target=" << target << ",\n"
       << "  exbuildings=" << exbuildings;
+  PXD_TRACE_SHARED_SPAN ("NonStateRpcServer::findpath");
 
   HexCoord sourceCoord;
   if (!CoordFromJson (source, sourceCoord))
@@ -305,9 +332,8 @@ NonStateRpcServer::findpath (const Json::Value& exbuildings,
          of the buildings we want to ignore or not.  */
       if (dynCopy->obstacles.IsBuilding (to))
         {
-          const auto mitTiles = dynCopy->buildingIds.find (to);
-          if (mitTiles == dynCopy->buildingIds.end ()
-                || exBuildingIds.count (mitTiles->second) == 0)
+          const auto id = dynCopy->obstacles.GetBuildingId (to);
+          if (exBuildingIds.count (id) == 0)
             return PathFinder::NO_CONNECTION;
         }
 
@@ -316,8 +342,11 @@ NonStateRpcServer::findpath (const Json::Value& exbuildings,
 
       return base;
     };
-  const PathFinder::DistanceT dist = finder.Compute (edges, sourceCoord,
-                                                     l1range);
+  PathFinder::DistanceT dist;
+  {
+    PXD_TRACE_SPAN ("PathFinder::Compute");
+    dist = finder.Compute (edges, sourceCoord, l1range);
+  }
 
   if (dist == PathFinder::NO_CONNECTION)
     ReturnError (ErrorCode::FINDPATH_NO_CONNECTION,
@@ -362,6 +391,7 @@ std::string
 NonStateRpcServer::encodewaypoints (const Json::Value& wp)
 {
   LOG (INFO) << "RPC method called: encodewaypoints\n" << wp;
+  PXD_TRACE_SHARED_SPAN ("NonStateRpcServer::encodewaypoints");
 
   CHECK (wp.isArray ());
 
@@ -383,12 +413,33 @@ NonStateRpcServer::encodewaypoints (const Json::Value& wp)
   return encoded;
 }
 
+std::string
+NonStateRpcServer::encodewaypointscompact (const Json::Value& wp)
+{
+  LOG (INFO) << "RPC method called: encodewaypointscompact\n" << wp;
+  PXD_TRACE_SHARED_SPAN ("NonStateRpcServer::encodewaypointscompact");
+
+  CHECK (wp.isArray ());
+
+  std::vector<HexCoord> wpArr;
+  for (const auto& entry : wp)
+    {
+      HexCoord c;
+      if (!CoordFromJson (entry, c))
+        ReturnError (ErrorCode::INVALID_ARGUMENT, "invalid waypoints");
+      wpArr.push_back (c);
+    }
+
+  return EncodeWaypointsCompact (wpArr);
+}
+
 Json::Value
 NonStateRpcServer::getregionat (const Json::Value& coord)
 {
   LOG (INFO)
       << "RPC method called: getregionat\n"
       << "  coord=" << coord;
+  PXD_TRACE_SHARED_SPAN ("NonStateRpcServer::getregionat");
 
   HexCoord c;
   if (!CoordFromJson (coord, c))
@@ -421,6 +472,7 @@ NonStateRpcServer::getbuildingshape (const Json::Value& centre, const int rot,
       << "RPC method called: getbuildingshape " << type << "\n"
       << "  centre=" << centre << "\n"
       << "  rot=" << rot;
+  PXD_TRACE_SHARED_SPAN ("NonStateRpcServer::getbuildingshape");
 
   HexCoord c;
   if (!CoordFromJson (centre, c))
@@ -469,13 +521,15 @@ Json::Value
 PXRpcServer::getcurrentstate ()
 {
   LOG (INFO) << "RPC method called: getcurrentstate";
-  return game.GetCurrentJsonState ();
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getcurrentstate");
+  return logic.GetCurrentJsonState (game);
 }
 
 Json::Value
 PXRpcServer::getnullstate ()
 {
   LOG (INFO) << "RPC method called: getnullstate";
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getnullstate");
   return game.GetNullJsonState ();
 }
 
@@ -483,6 +537,7 @@ Json::Value
 PXRpcServer::getpendingstate ()
 {
   LOG (INFO) << "RPC method called: getpendingstate";
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getpendingstate");
   return game.GetPendingJsonState ();
 }
 
@@ -504,6 +559,7 @@ Json::Value
 PXRpcServer::getaccounts ()
 {
   LOG (INFO) << "RPC method called: getaccounts";
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getaccounts");
   return logic.GetCustomStateData (game,
     [] (GameStateJson& gsj)
       {
@@ -515,6 +571,7 @@ Json::Value
 PXRpcServer::getbuildings ()
 {
   LOG (INFO) << "RPC method called: getbuildings";
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getbuildings");
   return logic.GetCustomStateData (game,
     [] (GameStateJson& gsj)
       {
@@ -526,6 +583,7 @@ Json::Value
 PXRpcServer::getcharacters ()
 {
   LOG (INFO) << "RPC method called: getcharacters";
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getcharacters");
   return logic.GetCustomStateData (game,
     [] (GameStateJson& gsj)
       {
@@ -533,10 +591,45 @@ PXRpcServer::getcharacters ()
       });
 }
 
+Json::Value
+PXRpcServer::getbuildingsinarea (const Json::Value& centre, const int l1range,
+                                 const std::string& owner)
+{
+  LOG (INFO)
+      << "RPC method called: getbuildingsinarea " << l1range
+      << " " << owner << "\n" << centre;
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getbuildingsinarea");
+
+  const HexCoord c = ParseAreaArguments (centre, l1range);
+  return logic.GetCustomStateData (game,
+    [&c, l1range, &owner] (GameStateJson& gsj)
+      {
+        return gsj.BuildingsInArea (c, l1range, owner);
+      });
+}
+
+Json::Value
+PXRpcServer::getcharactersinarea (const Json::Value& centre, const int l1range,
+                                  const std::string& owner)
+{
+  LOG (INFO)
+      << "RPC method called: getcharactersinarea " << l1range
+      << " " << owner << "\n" << centre;
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getcharactersinarea");
+
+  const HexCoord c = ParseAreaArguments (centre, l1range);
+  return logic.GetCustomStateData (game,
+    [&c, l1range, &owner] (GameStateJson& gsj)
+      {
+        return gsj.CharactersInArea (c, l1range, owner);
+      });
+}
+
 Json::Value
 PXRpcServer::getgroundloot ()
 {
   LOG (INFO) << "RPC method called: getgroundloot";
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getgroundloot");
   return logic.GetCustomStateData (game,
     [] (GameStateJson& gsj)
       {
@@ -548,6 +641,7 @@ Json::Value
 PXRpcServer::getongoings ()
 {
   LOG (INFO) << "RPC method called: getongoings";
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getongoings");
   return logic.GetCustomStateData (game,
     [] (GameStateJson& gsj)
       {
@@ -559,6 +653,7 @@ Json::Value
 PXRpcServer::getregions (const int fromHeight)
 {
   LOG (INFO) << "RPC method called: getregions " << fromHeight;
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getregions");
 
   return logic.GetCustomStateData (game,
     [fromHeight] (GameStateJson& gsj, const xaya::uint256 hash,
@@ -578,10 +673,49 @@ PXRpcServer::getregions (const int fromHeight)
       });
 }
 
+Json::Value
+PXRpcServer::getchangessince (const int fromHeight)
+{
+  LOG (INFO) << "RPC method called: getchangessince " << fromHeight;
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getchangessince");
+  CheckIntBounds ("fromheight", fromHeight, 0,
+                  std::numeric_limits<int>::max ());
+
+  return logic.GetCustomStateData (game,
+    [fromHeight] (GameStateJson& gsj, const xaya::uint256 hash,
+                  const int height)
+      {
+        const int window = PXLogic::GetChangesWindow ();
+        if (fromHeight + window < height)
+          {
+            std::ostringstream msg;
+            msg << "fromHeight " << fromHeight
+                << " is too low for current block height " << height
+                << ", needs to be at least " << height - window;
+            ReturnError (ErrorCode::GETCHANGES_FROM_TOO_LOW, msg.str ());
+          }
+
+        return gsj.ChangesSince (fromHeight);
+      });
+}
+
+Json::Value
+PXRpcServer::getstatehash ()
+{
+  LOG (INFO) << "RPC method called: getstatehash";
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getstatehash");
+  return logic.GetCustomStateData (game,
+    [] (GameStateJson& gsj)
+      {
+        return gsj.StateHash ();
+      });
+}
+
 Json::Value
 PXRpcServer::getmoneysupply ()
 {
   LOG (INFO) << "RPC method called: getmoneysupply";
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getmoneysupply");
   return logic.GetCustomStateData (game,
     [] (GameStateJson& gsj)
       {
@@ -593,6 +727,7 @@ Json::Value
 PXRpcServer::getprizestats ()
 {
   LOG (INFO) << "RPC method called: getprizestats";
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getprizestats");
   return logic.GetCustomStateData (game,
     [] (GameStateJson& gsj)
       {
@@ -606,6 +741,7 @@ PXRpcServer::gettradehistory (const int building, const std::string& item)
   LOG (INFO)
       << "RPC method called: gettradehistory "
       << item << " " << building;
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::gettradehistory");
   return logic.GetCustomStateData (game,
     [building, &item] (GameStateJson& gsj)
       {
@@ -617,6 +753,7 @@ Json::Value
 PXRpcServer::getbootstrapdata ()
 {
   LOG (INFO) << "RPC method called: getbootstrapdata";
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getbootstrapdata");
   return logic.GetCustomStateData (game,
     [] (GameStateJson& gsj)
       {
@@ -624,10 +761,31 @@ PXRpcServer::getbootstrapdata ()
       });
 }
 
+Json::Value
+PXRpcServer::getperfstats ()
+{
+  LOG (INFO) << "RPC method called: getperfstats";
+  return logic.GetPerfStats ().ToJson ();
+}
+
+bool
+PXRpcServer::traceblocks (const int count)
+{
+  LOG (INFO) << "RPC method called: traceblocks " << count;
+  CheckIntBounds ("count", count, 1, MAX_TRACED_BLOCKS);
+
+  if (!logic.TraceNextBlocks (count))
+    ReturnError (ErrorCode::TRACING_UNAVAILABLE,
+                 "tracing is not enabled on this node");
+
+  return true;
+}
+
 Json::Value
 PXRpcServer::getserviceinfo (const std::string& name, const Json::Value& op)
 {
   LOG (INFO) << "RPC method called: getserviceinfo " << name << "\n" << op;
+  PXD_TRACE_SHARED_SPAN ("PXRpcServer::getserviceinfo");
   return logic.GetCustomStateData (game,
     [&] (Database& db, const xaya::uint256& hash, const unsigned height)
     {
@@ -1,6 +1,6 @@
 /*
     GSP for the Taurion blockchain game
-    Copyright (C) 2019-2020  Autonomous Worlds Ltd
+    Copyright (C) 2019-2021  Autonomous Worlds Ltd
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -88,15 +88,13 @@ private:
   struct PathingData
   {
 
-    /** DynObstacles instance with all those buildings and characters added.  */
-    DynObstacles obstacles;
-
     /**
-     * Map from coordinate to the corresponding building ID.  We use that
-     * to selectively exclude buildings by ID from the obstacle map, e.g.
-     * when pathing "to" a building to enter it.
+     * DynObstacles instance with all those buildings and characters added.
+     * Its footprint index of building IDs is used to selectively exclude
+     * buildings from the obstacle map, e.g. when pathing "to" a building
+     * to enter it.
      */
-    std::unordered_map<HexCoord, Database::IdT> buildingIds;
+    DynObstacles obstacles;
 
     explicit PathingData (const xaya::Chain c)
       : obstacles(c)
@@ -155,6 +153,7 @@ public:
                         int l1range, const Json::Value& source,
                         const Json::Value& target) override;
   std::string encodewaypoints (const Json::Value& wp) override;
+  std::string encodewaypointscompact (const Json::Value& wp) override;
   Json::Value getregionat (const Json::Value& coord) override;
   Json::Value getbuildingshape (const Json::Value& centre, int rot,
                                 const std::string& type) override;
@@ -202,14 +201,22 @@ public:
   Json::Value getaccounts () override;
   Json::Value getbuildings () override;
   Json::Value getcharacters () override;
+  Json::Value getbuildingsinarea (const Json::Value& centre, int l1range,
+                                  const std::string& owner) override;
+  Json::Value getcharactersinarea (const Json::Value& centre, int l1range,
+                                   const std::string& owner) override;
   Json::Value getgroundloot () override;
   Json::Value getongoings () override;
   Json::Value getregions (int fromHeight) override;
+  Json::Value getchangessince (int fromHeight) override;
+  Json::Value getstatehash () override;
   Json::Value getmoneysupply () override;
   Json::Value getprizestats () override;
   Json::Value gettradehistory (int building, const std::string& item) override;
 
   Json::Value getbootstrapdata () override;
+  Json::Value getperfstats () override;
+  bool traceblocks (int count) override;
 
   Json::Value getserviceinfo (const std::string& name,
                               const Json::Value& op) override;
@@ -235,6 +242,12 @@ public:
     return nonstate.encodewaypoints (wp);
   }
 
+  std::string
+  encodewaypointscompact (const Json::Value& wp) override
+  {
+    return nonstate.encodewaypointscompact (wp);
+  }
+
   Json::Value
   getregionat (const Json::Value& coord) override
   {
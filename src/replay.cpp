@@ -0,0 +1,230 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "replay.hpp"
+
+#include "logic.hpp"
+#include "ongoings.hpp"
+
+#include "database/schema.hpp"
+
+#include <xayautil/hash.hpp>
+#include <xayautil/random.hpp>
+#include <xayautil/uint256.hpp>
+
+#include <glog/logging.h>
+
+#include <sqlite3.h>
+
+namespace pxd
+{
+
+/* ************************************************************************** */
+
+ReplayDatabase::ReplayDatabase (const std::string& file)
+  : db("replay", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE
+                  | SQLITE_OPEN_MEMORY)
+{
+  LOG (INFO) << "Loading game state from " << file << " into memory...";
+
+  sqlite3* source;
+  const int rc = sqlite3_open_v2 (file.c_str (), &source,
+                                  SQLITE_OPEN_READONLY, nullptr);
+  CHECK_EQ (rc, SQLITE_OK)
+      << "Failed to open " << file << ": " << sqlite3_errmsg (source);
+
+  sqlite3_backup* backup = sqlite3_backup_init (*db, "main", source, "main");
+  CHECK (backup != nullptr)
+      << "Failed to copy database: " << sqlite3_errmsg (*db);
+  CHECK_EQ (sqlite3_backup_step (backup, -1), SQLITE_DONE);
+  CHECK_EQ (sqlite3_backup_finish (backup), SQLITE_OK);
+  CHECK_EQ (sqlite3_close (source), SQLITE_OK);
+
+  SetDatabase (db);
+
+  /* This runs migrations and sets up the incremental state hash on our
+     connection, as tauriond would do when starting on the database.  */
+  SetupDatabaseSchema (db);
+
+  nextId = ReadNextId ("pxd");
+  nextLogId = ReadNextId ("log");
+  LOG (INFO)
+      << "Next IDs: " << nextId << " (pxd), " << nextLogId << " (log)";
+}
+
+Database::IdT
+ReplayDatabase::ReadNextId (const std::string& ns)
+{
+  /* This mirrors how SQLiteGame::AutoIds stores its state.  If there is
+     no entry yet for the namespace, IDs start at one.  */
+
+  auto check = db.PrepareRo (R"(
+    SELECT COUNT (*)
+      FROM `sqlite_master`
+      WHERE `type` = 'table' AND `name` = 'xayagame_ids'
+  )");
+  CHECK (check.Step ());
+  if (check.Get<int64_t> (0) == 0)
+    {
+      LOG (WARNING) << "Database has no auto-ID table, starting IDs at one";
+      return 1;
+    }
+
+  auto stmt = db.PrepareRo (R"(
+    SELECT `next`
+      FROM `xayagame_ids`
+      WHERE `namespace` = ?1
+  )");
+  stmt.Bind (1, ns);
+  if (!stmt.Step ())
+    return 1;
+
+  return stmt.Get<int64_t> (0);
+}
+
+Database::IdT
+ReplayDatabase::GetNextId ()
+{
+  return nextId++;
+}
+
+Database::IdT
+ReplayDatabase::GetLogId ()
+{
+  return nextLogId++;
+}
+
+/* ************************************************************************** */
+
+std::vector<Json::Value>
+FilterDetachedBlocks (const std::vector<Json::Value>& blocks)
+{
+  std::vector<Json::Value> res;
+  if (blocks.empty ())
+    return res;
+
+  const auto getMeta = [] (const Json::Value& blockData,
+                           const std::string& key) -> std::string
+    {
+      const auto& val = blockData["block"][key];
+      CHECK (val.isString ()) << "Block data has no " << key << ": " << val;
+      return val.asString ();
+    };
+
+  /* The parent of the first block is the state the replay starts from.  */
+  const std::string base = getMeta (blocks.front (), "parent");
+
+  for (const auto& blk : blocks)
+    {
+      const std::string parent = getMeta (blk, "parent");
+
+      /* If the block does not build on our current tip, there was a reorg.
+         Undo (i.e. drop) blocks until we reach the fork point.  */
+      size_t keep = res.size ();
+      while (keep > 0 && getMeta (res[keep - 1], "hash") != parent)
+        --keep;
+
+      if (keep == 0 && parent != base)
+        {
+          LOG (WARNING)
+              << "Recorded block " << getMeta (blk, "hash")
+              << " does not connect to the recorded chain, ignoring it";
+          continue;
+        }
+
+      if (keep < res.size ())
+        LOG (INFO)
+            << "Dropping " << (res.size () - keep)
+            << " recorded blocks detached before "
+            << getMeta (blk, "hash");
+      res.resize (keep);
+      res.push_back (blk);
+    }
+
+  return res;
+}
+
+/* ************************************************************************** */
+
+BlockReplayer::BlockReplayer (Database& d, const xaya::Chain c)
+  : db(d), chain(c), map(chain),
+    cfgCtx(chain, map, Context::NO_HEIGHT, Context::NO_TIMESTAMP),
+    ongoingsSchedule([this] (const OngoingOperation& op)
+      {
+        return GetOngoingEndHeight (op, cfgCtx);
+      })
+{}
+
+BlockPerfStats
+BlockReplayer::ProcessBlock (const Json::Value& blockData)
+{
+  const auto& blockMeta = blockData["block"];
+  CHECK (blockMeta.isObject ());
+
+  const auto& hashVal = blockMeta["hash"];
+  CHECK (hashVal.isString ());
+  const auto& parentVal = blockMeta["parent"];
+  CHECK (parentVal.isString ());
+  const auto& heightVal = blockMeta["height"];
+  CHECK (heightVal.isUInt64 ());
+
+  CHECK (lastBlockHash.empty () || parentVal.asString () == lastBlockHash)
+      << "Block " << hashVal.asString () << " at height "
+      << heightVal.asUInt64 () << " does not build on the previous block "
+      << lastBlockHash;
+
+  xaya::uint256 seed;
+  const auto& seedVal = blockMeta["rngseed"];
+  if (seedVal.isString ())
+    {
+      CHECK (seed.FromHex (seedVal.asString ()))
+          << "Invalid rngseed: " << seedVal;
+    }
+  else
+    seed = xaya::SHA256::Hash ("replay " + hashVal.asString ());
+  xaya::Random rnd;
+  rnd.Seed (seed);
+
+  BlockPerfStats perf(heightVal.asUInt64 (), hashVal.asString ());
+
+  /* Like SQLiteGame, we process each block in its own transaction.  */
+  db.Prepare ("BEGIN").Execute ();
+
+  if (!ongoingsSchedule.IsLoaded ())
+    {
+      perf.StartPhase ("loadongoings");
+      ongoingsSchedule.Load (db);
+      perf.EndPhase ();
+    }
+  db.SetOngoingsSchedule (&ongoingsSchedule);
+
+  PXLogic::UpdateState (db, rnd, chain, map,
+                        &damageListsCache, &combatModifiers,
+                        &perf, blockData);
+
+  perf.StartPhase ("commit");
+  db.Prepare ("COMMIT").Execute ();
+  perf.EndPhase ();
+
+  lastBlockHash = hashVal.asString ();
+  return perf;
+}
+
+/* ************************************************************************** */
+
+} // namespace pxd
@@ -0,0 +1,163 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PXD_REPLAY_HPP
+#define PXD_REPLAY_HPP
+
+#include "combat.hpp"
+#include "context.hpp"
+#include "perfstats.hpp"
+
+#include "database/damagelists.hpp"
+#include "database/database.hpp"
+#include "database/ongoing.hpp"
+#include "mapdata/basemap.hpp"
+
+#include <xayagame/sqlitestorage.hpp>
+
+#include <json/json.h>
+
+#include <string>
+#include <vector>
+
+namespace pxd
+{
+
+/**
+ * Database instance that holds an in-memory copy of a game-state database
+ * stored in a file (e.g. from a tauriond data directory), for replaying
+ * blocks on it independently of SQLiteGame.  The file itself is not
+ * modified.  IDs are initialised from the values libxayagame stored
+ * in the database and then handed out in memory.
+ */
+class ReplayDatabase : public Database
+{
+
+private:
+
+  /** The in-memory SQLite database.  */
+  xaya::SQLiteDatabase db;
+
+  /** The next ID to give out.  */
+  IdT nextId;
+
+  /** The next log ID to give out.  */
+  IdT nextLogId;
+
+  /**
+   * Reads the next value for an auto-ID namespace of SQLiteGame from
+   * the database.
+   */
+  IdT ReadNextId (const std::string& ns);
+
+public:
+
+  /**
+   * Opens the database by copying all data from the given file.
+   */
+  explicit ReplayDatabase (const std::string& file);
+
+  ReplayDatabase () = delete;
+  ReplayDatabase (const ReplayDatabase&) = delete;
+  void operator= (const ReplayDatabase&) = delete;
+
+  IdT GetNextId () override;
+  IdT GetLogId () override;
+
+};
+
+/**
+ * Filters a sequence of recorded block data (as written with --record_blocks)
+ * down to the blocks that form the final chain.  The recording contains
+ * all attached blocks, including those that were detached again later in
+ * a reorg; such blocks are dropped here, so that the result can be replayed
+ * with BlockReplayer.  Blocks that do not connect to any earlier block
+ * in the recording (nor to the starting state) cannot be replayed and are
+ * dropped with a warning.
+ */
+std::vector<Json::Value> FilterDetachedBlocks (
+    const std::vector<Json::Value>& blocks);
+
+/**
+ * Helper class that processes a sequence of blocks on a given database,
+ * using PXLogic::UpdateState in the same way as the real game does (with
+ * the in-memory caches kept across blocks).  This is used to replay
+ * recorded block data for benchmarking and verification.
+ */
+class BlockReplayer
+{
+
+private:
+
+  /** The database we work on.  */
+  Database& db;
+
+  /** The chain the blocks are from.  */
+  const xaya::Chain chain;
+
+  /** The base map for our chain.  */
+  const BaseMap map;
+
+  /** Context without height for the ongoings schedule.  */
+  const Context cfgCtx;
+
+  /** Damage lists kept across blocks.  */
+  DamageListsCache damageListsCache;
+
+  /** Schedule of ongoing operations kept across blocks.  */
+  OngoingsSchedule ongoingsSchedule;
+
+  /** Combat modifiers kept from one block to the next.  */
+  CombatModifierMemo combatModifiers;
+
+  /** Hash of the last block processed (or empty).  */
+  std::string lastBlockHash;
+
+public:
+
+  explicit BlockReplayer (Database& d, xaya::Chain c);
+
+  BlockReplayer () = delete;
+  BlockReplayer (const BlockReplayer&) = delete;
+  void operator= (const BlockReplayer&) = delete;
+
+  /**
+   * Processes the next block, given by the same block data that is passed
+   * to PXLogic::UpdateState.  The block must build on the previous one.
+   * The random-number generator is seeded from the block's "rngseed" as
+   * libxayagame does, or with a fixed value if there is none.
+   *
+   * Returns the performance data recorded while processing.
+   */
+  BlockPerfStats ProcessBlock (const Json::Value& blockData);
+
+  /**
+   * Returns the hash of the last block processed, or the empty string
+   * if there has not been any yet.
+   */
+  const std::string&
+  GetLastBlockHash () const
+  {
+    return lastBlockHash;
+  }
+
+};
+
+} // namespace pxd
+
+#endif // PXD_REPLAY_HPP
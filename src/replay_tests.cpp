@@ -0,0 +1,241 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "replay.hpp"
+
+#include "testutils.hpp"
+
+#include "database/account.hpp"
+#include "database/character.hpp"
+#include "database/dbtest.hpp"
+#include "database/moneysupply.hpp"
+#include "database/schema.hpp"
+#include "database/statehash.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace pxd
+{
+namespace
+{
+
+class BlockReplayerTests : public testing::Test
+{
+
+protected:
+
+  /**
+   * Sets up the schema and some initial state in a test database.
+   */
+  static void
+  InitialiseState (TestDatabase& db)
+  {
+    SetupDatabaseSchema (*db);
+    MoneySupply (db).InitialiseDatabase ();
+
+    AccountsTable accounts(db);
+    accounts.CreateNew ("domob")->SetFaction (Faction::RED);
+
+    CharacterTable characters(db);
+    auto c = characters.CreateNew ("domob", Faction::RED);
+    c->SetPosition (HexCoord (0, 0));
+    c->MutableProto ().set_speed (1'000);
+  }
+
+  /**
+   * Constructs block data for the given height and moves.  The block
+   * hashes are derived from the height.
+   */
+  static Json::Value
+  BlockData (const unsigned height, const std::string& moves)
+  {
+    Json::Value meta(Json::objectValue);
+    meta["hash"] = "block " + std::to_string (height);
+    meta["parent"] = "block " + std::to_string (height - 1);
+    meta["height"] = height;
+    meta["timestamp"] = 1'500'000'000 + height;
+
+    Json::Value res(Json::objectValue);
+    res["block"] = meta;
+    res["admin"] = Json::Value (Json::arrayValue);
+    res["moves"] = ParseJson (moves);
+
+    return res;
+  }
+
+  /**
+   * Replays a fixed sequence of blocks on the given database.
+   */
+  static void
+  ReplayBlocks (TestDatabase& db)
+  {
+    BlockReplayer replayer(db, xaya::Chain::REGTEST);
+    replayer.ProcessBlock (BlockData (10, "[]"));
+    replayer.ProcessBlock (BlockData (11, R"([
+      {
+        "name": "domob",
+        "move": {"c": {"id": 1, "wp": )" + WpStr ({HexCoord (5, 0)}) + R"(}}
+      }
+    ])"));
+    replayer.ProcessBlock (BlockData (12, "[]"));
+    EXPECT_EQ (replayer.GetLastBlockHash (), "block 12");
+  }
+
+};
+
+TEST_F (BlockReplayerTests, RecordsPhases)
+{
+  TestDatabase db;
+  InitialiseState (db);
+
+  BlockReplayer replayer(db, xaya::Chain::REGTEST);
+  const auto perf = replayer.ProcessBlock (BlockData (10, "[]"));
+
+  EXPECT_EQ (perf.GetHeight (), 10);
+  ASSERT_FALSE (perf.GetPhases ().empty ());
+  EXPECT_EQ (perf.GetPhases ().front ().name, "loadongoings");
+  EXPECT_EQ (perf.GetPhases ().back ().name, "commit");
+
+  const auto perf2 = replayer.ProcessBlock (BlockData (11, "[]"));
+  EXPECT_NE (perf2.GetPhases ().front ().name, "loadongoings");
+}
+
+TEST_F (BlockReplayerTests, Deterministic)
+{
+  TestDatabase db1;
+  InitialiseState (db1);
+  ReplayBlocks (db1);
+
+  TestDatabase db2;
+  InitialiseState (db2);
+  ReplayBlocks (db2);
+
+  EXPECT_EQ (ComputeStateHash (db1), ComputeStateHash (db2));
+}
+
+TEST_F (BlockReplayerTests, BlocksMustConnect)
+{
+  TestDatabase db;
+  InitialiseState (db);
+
+  BlockReplayer replayer(db, xaya::Chain::REGTEST);
+  replayer.ProcessBlock (BlockData (10, "[]"));
+  EXPECT_DEATH (replayer.ProcessBlock (BlockData (12, "[]")),
+                "does not build on the previous block");
+}
+
+class FilterDetachedBlocksTests : public testing::Test
+{
+
+protected:
+
+  /**
+   * Constructs minimal block data with the given hash and parent.
+   */
+  static Json::Value
+  Block (const std::string& hash, const std::string& parent)
+  {
+    Json::Value res(Json::objectValue);
+    res["block"]["hash"] = hash;
+    res["block"]["parent"] = parent;
+    return res;
+  }
+
+  /**
+   * Returns the hashes of the blocks returned from FilterDetachedBlocks.
+   */
+  static std::vector<std::string>
+  Filter (const std::vector<Json::Value>& blocks)
+  {
+    std::vector<std::string> res;
+    for (const auto& blk : FilterDetachedBlocks (blocks))
+      res.push_back (blk["block"]["hash"].asString ());
+    return res;
+  }
+
+};
+
+TEST_F (FilterDetachedBlocksTests, Basic)
+{
+  using Hashes = std::vector<std::string>;
+
+  EXPECT_EQ (Filter ({}), Hashes ({}));
+  EXPECT_EQ (Filter ({
+    Block ("a", "base"),
+    Block ("b", "a"),
+    Block ("c", "b"),
+  }), Hashes ({"a", "b", "c"}));
+}
+
+TEST_F (FilterDetachedBlocksTests, Reorgs)
+{
+  using Hashes = std::vector<std::string>;
+
+  EXPECT_EQ (Filter ({
+    Block ("a", "base"),
+    Block ("b", "a"),
+    Block ("c", "b"),
+    Block ("b2", "a"),
+    Block ("c2", "b2"),
+    Block ("d2", "c2"),
+  }), Hashes ({"a", "b2", "c2", "d2"}));
+
+  EXPECT_EQ (Filter ({
+    Block ("a", "base"),
+    Block ("b", "a"),
+    Block ("a2", "base"),
+  }), Hashes ({"a2"}));
+}
+
+TEST_F (FilterDetachedBlocksTests, NotConnecting)
+{
+  using Hashes = std::vector<std::string>;
+
+  EXPECT_EQ (Filter ({
+    Block ("a", "base"),
+    Block ("x", "unknown"),
+    Block ("b", "a"),
+  }), Hashes ({"a", "b"}));
+}
+
+TEST_F (BlockReplayerTests, ReplaysAfterReorg)
+{
+  TestDatabase db;
+  InitialiseState (db);
+
+  auto detached = BlockData (12, "[]");
+  detached["block"]["hash"] = "detached 12";
+
+  BlockReplayer replayer(db, xaya::Chain::REGTEST);
+  for (const auto& blk : FilterDetachedBlocks ({
+          BlockData (10, "[]"),
+          BlockData (11, "[]"),
+          detached,
+          BlockData (12, "[]"),
+          BlockData (13, "[]"),
+        }))
+    replayer.ProcessBlock (blk);
+
+  EXPECT_EQ (replayer.GetLastBlockHash (), "block 13");
+}
+
+} // anonymous namespace
+} // namespace pxd
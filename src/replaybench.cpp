@@ -0,0 +1,245 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Benchmark that replays recorded block data (e.g. written by tauriond
+   with --record_blocks) on top of a starting game-state database, and
+   reports the latency distribution per block and processing phase.  */
+
+#include "perfstats.hpp"
+#include "replay.hpp"
+
+#include "database/statehash.hpp"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <json/json.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+DEFINE_string (state, "",
+               "SQLite game-state database to start the replay from");
+DEFINE_string (blocks, "",
+               "file with the recorded block data, one JSON object per line");
+DEFINE_string (chain, "main",
+               "the chain the data is from (main, test or regtest)");
+DEFINE_string (expected_hash, "",
+               "if set, the expected state hash after the replay");
+DEFINE_int32 (max_blocks, 0,
+              "if positive, replay at most that many blocks");
+
+/**
+ * Parses the chain from its name as given in the flag.
+ */
+xaya::Chain
+ParseChain (const std::string& name)
+{
+  if (name == "main")
+    return xaya::Chain::MAIN;
+  if (name == "test")
+    return xaya::Chain::TEST;
+  if (name == "regtest")
+    return xaya::Chain::REGTEST;
+
+  LOG (FATAL) << "Invalid chain: " << name;
+}
+
+/**
+ * Collection of latency samples, for which we print a summary.
+ */
+class Distribution
+{
+
+private:
+
+  /** The samples in milliseconds.  */
+  std::vector<double> samples;
+
+  /**
+   * Returns the given percentile of the (sorted) samples.
+   */
+  double
+  Percentile (const double p) const
+  {
+    const size_t ind = std::min<size_t> (samples.size () * p / 100,
+                                         samples.size () - 1);
+    return samples[ind];
+  }
+
+public:
+
+  void
+  Add (const std::chrono::nanoseconds d)
+  {
+    samples.push_back (std::chrono::duration<double, std::milli> (d).count ());
+  }
+
+  /**
+   * Prints a summary line of the distribution.
+   */
+  void
+  Print (std::ostream& out, const std::string& name)
+  {
+    if (samples.empty ())
+      return;
+    std::sort (samples.begin (), samples.end ());
+
+    double total = 0.0;
+    for (const double s : samples)
+      total += s;
+
+    out << std::left << std::setw (16) << name << std::right
+        << std::setw (8) << samples.size ()
+        << std::fixed << std::setprecision (3)
+        << std::setw (12) << total / samples.size ()
+        << std::setw (12) << Percentile (50)
+        << std::setw (12) << Percentile (90)
+        << std::setw (12) << Percentile (99)
+        << std::setw (12) << samples.back ()
+        << std::setw (14) << total
+        << std::endl;
+  }
+
+};
+
+} // anonymous namespace
+
+int
+main (int argc, char** argv)
+{
+  google::InitGoogleLogging (argv[0]);
+
+  gflags::SetUsageMessage ("Replay recorded blocks for benchmarking");
+  gflags::ParseCommandLineFlags (&argc, &argv, true);
+
+  if (FLAGS_state.empty () || FLAGS_blocks.empty ())
+    {
+      std::cerr << "Both --state and --blocks must be given" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  std::ifstream in(FLAGS_blocks);
+  if (!in)
+    {
+      std::cerr << "Could not open " << FLAGS_blocks << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  /* The recording contains all blocks that were attached, including those
+     that were detached again in a reorg.  Read them all first and then
+     reconstruct the final chain from the parent links.  */
+  std::vector<Json::Value> recorded;
+  Json::CharReaderBuilder rbuilder;
+  std::string line;
+  while (std::getline (in, line))
+    {
+      if (line.empty ())
+        continue;
+
+      Json::Value blockData;
+      std::string parseErrs;
+      std::istringstream lineIn(line);
+      CHECK (Json::parseFromStream (rbuilder, lineIn, &blockData, &parseErrs))
+          << "Invalid block data in line " << (recorded.size () + 1) << ": "
+          << parseErrs;
+      recorded.push_back (std::move (blockData));
+    }
+  const auto blocks = pxd::FilterDetachedBlocks (recorded);
+
+  pxd::ReplayDatabase db(FLAGS_state);
+  pxd::BlockReplayer replayer(db, ParseChain (FLAGS_chain));
+
+  Distribution blockLatency;
+  std::map<std::string, Distribution> phaseLatency;
+  std::chrono::nanoseconds totalTime(0);
+  int numBlocks = 0;
+
+  for (const auto& blockData : blocks)
+    {
+      if (FLAGS_max_blocks > 0 && numBlocks >= FLAGS_max_blocks)
+        break;
+
+      const auto start = std::chrono::steady_clock::now ();
+      const auto perf = replayer.ProcessBlock (blockData);
+      const auto duration = std::chrono::steady_clock::now () - start;
+
+      totalTime += duration;
+      blockLatency.Add (duration);
+      for (const auto& p : perf.GetPhases ())
+        phaseLatency[p.name].Add (p.duration);
+
+      ++numBlocks;
+      VLOG (1)
+          << "Block " << perf.GetHeight () << ": "
+          << std::chrono::duration_cast<std::chrono::microseconds> (
+                duration).count ()
+          << " us";
+    }
+
+  if (numBlocks == 0)
+    {
+      std::cerr << "No blocks found in " << FLAGS_blocks << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  const double seconds = std::chrono::duration<double> (totalTime).count ();
+  std::cout
+      << "Replayed " << numBlocks << " blocks in " << seconds << " s ("
+      << numBlocks / seconds << " blocks/s)\n"
+      << std::endl;
+
+  std::cout << std::left << std::setw (16) << "latency (ms)" << std::right
+            << std::setw (8) << "count"
+            << std::setw (12) << "mean"
+            << std::setw (12) << "p50"
+            << std::setw (12) << "p90"
+            << std::setw (12) << "p99"
+            << std::setw (12) << "max"
+            << std::setw (14) << "total"
+            << std::endl;
+  blockLatency.Print (std::cout, "block");
+  for (auto& entry : phaseLatency)
+    entry.second.Print (std::cout, entry.first);
+  std::cout << std::endl;
+
+  const std::string hash = pxd::ComputeStateHash (db).ToHex ();
+  std::cout << "Final block: " << replayer.GetLastBlockHash () << "\n"
+            << "State hash:  " << hash << std::endl;
+
+  if (!FLAGS_expected_hash.empty () && hash != FLAGS_expected_hash)
+    {
+      std::cerr
+          << "State hash does not match, expected " << FLAGS_expected_hash
+          << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -12,6 +12,7 @@
 #include <glog/logging.h>
 
 #include <chrono>
+#include <string>
 
 namespace pxd
 {
@@ -46,6 +47,30 @@ RestApi::ComputeBootstrapData ()
   return res;
 }
 
+RestApi::SuccessResult
+RestApi::ComputeChanges (const std::string& fromStr)
+{
+  if (fromStr.empty () || fromStr.size () > 9
+        || fromStr.find_first_not_of ("0123456789") != std::string::npos)
+    throw HttpError (MHD_HTTP_BAD_REQUEST, "invalid height: " + fromStr);
+  const unsigned fromHeight = std::stoul (fromStr);
+
+  const Json::Value val = logic.GetCustomStateData (game,
+    [fromHeight] (GameStateJson& gsj, const xaya::uint256& hash,
+                  const unsigned height)
+      {
+        const unsigned window = PXLogic::GetChangesWindow ();
+        if (fromHeight + window < height)
+          throw HttpError (MHD_HTTP_BAD_REQUEST,
+                           "height is too low, needs to be at least "
+                              + std::to_string (height - window));
+
+        return gsj.ChangesSince (fromHeight);
+      });
+
+  return SuccessResult (val).Gzip ();
+}
+
 RestApi::SuccessResult
 RestApi::Process (const std::string& url)
 {
@@ -69,6 +94,13 @@ RestApi::Process (const std::string& url)
       return *res;
     }
 
+  if (MatchEndpoint (url, "/changes/", remainder))
+    return ComputeChanges (remainder);
+
+  if (MatchEndpoint (url, "/metrics", remainder) && remainder == "")
+    return SuccessResult ("text/plain; version=0.0.4",
+                          logic.GetPerfStats ().ToPrometheus ());
+
   throw HttpError (MHD_HTTP_NOT_FOUND, "invalid API endpoint");
 }
 
@@ -13,6 +13,7 @@
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 
 namespace pxd
@@ -60,6 +61,12 @@ private:
    */
   std::shared_ptr<SuccessResult> ComputeBootstrapData ();
 
+  /**
+   * Computes the result for a /changes/<height> request, i.e. the data
+   * returned by GameStateJson::ChangesSince for the given height.
+   */
+  SuccessResult ComputeChanges (const std::string& fromStr);
+
 protected:
 
   SuccessResult Process (const std::string& url) override;
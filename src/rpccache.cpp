@@ -0,0 +1,115 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "rpccache.hpp"
+
+#include <glog/logging.h>
+
+namespace pxd
+{
+
+void
+CoalescingRpcCache::SetBlock (const std::string& hash)
+{
+  std::lock_guard<std::mutex> lock(mut);
+  if (hash == block)
+    return;
+
+  VLOG (1) << "New block " << hash << ", clearing RPC cache";
+  block = hash;
+  entries.clear ();
+}
+
+void
+CoalescingRpcCache::RemoveEntry (const std::string& key, const uint64_t id)
+{
+  const auto mit = entries.find (key);
+  if (mit != entries.end () && mit->second.id == id)
+    entries.erase (mit);
+}
+
+Json::Value
+CoalescingRpcCache::Get (const std::string& method, const Json::Value& params,
+                         const Fetcher& fetch)
+{
+  Json::StreamWriterBuilder wbuilder;
+  wbuilder["commentStyle"] = "None";
+  wbuilder["indentation"] = "";
+  const std::string key = method + " " + Json::writeString (wbuilder, params);
+
+  std::unique_lock<std::mutex> lock(mut);
+
+  if (block.empty ())
+    {
+      ++numFetches;
+      lock.unlock ();
+      return fetch ();
+    }
+
+  const auto now = std::chrono::steady_clock::now ();
+  const auto mit = entries.find (key);
+  if (mit != entries.end ()
+        && (maxAge.count () == 0 || now - mit->second.time <= maxAge))
+    {
+      VLOG (2) << "Using cached or in-flight result for " << key;
+      auto res = mit->second.result;
+      lock.unlock ();
+      return res.get ();
+    }
+
+  std::promise<Json::Value> promise;
+  Entry entry;
+  entry.id = nextId++;
+  entry.result = promise.get_future ().share ();
+  entry.time = now;
+  const uint64_t id = entry.id;
+  const std::string requestBlock = block;
+  entries[key] = std::move (entry);
+  ++numFetches;
+  lock.unlock ();
+
+  Json::Value res;
+  try
+    {
+      res = fetch ();
+    }
+  catch (...)
+    {
+      promise.set_exception (std::current_exception ());
+      lock.lock ();
+      RemoveEntry (key, id);
+      throw;
+    }
+
+  promise.set_value (res);
+
+  const Json::Value resBlock
+      = res.isObject () ? res.get ("blockhash", Json::Value ()) : Json::Value ();
+  if (resBlock.isString () && resBlock.asString () != requestBlock)
+    {
+      VLOG (1)
+          << "Result for " << key << " is for block " << resBlock.asString ()
+          << ", not caching it";
+      lock.lock ();
+      RemoveEntry (key, id);
+    }
+
+  return res;
+}
+
+} // namespace pxd
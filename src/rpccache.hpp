@@ -0,0 +1,141 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PXD_RPCCACHE_HPP
+#define PXD_RPCCACHE_HPP
+
+#include <json/json.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace pxd
+{
+
+/**
+ * Cache for responses to state RPC methods that are expensive to retrieve
+ * (e.g. forwarded through Charon).  Results are keyed by method and
+ * parameters, and are valid only for the block that was current when they
+ * were requested.  Concurrent requests for the same method and parameters
+ * are coalesced into a single call of the underlying fetcher.
+ *
+ * The current block has to be set explicitly from the outside.  As long as
+ * it is not known, requests are just passed through without caching.
+ */
+class CoalescingRpcCache
+{
+
+public:
+
+  /** Function that retrieves the actual result for a request.  */
+  using Fetcher = std::function<Json::Value ()>;
+
+private:
+
+  /**
+   * A cached result, or one that is being retrieved.
+   */
+  struct Entry
+  {
+
+    /** Unique ID of this entry, used to match it after fetching.  */
+    uint64_t id;
+
+    /** The result (which may not be ready yet).  */
+    std::shared_future<Json::Value> result;
+
+    /** The time when the result was requested.  */
+    std::chrono::steady_clock::time_point time;
+
+  };
+
+  /**
+   * Maximum age of a cached result before it is fetched again, even if we
+   * have not seen a new block.  This is a safeguard against stale data in
+   * case we miss block notifications.  Zero means no limit.
+   */
+  const std::chrono::milliseconds maxAge;
+
+  /** The current block hash, or empty if unknown.  */
+  std::string block;
+
+  /** Entries for the current block by key.  */
+  std::map<std::string, Entry> entries;
+
+  /** Next ID to use for entries.  */
+  uint64_t nextId = 1;
+
+  /** Number of calls to the fetcher, for statistics and testing.  */
+  unsigned numFetches = 0;
+
+  /** Lock for this instance.  */
+  mutable std::mutex mut;
+
+  /**
+   * Removes the entry with the given key if it is the one with the
+   * given ID.  Must be called with the lock held.
+   */
+  void RemoveEntry (const std::string& key, uint64_t id);
+
+public:
+
+  explicit CoalescingRpcCache (const std::chrono::milliseconds a)
+    : maxAge(a)
+  {}
+
+  CoalescingRpcCache (const CoalescingRpcCache&) = delete;
+  void operator= (const CoalescingRpcCache&) = delete;
+
+  /**
+   * Updates the current block hash.  If it changed, all cached results
+   * are discarded.
+   */
+  void SetBlock (const std::string& hash);
+
+  /**
+   * Returns the result for the given method and parameters, either from
+   * the cache, by waiting for an in-flight request or by calling the
+   * fetcher.  Exceptions thrown by the fetcher are passed on to all
+   * callers waiting for it, and the result is not cached.
+   *
+   * If the result is an object with a "blockhash" field that does not match
+   * the current block, it is returned but not cached.
+   */
+  Json::Value Get (const std::string& method, const Json::Value& params,
+                   const Fetcher& fetch);
+
+  /**
+   * Returns the number of times the fetcher has been called.
+   */
+  unsigned
+  GetNumFetches () const
+  {
+    std::lock_guard<std::mutex> lock(mut);
+    return numFetches;
+  }
+
+};
+
+} // namespace pxd
+
+#endif // PXD_RPCCACHE_HPP
@@ -0,0 +1,185 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "rpccache.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pxd
+{
+namespace
+{
+
+class CoalescingRpcCacheTests : public testing::Test
+{
+
+protected:
+
+  CoalescingRpcCache cache;
+
+  /** The value returned by the fetcher.  */
+  Json::Value value;
+
+  CoalescingRpcCacheTests ()
+    : cache(std::chrono::milliseconds (0)), value(1)
+  {}
+
+  /**
+   * Requests the given method with no parameters, using a fetcher that
+   * returns the current value.
+   */
+  Json::Value
+  Get (const std::string& method)
+  {
+    return cache.Get (method, Json::Value (Json::arrayValue), [this] ()
+      {
+        return value;
+      });
+  }
+
+};
+
+TEST_F (CoalescingRpcCacheTests, NoBlockKnown)
+{
+  EXPECT_EQ (Get ("foo"), 1);
+  value = 2;
+  EXPECT_EQ (Get ("foo"), 2);
+  EXPECT_EQ (cache.GetNumFetches (), 2);
+}
+
+TEST_F (CoalescingRpcCacheTests, CachedPerBlock)
+{
+  cache.SetBlock ("block 1");
+  EXPECT_EQ (Get ("foo"), 1);
+  value = 2;
+  EXPECT_EQ (Get ("foo"), 1);
+  EXPECT_EQ (Get ("bar"), 2);
+  EXPECT_EQ (cache.GetNumFetches (), 2);
+
+  cache.SetBlock ("block 1");
+  EXPECT_EQ (Get ("foo"), 1);
+
+  cache.SetBlock ("block 2");
+  EXPECT_EQ (Get ("foo"), 2);
+  EXPECT_EQ (cache.GetNumFetches (), 3);
+}
+
+TEST_F (CoalescingRpcCacheTests, KeyedByParams)
+{
+  cache.SetBlock ("block");
+
+  Json::Value params(Json::objectValue);
+  params["id"] = 1;
+  const auto fetchId = [&params] ()
+    {
+      return params["id"];
+    };
+
+  EXPECT_EQ (cache.Get ("foo", params, fetchId), 1);
+  params["id"] = 2;
+  EXPECT_EQ (cache.Get ("foo", params, fetchId), 2);
+  params["id"] = 1;
+  EXPECT_EQ (cache.Get ("foo", params, fetchId), 1);
+  EXPECT_EQ (cache.GetNumFetches (), 2);
+}
+
+TEST_F (CoalescingRpcCacheTests, OtherBlockInResult)
+{
+  cache.SetBlock ("block 1");
+
+  value = Json::Value (Json::objectValue);
+  value["blockhash"] = "block 2";
+  EXPECT_EQ (Get ("foo"), value);
+  EXPECT_EQ (Get ("foo"), value);
+  EXPECT_EQ (cache.GetNumFetches (), 2);
+
+  value["blockhash"] = "block 1";
+  EXPECT_EQ (Get ("foo"), value);
+  EXPECT_EQ (Get ("foo"), value);
+  EXPECT_EQ (cache.GetNumFetches (), 3);
+}
+
+TEST_F (CoalescingRpcCacheTests, Errors)
+{
+  cache.SetBlock ("block");
+
+  const auto failing = [] () -> Json::Value
+    {
+      throw std::runtime_error ("failed");
+    };
+  EXPECT_THROW (cache.Get ("foo", Json::Value (), failing),
+                std::runtime_error);
+
+  EXPECT_EQ (Get ("foo"), 1);
+  EXPECT_EQ (cache.GetNumFetches (), 2);
+}
+
+TEST_F (CoalescingRpcCacheTests, MaxAge)
+{
+  CoalescingRpcCache aging(std::chrono::milliseconds (1));
+  aging.SetBlock ("block");
+
+  const auto fetch = [] ()
+    {
+      return Json::Value (42);
+    };
+  aging.Get ("foo", Json::Value (), fetch);
+  std::this_thread::sleep_for (std::chrono::milliseconds (10));
+  aging.Get ("foo", Json::Value (), fetch);
+  EXPECT_EQ (aging.GetNumFetches (), 2);
+}
+
+TEST_F (CoalescingRpcCacheTests, CoalescesInFlight)
+{
+  cache.SetBlock ("block");
+
+  std::atomic<bool> release(false);
+  const auto slow = [&release] ()
+    {
+      while (!release)
+        std::this_thread::sleep_for (std::chrono::milliseconds (1));
+      return Json::Value (42);
+    };
+
+  std::vector<std::thread> threads;
+  std::atomic<unsigned> correct(0);
+  for (unsigned i = 0; i < 5; ++i)
+    threads.emplace_back ([&] ()
+      {
+        if (cache.Get ("foo", Json::Value (), slow) == 42)
+          ++correct;
+      });
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (10));
+  release = true;
+  for (auto& t : threads)
+    t.join ();
+
+  EXPECT_EQ (correct, 5);
+  EXPECT_EQ (cache.GetNumFetches (), 1);
+}
+
+} // anonymous namespace
+} // namespace pxd
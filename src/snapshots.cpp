@@ -0,0 +1,123 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "snapshots.hpp"
+
+#include "jsonutils.hpp"
+
+#include <glog/logging.h>
+
+#include <zlib.h>
+
+#include <cstring>
+
+namespace pxd
+{
+
+std::string
+GzipCompress (const std::string& data)
+{
+  z_stream stream;
+  std::memset (&stream, 0, sizeof (stream));
+
+  /* Adding 16 to the window bits selects the gzip format.  */
+  CHECK_EQ (deflateInit2 (&stream, Z_BEST_COMPRESSION, Z_DEFLATED,
+                          MAX_WBITS + 16, 9, Z_DEFAULT_STRATEGY),
+            Z_OK);
+
+  std::string res(deflateBound (&stream, data.size ()), '\0');
+  stream.next_in
+      = reinterpret_cast<Bytef*> (const_cast<char*> (data.data ()));
+  stream.avail_in = data.size ();
+  stream.next_out = reinterpret_cast<Bytef*> (&res[0]);
+  stream.avail_out = res.size ();
+
+  CHECK_EQ (deflate (&stream, Z_FINISH), Z_STREAM_END);
+  res.resize (stream.total_out);
+  CHECK_EQ (deflateEnd (&stream), Z_OK);
+
+  return res;
+}
+
+Json::Value
+SnapshotCache::ComputeData (GameStateJson& gsj)
+{
+  Json::Value res(Json::objectValue);
+  res["accounts"] = gsj.Accounts ();
+  res["buildings"] = gsj.Buildings ();
+  res["characters"] = gsj.Characters ();
+  res["groundloot"] = gsj.GroundLoot ();
+  res["orderbooks"] = gsj.OrderBooks ();
+
+  return res;
+}
+
+void
+SnapshotCache::Update (const std::string& hash, const unsigned height,
+                       const Json::Value& data)
+{
+  CHECK (data.isObject ());
+
+  Json::StreamWriterBuilder wbuilder;
+  wbuilder["commentStyle"] = "None";
+  wbuilder["indentation"] = "";
+
+  std::map<std::string, std::shared_ptr<const Snapshot>> fresh;
+  for (auto it = data.begin (); it != data.end (); ++it)
+    {
+      Json::Value body(Json::objectValue);
+      body["blockhash"] = hash;
+      body["height"] = IntToJson (height);
+      body["data"] = *it;
+
+      auto snapshot = std::make_shared<Snapshot> ();
+      snapshot->block = hash;
+      snapshot->height = height;
+      snapshot->etag = "\"" + hash + "\"";
+      snapshot->body = GzipCompress (Json::writeString (wbuilder, body));
+
+      fresh.emplace (it.name (), std::move (snapshot));
+    }
+
+  VLOG (1) << "Updated snapshots for block " << hash;
+
+  std::lock_guard<std::mutex> lock(mut);
+  snapshots = std::move (fresh);
+  block = hash;
+}
+
+std::string
+SnapshotCache::GetBlock () const
+{
+  std::lock_guard<std::mutex> lock(mut);
+  return block;
+}
+
+std::shared_ptr<const SnapshotCache::Snapshot>
+SnapshotCache::Get (const std::string& name) const
+{
+  std::lock_guard<std::mutex> lock(mut);
+
+  const auto mit = snapshots.find (name);
+  if (mit == snapshots.end ())
+    return nullptr;
+
+  return mit->second;
+}
+
+} // namespace pxd
@@ -0,0 +1,119 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PXD_SNAPSHOTS_HPP
+#define PXD_SNAPSHOTS_HPP
+
+#include "gamestatejson.hpp"
+
+#include <json/json.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace pxd
+{
+
+/**
+ * Compresses the given data in gzip format.
+ */
+std::string GzipCompress (const std::string& data);
+
+/**
+ * Cache of precomputed, gzipped snapshots of parts of the game state
+ * (e.g. all characters or all buildings) that clients poll frequently.
+ * The snapshots are regenerated once per block (off the request path),
+ * and served with the block hash as ETag, so that clients can cheaply
+ * check whether anything changed.
+ */
+class SnapshotCache
+{
+
+public:
+
+  /**
+   * A single precomputed snapshot.
+   */
+  struct Snapshot
+  {
+
+    /** The block hash the snapshot is for.  */
+    std::string block;
+
+    /** The block height.  */
+    unsigned height;
+
+    /** The ETag value (including quotes) for this snapshot.  */
+    std::string etag;
+
+    /** The gzipped JSON body.  */
+    std::string body;
+
+  };
+
+private:
+
+  /** The current snapshots by name.  */
+  std::map<std::string, std::shared_ptr<const Snapshot>> snapshots;
+
+  /** The block hash of the current snapshots.  */
+  std::string block;
+
+  /** Lock for the snapshots.  */
+  mutable std::mutex mut;
+
+public:
+
+  SnapshotCache () = default;
+
+  SnapshotCache (const SnapshotCache&) = delete;
+  void operator= (const SnapshotCache&) = delete;
+
+  /**
+   * Extracts the data for all snapshots from the game state, returning
+   * a JSON object with the data for each snapshot by name.
+   */
+  static Json::Value ComputeData (GameStateJson& gsj);
+
+  /**
+   * Replaces all snapshots with the data returned by ComputeData for the
+   * given block.  The JSON data is serialised and compressed here, so that
+   * this should be called outside of any database locks.
+   */
+  void Update (const std::string& hash, unsigned height,
+               const Json::Value& data);
+
+  /**
+   * Returns the block hash for which the current snapshots are, or the empty
+   * string if there are none yet.
+   */
+  std::string GetBlock () const;
+
+  /**
+   * Returns the snapshot with the given name, or null if there is none
+   * (yet) with that name.
+   */
+  std::shared_ptr<const Snapshot> Get (const std::string& name) const;
+
+};
+
+} // namespace pxd
+
+#endif // PXD_SNAPSHOTS_HPP
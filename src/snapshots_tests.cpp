@@ -0,0 +1,155 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "snapshots.hpp"
+
+#include "testutils.hpp"
+
+#include "database/character.hpp"
+#include "database/dbtest.hpp"
+
+#include <gtest/gtest.h>
+
+#include <glog/logging.h>
+
+#include <zlib.h>
+
+#include <cstring>
+#include <string>
+
+namespace pxd
+{
+namespace
+{
+
+/**
+ * Decompresses gzipped data.
+ */
+std::string
+GzipUncompress (const std::string& data)
+{
+  z_stream stream;
+  std::memset (&stream, 0, sizeof (stream));
+  CHECK_EQ (inflateInit2 (&stream, MAX_WBITS + 16), Z_OK);
+
+  stream.next_in
+      = reinterpret_cast<Bytef*> (const_cast<char*> (data.data ()));
+  stream.avail_in = data.size ();
+
+  std::string res;
+  int rc;
+  do
+    {
+      char buf[1'024];
+      stream.next_out = reinterpret_cast<Bytef*> (buf);
+      stream.avail_out = sizeof (buf);
+      rc = inflate (&stream, Z_NO_FLUSH);
+      CHECK (rc == Z_OK || rc == Z_STREAM_END) << rc;
+      res.append (buf, sizeof (buf) - stream.avail_out);
+    }
+  while (rc != Z_STREAM_END);
+
+  CHECK_EQ (inflateEnd (&stream), Z_OK);
+  return res;
+}
+
+TEST (GzipCompressTests, RoundTrip)
+{
+  const std::string big(10'000, 'x');
+  for (const auto& data : {std::string (), std::string ("foo"), big})
+    EXPECT_EQ (GzipUncompress (GzipCompress (data)), data);
+
+  EXPECT_LT (GzipCompress (big).size (), 1'000);
+}
+
+class SnapshotCacheTests : public DBTestWithSchema
+{
+
+protected:
+
+  ContextForTesting ctx;
+  GameStateJson gsj;
+
+  SnapshotCache cache;
+
+  SnapshotCacheTests ()
+    : gsj(db, ctx)
+  {}
+
+  /**
+   * Returns the decompressed and parsed body of the given snapshot.
+   */
+  Json::Value
+  GetBody (const std::string& name)
+  {
+    const auto snapshot = cache.Get (name);
+    CHECK (snapshot != nullptr) << "Snapshot " << name << " not found";
+    return ParseJson (GzipUncompress (snapshot->body));
+  }
+
+};
+
+TEST_F (SnapshotCacheTests, Empty)
+{
+  EXPECT_EQ (cache.GetBlock (), "");
+  EXPECT_EQ (cache.Get ("characters"), nullptr);
+}
+
+TEST_F (SnapshotCacheTests, ComputeData)
+{
+  CharacterTable characters(db);
+  characters.CreateNew ("domob", Faction::RED);
+
+  const auto data = SnapshotCache::ComputeData (gsj);
+  for (const std::string name : {"accounts", "buildings", "characters",
+                                 "groundloot", "orderbooks"})
+    EXPECT_TRUE (data.isMember (name)) << name;
+  EXPECT_EQ (data["characters"], gsj.Characters ());
+}
+
+TEST_F (SnapshotCacheTests, Update)
+{
+  CharacterTable characters(db);
+  characters.CreateNew ("domob", Faction::RED);
+
+  cache.Update ("block 1", 10, SnapshotCache::ComputeData (gsj));
+  EXPECT_EQ (cache.GetBlock (), "block 1");
+  EXPECT_EQ (cache.Get ("invalid"), nullptr);
+
+  const auto snapshot = cache.Get ("characters");
+  ASSERT_NE (snapshot, nullptr);
+  EXPECT_EQ (snapshot->block, "block 1");
+  EXPECT_EQ (snapshot->height, 10);
+  EXPECT_EQ (snapshot->etag, "\"block 1\"");
+
+  const auto body = GetBody ("characters");
+  EXPECT_EQ (body["blockhash"], "block 1");
+  EXPECT_EQ (body["height"], 10);
+  EXPECT_EQ (body["data"], gsj.Characters ());
+
+  characters.CreateNew ("andy", Faction::GREEN);
+  cache.Update ("block 2", 11, SnapshotCache::ComputeData (gsj));
+  EXPECT_EQ (cache.Get ("characters")->etag, "\"block 2\"");
+  EXPECT_EQ (GetBody ("characters")["data"].size (), 2);
+
+  /* The old snapshot instance is still valid for readers holding it.  */
+  EXPECT_EQ (snapshot->block, "block 1");
+}
+
+} // anonymous namespace
+} // namespace pxd
@@ -0,0 +1,209 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "snapshotserver.hpp"
+
+#include <xayautil/uint256.hpp>
+
+#include <glog/logging.h>
+
+#include <sstream>
+#include <string>
+
+namespace pxd
+{
+
+namespace
+{
+
+/** URL prefix for the snapshot endpoints.  */
+const std::string URL_PREFIX = "/snapshot/";
+
+/**
+ * Checks whether the value of an If-None-Match header matches
+ * the given ETag.
+ */
+bool
+MatchesETag (const std::string& header, const std::string& etag)
+{
+  std::istringstream in(header);
+  std::string cur;
+  while (std::getline (in, cur, ','))
+    {
+      const size_t start = cur.find_first_not_of (" \t");
+      if (start == std::string::npos)
+        continue;
+      cur = cur.substr (start, cur.find_last_not_of (" \t") + 1 - start);
+
+      /* Weak comparison is fine for If-None-Match.  */
+      if (cur.substr (0, 2) == "W/")
+        cur = cur.substr (2);
+
+      if (cur == "*" || cur == etag)
+        return true;
+    }
+
+  return false;
+}
+
+} // anonymous namespace
+
+SnapshotServer::~SnapshotServer ()
+{
+  CHECK (daemon == nullptr) << "SnapshotServer has not been stopped";
+  CHECK (generator == nullptr);
+}
+
+void
+SnapshotServer::Refresh ()
+{
+  const Json::Value val = logic.GetCustomStateData (game,
+    [] (GameStateJson& gsj)
+      {
+        return SnapshotCache::ComputeData (gsj);
+      });
+
+  const auto& hashVal = val["blockhash"];
+  if (!hashVal.isString ())
+    {
+      LOG (WARNING) << "No current state, cannot refresh snapshots";
+      return;
+    }
+
+  cache.Update (hashVal.asString (), val["height"].asUInt (), val["data"]);
+}
+
+MhdResult
+SnapshotServer::RequestCallback (void* data, struct MHD_Connection* conn,
+                                 const char* url, const char* method,
+                                 const char* version,
+                                 const char* upload, size_t* uploadSize,
+                                 void** connData)
+{
+  auto* self = static_cast<SnapshotServer*> (data);
+
+  if (std::string (method) != "GET")
+    return QueueTextResponse (conn, MHD_HTTP_METHOD_NOT_ALLOWED,
+                              "only GET is supported");
+
+  const std::string urlStr(url);
+  if (urlStr.substr (0, URL_PREFIX.size ()) != URL_PREFIX)
+    return QueueTextResponse (conn, MHD_HTTP_NOT_FOUND,
+                              "invalid endpoint: " + urlStr);
+
+  const std::string name = urlStr.substr (URL_PREFIX.size ());
+  const auto snapshot = self->cache.Get (name);
+  if (snapshot == nullptr)
+    {
+      if (self->cache.GetBlock ().empty ())
+        return QueueTextResponse (conn, MHD_HTTP_SERVICE_UNAVAILABLE,
+                                  "snapshots are not yet available");
+      return QueueTextResponse (conn, MHD_HTTP_NOT_FOUND,
+                                "invalid snapshot: " + name);
+    }
+
+  const char* ifNoneMatch
+      = MHD_lookup_connection_value (conn, MHD_HEADER_KIND,
+                                     MHD_HTTP_HEADER_IF_NONE_MATCH);
+
+  unsigned status;
+  struct MHD_Response* resp;
+  if (ifNoneMatch != nullptr && MatchesETag (ifNoneMatch, snapshot->etag))
+    {
+      status = MHD_HTTP_NOT_MODIFIED;
+      resp = MHD_create_response_from_buffer (0, nullptr,
+                                              MHD_RESPMEM_PERSISTENT);
+    }
+  else
+    {
+      status = MHD_HTTP_OK;
+      resp = MHD_create_response_from_buffer (
+          snapshot->body.size (),
+          const_cast<char*> (snapshot->body.data ()),
+          MHD_RESPMEM_MUST_COPY);
+      MHD_add_response_header (resp, MHD_HTTP_HEADER_CONTENT_TYPE,
+                               "application/json");
+      MHD_add_response_header (resp, MHD_HTTP_HEADER_CONTENT_ENCODING,
+                               "gzip");
+    }
+  CHECK (resp != nullptr);
+
+  MHD_add_response_header (resp, MHD_HTTP_HEADER_ETAG,
+                           snapshot->etag.c_str ());
+  MHD_add_response_header (resp, MHD_HTTP_HEADER_CACHE_CONTROL, "no-cache");
+
+  const auto res = MHD_queue_response (conn, status, resp);
+  MHD_destroy_response (resp);
+
+  return res;
+}
+
+void
+SnapshotServer::Start ()
+{
+  CHECK (daemon == nullptr) << "SnapshotServer is already running";
+  shouldStop = false;
+
+  CHECK (generator == nullptr);
+  generator = std::make_unique<std::thread> ([this] ()
+    {
+      Refresh ();
+
+      xaya::uint256 known;
+      if (!known.FromHex (cache.GetBlock ()))
+        known.SetNull ();
+
+      while (!shouldStop)
+        {
+          xaya::uint256 newBlock;
+          game.WaitForChange (known, newBlock);
+          if (shouldStop)
+            break;
+
+          /* WaitForChange may also return on a timeout, in which case
+             we do not want to regenerate everything.  */
+          if (newBlock.IsNull () || newBlock == known)
+            continue;
+
+          Refresh ();
+          known = newBlock;
+        }
+    });
+
+  LOG (INFO) << "Starting snapshot server on port " << port;
+  daemon = MHD_start_daemon (MHD_USE_INTERNAL_POLLING_THREAD,
+                             port, nullptr, nullptr, &RequestCallback, this,
+                             MHD_OPTION_END);
+  CHECK (daemon != nullptr) << "Failed to start snapshot server";
+}
+
+void
+SnapshotServer::Stop ()
+{
+  CHECK (daemon != nullptr) << "SnapshotServer is not running";
+  MHD_stop_daemon (daemon);
+  daemon = nullptr;
+
+  /* The generator thread notices the flag at the latest when WaitForChange
+     returns after its timeout.  */
+  shouldStop = true;
+  generator->join ();
+  generator.reset ();
+}
+
+} // namespace pxd
@@ -0,0 +1,104 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PXD_SNAPSHOTSERVER_HPP
+#define PXD_SNAPSHOTSERVER_HPP
+
+#include "logic.hpp"
+#include "mhdutils.hpp"
+#include "snapshots.hpp"
+
+#include <xayagame/game.hpp>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace pxd
+{
+
+/**
+ * HTTP server that serves precomputed, gzipped snapshots of the game state
+ * (see SnapshotCache) at /snapshot/<name>.  The snapshots are regenerated
+ * on a background thread whenever a new block is processed, so that
+ * requests never hit the database.  Responses carry the block hash as
+ * ETag, and requests with a matching If-None-Match header get a 304.
+ *
+ * This needs access to the request headers, which xaya::RestApi does not
+ * provide, so that it runs as its own libmicrohttpd daemon.
+ */
+class SnapshotServer : public xaya::GameComponent
+{
+
+private:
+
+  /** The underlying Game instance.  */
+  xaya::Game& game;
+
+  /** The game logic implementation.  */
+  PXLogic& logic;
+
+  /** The port to listen on.  */
+  const int port;
+
+  /** The cache of current snapshots.  */
+  SnapshotCache cache;
+
+  /** The underlying daemon, if running.  */
+  struct MHD_Daemon* daemon = nullptr;
+
+  /** Set to true when the server is being stopped.  */
+  std::atomic<bool> shouldStop{false};
+
+  /** Thread regenerating the snapshots.  */
+  std::unique_ptr<std::thread> generator;
+
+  /**
+   * Regenerates the snapshots from the current game state.
+   */
+  void Refresh ();
+
+  /**
+   * Handler function for requests to the daemon.
+   */
+  static MhdResult RequestCallback (void* data, struct MHD_Connection* conn,
+                                    const char* url, const char* method,
+                                    const char* version,
+                                    const char* upload, size_t* uploadSize,
+                                    void** connData);
+
+public:
+
+  explicit SnapshotServer (xaya::Game& g, PXLogic& l, const int p)
+    : game(g), logic(l), port(p)
+  {}
+
+  ~SnapshotServer ();
+
+  SnapshotServer () = delete;
+  SnapshotServer (const SnapshotServer&) = delete;
+  void operator= (const SnapshotServer&) = delete;
+
+  void Start () override;
+  void Stop () override;
+
+};
+
+} // namespace pxd
+
+#endif // PXD_SNAPSHOTSERVER_HPP
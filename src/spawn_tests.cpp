@@ -104,7 +104,7 @@ TEST_F (SpawnTests, DataInitialised)
   ASSERT_TRUE (c != nullptr);
   ASSERT_EQ (c->GetOwner (), "domob");
 
-  EXPECT_TRUE (c->GetProto ().has_combat_data ());
+  EXPECT_TRUE (c->GetCombatData ().has_target_size ());
   EXPECT_GT (c->GetProto ().cargo_space (), 0);
   EXPECT_GT (c->GetHP ().armour (), 0);
   EXPECT_GT (c->GetHP ().shield (), 0);
@@ -0,0 +1,295 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Tool for exporting the game-state database of a tauriond data directory
+   to a snapshot file, and for importing such a snapshot into a fresh
+   data directory (so that a new node does not have to process the entire
+   chain from the initial state).  The "verify" mode just checks a snapshot
+   file against the per-table hashes it contains and an optional
+   checkpoint (block and state hash), without writing anything.
+
+   The checkpoint only covers the game state.  The internal tables of
+   libxayagame (in particular the undo data) are imported as-is, and
+   thus only snapshots from a trusted source should be used.
+
+   The database file is the "storage.sqlite" of libxayagame, found in
+   the data directory's subfolder for the game and chain.  */
+
+#include "database/database.hpp"
+#include "database/snapshot.hpp"
+#include "database/statehash.hpp"
+
+#include <xayagame/sqlitestorage.hpp>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <sqlite3.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace
+{
+
+DEFINE_string (db, "",
+               "the SQLite game-state database to export from or import to");
+DEFINE_string (snapshot, "",
+               "the snapshot file to write or read");
+DEFINE_string (expected_hash, "",
+               "if set, the state hash (checkpoint) an imported or verified"
+               " snapshot must match; requires --expected_block");
+DEFINE_string (expected_block, "",
+               "the block hash the checkpoint given by --expected_hash"
+               " is for");
+
+/**
+ * Database instance operating directly on an SQLite file.  This is just
+ * used for bulk reading and writing of the tables; it does not support
+ * auto-generated IDs.
+ */
+class FileDatabase : public pxd::Database
+{
+
+private:
+
+  /** The underlying SQLite database.  */
+  xaya::SQLiteDatabase db;
+
+public:
+
+  explicit FileDatabase (const std::string& file, const int flags)
+    : db(file, flags)
+  {
+    SetDatabase (db);
+  }
+
+  FileDatabase () = delete;
+  FileDatabase (const FileDatabase&) = delete;
+  void operator= (const FileDatabase&) = delete;
+
+  IdT
+  GetNextId () override
+  {
+    LOG (FATAL) << "FileDatabase does not support auto IDs";
+    return EMPTY_ID;
+  }
+
+  IdT
+  GetLogId () override
+  {
+    LOG (FATAL) << "FileDatabase does not support log IDs";
+    return EMPTY_ID;
+  }
+
+};
+
+/**
+ * Returns true if the given file exists.
+ */
+bool
+FileExists (const std::string& file)
+{
+  std::ifstream in(file);
+  return static_cast<bool> (in);
+}
+
+/**
+ * Imports the snapshot file into the given database and prints the
+ * resulting state hash.  Returns false if the import failed or the
+ * hash does not match the expected checkpoint.
+ */
+bool
+ImportAndCheck (pxd::Database& db)
+{
+  std::ifstream in(FLAGS_snapshot, std::ios::binary);
+  if (!in)
+    {
+      std::cerr << "Could not open " << FLAGS_snapshot << std::endl;
+      return false;
+    }
+
+  pxd::SnapshotInfo info;
+  if (!pxd::ImportSnapshot (in, db, info))
+    {
+      std::cerr << "Snapshot " << FLAGS_snapshot << " is invalid" << std::endl;
+      return false;
+    }
+
+  const auto hash = pxd::ComputeStateHash (db);
+  std::cout << "Block: " << info.block << "\n"
+            << "Tables: " << info.tableHashes.size () << "\n"
+            << "State hash: " << hash.ToHex () << std::endl;
+
+  if (FLAGS_expected_hash.empty ())
+    {
+      LOG (WARNING) << "No --expected_hash given, not checking the state";
+      return true;
+    }
+
+  /* A state hash alone does not say which block the state is at.  Thus
+     the checkpoint must also match the snapshot's block, so that tauriond
+     does not continue syncing from a different (e.g. orphaned) block.  */
+  if (info.block != FLAGS_expected_block)
+    {
+      std::cerr << "Snapshot is for block " << info.block
+                << ", expected " << FLAGS_expected_block << std::endl;
+      return false;
+    }
+
+  if (hash.ToHex () != FLAGS_expected_hash)
+    {
+      std::cerr << "State hash mismatch, expected " << FLAGS_expected_hash
+                << std::endl;
+      return false;
+    }
+
+  std::cout << "State hash matches the checkpoint" << std::endl;
+  return true;
+}
+
+/**
+ * Writes the database to a snapshot file.
+ */
+bool
+RunExport ()
+{
+  FileDatabase db(FLAGS_db, SQLITE_OPEN_READONLY);
+
+  std::ofstream out(FLAGS_snapshot, std::ios::binary);
+  if (!out)
+    {
+      std::cerr << "Could not open " << FLAGS_snapshot << std::endl;
+      return false;
+    }
+
+  /* The printed state hash must match the exported data, even if tauriond
+     is processing blocks on the database at the same time.  Hence we do
+     both inside a single read transaction.  */
+  db.Prepare ("BEGIN").Execute ();
+  pxd::ExportSnapshot (db, out);
+  const auto hash = pxd::ComputeStateHash (db);
+  db.Prepare ("ROLLBACK").Execute ();
+
+  std::cout << "State hash: " << hash.ToHex () << std::endl;
+
+  return true;
+}
+
+/**
+ * Loads a snapshot file into a new database.  The data is written to
+ * a temporary file first, which is only moved into place after it has been
+ * fully verified.  That way, a failed import never leaves a partial
+ * database behind that tauriond would then pick up.
+ */
+bool
+RunImport ()
+{
+  if (FileExists (FLAGS_db))
+    {
+      std::cerr << FLAGS_db << " exists already, refusing to overwrite"
+                << std::endl;
+      return false;
+    }
+
+  const std::string tmpFile = FLAGS_db + ".tmp";
+  std::remove (tmpFile.c_str ());
+
+  bool ok;
+  {
+    FileDatabase db(tmpFile, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    ok = ImportAndCheck (db);
+  }
+
+  if (!ok)
+    {
+      std::remove (tmpFile.c_str ());
+      return false;
+    }
+
+  CHECK_EQ (std::rename (tmpFile.c_str (), FLAGS_db.c_str ()), 0)
+      << "Failed to rename " << tmpFile << " to " << FLAGS_db;
+  std::cout << "Imported snapshot into " << FLAGS_db << std::endl;
+
+  return true;
+}
+
+/**
+ * Checks a snapshot file by importing it into an in-memory database.
+ */
+bool
+RunVerify ()
+{
+  FileDatabase db("verify", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE
+                              | SQLITE_OPEN_MEMORY);
+  return ImportAndCheck (db);
+}
+
+} // anonymous namespace
+
+int
+main (int argc, char** argv)
+{
+  google::InitGoogleLogging (argv[0]);
+
+  gflags::SetUsageMessage (
+      "statesnapshot export|import|verify [flags]\n\n"
+      "The checkpoint given by --expected_hash only covers the game state."
+      "  The internal\ntables of libxayagame (xayagame_*, e.g. undo data)"
+      " are trusted as-is.");
+  gflags::ParseCommandLineFlags (&argc, &argv, true);
+
+  if (argc != 2)
+    {
+      std::cerr << "Exactly one command (export, import or verify)"
+                << " must be given" << std::endl;
+      return EXIT_FAILURE;
+    }
+  const std::string cmd = argv[1];
+
+  if (FLAGS_snapshot.empty () || (cmd != "verify" && FLAGS_db.empty ()))
+    {
+      std::cerr << "--snapshot and --db must be given" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  if (FLAGS_expected_hash.empty () != FLAGS_expected_block.empty ())
+    {
+      std::cerr << "--expected_hash and --expected_block must be given"
+                << " together" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  bool ok;
+  if (cmd == "export")
+    ok = RunExport ();
+  else if (cmd == "import")
+    ok = RunImport ();
+  else if (cmd == "verify")
+    ok = RunVerify ();
+  else
+    {
+      std::cerr << "Invalid command: " << cmd << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
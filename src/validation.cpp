@@ -0,0 +1,751 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "validation.hpp"
+
+#include "database/account.hpp"
+#include "database/building.hpp"
+#include "database/character.hpp"
+#include "database/dex.hpp"
+#include "database/faction.hpp"
+#include "database/inventory.hpp"
+#include "database/ongoing.hpp"
+
+#include <xayautil/uint256.hpp>
+
+#include <glog/logging.h>
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <set>
+#include <type_traits>
+#include <unordered_map>
+
+namespace pxd
+{
+
+namespace
+{
+
+/* ************************************************************************** */
+
+/**
+ * Calls the callback for all buildings, or just the marked ones that
+ * still exist in the database.
+ */
+template <typename Fcn>
+  void
+  ForBuildings (Database& db, const DirtyIds* dirty, const Fcn& cb)
+{
+  BuildingsTable tbl(db);
+
+  if (dirty == nullptr)
+    {
+      auto res = tbl.QueryAll ();
+      while (res.Step ())
+        cb (*tbl.GetFromResult (res));
+      return;
+    }
+
+  for (const auto id : dirty->GetBuildings ())
+    {
+      auto b = tbl.GetById (id);
+      if (b != nullptr)
+        cb (*b);
+    }
+}
+
+/**
+ * Calls the callback for all characters, or just the marked ones that
+ * still exist in the database.
+ */
+template <typename Fcn>
+  void
+  ForCharacters (Database& db, const DirtyIds* dirty, const Fcn& cb)
+{
+  CharacterTable tbl(db);
+
+  if (dirty == nullptr)
+    {
+      auto res = tbl.QueryAll ();
+      while (res.Step ())
+        cb (*tbl.GetFromResult (res));
+      return;
+    }
+
+  for (const auto id : dirty->GetCharacters ())
+    {
+      auto c = tbl.GetById (id);
+      if (c != nullptr)
+        cb (*c);
+    }
+}
+
+/**
+ * Calls the callback for all characters inside the marked buildings
+ * (including deleted ones, for which there should be none).
+ */
+template <typename Fcn>
+  void
+  ForCharactersInDirtyBuildings (Database& db, const DirtyIds& dirty,
+                                 const Fcn& cb)
+{
+  CharacterTable tbl(db);
+  for (const auto id : dirty.GetBuildings ())
+    {
+      auto res = tbl.QueryForBuilding (id);
+      while (res.Step ())
+        cb (*tbl.GetFromResult (res));
+    }
+}
+
+/**
+ * Faction of accounts by name.  In full mode, all initialised accounts are
+ * loaded up front.  Otherwise, they are looked up (and cached) on demand.
+ */
+class AccountFactions
+{
+
+private:
+
+  AccountsTable accounts;
+
+  /** Whether all accounts have been loaded.  */
+  bool full;
+
+  /** Known factions by account name.  */
+  std::unordered_map<std::string, Faction> factions;
+
+public:
+
+  explicit AccountFactions (Database& db, const bool f)
+    : accounts(db), full(f)
+  {
+    if (!full)
+      return;
+
+    auto res = accounts.QueryInitialised ();
+    while (res.Step ())
+      {
+        auto a = accounts.GetFromResult (res);
+        const auto f = a->GetFaction ();
+        CHECK (f != Faction::INVALID && f != Faction::ANCIENT)
+            << "Account " << a->GetName () << " has invalid faction";
+        auto insert = factions.emplace (a->GetName (), f);
+        CHECK (insert.second) << "Duplicate account name " << a->GetName ();
+      }
+  }
+
+  /**
+   * Returns the faction of the given account, or INVALID if it does not
+   * exist or is not initialised.
+   */
+  Faction
+  Get (const std::string& name)
+  {
+    const auto mit = factions.find (name);
+    if (mit != factions.end ())
+      return mit->second;
+    if (full)
+      return Faction::INVALID;
+
+    auto a = accounts.GetByName (name);
+    const Faction f = (a == nullptr ? Faction::INVALID : a->GetFaction ());
+    CHECK (f != Faction::ANCIENT)
+        << "Account " << name << " has invalid faction";
+    factions.emplace (name, f);
+    return f;
+  }
+
+};
+
+/* ************************************************************************** */
+
+/**
+ * Verifies general consistency of buildings.
+ */
+void
+ValidateBuildings (Database& db, const Context& ctx, const DirtyIds* dirty)
+{
+  ForBuildings (db, dirty, [&ctx] (const Building& b)
+    {
+      const auto& pb = b.GetProto ();
+
+      CHECK (pb.age_data ().has_founded_height ())
+          << "Building " << b.GetId () << " has no founded height";
+      CHECK_LE (pb.age_data ().founded_height (), ctx.Height ())
+          << "Building " << b.GetId () << " is founded in the future";
+
+      if (pb.foundation ())
+        CHECK (!pb.age_data ().has_finished_height ())
+            << "Foundation " << b.GetId () << " has already finished height";
+      else
+        {
+          CHECK (pb.age_data ().has_finished_height ())
+              << "Building " << b.GetId () << " has no finished height";
+          CHECK_GE (pb.age_data ().finished_height (),
+                    pb.age_data ().founded_height ())
+              << "Building " << b.GetId ()
+              << " was finished before being founded";
+          CHECK_LE (pb.age_data ().finished_height (), ctx.Height ())
+              << "Building " << b.GetId () << " is finished in the future";
+        }
+
+      const auto& ro = ctx.RoConfig ().Building (b.GetType ());
+      const auto& constr = ro.construction ();
+      if (constr.has_faction ())
+        {
+          const auto roFaction = FactionFromString (constr.faction ());
+          CHECK (b.GetFaction () == roFaction)
+              << "Building " << b.GetId ()
+              << " is of faction " << FactionToString (b.GetFaction ())
+              << " but the base data requires faction "
+              << FactionToString (roFaction);
+        }
+    });
+}
+
+/**
+ * Verifies that each character's and building's faction in the database
+ * matches the owner's faction.
+ */
+void
+ValidateCharacterBuildingFactions (Database& db, const Context& ctx,
+                                   const DirtyIds* dirty)
+{
+  AccountFactions accountFactions(db, dirty == nullptr);
+
+  if (dirty != nullptr)
+    for (const auto& name : dirty->GetAccounts ())
+      accountFactions.Get (name);
+
+  ForCharacters (db, dirty, [&accountFactions] (const Character& c)
+    {
+      const auto f = accountFactions.Get (c.GetOwner ());
+      CHECK (f != Faction::INVALID)
+          << "Character " << c.GetId ()
+          << " owned by uninitialised account " << c.GetOwner ();
+      CHECK (c.GetFaction () == f)
+          << "Faction mismatch between character " << c.GetId ()
+          << " and owner account " << c.GetOwner ();
+    });
+
+  ForBuildings (db, dirty, [&accountFactions] (const Building& b)
+    {
+      if (b.GetFaction () == Faction::ANCIENT)
+        return;
+      const auto f = accountFactions.Get (b.GetOwner ());
+      CHECK (f != Faction::INVALID)
+          << "Building " << b.GetId ()
+          << " owned by uninitialised account " << b.GetOwner ();
+      CHECK (b.GetFaction () == f)
+          << "Faction mismatch between building " << b.GetId ()
+          << " and owner account " << b.GetOwner ();
+    });
+}
+
+/**
+ * Verifies that each account has at most the maximum allowed number of
+ * characters in the database.
+ */
+void
+ValidateCharacterLimit (Database& db, const Context& ctx,
+                        const DirtyIds* dirty)
+{
+  CharacterTable characters(db);
+  const auto check = [&] (const std::string& name)
+    {
+      CHECK_LE (characters.CountForOwner (name),
+                ctx.RoConfig ()->params ().character_limit ())
+          << "Account " << name << " has too many characters";
+    };
+
+  if (dirty == nullptr)
+    {
+      AccountsTable accounts(db);
+      auto res = accounts.QueryInitialised ();
+      while (res.Step ())
+        check (accounts.GetFromResult (res)->GetName ());
+      return;
+    }
+
+  /* Only new characters (or account changes) can push an account over
+     the limit, so we check the owners of all touched characters.  */
+  std::set<std::string> owners = dirty->GetAccounts ();
+  ForCharacters (db, dirty, [&owners] (const Character& c)
+    {
+      owners.insert (c.GetOwner ());
+    });
+  for (const auto& name : owners)
+    check (name);
+}
+
+/**
+ * Verifies general assumptions about characters.
+ */
+void
+ValidateCharacters (Database& db, const Context& ctx, const DirtyIds* dirty)
+{
+  BuildingsTable buildings(db);
+
+  const auto check = [&] (const Character& c)
+    {
+      const auto& pb = c.GetProto ();
+
+      /* Check cargo space limit.  */
+      CHECK_LE (c.UsedCargoSpace (ctx.RoConfig ()), pb.cargo_space ())
+          << "Character " << c.GetId () << " exceeds cargo limit";
+
+      /* If the character is inside a building, check that it is matching
+         their faction or ancient.  */
+      if (c.IsInBuilding ())
+        {
+          const auto id = c.GetBuildingId ();
+          auto b = buildings.GetById (id);
+          CHECK (b != nullptr)
+              << "Character " << c.GetId ()
+              << " is in non-existant building " << id;
+
+          if (b->GetFaction () != Faction::ANCIENT)
+            CHECK (c.GetFaction () == b->GetFaction ())
+                << "Character " << c.GetId ()
+                << " is in building " << id
+                << " of opposing faction";
+        }
+    };
+
+  ForCharacters (db, dirty, check);
+  if (dirty != nullptr)
+    ForCharactersInDirtyBuildings (db, *dirty, check);
+}
+
+/**
+ * Verifies that all "in building" inventories have an existing
+ * building and account association.  No inventories may be inside a
+ * foundation.
+ */
+void
+ValidateBuildingInventories (Database& db, const Context& ctx,
+                             const DirtyIds* dirty)
+{
+  BuildingInventoriesTable inv(db);
+  AccountsTable accounts(db);
+  BuildingsTable buildings(db);
+
+  const auto check = [&] (const BuildingInventory& h)
+    {
+      auto b = buildings.GetById (h.GetBuildingId ());
+      CHECK (b != nullptr)
+          << "Inventory for non-existant building " << h.GetBuildingId ();
+      CHECK (!b->GetProto ().foundation ())
+          << "Inventory for " << h.GetAccount ()
+          << " in foundation " << h.GetBuildingId ();
+      CHECK (accounts.GetByName (h.GetAccount ()) != nullptr)
+          << "Inventory for non-existant account " << h.GetAccount ();
+    };
+
+  if (dirty == nullptr)
+    {
+      auto res = inv.QueryAll ();
+      while (res.Step ())
+        check (*inv.GetFromResult (res));
+    }
+  else
+    {
+      for (const auto& key : dirty->GetBuildingInventories ())
+        {
+          auto h = inv.Get (key.first, key.second);
+          if (!h->GetInventory ().IsEmpty ())
+            check (*h);
+        }
+
+      /* Buildings that have been turned into foundations (or deleted)
+         must not have any inventories.  */
+      for (const auto id : dirty->GetBuildings ())
+        {
+          auto res = inv.QueryForBuilding (id);
+          while (res.Step ())
+            check (*inv.GetFromResult (res));
+        }
+    }
+
+  ForBuildings (db, dirty, [] (const Building& b)
+    {
+      const auto& pb = b.GetProto ();
+      CHECK (pb.foundation () || !pb.has_construction_inventory ())
+          << "Building " << b.GetId ()
+          << " is not a foundation but has construction inventory";
+    });
+}
+
+/**
+ * Verifies that the links between characters/buildings and ongoing
+ * operations are all valid.
+ */
+void
+ValidateOngoingsLinks (Database& db, const Context& ctx,
+                       const DirtyIds* dirty)
+{
+  BuildingsTable buildings(db);
+  CharacterTable characters(db);
+  OngoingsTable ongoings(db);
+
+  const auto checkOp = [&] (const OngoingOperation& op)
+    {
+      const auto bId = op.GetBuildingId ();
+      const auto cId = op.GetCharacterId ();
+
+      if (bId != Database::EMPTY_ID)
+        {
+          auto b = buildings.GetById (bId);
+          CHECK (b != nullptr)
+              << "Operation " << op.GetId ()
+              << " refers to non-existing building " << bId;
+          if (op.GetProto ().has_building_construction ())
+            CHECK_EQ (b->GetProto ().ongoing_construction (), op.GetId ())
+                << "Building " << bId
+                << " does not refer back to ongoing " << op.GetId ();
+        }
+
+      if (cId != Database::EMPTY_ID)
+        {
+          auto c = characters.GetById (cId);
+          CHECK (c != nullptr)
+              << "Operation " << op.GetId ()
+              << " refers to non-existing character " << cId;
+          CHECK_EQ (c->GetProto ().ongoing (), op.GetId ())
+              << "Character " << cId
+              << " does not refer back to ongoing " << op.GetId ();
+        }
+    };
+
+  if (dirty == nullptr)
+    {
+      auto res = ongoings.QueryAll ();
+      while (res.Step ())
+        checkOp (*ongoings.GetFromResult (res));
+    }
+  else
+    {
+      for (const auto id : dirty->GetOngoings ())
+        {
+          auto op = ongoings.GetById (id);
+          if (op != nullptr)
+            checkOp (*op);
+        }
+
+      /* Characters and buildings that have been deleted must not have
+         any operations left referring to them.  */
+      for (const auto id : dirty->GetBuildings ())
+        {
+          auto res = ongoings.QueryForBuilding (id);
+          while (res.Step ())
+            checkOp (*ongoings.GetFromResult (res));
+        }
+      for (const auto id : dirty->GetCharacters ())
+        {
+          auto res = ongoings.QueryForCharacter (id);
+          while (res.Step ())
+            checkOp (*ongoings.GetFromResult (res));
+        }
+    }
+
+  ForCharacters (db, dirty, [&] (const Character& c)
+    {
+      if (!c.IsBusy ())
+        return;
+
+      const auto opId = c.GetProto ().ongoing ();
+      const auto op = ongoings.GetById (opId);
+      CHECK (op != nullptr)
+          << "Character " << c.GetId ()
+          << " has non-existing ongoing operation " << opId;
+      CHECK_EQ (op->GetCharacterId (), c.GetId ())
+          << "Operation " << opId
+          << " does not refer back to character " << c.GetId ();
+    });
+
+  ForBuildings (db, dirty, [&] (const Building& b)
+    {
+      if (!b.GetProto ().has_ongoing_construction ())
+        return;
+
+      const auto opId = b.GetProto ().ongoing_construction ();
+      const auto op = ongoings.GetById (opId);
+      CHECK (op != nullptr)
+          << "Building " << b.GetId ()
+          << " has non-existing ongoing operation " << opId;
+      CHECK_EQ (op->GetBuildingId (), b.GetId ())
+          << "Operation " << opId
+          << " does not refer back to building " << b.GetId ();
+      CHECK (op->GetProto ().has_building_construction ())
+          << "Building " << b.GetId ()
+          << " refers to ongoing " << opId
+          << " that is not a building construction";
+    });
+}
+
+/**
+ * Validates that all DEX orders refer to valid accounts and buildings.
+ */
+void
+ValidateOrderLinks (Database& db, const Context& ctx, const DirtyIds* dirty)
+{
+  AccountsTable accounts(db);
+  BuildingsTable buildings(db);
+  DexOrderTable orders(db);
+
+  const auto check = [&] (const DexOrder& o)
+    {
+      CHECK (accounts.GetByName (o.GetAccount ()) != nullptr)
+          << "Order " << o.GetId ()
+          << " refers to non-existing account " << o.GetAccount ();
+
+      auto b = buildings.GetById (o.GetBuilding ());
+      CHECK (b != nullptr)
+          << "Order " << o.GetId ()
+          << " refers to non-existing building " << o.GetBuilding ();
+      CHECK (!b->GetProto ().foundation ())
+          << "Order " << o.GetId ()
+          << " is in foundation " << o.GetBuilding ();
+    };
+
+  if (dirty == nullptr)
+    {
+      auto res = orders.QueryAll ();
+      while (res.Step ())
+        check (*orders.GetFromResult (res));
+      return;
+    }
+
+  for (const auto id : dirty->GetOrders ())
+    {
+      auto o = orders.GetById (id);
+      if (o != nullptr)
+        check (*o);
+    }
+
+  for (const auto id : dirty->GetBuildings ())
+    {
+      auto res = orders.QueryForBuilding (id);
+      while (res.Step ())
+        check (*orders.GetFromResult (res));
+    }
+}
+
+/**
+ * Verifies that the in-memory schedule of ongoing operations (if any is
+ * in use) matches the database.
+ */
+void
+ValidateOngoingsSchedule (Database& db)
+{
+  const auto* schedule = db.GetOngoingsSchedule ();
+  if (schedule != nullptr)
+    schedule->Verify (db);
+}
+
+/* ************************************************************************** */
+
+/** Signature of the individual validator functions.  */
+using ValidatorFcn = void (*) (Database& db, const Context& ctx,
+                               const DirtyIds* dirty);
+
+/** All validators that we run.  They are independent of each other.  */
+const ValidatorFcn VALIDATORS[] =
+  {
+    &ValidateBuildings,
+    &ValidateCharacters,
+    &ValidateCharacterBuildingFactions,
+    &ValidateCharacterLimit,
+    &ValidateBuildingInventories,
+    &ValidateOngoingsLinks,
+    &ValidateOrderLinks,
+  };
+
+/**
+ * Returns the block hash stored by libxayagame as current state in
+ * the given database, or an empty string if there is none.
+ */
+std::string
+GetCurrentBlock (Database& db)
+{
+  auto stmt = (*db).PrepareRo (R"(
+    SELECT `value`
+      FROM `xayagame_current`
+      WHERE `key` = 'blockhash'
+  )");
+  if (!stmt.Step ())
+    return "";
+
+  CHECK_EQ (sqlite3_column_bytes (stmt.ro (), 0),
+            static_cast<int> (xaya::uint256::NUM_BYTES));
+  xaya::uint256 hash;
+  hash.FromBlob (static_cast<const unsigned char*> (
+      sqlite3_column_blob (stmt.ro (), 0)));
+
+  return hash.ToHex ();
+}
+
+} // anonymous namespace
+
+void
+ValidateStateFull (Database& db, const Context& ctx)
+{
+  for (const auto fcn : VALIDATORS)
+    fcn (db, ctx, nullptr);
+  ValidateOngoingsSchedule (db);
+}
+
+void
+ValidateStateIncremental (Database& db, const Context& ctx,
+                          const DirtyIds& dirty)
+{
+  VLOG (1)
+      << "Validating " << dirty.Size () << " touched entities"
+      << " of the game state...";
+  for (const auto fcn : VALIDATORS)
+    fcn (db, ctx, &dirty);
+}
+
+void
+ValidateStateParallel (const std::vector<Database*>& dbs, const Context& ctx,
+                       const DirtyIds* dirty)
+{
+  CHECK (!dbs.empty ());
+
+  /* The validators take very different time depending on the state,
+     so rather than a fixed assignment, each thread picks the next
+     validator still to be run when it is done with its previous one.  */
+  std::atomic<size_t> next(0);
+  const auto worker = [&] (Database& db)
+    {
+      while (true)
+        {
+          const size_t ind = next++;
+          if (ind >= std::extent<decltype (VALIDATORS)>::value)
+            break;
+          VALIDATORS[ind] (db, ctx, dirty);
+        }
+    };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < dbs.size (); ++i)
+    threads.emplace_back (worker, std::ref (*dbs[i]));
+  worker (*dbs[0]);
+  for (auto& t : threads)
+    t.join ();
+}
+
+/* ************************************************************************** */
+
+AsyncStateValidator::AsyncStateValidator (const std::string& f,
+                                          const xaya::Chain c,
+                                          const BaseMap& m, const unsigned n)
+  : file(f), chain(c), map(m), numThreads(std::max (1u, n))
+{
+  LOG (INFO)
+      << "Validating game states of " << file << " asynchronously with "
+      << numThreads << " threads";
+}
+
+AsyncStateValidator::~AsyncStateValidator ()
+{
+  Wait ();
+}
+
+void
+AsyncStateValidator::Wait ()
+{
+  if (job == nullptr)
+    return;
+
+  job->join ();
+  job.reset ();
+}
+
+bool
+AsyncStateValidator::Start (const std::string& hash, const unsigned height,
+                            const int64_t timestamp,
+                            std::unique_ptr<DirtyIds> dirty)
+{
+  Wait ();
+
+  /* Open the connections and their read transactions right now, so that
+     they are bound to the current state.  In SQLite, the snapshot is only
+     taken with the first read, which we use to verify that the state
+     is indeed the one of the expected block.  libxayagame may batch
+     multiple blocks into a single transaction (e.g. while catching up),
+     in which case the block's state has never been committed.  */
+  std::vector<std::unique_ptr<ReadOnlyDatabase>> dbs;
+  for (unsigned i = 0; i < numThreads; ++i)
+    {
+      auto db = std::make_unique<ReadOnlyDatabase> (file);
+      db->Prepare ("BEGIN").Execute ();
+      const std::string current = GetCurrentBlock (*db);
+      if (current != hash)
+        {
+          VLOG (1)
+              << "Committed state is at block " << current
+              << " instead of " << hash << " (height " << height << ")"
+              << ", skipping validation";
+          db->Prepare ("ROLLBACK").Execute ();
+          for (auto& d : dbs)
+            d->Prepare ("ROLLBACK").Execute ();
+          return false;
+        }
+      dbs.push_back (std::move (db));
+    }
+
+  /* The thread takes over the connections and dirty IDs.  They are held
+     in shared pointers, since C++14 lambdas cannot capture by move.  */
+  auto jobDbs = std::make_shared<decltype (dbs)> (std::move (dbs));
+  std::shared_ptr<DirtyIds> jobDirty (std::move (dirty));
+
+  job = std::make_unique<std::thread> (
+      [this, height, timestamp, jobDbs, jobDirty] ()
+    {
+      const Context ctx(chain, map, height, timestamp);
+
+      std::vector<Database*> ptrs;
+      for (auto& db : *jobDbs)
+        ptrs.push_back (db.get ());
+
+      const auto start = std::chrono::steady_clock::now ();
+      ValidateStateParallel (ptrs, ctx, jobDirty.get ());
+      const auto end = std::chrono::steady_clock::now ();
+
+      for (auto& db : *jobDbs)
+        db->Prepare ("ROLLBACK").Execute ();
+
+      VLOG (1)
+          << "Validated " << (jobDirty == nullptr ? "full" : "incremental")
+          << " state at height " << height << " in "
+          << std::chrono::duration_cast<std::chrono::milliseconds> (
+                end - start).count ()
+          << " ms";
+    });
+
+  return true;
+}
+
+} // namespace pxd
@@ -0,0 +1,134 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PXD_VALIDATION_HPP
+#define PXD_VALIDATION_HPP
+
+#include "connectionpool.hpp"
+#include "context.hpp"
+
+#include "database/database.hpp"
+#include "database/dirtyids.hpp"
+#include "mapdata/basemap.hpp"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pxd
+{
+
+/*
+ * Consistency checks of the game state ("slow assertions").  The state
+ * is checked by a fixed set of independent validators (buildings,
+ * characters, faction links, character limit, inventories, ongoing links
+ * and order links).  Each of them can either run on the full state, or
+ * only on the entities recorded in a DirtyIds instance (plus whatever
+ * links to them).  All of them CHECK-fail if the state is invalid.
+ */
+
+/**
+ * Runs all validators on the full state.  This also verifies the
+ * in-memory schedule of ongoing operations, if one is attached to the
+ * database.
+ */
+void ValidateStateFull (Database& db, const Context& ctx);
+
+/**
+ * Runs all validators just on the entities marked in the given DirtyIds,
+ * e.g. the ones that have been touched while processing a block.
+ */
+void ValidateStateIncremental (Database& db, const Context& ctx,
+                               const DirtyIds& dirty);
+
+/**
+ * Runs the validators distributed over multiple threads.  Each thread
+ * uses its own of the given database instances, which should be separate
+ * (read-only) connections to the same state.  If dirty is null, the full
+ * state is validated (without the ongoings schedule, which is bound to
+ * the main connection); otherwise just the marked entities.
+ */
+void ValidateStateParallel (const std::vector<Database*>& dbs,
+                            const Context& ctx, const DirtyIds* dirty);
+
+/**
+ * Validates already committed states on background threads, so that
+ * the validation overlaps with processing of the next block rather than
+ * adding to the block time.  Each job uses a fixed number of read-only
+ * connections to the database file, on which a read transaction is
+ * opened before Start returns.  Thus (with SQLite's WAL mode) the job
+ * sees exactly the state at the time of Start, even if the main
+ * connection commits further changes in the mean time.
+ *
+ * At most one job is running at a time; starting a new one waits for
+ * the previous to finish.
+ */
+class AsyncStateValidator
+{
+
+private:
+
+  /** The database file to validate.  */
+  const std::string file;
+
+  /** The chain we are on.  */
+  const xaya::Chain chain;
+
+  /** The basemap to use for the contexts.  */
+  const BaseMap& map;
+
+  /** Number of threads (and connections) to use for each job.  */
+  const unsigned numThreads;
+
+  /** The thread running the current job, if any.  */
+  std::unique_ptr<std::thread> job;
+
+public:
+
+  explicit AsyncStateValidator (const std::string& f, xaya::Chain c,
+                                const BaseMap& m, unsigned n);
+
+  ~AsyncStateValidator ();
+
+  AsyncStateValidator () = delete;
+  AsyncStateValidator (const AsyncStateValidator&) = delete;
+  void operator= (const AsyncStateValidator&) = delete;
+
+  /**
+   * Starts validating the current committed state, which should correspond
+   * to the given block hash, height and timestamp.  If dirty is null,
+   * the full state is checked, and otherwise just the marked entities.
+   *
+   * If the committed state is not at the given block (e.g. because
+   * libxayagame batched it into one transaction with later blocks),
+   * no validation is done and false is returned.
+   */
+  bool Start (const std::string& hash, unsigned height, int64_t timestamp,
+              std::unique_ptr<DirtyIds> dirty);
+
+  /**
+   * Waits for the currently running job (if any) to finish.
+   */
+  void Wait ();
+
+};
+
+} // namespace pxd
+
+#endif // PXD_VALIDATION_HPP
@@ -0,0 +1,335 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "validation.hpp"
+
+#include "testutils.hpp"
+
+#include "database/account.hpp"
+#include "database/building.hpp"
+#include "database/character.hpp"
+#include "database/dbtest.hpp"
+#include "database/dex.hpp"
+#include "database/ongoing.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sqlite3.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pxd
+{
+namespace
+{
+
+class ValidationTests : public DBTestWithSchema
+{
+
+protected:
+
+  ContextForTesting ctx;
+
+  AccountsTable accounts;
+  BuildingsTable buildings;
+  CharacterTable characters;
+  DexOrderTable orders;
+
+  DirtyIds dirty;
+
+  ValidationTests ()
+    : accounts(db), buildings(db), characters(db), orders(db)
+  {
+    accounts.CreateNew ("red")->SetFaction (Faction::RED);
+    accounts.CreateNew ("green")->SetFaction (Faction::GREEN);
+  }
+
+  /**
+   * Creates a finished building of the given owner and faction.
+   */
+  Database::IdT
+  CreateBuilding (const std::string& owner, const Faction f)
+  {
+    auto b = buildings.CreateNew ("checkmark", owner, f);
+    b->MutableProto ().mutable_age_data ()->set_founded_height (0);
+    b->MutableProto ().mutable_age_data ()->set_finished_height (0);
+    return b->GetId ();
+  }
+
+  /**
+   * Attaches our DirtyIds to the database, so that all further changes
+   * are recorded.
+   */
+  void
+  StartRecording ()
+  {
+    db.SetDirtyIds (&dirty);
+  }
+
+  void
+  ValidateIncremental ()
+  {
+    ValidateStateIncremental (db, ctx, dirty);
+  }
+
+};
+
+TEST_F (ValidationTests, ValidState)
+{
+  const auto bId = CreateBuilding ("red", Faction::RED);
+  StartRecording ();
+  characters.CreateNew ("red", Faction::RED)->SetBuildingId (bId);
+  orders.CreateNew (bId, "red", DexOrder::Type::BID, "foo", 1, 2);
+
+  ValidateIncremental ();
+  ValidateStateFull (db, ctx);
+}
+
+TEST_F (ValidationTests, UntouchedEntitiesIgnored)
+{
+  characters.CreateNew ("red", Faction::GREEN);
+
+  StartRecording ();
+  characters.CreateNew ("green", Faction::GREEN);
+
+  ValidateIncremental ();
+  EXPECT_DEATH (ValidateStateFull (db, ctx), "Faction mismatch");
+}
+
+TEST_F (ValidationTests, TouchedCharacter)
+{
+  const auto bId = CreateBuilding ("green", Faction::GREEN);
+  const auto cId = characters.CreateNew ("red", Faction::RED)->GetId ();
+
+  StartRecording ();
+  characters.GetById (cId)->SetBuildingId (bId);
+
+  EXPECT_DEATH (ValidateIncremental (), "of opposing faction");
+}
+
+TEST_F (ValidationTests, DeletedBuilding)
+{
+  const auto bId = CreateBuilding ("red", Faction::RED);
+  characters.CreateNew ("red", Faction::RED)->SetBuildingId (bId);
+
+  StartRecording ();
+  buildings.DeleteById (bId);
+
+  EXPECT_DEATH (ValidateIncremental (), "non-existant building");
+}
+
+TEST_F (ValidationTests, DeletedCharacterWithOngoing)
+{
+  OngoingsTable ongoings(db);
+
+  const auto cId = characters.CreateNew ("red", Faction::RED)->GetId ();
+  {
+    auto op = ongoings.CreateNew (1);
+    op->SetCharacterId (cId);
+    op->MutableProto ().mutable_prospection ();
+    characters.GetById (cId)->MutableProto ().set_ongoing (op->GetId ());
+  }
+
+  StartRecording ();
+  characters.DeleteById (cId);
+
+  EXPECT_DEATH (ValidateIncremental (), "non-existing character");
+}
+
+TEST_F (ValidationTests, BuildingTurnedFoundation)
+{
+  const auto bId = CreateBuilding ("red", Faction::RED);
+  orders.CreateNew (bId, "red", DexOrder::Type::ASK, "foo", 1, 2);
+
+  StartRecording ();
+  {
+    auto b = buildings.GetById (bId);
+    b->MutableProto ().set_foundation (true);
+    b->MutableProto ().mutable_age_data ()->clear_finished_height ();
+  }
+
+  EXPECT_DEATH (ValidateIncremental (), "is in foundation");
+}
+
+TEST_F (ValidationTests, CharacterLimit)
+{
+  StartRecording ();
+  const unsigned limit = ctx.RoConfig ()->params ().character_limit ();
+  for (unsigned i = 0; i < limit; ++i)
+    characters.CreateNew ("red", Faction::RED);
+  ValidateIncremental ();
+
+  characters.CreateNew ("red", Faction::RED);
+  EXPECT_DEATH (ValidateIncremental (), "has too many characters");
+}
+
+/**
+ * Tests for the parallel and asynchronous validation, which need the state
+ * in a database file (so that multiple connections can be opened to it).
+ */
+class ParallelValidationTests : public ValidationTests
+{
+
+protected:
+
+  /** The temporary file with a copy of the database.  */
+  std::string file;
+
+  ParallelValidationTests ()
+  {
+    char name[] = "/tmp/taurion-validation-XXXXXX";
+    const int fd = mkstemp (name);
+    CHECK_GE (fd, 0);
+    close (fd);
+    file = name;
+
+    auto stmt = db.Prepare (R"(
+      CREATE TABLE `xayagame_current` (
+        `key` TEXT PRIMARY KEY,
+        `value` BLOB NOT NULL
+      )
+    )");
+    stmt.Execute ();
+  }
+
+  ~ParallelValidationTests ()
+  {
+    std::remove (file.c_str ());
+  }
+
+  /**
+   * Writes the current state of our database to the file.
+   */
+  void
+  WriteFile ()
+  {
+    sqlite3* target;
+    CHECK_EQ (sqlite3_open (file.c_str (), &target), SQLITE_OK);
+    sqlite3_backup* backup = sqlite3_backup_init (target, "main",
+                                                  **db, "main");
+    CHECK (backup != nullptr);
+    CHECK_EQ (sqlite3_backup_step (backup, -1), SQLITE_DONE);
+    CHECK_EQ (sqlite3_backup_finish (backup), SQLITE_OK);
+    CHECK_EQ (sqlite3_close (target), SQLITE_OK);
+  }
+
+  /**
+   * Sets the current block hash as libxayagame would store it.
+   */
+  void
+  SetCurrentBlock (const std::string& hash)
+  {
+    auto stmt = db.Prepare (R"(
+      INSERT OR REPLACE INTO `xayagame_current` (`key`, `value`)
+        VALUES ('blockhash', x')" + hash + R"(')
+    )");
+    stmt.Execute ();
+  }
+
+  /**
+   * Runs parallel validation with the given number of threads on the file.
+   */
+  void
+  ValidateParallel (const unsigned threads, const DirtyIds* d)
+  {
+    std::vector<std::unique_ptr<ReadOnlyDatabase>> dbs;
+    std::vector<Database*> ptrs;
+    for (unsigned i = 0; i < threads; ++i)
+      {
+        dbs.push_back (std::make_unique<ReadOnlyDatabase> (file));
+        ptrs.push_back (dbs.back ().get ());
+      }
+
+    ValidateStateParallel (ptrs, ctx, d);
+  }
+
+};
+
+TEST_F (ParallelValidationTests, Valid)
+{
+  const auto bId = CreateBuilding ("red", Faction::RED);
+  StartRecording ();
+  characters.CreateNew ("red", Faction::RED)->SetBuildingId (bId);
+  WriteFile ();
+
+  ValidateParallel (1, nullptr);
+  ValidateParallel (3, nullptr);
+  ValidateParallel (3, &dirty);
+}
+
+TEST_F (ParallelValidationTests, Invalid)
+{
+  const auto bId = CreateBuilding ("green", Faction::GREEN);
+  characters.CreateNew ("red", Faction::RED)->SetBuildingId (bId);
+  WriteFile ();
+
+  EXPECT_DEATH (ValidateParallel (3, nullptr), "of opposing faction");
+}
+
+const std::string BLOCK_HASH
+    = "0000000000000000000000000000000000000000000000000000000000000abc";
+const std::string OTHER_HASH
+    = "0000000000000000000000000000000000000000000000000000000000000def";
+
+TEST_F (ParallelValidationTests, Async)
+{
+  const auto bId = CreateBuilding ("green", Faction::GREEN);
+  StartRecording ();
+  characters.CreateNew ("red", Faction::RED)->SetBuildingId (bId);
+  SetCurrentBlock (BLOCK_HASH);
+  WriteFile ();
+
+  AsyncStateValidator validator(file, ctx.Chain (), ctx.Map (), 2);
+  EXPECT_DEATH (
+    {
+      validator.Start (BLOCK_HASH, ctx.Height (), ctx.Timestamp (),
+                       std::make_unique<DirtyIds> (dirty));
+      validator.Wait ();
+    }, "of opposing faction");
+
+  /* Touched entities that are fine do not trigger a failure.  */
+  DirtyIds other;
+  other.MarkAccount ("green");
+  EXPECT_TRUE (validator.Start (BLOCK_HASH, ctx.Height (), ctx.Timestamp (),
+                                std::make_unique<DirtyIds> (other)));
+  validator.Wait ();
+}
+
+TEST_F (ParallelValidationTests, AsyncOtherBlockCommitted)
+{
+  const auto bId = CreateBuilding ("green", Faction::GREEN);
+  StartRecording ();
+  characters.CreateNew ("red", Faction::RED)->SetBuildingId (bId);
+  SetCurrentBlock (OTHER_HASH);
+  WriteFile ();
+
+  /* The committed state is not the one of the block we want to validate
+     (e.g. because it was batched with others), so it is skipped.  */
+  AsyncStateValidator validator(file, ctx.Chain (), ctx.Map (), 2);
+  EXPECT_FALSE (validator.Start (BLOCK_HASH, ctx.Height (), ctx.Timestamp (),
+                                 std::make_unique<DirtyIds> (dirty)));
+  validator.Wait ();
+}
+
+} // anonymous namespace
+} // namespace pxd
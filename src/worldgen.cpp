@@ -0,0 +1,327 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "worldgen.hpp"
+
+#include "buildings.hpp"
+#include "logic.hpp"
+#include "spawn.hpp"
+
+#include "database/account.hpp"
+#include "database/building.hpp"
+#include "database/character.hpp"
+#include "database/dex.hpp"
+#include "database/inventory.hpp"
+#include "database/ongoing.hpp"
+
+#include <glog/logging.h>
+
+namespace pxd
+{
+
+namespace
+{
+
+/** The factions of players.  */
+const Faction PLAYER_FACTIONS[] = {Faction::RED, Faction::GREEN, Faction::BLUE};
+
+/**
+ * Building types (without the faction prefix) that we place.  They are
+ * all constructible by players of the corresponding faction.
+ */
+const char* const BUILDING_TYPES[] = {"rt", "r", "rf", "cf", "cc"};
+
+/** Items used for DEX orders and building inventories.  */
+const char* const ITEMS[] = {"mat a", "mat b", "mat c", "mat d"};
+
+/** Output of generated item-construction operations.  */
+constexpr const char* CONSTRUCTION_OUTPUT = "lf gun";
+
+/** Number of placement attempts for each building before we give up.  */
+constexpr unsigned BUILDING_ATTEMPTS = 100;
+
+/** Maximum duration (in blocks) of generated ongoing operations.  */
+constexpr unsigned MAX_ONGOING_BLOCKS = 100;
+
+/**
+ * Returns a random element of an array.
+ */
+template <typename T, size_t N>
+  const T&
+  RandomElement (xaya::Random& rnd, const T (&arr)[N])
+{
+  return arr[rnd.NextInt (N)];
+}
+
+} // anonymous namespace
+
+WorldGenerator::WorldGenerator (Database& d, const Context& c,
+                                xaya::Random& r, const WorldGenParams& p)
+  : db(d), ctx(c), rnd(r), params(p), dyn(db, ctx)
+{}
+
+HexCoord
+WorldGenerator::RandomLocation ()
+{
+  HexCoord centre;
+  HexCoord::IntT radius;
+  if (hotspots.empty ())
+    {
+      centre = HexCoord (0, 0);
+      radius = params.spreadRadius;
+    }
+  else
+    {
+      centre = hotspots[rnd.NextInt (hotspots.size ())];
+      radius = params.hotspotRadius;
+    }
+
+  return ChooseSpawnLocation (centre, radius, rnd, dyn, ctx);
+}
+
+Faction
+WorldGenerator::RandomFaction ()
+{
+  return RandomElement (rnd, PLAYER_FACTIONS);
+}
+
+const std::string&
+WorldGenerator::RandomAccount (const Faction f)
+{
+  const auto& names = accounts.at (f);
+  CHECK (!names.empty ());
+  return names[rnd.NextInt (names.size ())];
+}
+
+void
+WorldGenerator::CreateAccounts ()
+{
+  CHECK_GE (params.accounts, 3)
+      << "We need at least one account per faction";
+
+  AccountsTable tbl(db);
+  for (unsigned i = 0; i < params.accounts; ++i)
+    {
+      const std::string name = "player " + std::to_string (i);
+      const Faction f = PLAYER_FACTIONS[i % 3];
+      tbl.CreateNew (name)->SetFaction (f);
+      accounts[f].push_back (name);
+    }
+
+  LOG (INFO) << "Created " << params.accounts << " accounts";
+}
+
+void
+WorldGenerator::CreateBuildings ()
+{
+  BuildingsTable tbl(db);
+  BuildingInventoriesTable inv(db);
+
+  unsigned placed = 0;
+  for (unsigned i = 0; i < params.buildings; ++i)
+    {
+      const Faction f = RandomFaction ();
+      const std::string type = FactionToString (f) + " "
+                                  + RandomElement (rnd, BUILDING_TYPES);
+
+      proto::ShapeTransformation trafo;
+      trafo.set_rotation_steps (rnd.NextInt (6));
+
+      bool found = false;
+      HexCoord pos;
+      for (unsigned j = 0; j < BUILDING_ATTEMPTS; ++j)
+        {
+          pos = RandomLocation ();
+          if (CanPlaceBuilding (type, trafo, pos, dyn, ctx))
+            {
+              found = true;
+              break;
+            }
+        }
+      if (!found)
+        {
+          LOG (WARNING) << "Could not find a place for building " << i;
+          continue;
+        }
+
+      /* Every fourth building is left as foundation (without the resources
+         to start construction yet).  Those cannot hold inventories or
+         DEX orders, so we only keep track of the finished ones.  */
+      const bool foundation = (i % 4 == 3);
+
+      auto b = tbl.CreateNew (type, RandomAccount (f), f);
+      b->SetCentre (pos);
+      auto& pb = b->MutableProto ();
+      *pb.mutable_shape_trafo () = trafo;
+      pb.mutable_age_data ()->set_founded_height (ctx.Height ());
+      if (foundation)
+        pb.set_foundation (true);
+      else
+        pb.mutable_age_data ()->set_finished_height (ctx.Height ());
+      UpdateBuildingStats (*b, ctx.Chain ());
+      dyn.AddBuilding (*b);
+      ++placed;
+
+      if (foundation)
+        continue;
+
+      buildings[f].push_back (b->GetId ());
+      for (const auto& name : accounts.at (f))
+        if (rnd.ProbabilityRoll (1, 2))
+          inv.Get (b->GetId (), name)->GetInventory ().AddFungibleCount (
+              RandomElement (rnd, ITEMS), 1 + rnd.NextInt (1'000));
+    }
+
+  LOG (INFO) << "Placed " << placed << " buildings";
+}
+
+void
+WorldGenerator::CreateCharacters ()
+{
+  CharacterTable tbl(db);
+  const unsigned limit = ctx.RoConfig ()->params ().character_limit ();
+
+  for (const auto f : PLAYER_FACTIONS)
+    {
+      const auto& names = accounts.at (f);
+      CHECK_LE (params.charactersPerFaction, names.size () * limit)
+          << "Not enough accounts in faction " << FactionToString (f)
+          << " for the requested number of characters";
+
+      for (unsigned i = 0; i < params.charactersPerFaction; ++i)
+        {
+          /* Distribute characters round-robin over the accounts, so that
+             we never exceed the limit.  */
+          const auto& owner = names[i % names.size ()];
+          auto c = SpawnCharacter (owner, f, tbl, ctx);
+
+          const HexCoord pos = RandomLocation ();
+          c->SetPosition (pos);
+          dyn.AddVehicle (pos);
+          characters[f].push_back (c->GetId ());
+        }
+    }
+
+  LOG (INFO)
+      << "Created " << params.charactersPerFaction
+      << " characters per faction";
+}
+
+void
+WorldGenerator::CreateDexOrders ()
+{
+  DexOrderTable tbl(db);
+
+  unsigned created = 0;
+  for (unsigned i = 0; i < params.dexOrders; ++i)
+    {
+      /* Orders can be placed by any account in any (finished) building,
+         but we keep them to the same faction for simplicity.  */
+      const Faction f = RandomFaction ();
+      const auto& bIds = buildings[f];
+      if (bIds.empty ())
+        continue;
+
+      const auto type = rnd.ProbabilityRoll (1, 2)
+                          ? DexOrder::Type::BID : DexOrder::Type::ASK;
+      tbl.CreateNew (bIds[rnd.NextInt (bIds.size ())], RandomAccount (f),
+                     type, RandomElement (rnd, ITEMS),
+                     1 + rnd.NextInt (100), 1 + rnd.NextInt (1'000));
+      ++created;
+    }
+
+  LOG (INFO) << "Created " << created << " DEX orders";
+}
+
+void
+WorldGenerator::CreateOngoings ()
+{
+  BuildingsTable buildingsTbl(db);
+  CharacterTable charactersTbl(db);
+  OngoingsTable tbl(db);
+
+  unsigned created = 0;
+  for (unsigned i = 0; i < params.ongoings; ++i)
+    {
+      const Faction f = RandomFaction ();
+      const auto& bIds = buildings[f];
+      if (bIds.empty ())
+        continue;
+      const auto bId = bIds[rnd.NextInt (bIds.size ())];
+
+      auto op = tbl.CreateNew (ctx.Height ());
+      op->SetHeight (ctx.Height () + 1 + rnd.NextInt (MAX_ONGOING_BLOCKS));
+      op->SetBuildingId (bId);
+
+      /* Alternate between armour repair of a character (which we move
+         into the building) and item construction.  */
+      auto& cIds = characters[f];
+      if (i % 2 == 0 && !cIds.empty ())
+        {
+          auto c = charactersTbl.GetById (cIds.back ());
+          cIds.pop_back ();
+          CHECK (c != nullptr);
+
+          dyn.RemoveVehicle (c->GetPosition ());
+          c->SetBuildingId (bId);
+          c->MutableProto ().set_ongoing (op->GetId ());
+
+          op->SetCharacterId (c->GetId ());
+          op->MutableProto ().mutable_armour_repair ();
+        }
+      else
+        {
+          auto* constr = op->MutableProto ().mutable_item_construction ();
+          constr->set_account (buildingsTbl.GetById (bId)->GetOwner ());
+          constr->set_output_type (CONSTRUCTION_OUTPUT);
+          constr->set_num_items (1 + rnd.NextInt (10));
+        }
+
+      ++created;
+    }
+
+  LOG (INFO) << "Created " << created << " ongoing operations";
+}
+
+void
+WorldGenerator::Generate ()
+{
+  for (unsigned i = 0; i < params.hotspots; ++i)
+    {
+      const auto old = hotspots;
+      hotspots.clear ();
+      const HexCoord centre = RandomLocation ();
+      hotspots = old;
+      hotspots.push_back (centre);
+    }
+
+  CreateAccounts ();
+  CreateBuildings ();
+  CreateCharacters ();
+  CreateDexOrders ();
+  CreateOngoings ();
+}
+
+void
+WorldGenerator::Validate (Database& db, const Context& ctx)
+{
+  LOG (INFO) << "Validating generated state...";
+  PXLogic::ValidateStateSlow (db, ctx);
+}
+
+} // namespace pxd
@@ -0,0 +1,165 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PXD_WORLDGEN_HPP
+#define PXD_WORLDGEN_HPP
+
+#include "context.hpp"
+#include "dynobstacles.hpp"
+
+#include "database/database.hpp"
+#include "database/faction.hpp"
+#include "hexagonal/coord.hpp"
+
+#include <xayautil/random.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace pxd
+{
+
+/**
+ * Parameters for the synthetic game world that WorldGenerator creates.
+ */
+struct WorldGenParams
+{
+
+  /** Number of accounts (spread evenly across the three factions).  */
+  unsigned accounts = 30;
+
+  /** Number of characters to create for each faction.  */
+  unsigned charactersPerFaction = 100;
+
+  /** Number of player buildings to place.  */
+  unsigned buildings = 10;
+
+  /** Number of DEX orders to create in the buildings.  */
+  unsigned dexOrders = 100;
+
+  /** Number of ongoing operations (armour repair and item construction).  */
+  unsigned ongoings = 10;
+
+  /**
+   * Number of "hotspots" (e.g. battle areas) where characters and buildings
+   * are clustered.  If zero, they are spread out over the map instead.
+   */
+  unsigned hotspots = 0;
+
+  /** Radius around each hotspot's centre in which things are placed.  */
+  HexCoord::IntT hotspotRadius = 20;
+
+  /**
+   * Radius around the origin within which characters and buildings are
+   * placed if not clustered into hotspots.
+   */
+  HexCoord::IntT spreadRadius = 2'000;
+
+};
+
+/**
+ * Generator for a synthetic (but consistent) game state of configurable
+ * size, written directly into a database.  This is used for scale testing,
+ * e.g. running the benchmarks and replaybench on states that are much
+ * larger than mainnet currently is.
+ *
+ * The state is generated on top of an initialised database (i.e. with
+ * schema, money supply and initial buildings), and satisfies all the
+ * checks of PXLogic::ValidateStateSlow.
+ */
+class WorldGenerator
+{
+
+private:
+
+  /** The database to write to.  */
+  Database& db;
+
+  /** The context (e.g. block height) for the state.  */
+  const Context& ctx;
+
+  /** Random generator to use.  */
+  xaya::Random& rnd;
+
+  /** The parameters for the world.  */
+  const WorldGenParams& params;
+
+  /** Obstacles of the state built so far.  */
+  DynObstacles dyn;
+
+  /** The hotspot centres (if any).  */
+  std::vector<HexCoord> hotspots;
+
+  /** Names of the accounts created, by faction.  */
+  std::map<Faction, std::vector<std::string>> accounts;
+
+  /** IDs of the finished (non-foundation) buildings created, by faction.  */
+  std::map<Faction, std::vector<Database::IdT>> buildings;
+
+  /** IDs of the characters on the map (i.e. not busy), by faction.  */
+  std::map<Faction, std::vector<Database::IdT>> characters;
+
+  /**
+   * Returns a random accessible location on the map, which is free of
+   * buildings and vehicles.  The location is in one of the hotspots, or
+   * anywhere within the spread radius.
+   */
+  HexCoord RandomLocation ();
+
+  /**
+   * Returns a random faction (for which accounts exist).
+   */
+  Faction RandomFaction ();
+
+  /**
+   * Returns a random account name of the given faction.
+   */
+  const std::string& RandomAccount (Faction f);
+
+  void CreateAccounts ();
+  void CreateBuildings ();
+  void CreateCharacters ();
+  void CreateDexOrders ();
+  void CreateOngoings ();
+
+public:
+
+  explicit WorldGenerator (Database& d, const Context& c, xaya::Random& r,
+                           const WorldGenParams& p);
+
+  WorldGenerator () = delete;
+  WorldGenerator (const WorldGenerator&) = delete;
+  void operator= (const WorldGenerator&) = delete;
+
+  /**
+   * Generates the world in the database.
+   */
+  void Generate ();
+
+  /**
+   * Runs the full PXLogic::ValidateStateSlow checks on the database,
+   * CHECK-failing if the state is invalid.
+   */
+  static void Validate (Database& db, const Context& ctx);
+
+};
+
+} // namespace pxd
+
+#endif // PXD_WORLDGEN_HPP
@@ -0,0 +1,131 @@
+/*
+    GSP for the Taurion blockchain game
+    Copyright (C) 2021  Autonomous Worlds Ltd
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "worldgen.hpp"
+
+#include "buildings.hpp"
+#include "testutils.hpp"
+
+#include "database/dbtest.hpp"
+#include "database/moneysupply.hpp"
+#include "database/schema.hpp"
+#include "database/statehash.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace pxd
+{
+namespace
+{
+
+class WorldGeneratorTests : public DBTestWithSchema
+{
+
+protected:
+
+  ContextForTesting ctx;
+  TestRandom rnd;
+
+  WorldGenParams params;
+
+  WorldGeneratorTests ()
+  {
+    InitialiseBuildings (db, ctx.Chain ());
+    db.SetNextId (1'001);
+
+    params.accounts = 9;
+    params.charactersPerFaction = 20;
+    params.buildings = 8;
+    params.dexOrders = 20;
+    params.ongoings = 4;
+  }
+
+  /**
+   * Runs the generator with the configured parameters and validates
+   * the result.
+   */
+  void
+  Generate ()
+  {
+    WorldGenerator gen(db, ctx, rnd, params);
+    gen.Generate ();
+    WorldGenerator::Validate (db, ctx);
+  }
+
+  /**
+   * Returns the number of rows in a table matching the given condition.
+   */
+  unsigned
+  CountRows (const std::string& table, const std::string& cond = "1")
+  {
+    auto stmt = (*db).PrepareRo ("SELECT COUNT (*) FROM `" + table + "`"
+                                   " WHERE " + cond);
+    CHECK (stmt.Step ());
+    return stmt.Get<int64_t> (0);
+  }
+
+};
+
+TEST_F (WorldGeneratorTests, Spread)
+{
+  const unsigned initialBuildings = CountRows ("buildings");
+  Generate ();
+
+  EXPECT_EQ (CountRows ("accounts"), 9);
+  EXPECT_EQ (CountRows ("characters"), 3 * 20);
+  EXPECT_EQ (CountRows ("buildings"), initialBuildings + 8);
+  EXPECT_GT (CountRows ("dex_orders"), 0);
+  EXPECT_GT (CountRows ("ongoing_operations"), 0);
+}
+
+TEST_F (WorldGeneratorTests, Hotspots)
+{
+  params.hotspots = 2;
+  params.hotspotRadius = 30;
+  Generate ();
+
+  EXPECT_EQ (CountRows ("characters"), 3 * 20);
+}
+
+TEST_F (WorldGeneratorTests, Deterministic)
+{
+  Generate ();
+
+  TestDatabase other;
+  SetupDatabaseSchema (*other);
+  MoneySupply (other).InitialiseDatabase ();
+  InitialiseBuildings (other, ctx.Chain ());
+  other.SetNextId (1'001);
+
+  TestRandom otherRnd;
+  WorldGenerator gen(other, ctx, otherRnd, params);
+  gen.Generate ();
+
+  EXPECT_EQ (ComputeStateHash (db), ComputeStateHash (other));
+}
+
+TEST_F (WorldGeneratorTests, TooManyCharacters)
+{
+  params.charactersPerFaction = 1'000;
+  EXPECT_DEATH (Generate (), "Not enough accounts");
+}
+
+} // anonymous namespace
+} // namespace pxd